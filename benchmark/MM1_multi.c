@@ -44,6 +44,7 @@ struct trial {
     uint64_t obj_cnt;
     double sum_wait;
     double avg_wait;
+    struct cmb_event_queue_stats qstats;
 };
 
 struct context {
@@ -121,6 +122,7 @@ void run_trial(void *vtrl)
     cmb_process_destroy(sim->service);
     cmb_objectqueue_terminate(sim->queue);
     cmb_objectqueue_destroy(sim->queue);
+    cmb_event_queue_stats(&(trl->qstats));
     cmb_event_queue_terminate();
     free(sim);
     free(ctx);
@@ -144,11 +146,38 @@ int main(void)
 
     struct cmb_datasummary summary;
     cmb_datasummary_initialize(&summary);
+    struct cmb_event_queue_stats qsum = { 0 };
+    double probes = 0.0;
+    double levels = 0.0;
     for (unsigned ui = 0; ui < NUM_TRIALS; ui++) {
         const double avg_tsys = experiment[ui].sum_wait / (double)(experiment[ui].obj_cnt);
         cmb_datasummary_add(&summary, avg_tsys);
+
+        const struct cmb_event_queue_stats *qs = &(experiment[ui].qstats);
+        qsum.enqueues += qs->enqueues;
+        qsum.dequeues += qs->dequeues;
+        qsum.cancels += qs->cancels;
+        qsum.reschedules += qs->reschedules;
+        qsum.peak_depth = (qs->peak_depth > qsum.peak_depth) ? qs->peak_depth : qsum.peak_depth;
+        qsum.heap_grows += qs->heap_grows;
+        qsum.hash_lookups += qs->hash_lookups;
+        probes += qs->probe_mean * (double)(qs->hash_lookups);
+        qsum.probe_max = (qs->probe_max > qsum.probe_max) ? qs->probe_max : qsum.probe_max;
+        qsum.heap_sifts += qs->heap_sifts;
+        levels += qs->sift_mean * (double)(qs->heap_sifts);
     }
 
+    printf("Event queue: %" PRIu64 " enqueued, %" PRIu64 " dequeued, %" PRIu64
+           " cancelled, %" PRIu64 " rescheduled, peak depth %" PRIu64 "\n",
+           qsum.enqueues, qsum.dequeues, qsum.cancels, qsum.reschedules, qsum.peak_depth);
+    printf("Heap: %" PRIu64 " grows, %" PRIu64 " sifts, mean %.2f levels, "
+           "%" PRIu64 " hash lookups, mean probe %.2f, max probe %" PRIu64 "\n",
+           qsum.heap_grows, qsum.heap_sifts,
+           (qsum.heap_sifts > 0u) ? levels / (double)(qsum.heap_sifts) : 0.0,
+           qsum.hash_lookups,
+           (qsum.hash_lookups > 0u) ? probes / (double)(qsum.hash_lookups) : 0.0,
+           qsum.probe_max);
+
     free(experiment);
 
     const unsigned un = cmb_datasummary_count(&summary);
@@ -2,6 +2,13 @@
  * Benchmark case: M/M/1 queue, stop after one million objects
  * Single-core version.
  *
+ * Usage:
+ *      MM1_single [-m]
+ *
+ * With -m, runs a many-events variant instead, a hundred thousand independent
+ * M/M/1 queues modeled with plain events, keeping some 190 000 events in the
+ * event queue, once with each event queue backend for comparison.
+ *
  * Copyright (c) Asbjørn M. Bonvik 2026.
  *
  * Licensed under the Apache License, Version 2.0 (the "License");
@@ -20,6 +27,8 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <cimba.h>
 
@@ -127,8 +136,144 @@ void run_trial(void *vtrl)
     free(ctx);
 }
 
-int main(void)
+/*
+ * The many-events variant. Each station is an M/M/1 queue that only keeps
+ * count of its customers, with one arrival event and (if busy) one departure
+ * event in the event queue at any time. The stations start from the stationary
+ * distribution of the number in system, geometric with parameter 1 - rho, and
+ * the average system time follows from Little's law as the time integral of
+ * the number in system divided by the number of customers served.
+ */
+#define NUM_STATIONS 100000u
+
+struct station {
+    uint64_t in_system;
+    double last_change;
+};
+
+struct many_trial {
+    struct station *stations;
+    double arr_mean;
+    double srv_mean;
+    uint64_t obj_cnt;
+    double area;
+};
+
+static void station_update(struct station *st, struct many_trial *trl)
 {
+    const double now = cmb_time();
+    trl->area += (double)st->in_system * (now - st->last_change);
+    st->last_change = now;
+}
+
+static void departure_event(void *vst, void *vtrl)
+{
+    struct station *st = vst;
+    struct many_trial *trl = vtrl;
+    station_update(st, trl);
+    st->in_system--;
+    if (++trl->obj_cnt == NUM_OBJECTS) {
+        cmb_event_queue_clear();
+        return;
+    }
+
+    if (st->in_system > 0u) {
+        const double t_srv = cmb_random_exponential(trl->srv_mean);
+        (void)cmb_event_schedule(departure_event, st, trl, cmb_time() + t_srv, 0);
+    }
+}
+
+static void arrival_event(void *vst, void *vtrl)
+{
+    struct station *st = vst;
+    struct many_trial *trl = vtrl;
+    station_update(st, trl);
+    st->in_system++;
+    if (st->in_system == 1u) {
+        const double t_srv = cmb_random_exponential(trl->srv_mean);
+        (void)cmb_event_schedule(departure_event, st, trl, cmb_time() + t_srv, 0);
+    }
+
+    const double t_arr = cmb_random_exponential(trl->arr_mean);
+    (void)cmb_event_schedule(arrival_event, st, trl, cmb_time() + t_arr, 0);
+}
+
+void run_many_trial(struct many_trial *trl)
+{
+    cmb_logger_flags_off(CMB_LOGGER_INFO);
+    cmb_random_initialize(cmb_random_hwseed());
+    cmb_event_queue_initialize(0.0);
+
+    const double rho = trl->srv_mean / trl->arr_mean;
+    for (uint64_t ui = 0u; ui < NUM_STATIONS; ui++) {
+        struct station *st = &(trl->stations[ui]);
+        st->in_system = cmb_random_geometric(1.0 - rho) - 1u;
+        st->last_change = 0.0;
+        if (st->in_system > 0u) {
+            const double t_srv = cmb_random_exponential(trl->srv_mean);
+            (void)cmb_event_schedule(departure_event, st, trl, t_srv, 0);
+        }
+
+        const double t_arr = cmb_random_exponential(trl->arr_mean);
+        (void)cmb_event_schedule(arrival_event, st, trl, t_arr, 0);
+    }
+
+    cmb_event_queue_execute();
+
+    /* Close the books at the current time for the customers still present */
+    for (uint64_t ui = 0u; ui < NUM_STATIONS; ui++) {
+        station_update(&(trl->stations[ui]), trl);
+    }
+
+    cmb_event_queue_terminate();
+    cmb_random_terminate();
+}
+
+static void run_many(void)
+{
+    const enum cmb_event_queue_backend backends[] = { CMB_EVENT_QUEUE_HEAP,
+                                                      CMB_EVENT_QUEUE_LADDER,
+                                                      CMB_EVENT_QUEUE_RADIX };
+    const char *names[] = { "heap", "ladder", "radix" };
+
+    struct many_trial *trl = malloc(sizeof(*trl));
+    trl->stations = malloc(NUM_STATIONS * sizeof(struct station));
+    for (unsigned ui = 0u; ui < sizeof(backends) / sizeof(backends[0]); ui++) {
+        trl->arr_mean = 1.0 / ARRIVAL_RATE;
+        trl->srv_mean = 1.0 / SERVICE_RATE;
+        trl->obj_cnt = 0u;
+        trl->area = 0.0;
+        cmb_event_queue_backend_set(backends[ui]);
+
+        const clock_t start_time = clock();
+        run_many_trial(trl);
+        const clock_t end_time = clock();
+
+        printf("%-8s Average system time %f (expected %f), %.3f sec\n",
+               names[ui],
+               trl->area / (double)trl->obj_cnt,
+               1.0 / (SERVICE_RATE - ARRIVAL_RATE),
+               (double)(end_time - start_time) / CLOCKS_PER_SEC);
+    }
+
+    free(trl->stations);
+    free(trl);
+}
+
+int main(const int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "m")) != -1) {
+        switch (opt) {
+            case 'm':
+                run_many();
+                return EXIT_SUCCESS;
+            default:
+                fprintf(stderr, "Usage: %s [-m]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
     struct trial *trl = malloc(sizeof(*trl));
     trl->arr_mean = 1.0 / ARRIVAL_RATE;
     trl->srv_mean = 1.0 / SERVICE_RATE;
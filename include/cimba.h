@@ -57,14 +57,19 @@ extern const char *cimba_version(void);
 #include "cmb_dataset.h"
 #include "cmb_datasummary.h"
 #include "cmb_event.h"
+#include "cmb_generator.h"
 #include "cmb_logger.h"
 #include "cmb_objectqueue.h"
 #include "cmb_process.h"
+#include "cmb_processpool.h"
+#include "cmb_profiler.h"
 #include "cmb_random.h"
 #include "cmb_resource.h"
 #include "cmb_resourceguard.h"
 #include "cmb_resourcepool.h"
+#include "cmb_snapshot.h"
 #include "cmb_timeseries.h"
+#include "cmb_trace.h"
 #include "cmb_wtdsummary.h"
 
 /**
@@ -35,8 +35,10 @@
  * the event queue is implemented as a hashheap where the event handle is a hash_key
  * in the hash map and the event's current location in the heap is the hash map
  * value. This gives O(1) cancellations and reschedules with no need to search
- * the entire heap to find a future event. The details of the data structure
- * are not exposed in this header file, see `cmb_event.c` for implementation.
+ * the entire heap to find a future event. For very large event queues, a
+ * ladder queue can be used instead, see `cmb_event_queue_backend_set`. The
+ * details of the data structures are not exposed in this header file, see
+ * `cmb_event.c` for implementation.
  *
  * As always, the error handling is draconian. Functions for e.g., rescheduling
  * an event will trip an assertion if the given event is not currently in the
@@ -103,17 +105,207 @@ typedef void (cmb_event_func)(void *subject, void *object);
 extern void cmb_event_queue_initialize(double start_time);
 
 /**
- * @brief Reset event queue to fresh state. Free's memory allocated for internal
- *        workings of the event queue.
+ * @brief Reset event queue to fresh state. Frees or keeps the memory allocated
+ *        for internal workings of the event queue.
  *
  * No argument needed, acts on the current thread's event queue.
  *
  * Call at the end of every simulation trial to clean up allocated space for the
  * event queue. Then call `cmb_event_queue_initialize()` again at the start of
  * the next trial.
+ *
+ * Unless larger than the retain limit, see `cmb_event_queue_retain_limit_set`,
+ * the emptied event queue is kept for the next trial in the same thread, and
+ * is only freed when the thread exits.
  */
 extern void cmb_event_queue_terminate(void);
 
+/**
+ * @brief Get the current branching factor for event queues, 2, 4, or 8.
+ */
+extern unsigned cmb_event_queue_arity(void);
+
+/**
+ * @brief Set the global branching factor for the heap underlying the event
+ * queue. Will take effect for all calls to `cmb_event_queue_initialize` from
+ * now on, but will not change any event queue that is already initialized.
+ *
+ * The default is a binary heap, which is the best choice for the usual event
+ * queue of tens or hundreds of events. For very large event queues, a 4-ary or
+ * 8-ary heap has a shallower tree and fewer cache misses per operation, where
+ * the sibling nodes compared at each level sit in adjacent cache lines.
+ *
+ * Events at the same time and priority execute in the same FIFO order
+ * regardless of the branching factor.
+ *
+ * @param arity The number of children per heap node, 2, 4, or 8.
+ */
+extern void cmb_event_queue_arity_set(unsigned arity);
+
+/**
+ * @brief Is the event queue using slot-indexed event handles?
+ */
+extern bool cmb_event_queue_slot_handles(void);
+
+/**
+ * @brief Choose between hashed and slot-indexed event handles for the heap
+ * underlying the event queue. Will take effect for all calls to
+ * `cmb_event_queue_initialize` from now on, but will not change any event
+ * queue that is already initialized.
+ *
+ * By default, event handles are sequence numbers, found in the heap through a
+ * hash map. The hash map is built at the first lookup, such as the first
+ * cancelled timer, and rebuilt now and then to clear out deleted entries.
+ * With slot-indexed handles, each handle also contains the position of the
+ * event in the heap's internal item array, so that checking, cancelling, or
+ * rescheduling an event goes straight there without any hash map. This also
+ * holds for events scheduled for the current time, which keep a slot in the
+ * heap for their handle while waiting in front of it.
+ *
+ * Handles are still unique, increasing, and opaque, and events execute in the
+ * same order either way, but slot-indexed handles are much larger numbers.
+ * Only some 68 billion of them can be issued per trial.
+ *
+ * @param slots True for slot-indexed handles, false for hashed handles.
+ */
+extern void cmb_event_queue_slot_handles_set(bool slots);
+
+/**
+ * @brief Is the event queue keeping an index of events by subject?
+ */
+extern bool cmb_event_queue_subject_index(void);
+
+/**
+ * @brief Keep an index of the pending events by subject, or not. Will take
+ * effect for all calls to `cmb_event_queue_initialize` from now on, but will
+ * not change any event queue that is already initialized.
+ *
+ * Whenever a process is stopped, interrupted, or finishes, its pending wakeup
+ * events are cancelled by `cmb_event_pattern_cancel` with the process as the
+ * subject. Without the index, each such call searches the entire event queue.
+ * With it, only the events for that subject are visited, at the cost of an
+ * index update for every event scheduled and executed. It pays off for models
+ * with large event queues and many processes coming and going.
+ *
+ * The index is used by `cmb_event_pattern_find`, `cmb_event_pattern_count`,
+ * and `cmb_event_pattern_cancel` whenever the subject is given, not
+ * `CMB_ANY_SUBJECT`. Which matching event `cmb_event_pattern_find` returns
+ * may differ from the unindexed search.
+ *
+ * @param subjects True to keep the index, false for none.
+ */
+extern void cmb_event_queue_subject_index_set(bool subjects);
+
+/**
+ * @brief The available implementations of the event queue.
+ */
+enum cmb_event_queue_backend {
+    CMB_EVENT_QUEUE_HEAP = 0,   /**< Heap with hash map, the default */
+    CMB_EVENT_QUEUE_LADDER,     /**< Ladder queue of time buckets */
+    CMB_EVENT_QUEUE_RADIX,      /**< Radix heap on the bits of the time */
+    CMB_EVENT_QUEUE_AUTO        /**< Heap, switching to ladder queue when large */
+};
+
+/**
+ * @brief Get the current event queue backend for future event queues.
+ */
+extern enum cmb_event_queue_backend cmb_event_queue_backend(void);
+
+/**
+ * @brief Set the global event queue backend. Will take effect for all calls
+ * to `cmb_event_queue_initialize` from now on, but will not change any event
+ * queue that is already initialized.
+ *
+ * The default heap is O(log n) per event, with the least overhead for the
+ * usual small event queue. The ladder queue keeps the events in unsorted
+ * buckets by time, only sorting a short list of the nearest events at a time,
+ * for amortized O(1) per event, pulling ahead of the heap as the event queue
+ * grows into the thousands of events. `CMB_EVENT_QUEUE_AUTO` starts each
+ * trial with a heap and moves the events over to a ladder queue if the event
+ * queue grows beyond a thousand events, staying with the ladder queue for the
+ * rest of the trial.
+ *
+ * The radix heap exploits that the simulation clock never goes backwards. It
+ * buckets the events by the highest bit where the bit pattern of their time
+ * differs from the current time, so that each event is only moved to a lower
+ * bucket a few times before it is due, never compared with more than the
+ * events due at the same time.
+ *
+ * Events execute in exactly the same order with either backend: Earliest time
+ * first, then highest priority, then FIFO. Event handles remain valid across a
+ * switch.
+ *
+ * @param backend One of the `cmb_event_queue_backend` values.
+ */
+extern void cmb_event_queue_backend_set(enum cmb_event_queue_backend backend);
+
+/**
+ * @brief Get the expected number of events for future event queues.
+ */
+extern uint64_t cmb_event_queue_capacity_hint(void);
+
+/**
+ * @brief Tell the event queue how many events to expect at the same time,
+ * so that it can start out at that size instead of doubling its way up from a
+ * few events. Will take effect for all calls to `cmb_event_queue_initialize`
+ * from now on. The queue still grows as needed if the hint is too low.
+ *
+ * Without a hint, the event queue starts out as large as the previous event
+ * queue in the same thread grew, on the assumption that the trials are much
+ * alike. The default hint is zero, i.e., no idea.
+ *
+ * @param events The expected number of events in the queue.
+ */
+extern void cmb_event_queue_capacity_hint_set(uint64_t events);
+
+/**
+ * @brief Get the largest event queue that is kept from one trial to the next.
+ */
+extern uint64_t cmb_event_queue_retain_limit(void);
+
+/**
+ * @brief Set the largest event queue, in number of events, that
+ * `cmb_event_queue_terminate` keeps for reuse by the next trial in the same
+ * thread, instead of freeing its memory. Will take effect for all calls to
+ * `cmb_event_queue_terminate` from now on.
+ *
+ * Running many short trials per thread, reusing the event queue saves
+ * allocating it again and growing it step by step in every trial. Larger event
+ * queues are freed at the end of the trial, to avoid holding on to much memory
+ * for each thread. The limit applies to the heap, ladder queues and radix heaps
+ * are always freed. The default is 65536 events, zero to never keep anything.
+ *
+ * @param events The largest event queue capacity to keep.
+ */
+extern void cmb_event_queue_retain_limit_set(uint64_t events);
+
+/**
+ * @brief Is direct handoff between processes turned on for future event queues?
+ */
+extern bool cmb_event_queue_handoff(void);
+
+/**
+ * @brief Let processes hand control directly to each other. Will take effect
+ * for all calls to `cmb_event_queue_initialize` from now on. Default off.
+ *
+ * Normally, a process that holds or waits yields control back to the
+ * dispatcher, which executes the next event, often a wakeup call resuming
+ * another process. That is two context switches per handoff from one process
+ * to the next. With direct handoff, the yielding process looks at the next event
+ * itself, and if it is the end of a `cmb_process_hold` by some process,
+ * takes it off the queue and switches straight to that process, or just carries
+ * on if it is its own. Anything else goes to the dispatcher as usual.
+ *
+ * The events execute in exactly the same order either way. Handoffs only happen
+ * inside `cmb_event_queue_execute()`, `cmb_event_queue_execute_until()` and
+ * `cmb_event_queue_execute_n()`, which count the events taken that way just as
+ * the others, not in a loop calling `cmb_event_execute_next()`, and not while
+ * the profiler is on.
+ *
+ * @param handoff `true` to hand off directly.
+ */
+extern void cmb_event_queue_handoff_set(bool handoff);
+
 /**
  * @brief Clears out all scheduled events from the queue.
  *
@@ -135,11 +327,49 @@ extern bool cmb_event_queue_is_empty(void);
  */
 extern uint64_t cmb_event_queue_count(void);
 
+/**
+ * @brief Counts of the work done by the event queue in the current trial, for
+ *        tuning the event queue options with `cmb_event_queue_stats`.
+ *
+ * The heap figures only cover the time that the heap was in use, up to a
+ * switch to a ladder queue for `CMB_EVENT_QUEUE_AUTO`, and are all zero for the
+ * ladder queue and the radix heap.
+ */
+struct cmb_event_queue_stats {
+    uint64_t enqueues;      /**< Events scheduled */
+    uint64_t dequeues;      /**< Events executed */
+    uint64_t cancels;       /**< Events cancelled, one by one or by pattern */
+    uint64_t reschedules;   /**< Events rescheduled or reprioritized */
+    uint64_t peak_depth;    /**< The most events in the queue at the same time */
+    uint64_t heap_grows;    /**< Times the heap doubled its capacity */
+    uint64_t hash_lookups;  /**< Event handles looked up in the hash map */
+    double probe_mean;      /**< Mean probe length per hash map lookup */
+    uint64_t probe_max;     /**< Longest probe length in a hash map lookup */
+    uint64_t heap_sifts;    /**< Events moved up or down the heap */
+    double sift_mean;       /**< Mean number of levels moved per sift */
+};
+
+/**
+ * @brief Get the statistics for the event queue in this thread, counting from
+ *        the last `cmb_event_queue_initialize`. Also valid after
+ *        `cmb_event_queue_terminate`, until the next trial starts.
+ *
+ * The counting is always on, a few additions per event, so that the figures
+ * are there also in release builds without recompiling.
+ *
+ * @param sp Pointer to the struct to fill in.
+ */
+extern void cmb_event_queue_stats(struct cmb_event_queue_stats *sp);
+
 /**
  * @brief Insert an event in the event queue as indicated by the activation time
  *        and priority. An event cannot be scheduled at a time before the
  *        current simulation time.
  *
+ * Events scheduled for the current simulation time, such as wakeup calls to
+ * processes, take a shortcut past the main event queue, but execute in the
+ * same order as any other events.
+ *
  * @param action  Pointer to the event function to execute.
  * @param subject Pointer to something user-defined, intended as a self-pointer
  *                for whatever entity (e.g., a `cmb_process`) is acting here.
@@ -162,6 +392,67 @@ extern uint64_t cmb_event_schedule(cmb_event_func *action,
                                    double time,
                                    int64_t priority);
 
+/**
+ * @brief Insert an event that recurs at fixed intervals, first at time `first`,
+ *        then every `period` after that, until cancelled.
+ *
+ * The event keeps the same handle for all its occurrences. Each time it is
+ * executed, it is given its next time in place in the event queue before the
+ * action is called, instead of being removed and scheduled anew. The action
+ * can cancel it by `cmb_event_cancel(cmb_event_current())`, or move its next
+ * occurrence by `cmb_event_reschedule`, with the period counted from there.
+ * Processes waiting for it are woken at each occurrence.
+ *
+ * Useful for sampling, clocks, and polling loops, at about half the cost of an
+ * event that schedules itself again.
+ *
+ * @param action  Pointer to the event function to execute.
+ * @param subject Pointer to something user-defined, as for `cmb_event_schedule`.
+ * @param object  Pointer to something user-defined, as for `cmb_event_schedule`.
+ * @param first   The simulation time of the first occurrence, greater than or
+ *                equal to the current simulation time.
+ * @param period  The time between occurrences, greater than zero.
+ * @param priority The priority of each occurrence, as for `cmb_event_schedule`.
+ * @return        The unique handle of the event, the same for all occurrences.
+ */
+extern uint64_t cmb_event_schedule_periodic(cmb_event_func *action,
+                                            void *subject,
+                                            void *object,
+                                            double first,
+                                            double period,
+                                            int64_t priority);
+
+/**
+ * @brief One event to schedule with `cmb_event_schedule_batch`, with the same
+ *        meaning of each member as for the arguments to `cmb_event_schedule`.
+ */
+struct cmb_event_spec {
+    cmb_event_func *action;     /**< The event function to execute */
+    void *subject;              /**< The entity acting here */
+    void *object;               /**< The object the subject is acting on */
+    double time;                /**< The simulation time of the event */
+    int64_t priority;           /**< The priority of the event at that time */
+};
+
+/**
+ * @brief Schedule many events at once, such as all the initial events of a
+ *        model, with the same result as calling `cmb_event_schedule` for each
+ *        of them in turn.
+ *
+ * With the heap as the event queue, the new events are put in place with one
+ * rebuild of the heap in linear time instead of one by one in logarithmic
+ * time each, whenever that is faster.
+ *
+ * @param n       The number of events.
+ * @param specs   Array of `n` event specifications.
+ * @param handles Array of room for `n` event handles, to receive the handles
+ *                of the scheduled events in the same order, or `NULL` if the
+ *                handles are not needed.
+ */
+extern void cmb_event_schedule_batch(uint64_t n,
+                                     const struct cmb_event_spec *specs,
+                                     uint64_t *handles);
+
 /**
  * @brief Removes and executes the first event in the event queue.
  *
@@ -177,10 +468,38 @@ extern bool cmb_event_execute_next(void);
  * queue and stop the simulation. This can either be pre-scheduled for some
  * particular time or triggered by some other condition such as reaching a
  * certain number of samples in some data collector, a confidence interval being
- * narrow enough, or anything else.
+ * narrow enough, or anything else. To stop at a given time or after a given
+ * number of events and keep the rest of the queue for later, see
+ * `cmb_event_queue_execute_until()` and `cmb_event_queue_execute_n()`.
  */
 extern void cmb_event_queue_execute(void);
 
+/**
+ * @brief Executes the events up to and including time `t`, then moves the
+ *        clock to `t` and returns, leaving any later events in the queue.
+ *
+ * The simulation can be resumed from there by another call, for example, to
+ * end a warm-up period, to collect the statistics of one batch-means window
+ * at a time, or to check on the model at regular intervals, without having to
+ * schedule a stopping event. Events scheduled for exactly `t` are executed,
+ * also any scheduled for `t` by events at `t`.
+ *
+ * @param t The time to run until, no earlier than the current time.
+ * @return The number of events executed.
+ */
+extern uint64_t cmb_event_queue_execute_until(double t);
+
+/**
+ * @brief Executes the next `n` events, or until the event queue is empty if
+ *        that happens first, and returns, leaving any later events in the
+ *        queue. The clock stays at the time of the last event executed.
+ *
+ * @param n The number of events to execute.
+ * @return The number of events executed, less than `n` only if the event
+ *         queue ran empty.
+ */
+extern uint64_t cmb_event_queue_execute_n(uint64_t n);
+
 /**
  * @brief Returns the handle of the currently or most recently executed event.
  *
@@ -0,0 +1,213 @@
+/**
+ * @file cmb_generator.h
+ * @brief A stackless process for the simple generators of a model, e.g., an
+ *        arrival process that holds, creates a customer, puts it in a queue,
+ *        and loops. It runs as a step function called directly from the
+ *        event dispatcher, with no coroutine stack and no context switch.
+ *
+ * A generator has no call stack to keep between steps. Whatever it needs to
+ * remember goes in its context. Each call to its step function does whatever
+ * the generator does at that point in time, and returns how long to wait until
+ * the next call, the equivalent of `cmb_process_hold`. It can return
+ * `CMB_GENERATOR_DONE` instead to finish.
+ *
+ * The step function runs as an event, not inside a process. It can do anything
+ * an event function can do, e.g., put objects into a `cmb_objectqueue` or a
+ * `cmb_buffer` with space for them, signal a `cmb_condition`, schedule events,
+ * and start, interrupt, or stop processes. It cannot do anything that would
+ * make the caller wait, such as `cmb_resource_acquire`, `cmb_objectqueue_get`,
+ * or a put into a full queue. Check `cmb_objectqueue_space` first if the queue
+ * has a limited capacity, or use a `cmb_process` for that kind of logic.
+ *
+ * Processes can wait for the next step of a generator with
+ * `cmb_process_wait_event(cmb_generator_event(gp))`, and a process or an event
+ * can stop it with `cmb_generator_stop`.
+ *
+ * Typical use, for an arrival generator:
+ * @code
+ * static double arrivals(struct cmb_generator *gp, void *vctx)
+ * {
+ *     struct context *ctx = vctx;
+ *     if (cmb_generator_steps(gp) > 0u) {
+ *         cmb_objectqueue_put(ctx->queue, new_customer());
+ *     }
+ *
+ *     return cmb_random_exponential(ctx->mean);
+ * }
+ * ...
+ * struct cmb_generator *gp = cmb_generator_create();
+ * cmb_generator_initialize(gp, "Arrivals", arrivals, &ctx, 0);
+ * cmb_generator_start(gp);
+ * @endcode
+ */
+
+/*
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CIMBA_CMB_GENERATOR_H
+#define CIMBA_CMB_GENERATOR_H
+
+#include <stdint.h>
+
+#include "cmb_process.h"
+
+#include "cmi_memregistry.h"
+
+/**
+ * @brief Return value from a step function to finish the generator.
+ */
+#define CMB_GENERATOR_DONE (-1.0)
+
+/* Declare that there is such a thing */
+struct cmb_generator;
+
+/**
+ * @brief The step function prototype, taking a pointer to the generator itself
+ * and the context pointer given at initialization, returning the time until
+ * the next step, or `CMB_GENERATOR_DONE` to finish.
+ * @relates cmb_generator
+ */
+typedef double (cmb_generator_func)(struct cmb_generator *gp, void *context);
+
+/**
+ * @brief The generator struct, a name, a step function with its context, and
+ *        the event for its next step.
+ */
+struct cmb_generator {
+    cmb_generator_func *step;               /**< The step function */
+    void *context;                          /**< Passed to the step function */
+    int64_t priority;                       /**< Priority of the step events */
+    enum cmb_process_state status;          /**< Same meaning as for a process */
+    uint64_t event;                         /**< The next step event, if any */
+    uint64_t steps;                         /**< Number of steps taken */
+    char name[CMB_PROCESS_NAMEBUF_SZ];      /**< The generator name string */
+    struct cmi_memregistry_item terminate;  /**< Internal use */
+    struct cmi_memregistry_item destroy;    /**< Internal use */
+};
+
+/**
+ * @brief Allocate memory for the generator object.
+ *
+ * @memberof cmb_generator
+ * @return Pointer to the new generator.
+ */
+extern struct cmb_generator *cmb_generator_create(void);
+
+/**
+ * @brief Initialize the generator. Does not start it yet.
+ *
+ * @memberof cmb_generator
+ * @param gp Pointer to an already created generator.
+ * @param name Null terminated string for the generator name.
+ * @param stepfunc The step function.
+ * @param context Pointer to whatever context the step function needs.
+ * @param priority The priority of its step events.
+ */
+extern void cmb_generator_initialize(struct cmb_generator *gp,
+                                     const char *name,
+                                     cmb_generator_func *stepfunc,
+                                     void *context,
+                                     int64_t priority);
+
+/**
+ * @brief Start the generator, taking its first step at the current time.
+ *
+ * @memberof cmb_generator
+ * @param gp Pointer to an initialized generator.
+ */
+extern void cmb_generator_start(struct cmb_generator *gp);
+
+/**
+ * @brief Stop the generator, cancelling its next step. Can be called from a
+ *        process, an event, or its own step function. Does nothing if it has
+ *        already finished.
+ *
+ * @memberof cmb_generator
+ * @param gp Pointer to a generator.
+ */
+extern void cmb_generator_stop(struct cmb_generator *gp);
+
+/**
+ * @brief Un-initialize the generator, stopping it first if needed.
+ *
+ * @memberof cmb_generator
+ * @param gp Pointer to a generator.
+ */
+extern void cmb_generator_terminate(struct cmb_generator *gp);
+
+/**
+ * @brief Deallocate memory for the generator. Call `cmb_generator_terminate`
+ *        first.
+ *
+ * @memberof cmb_generator
+ * @param gp Pointer to a generator.
+ */
+extern void cmb_generator_destroy(struct cmb_generator *gp);
+
+/**
+ * @brief The name of the generator.
+ *
+ * @memberof cmb_generator
+ * @param gp Pointer to a generator.
+ */
+static inline const char *cmb_generator_name(const struct cmb_generator *gp)
+{
+    cmb_assert_release(gp != NULL);
+
+    return gp->name;
+}
+
+/**
+ * @brief The status of the generator, initialized, running, or finished.
+ *
+ * @memberof cmb_generator
+ * @param gp Pointer to a generator.
+ */
+static inline enum cmb_process_state cmb_generator_status(const struct cmb_generator *gp)
+{
+    cmb_assert_release(gp != NULL);
+
+    return gp->status;
+}
+
+/**
+ * @brief The number of steps taken so far, not counting the one in progress.
+ *
+ * @memberof cmb_generator
+ * @param gp Pointer to a generator.
+ */
+static inline uint64_t cmb_generator_steps(const struct cmb_generator *gp)
+{
+    cmb_assert_release(gp != NULL);
+
+    return gp->steps;
+}
+
+/**
+ * @brief The handle of the event for its next step, zero if none, for use by
+ *        `cmb_process_wait_event` and the other event functions.
+ *
+ * @memberof cmb_generator
+ * @param gp Pointer to a generator.
+ */
+static inline uint64_t cmb_generator_event(const struct cmb_generator *gp)
+{
+    cmb_assert_release(gp != NULL);
+
+    return gp->event;
+}
+
+#endif /* CIMBA_CMB_GENERATOR_H */
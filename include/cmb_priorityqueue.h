@@ -81,6 +81,22 @@ extern void cmb_priorityqueue_initialize(struct cmb_priorityqueue *pqp,
  */
 extern void cmb_priorityqueue_terminate(struct cmb_priorityqueue *pqp);
 
+/**
+ * @brief Get the current default branching factor for priority queues.
+ */
+extern unsigned cmb_priorityqueue_default_arity(void);
+
+/**
+ * @brief Set the global default branching factor, 2, 4, or 8, for the heap in
+ * priority queues. Will take effect for all calls to
+ * `cmb_priorityqueue_initialize` from now on, but will not change any already
+ * initialized priority queues. Binary unless told otherwise, a 4-ary or 8-ary
+ * heap can be faster for queues holding many thousands of objects.
+ *
+ * @param arity The number of children per heap node, 2, 4, or 8.
+ */
+extern void cmb_priorityqueue_default_arity_set(unsigned arity);
+
 /**
  * @brief  Deallocate memory for an object queue.
  *
@@ -99,6 +99,21 @@
  */
 #define CMB_PROCESS_TIMEOUT INT64_C(-5)
 
+/**
+ * @brief The default safety margin for sizing stacks from measured use, the
+ *        factor to multiply the recorded peak by.
+ * @relates cmb_process
+ */
+#define CMB_PROCESS_STACK_MARGIN 2.0
+
+/**
+ * @brief The smallest recorded peak used for sizing stacks from measured use,
+ *        before the safety margin, covering the paths through the library a
+ *        shallow pilot trial may never have taken.
+ * @relates cmb_process
+ */
+#define CMB_PROCESS_STACK_MIN (16u * 1024u)
+
 /**
  * @brief The states a process can be in (direct from the underlying coroutine)
  * @relates cmb_process
@@ -110,6 +125,9 @@ enum cmb_process_state {
     CMB_PROCESS_FINISHED
 };
 
+/* Declare that there is such a thing, see cmb_processpool.h */
+struct cmb_processpool;
+
 /**
  * @brief The process struct, inheriting all properties from `cmi_coroutine` by
  * composition, adding the name, priority, and lists of resources it may be
@@ -119,10 +137,12 @@ struct cmb_process {
     struct cmi_coroutine core;              /**< The parent coroutine */
     uint64_t handle;                        /**< Unique identifier */
     int64_t priority;                       /**< The current process priority */
+    uint64_t hold;                          /**< Wakeup event of a hold in progress, if any */
     struct cmi_slist_node awaits;           /**< What this process is waiting for, if anything */
     struct cmi_slist_node resources;        /**< Any resources held by this process */
     struct cmi_slist_node waiters;          /**< Any other processes waiting for this process to finish */
     char name[CMB_PROCESS_NAMEBUF_SZ];      /**< The process name string */
+    struct cmb_processpool *pool;           /**< The pool it goes back to when finished, if any */
     struct cmi_memregistry_item terminate;   /**< Internal use */
     struct cmi_memregistry_item destroy;     /**< Internal use */
 };
@@ -208,6 +228,42 @@ extern void cmb_process_initialize_wssz(struct cmb_process *pp,
                                         int64_t priority,
                                         size_t stacksize);
 
+/**
+ * @brief Initialize process parameters to run on the stack shared by all
+ * processes of this thread initialized this way. Does not start the process.
+ *
+ * The shared stack is 1 MiB, allocated once per thread. Only the process
+ * currently running has its frames there. When it is switched out and another
+ * shared stack process switched in, the part of the stack it actually uses is
+ * copied out to a buffer of its own, and the other one's copied back in. A
+ * process holding a few hundred bytes of stack then costs a few hundred bytes
+ * of memory rather than a full stack of its own, which pays off for models with
+ * very many small processes, at the price of the copying on each switch.
+ *
+ * The restriction is that nothing may point into the stack of a shared stack
+ * process while it is switched out, since another process' frames are then in
+ * that place. Do not hand out pointers to local variables of the process
+ * function, e.g., as the object of `cmb_objectqueue_put` or as the context of
+ * an event, unless it is certain that they are used and forgotten before the
+ * process yields. Cimba itself only keeps pointers to the process struct.
+ *
+ * Shared stack processes are not painted for stack measurement, and can be
+ * freely mixed with processes with stacks of their own.
+ *
+ * @memberof cmb_process
+ * @param pp Pointer to an already created process.
+ * @param name Null terminated string for the process name.
+ * @param procfunc The process function that will be executed.
+ * @param context Pointer to whatever context the process function needs.
+ * @param priority The initial priority for the process, used in various
+ *                 priority queues the process may find itself in.
+ */
+extern void cmb_process_initialize_shared(struct cmb_process *pp,
+                                          const char *name,
+                                          cmb_process_func procfunc,
+                                          void *context,
+                                          int64_t priority);
+
 /**
  * @brief Deallocate memory for the underlying coroutine stack but not for the
  * process object itself. In particular, the process exit value is still there.
@@ -268,16 +324,7 @@ static inline struct cmb_process *cmb_process_current(void)
  * @return Whatever signal value is passed by whatever process causing this one
  *         to resume again, possibly itself by setting a timer before calling.
  */
-CMB_MAYBE_UNUSED
-static inline int64_t cmb_process_yield(void)
-{
-    const struct cmb_process *pp = (struct cmb_process *)cmi_coroutine_current();
-    cmb_assert_release(pp != (struct cmb_process *)cmi_coroutine_main());
-
-    const int64_t sig = (int64_t)cmi_coroutine_yield(NULL);
-
-    return sig;
-}
+extern int64_t cmb_process_yield(void);
 
 /**
  * @brief  Schedule a wakeup event at the current time for a yielded process. The
@@ -575,4 +622,146 @@ extern size_t cmb_process_default_stacksize(void);
  */
 extern void cmb_process_default_stacksize_set(size_t sz);
 
+/**
+ * @brief  Do new process stacks come from reserved slabs of address space?
+ */
+extern bool cmb_process_stack_slabs(void);
+
+/**
+ * @brief  Take the stacks of all processes initialized from now on from large
+ * reserved ranges of address space, slabs, instead of one heap block each.
+ *
+ * Only the pages a process actually touches take memory, the rest of its stack
+ * is just address space. When the process is terminated, its stack gives its
+ * pages back to the system before going back to the pool for reuse. This lets
+ * models with very many processes run at the real footprint of the stacks
+ * rather than their full size, at the cost of some system calls.
+ *
+ * Each stack still has a guard page below it. Under Linux, each guard page
+ * splits the mapping, and the number of mappings per process is limited by
+ * `vm.max_map_count`, 65530 by default. For more than about 30 000 processes
+ * at the same time, that limit needs to be raised.
+ *
+ * Stacks are not taken from slabs while snapshots are enabled, since these
+ * need to be in the snapshot arena. No difference under Windows, where each
+ * stack is its own reservation already.
+ *
+ * @param on `true` to take new stacks from slabs.
+ */
+extern void cmb_process_stack_slabs_set(bool on);
+
+/**
+ * @brief  Make sure that the calling thread has at least `n` stacks of size
+ * `sz` ready for new processes, allocated and guarded ahead of time. This moves
+ * the serializing system calls for the guard pages out of the timed part of a
+ * run, e.g., calling it before starting a large model or after the warm-up.
+ *
+ * The stacks come from the heap or from slabs, as set by
+ * `cmb_process_stack_slabs_set`, and are kept whatever the retention cap. They
+ * are only used by processes with the same stack size after rounding up to
+ * whole pages.
+ *
+ * @param n The number of stacks.
+ * @param sz Stack size in bytes, zero for the current default stack size.
+ */
+extern void cmb_process_stacks_prewarm(uint64_t n, size_t sz);
+
+/**
+ * @brief  Get the current cap on recycled stacks kept by each thread.
+ */
+extern size_t cmb_process_stack_retention(void);
+
+/**
+ * @brief  Set the cap on recycled stacks each thread keeps for reuse, in bytes
+ * including the guard pages. A stack coming back from a terminated process when
+ * the pool is full is freed instead of kept, so that a burst of processes in one
+ * trial does not keep its memory for the rest of the experiment. Default
+ * 1 GiB. Stacks from slabs give their pages back anyway, and do not count.
+ *
+ * @param sz The cap in bytes, zero to keep none.
+ */
+extern void cmb_process_stack_retention_set(size_t sz);
+
+/**
+ * @brief  The number of bytes of recycled stacks kept for reuse by the calling
+ * thread, counted the same way as the retention cap.
+ */
+extern size_t cmb_process_stacks_pooled(void);
+
+/**
+ * @brief  Is stack measurement on for future inits?
+ */
+extern bool cmb_process_stack_measure(void);
+
+/**
+ * @brief  Turn stack measurement on or off for all calls to
+ * `cmb_process_initialize` and `cmb_process_initialize_wssz` from now on.
+ *
+ * While on, each new process stack is filled with a known pattern. When the
+ * process is terminated by `cmb_process_terminate`, the deepest point where the
+ * pattern was overwritten is its peak stack use, recorded for its process
+ * function. The record is shared by all threads and keeps the largest peak
+ * seen for each function, across trials, until cleared by
+ * `cmb_process_stack_peaks_clear`.
+ *
+ * The records are by process function rather than by name, since many
+ * processes share a function under different names. Painting the stack
+ * touches all of it, so the mode costs time and memory. Turn it on for a few
+ * pilot trials, not for the production runs.
+ *
+ * @param on `true` to paint and measure the stacks of future processes.
+ */
+extern void cmb_process_stack_measure_set(bool on);
+
+/**
+ * @brief  Is automatic stack sizing on for future inits?
+ */
+extern bool cmb_process_stack_autosize(void);
+
+/**
+ * @brief  Turn automatic stack sizing on or off for all calls to
+ * `cmb_process_initialize` from now on.
+ *
+ * While on, a process whose function has a recorded peak stack use gets a
+ * stack of that peak, or `CMB_PROCESS_STACK_MIN` if larger, times the safety
+ * margin, rounded up to a multiple of the page size, instead of the default
+ * stack size. Processes with functions not
+ * yet measured get the default size, as do all calls to
+ * `cmb_process_initialize_wssz`.
+ *
+ * The peak only covers the paths the pilot trials happened to take. A later
+ * trial going deeper will overflow into the guard page and segfault, hence
+ * the margin.
+ *
+ * @param on `true` to size the stacks of future processes from the records.
+ */
+extern void cmb_process_stack_autosize_set(bool on);
+
+/**
+ * @brief  Get the current safety margin for automatic stack sizing.
+ */
+extern double cmb_process_stack_margin(void);
+
+/**
+ * @brief  Set the safety margin for automatic stack sizing, the factor to
+ * multiply the recorded peak by. Default `CMB_PROCESS_STACK_MARGIN`.
+ *
+ * @param margin The factor, at least 1.0.
+ */
+extern void cmb_process_stack_margin_set(double margin);
+
+/**
+ * @brief  Get the peak stack use recorded for a process function, in bytes,
+ * or zero if no process running that function has been measured.
+ *
+ * @param procfunc The process function.
+ */
+extern size_t cmb_process_stack_peak(cmb_process_func procfunc);
+
+/**
+ * @brief  Forget all recorded peaks. Not to be called while other threads may
+ * be initializing or terminating processes.
+ */
+extern void cmb_process_stack_peaks_clear(void);
+
 #endif /* CIMBA_CMB_PROCESS_H */
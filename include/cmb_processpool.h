@@ -0,0 +1,165 @@
+/**
+ * @file cmb_processpool.h
+ * @brief A pool of processes for short-lived entities such as customers,
+ *        keeping finished processes with their stacks ready to run again
+ *        instead of creating and destroying one for each entity.
+ *
+ * A process from `cmb_processpool_spawn` is started at once with the given
+ * process function and context. When it finishes, by returning, by
+ * `cmb_process_exit`, or by being stopped, it goes back to the pool by itself,
+ * and the next spawn may pick it up again. There is no need to terminate or
+ * destroy it, and the calling code must not do so.
+ *
+ * Spawning a process from the pool costs about the same as restarting a
+ * finished process: no allocation, no registration, no name formatting, and
+ * no stack lookup, only the new first stack frame and the start event.
+ *
+ * The process pointer returned from the spawn is good while the process runs.
+ * Other processes can wait for it, interrupt it, and stop it as usual. Once it
+ * has finished, the pointer may refer to some other entity spawned later,
+ * so do not keep it around longer than that, and do not count on its exit
+ * value.
+ *
+ * All processes in a pool have the name and the priority given to the pool,
+ * and stacks of the default stack size in effect when each one was first
+ * created. They are plain `cmb_process` objects, not derived classes.
+ */
+
+/*
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CIMBA_CMB_PROCESSPOOL_H
+#define CIMBA_CMB_PROCESSPOOL_H
+
+#include <stdint.h>
+
+#include "cmb_process.h"
+
+#include "cmi_memregistry.h"
+
+/**
+ * @brief The process pool struct, the processes it has made, and the ones of
+ *        them ready for reuse.
+ */
+struct cmb_processpool {
+    char name[CMB_PROCESS_NAMEBUF_SZ];      /**< Name given to its processes */
+    int64_t priority;                       /**< Priority given to its processes */
+    bool initialized;                       /**< Internal use */
+    struct cmb_process **all;               /**< All its processes */
+    uint64_t all_cnt;                       /**< Number of processes made */
+    uint64_t all_len;                       /**< Length of the array */
+    struct cmb_process **free;              /**< The finished ones, a stack */
+    uint64_t free_cnt;                      /**< Number ready for reuse */
+    uint64_t free_len;                      /**< Length of the array */
+    uint64_t spawned;                       /**< Number of spawns so far */
+    struct cmi_memregistry_item terminate;  /**< Internal use */
+    struct cmi_memregistry_item destroy;    /**< Internal use */
+};
+
+/**
+ * @brief Allocate memory for a process pool.
+ *
+ * @memberof cmb_processpool
+ * @return Pointer to the new process pool.
+ */
+extern struct cmb_processpool *cmb_processpool_create(void);
+
+/**
+ * @brief Make an allocated process pool ready for use.
+ *
+ * @memberof cmb_processpool
+ * @param ppp Pointer to an allocated process pool.
+ * @param name Null terminated string, the name of all its processes.
+ * @param priority The initial priority of each spawned process.
+ */
+extern void cmb_processpool_initialize(struct cmb_processpool *ppp,
+                                       const char *name,
+                                       int64_t priority);
+
+/**
+ * @brief Stop any of its processes still running, and terminate and destroy
+ *        all of them.
+ *
+ * @memberof cmb_processpool
+ * @param ppp Pointer to a process pool.
+ */
+extern void cmb_processpool_terminate(struct cmb_processpool *ppp);
+
+/**
+ * @brief Deallocate memory for the process pool. Call
+ *        `cmb_processpool_terminate` first.
+ *
+ * @memberof cmb_processpool
+ * @param ppp Pointer to a process pool.
+ */
+extern void cmb_processpool_destroy(struct cmb_processpool *ppp);
+
+/**
+ * @brief Start a process from the pool with the given process function and
+ *        context, reusing a finished one if there is one, otherwise making a
+ *        new one. Like `cmb_process_start`, the process starts running at the
+ *        current time, not within this call.
+ *
+ * @memberof cmb_processpool
+ * @param ppp Pointer to a process pool.
+ * @param procfunc The process function to run.
+ * @param context Pointer to whatever context the process function needs.
+ * @return Pointer to the process, good until it finishes.
+ */
+extern struct cmb_process *cmb_processpool_spawn(struct cmb_processpool *ppp,
+                                                 cmb_process_func procfunc,
+                                                 void *context);
+
+/**
+ * @brief The number of processes the pool has made, running or not.
+ *
+ * @memberof cmb_processpool
+ * @param ppp Pointer to a process pool.
+ */
+static inline uint64_t cmb_processpool_size(const struct cmb_processpool *ppp)
+{
+    cmb_assert_release(ppp != NULL);
+
+    return ppp->all_cnt;
+}
+
+/**
+ * @brief The number of finished processes ready for reuse.
+ *
+ * @memberof cmb_processpool
+ * @param ppp Pointer to a process pool.
+ */
+static inline uint64_t cmb_processpool_available(const struct cmb_processpool *ppp)
+{
+    cmb_assert_release(ppp != NULL);
+
+    return ppp->free_cnt;
+}
+
+/**
+ * @brief The number of spawns so far.
+ *
+ * @memberof cmb_processpool
+ * @param ppp Pointer to a process pool.
+ */
+static inline uint64_t cmb_processpool_spawned(const struct cmb_processpool *ppp)
+{
+    cmb_assert_release(ppp != NULL);
+
+    return ppp->spawned;
+}
+
+#endif /* CIMBA_CMB_PROCESSPOOL_H */
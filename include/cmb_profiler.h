@@ -0,0 +1,115 @@
+/**
+ * @file cmb_profiler.h
+ * @brief Built-in profiler, measuring the processor time spent in each event
+ *        function and each process function of the model.
+ *
+ * When turned on, the profiler reads the processor time stamp counter (TSC)
+ * around every event and every coroutine context switch, and adds up the
+ * cycles and the number of calls for each event function, each process
+ * function, and for the context switches themselves. The time is exclusive:
+ * An event that resumes a process is charged for its own work only, the time
+ * until the process yields again goes to the process function, and the
+ * switching back and forth goes to the context switches.
+ *
+ * Each thread keeps its own tables, merged into a common one when the worker
+ * threads of `cimba_run` finish, so that the report covers all trials in the
+ * experiment. Function names are looked up in the symbol table of the
+ * executable. Static functions and executables linked without exporting their
+ * symbols (`-rdynamic`) show as an offset into the file instead, or with the
+ * name of a process for process functions.
+ *
+ * The profiler is off by default, costing one test per event and per context
+ * switch.
+ */
+
+/*
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CIMBA_CMB_PROFILER_H
+#define CIMBA_CMB_PROFILER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cmb_event.h"
+#include "cmb_process.h"
+
+/**
+ * @brief The accumulated count and processor cycles for one function.
+ */
+struct cmb_profiler_count {
+    uint64_t calls;     /**< Events executed, process activations, or switches */
+    uint64_t cycles;    /**< Time stamp counter cycles spent in total */
+};
+
+/**
+ * @brief Is the profiler turned on for future trials?
+ */
+extern bool cmb_profiler_enabled(void);
+
+/**
+ * @brief Turn the profiler on or off. Takes effect from the next call to
+ *        `cmb_event_queue_initialize` in each thread, i.e., from the next
+ *        trial, not in the middle of one.
+ *
+ * @param on `true` to profile, `false` to stop.
+ */
+extern void cmb_profiler_enabled_set(bool on);
+
+/**
+ * @brief Get the profile of an event function, summed over the threads that
+ *        have finished and the calling thread.
+ *
+ * @param action The event function.
+ * @param pc Pointer to the struct to fill in.
+ * @return `true` if the event function has been profiled, `false` if not.
+ */
+extern bool cmb_profiler_event(cmb_event_func *action, struct cmb_profiler_count *pc);
+
+/**
+ * @brief Get the profile of a process function, summed over all processes
+ *        running it, the threads that have finished, and the calling thread.
+ *
+ * @param func The process function.
+ * @param pc Pointer to the struct to fill in.
+ * @return `true` if the process function has been profiled, `false` if not.
+ */
+extern bool cmb_profiler_process(cmb_process_func *func, struct cmb_profiler_count *pc);
+
+/**
+ * @brief Get the profile of the coroutine context switches.
+ *
+ * @param pc Pointer to the struct to fill in.
+ */
+extern void cmb_profiler_switches(struct cmb_profiler_count *pc);
+
+/**
+ * @brief Print the profile, one line per function with the number of calls,
+ *        the cycles in total and per call, and the share of all the profiled
+ *        cycles, highest first.
+ *
+ * @param fp A file pointer to print to, perhaps `stdout`.
+ */
+extern void cmb_profiler_print(FILE *fp);
+
+/**
+ * @brief Discard the profile collected so far, in the common table and in the
+ *        calling thread. Call between experiments, not while one is running.
+ */
+extern void cmb_profiler_reset(void);
+
+#endif /* CIMBA_CMB_PROFILER_H */
@@ -83,6 +83,22 @@ extern void cmb_resourceguard_initialize(struct cmb_resourceguard *rgp,
  */
 extern void cmb_resourceguard_terminate(struct cmb_resourceguard *rgp);
 
+/**
+ * @brief Get the current default branching factor for resource guard queues.
+ */
+extern unsigned cmb_resourceguard_default_arity(void);
+
+/**
+ * @brief Set the global default branching factor, 2, 4, or 8, for the heap in
+ * resource guard priority queues. Will take effect for all calls to
+ * `cmb_resourceguard_initialize` from now on, but will not change any already
+ * initialized resource guards. Binary unless told otherwise, only worth
+ * changing if thousands of processes are expected to wait in the same queue.
+ *
+ * @param arity The number of children per heap node, 2, 4, or 8.
+ */
+extern void cmb_resourceguard_default_arity_set(unsigned arity);
+
 /**
  * @brief  Enqueue and suspend the calling process until it reaches the front of
  *         the priority queue and its demand function returns true.
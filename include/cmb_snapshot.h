@@ -0,0 +1,152 @@
+/**
+ * @file cmb_snapshot.h
+ * @brief Snapshot and restore of the simulation state of a trial, for running
+ *        many trials from the same warmed-up state without repeating the
+ *        warm-up period in each.
+ *
+ * A snapshot is a copy of everything the trial has in this thread: the event
+ * queue and the simulation clock, the random number generator state, the
+ * processes with their coroutine stacks, and the resources, queues, and other
+ * Cimba objects of the model. Restoring it puts all of it back exactly as it
+ * was, at the same addresses, so that all pointers between the objects stay
+ * valid. The trial then continues from the point where the snapshot was taken.
+ *
+ * For this to work, Cimba keeps the memory of each thread in an arena at a
+ * fixed address while snapshots are enabled, and copies the part of the arena
+ * in use. Turn it on with `cmb_snapshot_enabled_set` before calling
+ * `cmb_event_queue_initialize` for the warm-up trial, and create the model
+ * after that call. Any memory the model allocates on its own, such as the trial
+ * struct, is not in the arena. Add it to the snapshot with
+ * `cmb_snapshot_region_add` to have it saved and restored as well.
+ *
+ * Typical use, in one thread:
+ * @code
+ * cmb_snapshot_enabled_set(true);
+ * cmb_event_queue_initialize(0.0);
+ * ... create the model and run it to the end of the warm-up period ...
+ * struct cmb_snapshot *sp = cmb_snapshot_create();
+ * cmb_snapshot_region_add(sp, &model, sizeof(model));
+ * cmb_snapshot_take(sp);
+ * for (each replication) {
+ *     cmb_snapshot_restore(sp);
+ *     cmb_random_initialize(seed[replication]);
+ *     ... run it and collect the results ...
+ * }
+ * cmb_snapshot_destroy(sp);
+ * @endcode
+ *
+ * Note that the restore also restores the random number generator, so that
+ * each restored trial would repeat the same sample path unless reseeded.
+ *
+ * A snapshot belongs to the thread that took it, and can only be restored in
+ * that thread. Take and restore from the main program, not from inside a
+ * process, between calls to the `cmb_event_queue_execute` functions.
+ * Coroutine stacks in the arena have no guard page, and the snapshot does not
+ * cover the shadow state of the sanitizers.
+ */
+
+/*
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CIMBA_CMB_SNAPSHOT_H
+#define CIMBA_CMB_SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief The default size of the address range reserved for the arena of each
+ *        thread, 4 GiB. Only the pages actually used take memory.
+ */
+#define CMB_SNAPSHOT_ARENA_DEFAULT (UINT64_C(1) << 32)
+
+/**
+ * @brief A saved copy of the simulation state of one thread, opaque.
+ */
+struct cmb_snapshot;
+
+/**
+ * @brief Are snapshots enabled for future trials?
+ */
+extern bool cmb_snapshot_enabled(void);
+
+/**
+ * @brief Turn snapshots on or off. Takes effect from the next call to
+ *        `cmb_event_queue_initialize` in each thread, i.e., from the next
+ *        trial, not in the middle of one.
+ *
+ * @param on `true` to keep the memory of future trials in the arena.
+ */
+extern void cmb_snapshot_enabled_set(bool on);
+
+/**
+ * @brief Set the size of the address range to reserve for the arena of each
+ *        thread, for threads that have not yet reserved one. Default
+ *        `CMB_SNAPSHOT_ARENA_DEFAULT`.
+ *
+ * @param sz The size in bytes.
+ */
+extern void cmb_snapshot_arena_size_set(size_t sz);
+
+/**
+ * @brief Allocate an empty snapshot object.
+ *
+ * @return Pointer to the new snapshot.
+ */
+extern struct cmb_snapshot *cmb_snapshot_create(void);
+
+/**
+ * @brief Add a memory region of the model outside the arena, to be saved and
+ *        restored along with the Cimba state, e.g., the trial struct.
+ *
+ * @param sp Pointer to the snapshot.
+ * @param p Start of the region.
+ * @param sz Size of the region in bytes.
+ */
+extern void cmb_snapshot_region_add(struct cmb_snapshot *sp, void *p, size_t sz);
+
+/**
+ * @brief Save the current simulation state of the calling thread into the
+ *        snapshot, replacing any state saved there before.
+ *
+ * @param sp Pointer to the snapshot.
+ */
+extern void cmb_snapshot_take(struct cmb_snapshot *sp);
+
+/**
+ * @brief Put the simulation state of the calling thread back to what it was
+ *        when the snapshot was taken. Can be repeated as often as needed.
+ *
+ * @param sp Pointer to the snapshot.
+ */
+extern void cmb_snapshot_restore(const struct cmb_snapshot *sp);
+
+/**
+ * @brief The number of bytes saved in the snapshot.
+ *
+ * @param sp Pointer to the snapshot.
+ */
+extern size_t cmb_snapshot_size(const struct cmb_snapshot *sp);
+
+/**
+ * @brief Free the snapshot.
+ *
+ * @param sp Pointer to the snapshot.
+ */
+extern void cmb_snapshot_destroy(struct cmb_snapshot *sp);
+
+#endif /* CIMBA_CMB_SNAPSHOT_H */
@@ -0,0 +1,157 @@
+/**
+ * @file cmb_trace.h
+ * @brief Binary event trace, recording every executed event and every process
+ *        state transition into a memory-mapped ring buffer file per thread.
+ *
+ * The logger formats text under a global mutex, which is fine for following a
+ * model in detail but far too slow for production-size runs. The trace writes
+ * fixed-size binary records instead, without formatting, locking, or system
+ * calls, straight into a file mapped into memory. Each thread writes its own
+ * file, named `<prefix>.<n>.cmbtrace` with `n` counting the files opened in
+ * this program run. The file is a ring: When full, the oldest records are
+ * overwritten, keeping the most recent ones up to the capacity.
+ *
+ * The records are:
+ *  - `CMB_TRACE_TRIAL`: A new trial started in this thread.
+ *  - `CMB_TRACE_EVENT`: An event about to execute, with its time, priority,
+ *     handle, action, subject and object.
+ *  - `CMB_TRACE_SYMBOL`: The name of an event function, written the first time
+ *     the function is seen, and now and then after that.
+ *  - `CMB_TRACE_PROCESS_NAME`: A process was initialized or renamed.
+ *  - `CMB_TRACE_PROCESS_RUN`: A process got control, started or resumed.
+ *  - `CMB_TRACE_PROCESS_YIELD`: A process gave up control, still running.
+ *  - `CMB_TRACE_PROCESS_EXIT`: A process gave up control for the last time.
+ *
+ * Since the file is shared with the operating system, the records written are
+ * there even if the program crashes. Decode it with the `cmb_tracedump` tool,
+ * as text or as a JSON trace for the Chrome and Perfetto trace viewers.
+ *
+ * The trace is off by default, costing one test per event and per context
+ * switch.
+ */
+
+/*
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CIMBA_CMB_TRACE_H
+#define CIMBA_CMB_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief The first eight bytes of a trace file, "CMBTRACE" in ASCII.
+ */
+#define CMB_TRACE_MAGIC UINT64_C(0x4543415254424D43)
+
+/**
+ * @brief The version of the file format described here.
+ */
+#define CMB_TRACE_VERSION 1u
+
+/**
+ * @brief Room for a process name in a trace record, including the terminating
+ *        zero. Matches `CMB_PROCESS_NAMEBUF_SZ`.
+ */
+#define CMB_TRACE_NAME_SZ 32
+
+/**
+ * @brief Room for a function name in a trace record, including the terminating
+ *        zero. Longer names are cut short.
+ */
+#define CMB_TRACE_SYMBOL_SZ 40
+
+/**
+ * @brief The kinds of trace records.
+ */
+enum cmb_trace_kind {
+    CMB_TRACE_TRIAL = 1,        /**< A trial started, `handle` is its index */
+    CMB_TRACE_EVENT,            /**< An event about to execute */
+    CMB_TRACE_SYMBOL,           /**< The name of an event function */
+    CMB_TRACE_PROCESS_NAME,     /**< A process got its name */
+    CMB_TRACE_PROCESS_RUN,      /**< A process got control */
+    CMB_TRACE_PROCESS_YIELD,    /**< A process gave up control */
+    CMB_TRACE_PROCESS_EXIT      /**< A process finished */
+};
+
+/**
+ * @brief The header at the start of a trace file, 64 bytes. The records follow
+ *        immediately after it.
+ */
+struct cmb_trace_header {
+    uint64_t magic;             /**< `CMB_TRACE_MAGIC` */
+    uint32_t version;           /**< `CMB_TRACE_VERSION` */
+    uint32_t record_size;       /**< `sizeof(struct cmb_trace_record)` */
+    uint64_t capacity;          /**< Number of records in the ring, a power of two */
+    uint64_t written;           /**< Records written in total, the next goes to `written % capacity` */
+    uint64_t thread_id;         /**< The `cimba_thread_id` of the writing thread */
+    uint64_t reserved[3];       /**< Zero */
+};
+
+/**
+ * @brief One trace record, 64 bytes. Pointers are stored as integers to keep
+ *        the size the same everywhere. Process records identify the process by
+ *        its address, the name record maps it to the handle and name.
+ */
+struct cmb_trace_record {
+    uint32_t kind;              /**< One of `enum cmb_trace_kind` */
+    uint32_t reserved;          /**< Zero */
+    double time;                /**< Simulation time */
+    union {
+        struct {
+            int64_t priority;   /**< Event priority */
+            uint64_t handle;    /**< Event handle, or trial index */
+            uint64_t action;    /**< Event function address */
+            uint64_t subject;   /**< Event subject pointer */
+            uint64_t object;    /**< Event object pointer */
+        } event;                /**< For `CMB_TRACE_TRIAL` and `CMB_TRACE_EVENT` */
+        struct {
+            uint64_t process;   /**< Process address */
+            uint64_t handle;    /**< Process handle, name records only */
+            char name[CMB_TRACE_NAME_SZ]; /**< Process name, name records only */
+        } process;              /**< For the `CMB_TRACE_PROCESS_*` records */
+        struct {
+            uint64_t address;   /**< Function address */
+            char name[CMB_TRACE_SYMBOL_SZ]; /**< Function name or file and offset */
+        } symbol;               /**< For `CMB_TRACE_SYMBOL` */
+    } u;                        /**< The record contents */
+};
+
+/**
+ * @brief Is the trace turned on for future trials?
+ */
+extern bool cmb_trace_enabled(void);
+
+/**
+ * @brief Turn the trace on. Takes effect from the next call to
+ *        `cmb_event_queue_initialize` in each thread, i.e., from the next
+ *        trial. Each thread then opens its own trace file, kept open for the
+ *        following trials until the thread exits or `cmb_trace_stop` is called.
+ *
+ * @param prefix The path and start of the file names, e.g., `"run/mm1"`.
+ * @param capacity Number of records to keep in each file, rounded up to a
+ *                 power of two, 64 bytes each.
+ */
+extern void cmb_trace_start(const char *prefix, uint64_t capacity);
+
+/**
+ * @brief Turn the trace off for future trials, and close the trace file of the
+ *        calling thread. Worker threads close theirs when they exit. Call
+ *        between trials, not in the middle of one.
+ */
+extern void cmb_trace_stop(void);
+
+#endif /* CIMBA_CMB_TRACE_H */
@@ -83,6 +83,10 @@ extern void cmi_hashheap_thread_cleanup(void);
 extern void cmi_event_thread_cleanup(void);
 extern void cmi_coroutine_thread_cleanup(void);
 extern void cmi_mempool_thread_cleanup(void);
+extern void cmi_profiler_thread_cleanup(void);
+extern void cmi_trace_thread_cleanup(void);
+extern void cmi_snapshot_thread_cleanup(void);
+extern void cmi_arena_thread_cleanup(void);
 
 /*
  * This function will run _before_ the start of main(), guaranteed before any
@@ -108,11 +112,15 @@ static void thread_pthread_cleanup(void *arg)
 {
     cmb_unused(arg);
 
-    /* The sequence is important here, mempools last */
+    /* The sequence is important here, mempools and then the arena last */
+    cmi_snapshot_thread_cleanup();
+    cmi_profiler_thread_cleanup();
+    cmi_trace_thread_cleanup();
     cmi_hashheap_thread_cleanup();
     cmi_event_thread_cleanup();
     cmi_coroutine_thread_cleanup();
     cmi_mempool_thread_cleanup();
+    cmi_arena_thread_cleanup();
 }
 
 /* Call signature as expected by atexit(). Will run on program exit.
@@ -125,10 +133,14 @@ static void thread_pthread_cleanup(void *arg)
 static void thread_main_cleanup(void)
 {
     if (cmi_coroutine_current() == cmi_coroutine_main()) {
+        cmi_snapshot_thread_cleanup();
+        cmi_profiler_thread_cleanup();
+        cmi_trace_thread_cleanup();
         cmi_hashheap_thread_cleanup();
         cmi_event_thread_cleanup();
         cmi_coroutine_thread_cleanup();
         cmi_mempool_thread_cleanup();
+        cmi_arena_thread_cleanup();
     }
 }
 
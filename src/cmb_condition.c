@@ -176,8 +176,8 @@ uint64_t cmb_condition_signal(struct cmb_condition *cp)
     /* First pass, recording the satisfied demand predicates */
     for (uint64_t ui = 1; ui <= hp->heap_count; ui++) {
         /* Decode the hashheap item */
-        struct cmi_heap_tag *htp = &(hp->heap[ui]);
-        void **item = htp->item;
+        const struct cmi_heap_tag *htp = &(hp->heap[ui]);
+        void **item = cmi_hashheap_item_at(hp, ui);
         struct cmb_process *pp = item[0];
         cmb_condition_demand_func *demand = item[1];
         const void *ctx = item[2];
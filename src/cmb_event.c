@@ -18,17 +18,24 @@
  */
 
 #include <assert.h>
+#include <math.h>
 
 #include "cmb_assert.h"
 #include "cmb_event.h"
 #include "cmb_logger.h"
 #include "cmb_process.h"
 
+#include "cmi_bucketqueue.h"
 #include "cmi_config.h"
+#include "cmi_fastlane.h"
 #include "cmi_hashheap.h"
 #include "cmi_memutils.h"
 #include "cmi_process.h"
+#include "cmi_profiler.h"
 #include "cmi_slist.h"
+#include "cmi_snapshot.h"
+#include "cmi_subjectindex.h"
+#include "cmi_trace.h"
 
 /*
  * sim_time - The simulation clock. It can be initiated to start from a
@@ -38,13 +45,83 @@
 static CMB_THREAD_LOCAL double sim_time = 0.0;
 
 /*
- * event_queue - The main event queue, implemented as a hash/heap.
+ * event_queue - The main event queue, implemented as a hash/heap, or
+ * event_ladder, the same as a ladder queue or radix heap. While initialized,
+ * exactly one of them is in use, the other one is NULL.
  */
 static CMB_THREAD_LOCAL struct cmi_hashheap *event_queue = NULL;
+static CMB_THREAD_LOCAL struct cmi_bucketqueue *event_ladder = NULL;
+
+/*
+ * event_lane - Events scheduled for the current time, in front of the main
+ * event queue, taking their handles from the same running counter.
+ */
+static CMB_THREAD_LOCAL struct cmi_fastlane *event_lane = NULL;
+
+/*
+ * spare_queue, spare_lane - The heap and fast lane of the previous trial in
+ * this thread, kept for the next trial to save allocating and regrowing them.
+ * queue_peak is the most events the previous heap held at the same time, used
+ * to presize the next one.
+ */
+static CMB_THREAD_LOCAL struct cmi_hashheap *spare_queue = NULL;
+static CMB_THREAD_LOCAL struct cmi_fastlane *spare_lane = NULL;
+static CMB_THREAD_LOCAL uint64_t queue_peak = UINT64_C(0);
+
+/*
+ * queue_stats - The counts of events through the queue in this trial, with the
+ * heap figures filled in when asked for by cmb_event_queue_stats. heap_retired
+ * holds the heap statistics of a heap that is done for this trial, at the
+ * switch to a ladder queue or at the end of the trial.
+ */
+static CMB_THREAD_LOCAL struct cmb_event_queue_stats queue_stats;
+static CMB_THREAD_LOCAL struct cmi_hashheap_stats heap_retired;
 
 /* The initial capacity of the heap is 2^QUEUE_INIT_EXP items, resizing as needed */
 #define QUEUE_INIT_EXP 3
 
+/* Expected number of events for future event queues, zero if no idea */
+static uint64_t queue_capacity_hint = UINT64_C(0);
+
+/* Heaps larger than this many events are freed at the end of a trial, not kept */
+static uint64_t queue_retain_limit = UINT64_C(1) << 16;
+
+/* The bucket queues start larger, they are not used for small queues anyway */
+#define LADDER_INIT_EXP 10
+
+/* Branching factor of the heap for future event queues, binary unless told otherwise */
+static unsigned queue_arity = 2u;
+
+/* Slot-indexed event handles for future event queues, hashed unless told otherwise */
+static bool queue_slot_handles = false;
+
+/* Index by subject for future event queues, off unless told otherwise */
+static bool queue_subject_index = false;
+
+/* Backend for future event queues, heap unless told otherwise */
+static unsigned queue_backend = CMB_EVENT_QUEUE_HEAP;
+
+/* Direct handoff between processes for future event queues, off unless told otherwise */
+static bool queue_handoff = false;
+
+/* An automatic event queue switches from heap to ladder at this many events */
+#define QUEUE_AUTO_LADDER 1024u
+static CMB_THREAD_LOCAL bool queue_auto = false;
+
+/*
+ * run_handoff, run_until, run_left - Whether the running cmb_event_queue_execute
+ * function lets a yielding process take the next event itself, see
+ * cmi_event_handoff, and how far the run may go, counting the events taken that
+ * way as well as those executed by the loop itself.
+ */
+static CMB_THREAD_LOCAL bool handoff_on = false;
+static CMB_THREAD_LOCAL bool run_handoff = false;
+static CMB_THREAD_LOCAL double run_until = 0.0;
+static CMB_THREAD_LOCAL uint64_t run_left = UINT64_C(0);
+
+/* The handle of the most recently dequeued event */
+static CMB_THREAD_LOCAL uint64_t current_handle = UINT64_C(0);
+
 /* Temporary index buffer for pattern matches, static thread local for efficiency */
 static CMB_THREAD_LOCAL uint64_t *match_buf = NULL;
 static CMB_THREAD_LOCAL uint64_t match_buf_size = UINT64_C(0);
@@ -72,8 +149,8 @@ double cmb_time(void)
  * Ranking determines the event queue order, where lower reactivation times
  * (rank_d64) go before higher, if equal, then higher priority (rank_i64) before
  * lower, and if that also is equal, FIFO order based on hash key value.
- * This may be the same as using default_compare in cmi_hashheap.c but is
- * repeated here to make the event queue logic self-contained.
+ * The heap has the same ordering built in as CMI_HASHHEAP_ORDER_TIME, this is
+ * for comparing the fast lane with whichever main event queue is in use.
  */
 static bool event_compare(const struct cmi_heap_tag *a,
                             const struct cmi_heap_tag *b)
@@ -102,39 +179,333 @@ static bool event_compare(const struct cmi_heap_tag *a,
     return false;
 }
 
+/*
+ * queue_spare_free - Free the heap kept from the previous trial, if any.
+ */
+static void queue_spare_free(void)
+{
+    if (spare_queue != NULL) {
+        cmi_hashheap_terminate(spare_queue);
+        cmi_hashheap_destroy(spare_queue);
+        spare_queue = NULL;
+    }
+}
+
+/*
+ * queue_keep - Note the peak size and the statistics of a heap that is done
+ * for this trial and keep it for the next trial, unless it is larger than the
+ * retain limit.
+ */
+static void queue_keep(struct cmi_hashheap *hp)
+{
+    cmb_assert_debug(hp != NULL);
+
+    queue_peak = hp->heap_peak;
+    heap_retired = hp->stats;
+    queue_spare_free();
+    if (hp->heap_size <= __atomic_load_n(&queue_retain_limit, __ATOMIC_RELAXED)) {
+        spare_queue = hp;
+    }
+    else {
+        cmi_hashheap_terminate(hp);
+        cmi_hashheap_destroy(hp);
+    }
+}
+
+/*
+ * queue_presize - The number of events to make room for in a new heap, the
+ * larger of the capacity hint and the peak of the previous trial, but no more
+ * than an automatic event queue holds before switching to a ladder queue.
+ */
+static uint64_t queue_presize(void)
+{
+    uint64_t want = __atomic_load_n(&queue_capacity_hint, __ATOMIC_RELAXED);
+    if (queue_peak > want) {
+        want = queue_peak;
+    }
+
+    if (queue_auto && (want > QUEUE_AUTO_LADDER)) {
+        want = QUEUE_AUTO_LADDER;
+    }
+
+    return want;
+}
+
 /*
  * cmb_event_queue_initialize - Set starting simulation time, allocate and initialize
- * hashheap for use. Allocates contiguous memory aligned to an integer number
- * of memory pages for efficiency.
+ * hashheap (or ladder queue) for use. Allocates contiguous memory aligned to an
+ * integer number of memory pages for efficiency.
  */
 void cmb_event_queue_initialize(const double start_time)
 {
     /* Expect a fresh, empty event queue. Verify to make sure any error handling
      * in a previous trial cleaned up after itself before coming here again. */
     cmb_assert_release(event_queue == NULL);
+    cmb_assert_release(event_ladder == NULL);
 
     sim_time = start_time;
-    event_queue = cmi_hashheap_create();
-    cmi_hashheap_initialize(event_queue, QUEUE_INIT_EXP, event_compare);
+    current_handle = UINT64_C(0);
+    cmi_memset(&queue_stats, 0u, sizeof(queue_stats));
+    cmi_memset(&heap_retired, 0u, sizeof(heap_retired));
+    handoff_on = __atomic_load_n(&queue_handoff, __ATOMIC_RELAXED);
+    cmi_snapshot_trial_start();
+    cmi_profiler_trial_start();
+    cmi_trace_trial_start();
+    if (spare_lane != NULL) {
+        /* Emptied at the end of the previous trial */
+        event_lane = spare_lane;
+        spare_lane = NULL;
+    }
+    else {
+        event_lane = cmi_fastlane_create();
+        cmi_fastlane_initialize(event_lane);
+    }
+
+    const unsigned backend = __atomic_load_n(&queue_backend, __ATOMIC_RELAXED);
+    queue_auto = (backend == CMB_EVENT_QUEUE_AUTO);
+    if ((backend == CMB_EVENT_QUEUE_LADDER) || (backend == CMB_EVENT_QUEUE_RADIX)) {
+        queue_spare_free();
+        event_ladder = cmi_bucketqueue_create();
+        cmi_bucketqueue_initialize(event_ladder,
+                                   LADDER_INIT_EXP,
+                                   (backend == CMB_EVENT_QUEUE_RADIX) ?
+                                       CMI_BUCKETQUEUE_RADIX : CMI_BUCKETQUEUE_LADDER);
+        if (__atomic_load_n(&queue_subject_index, __ATOMIC_RELAXED)) {
+            cmi_bucketqueue_index_subjects(event_ladder);
+        }
+    }
+    else {
+        const unsigned arity = __atomic_load_n(&queue_arity, __ATOMIC_RELAXED);
+        const bool slots = __atomic_load_n(&queue_slot_handles, __ATOMIC_RELAXED);
+        const bool subjects = __atomic_load_n(&queue_subject_index, __ATOMIC_RELAXED);
+        const uint16_t flags = cmi_hashheap_arity_flag(arity)
+                               | (slots ? CMI_HASHHEAP_SLOT_KEYS : 0u)
+                               | (subjects ? CMI_HASHHEAP_SUBJECT_INDEX : 0u)
+                               | CMI_HASHHEAP_ORDER_TIME;
+        const uint64_t want = queue_presize();
+        if ((spare_queue != NULL) && (spare_queue->heap_flags == flags)) {
+            event_queue = spare_queue;
+            spare_queue = NULL;
+            cmi_hashheap_rewind(event_queue);
+            cmi_hashheap_reserve(event_queue, want);
+        }
+        else {
+            queue_spare_free();
+            uint16_t hexp = QUEUE_INIT_EXP;
+            while ((UINT64_C(1) << hexp) < want) {
+                hexp++;
+            }
+
+            event_queue = cmi_hashheap_create();
+            cmi_hashheap_initialize_wflags(event_queue, hexp, NULL, flags);
+        }
+    }
 }
 
 /*
- * cmb_event_queue_terminate - Clean up, deallocating space.
+ * queue_switch_to_ladder - Move all events from the heap to a new ladder queue,
+ * keeping their handles, and continue the series of handles from there.
  */
-void cmb_event_queue_terminate(void)
+static void queue_switch_to_ladder(void)
 {
-    cmb_assert_release(event_queue != NULL);
+    cmb_assert_debug(event_queue != NULL);
+    cmb_assert_debug(event_ladder == NULL);
+
+    cmb_logger_info(stdout,
+                    "Switching to ladder queue at %" PRIu64 " events",
+                    cmi_hashheap_count(event_queue));
+
+    event_ladder = cmi_bucketqueue_create();
+    cmi_bucketqueue_initialize(event_ladder, LADDER_INIT_EXP, CMI_BUCKETQUEUE_LADDER);
+    if (event_queue->subjects != NULL) {
+        cmi_bucketqueue_index_subjects(event_ladder);
+    }
+
+    for (uint64_t ui = 1u; ui <= event_queue->heap_count; ui++) {
+        const struct cmi_heap_tag *htp = &(event_queue->heap[ui]);
+        const struct cmi_heap_item *itp = &(event_queue->items[htp->item_slot]);
+        (void)cmi_bucketqueue_enqueue_recurring(event_ladder,
+                                                itp->item[0], itp->item[1],
+                                                itp->item[2], itp->item[3],
+                                                htp->hash_key,
+                                                htp->rank_d64,
+                                                htp->rank_i64,
+                                                itp->period);
+    }
 
-    cmi_hashheap_terminate(event_queue);
-    cmi_hashheap_destroy(event_queue);
+    event_ladder->item_counter = cmi_hashheap_key_max(event_queue);
+    queue_keep(event_queue);
     event_queue = NULL;
-    sim_time = 0.0;
+    queue_auto = false;
+}
 
-    if (match_buf != NULL) {
-        cmi_free(match_buf);
-        match_buf = NULL;
-        match_buf_size = UINT64_C(0);
+/*
+ * cmb_event_queue_arity - get global variable for all future inits
+ */
+unsigned cmb_event_queue_arity(void)
+{
+    const unsigned arity = __atomic_load_n(&queue_arity, __ATOMIC_RELAXED);
+
+    return arity;
+}
+
+/*
+ * cmb_event_queue_arity_set - set global variable for all future inits
+ */
+void cmb_event_queue_arity_set(const unsigned arity)
+{
+    cmb_assert_release((arity == 2u) || (arity == 4u) || (arity == 8u));
+    __atomic_store_n(&queue_arity, arity, __ATOMIC_RELAXED);
+}
+
+/*
+ * cmb_event_queue_slot_handles - get global variable for all future inits
+ */
+bool cmb_event_queue_slot_handles(void)
+{
+    const bool slots = __atomic_load_n(&queue_slot_handles, __ATOMIC_RELAXED);
+
+    return slots;
+}
+
+/*
+ * cmb_event_queue_slot_handles_set - set global variable for all future inits
+ */
+void cmb_event_queue_slot_handles_set(const bool slots)
+{
+    __atomic_store_n(&queue_slot_handles, slots, __ATOMIC_RELAXED);
+}
+
+/*
+ * cmb_event_queue_subject_index - get global variable for all future inits
+ */
+bool cmb_event_queue_subject_index(void)
+{
+    const bool subjects = __atomic_load_n(&queue_subject_index, __ATOMIC_RELAXED);
+
+    return subjects;
+}
+
+/*
+ * cmb_event_queue_subject_index_set - set global variable for all future inits
+ */
+void cmb_event_queue_subject_index_set(const bool subjects)
+{
+    __atomic_store_n(&queue_subject_index, subjects, __ATOMIC_RELAXED);
+}
+
+/*
+ * cmb_event_queue_backend - get global variable for all future inits
+ */
+enum cmb_event_queue_backend cmb_event_queue_backend(void)
+{
+    const unsigned backend = __atomic_load_n(&queue_backend, __ATOMIC_RELAXED);
+
+    return (enum cmb_event_queue_backend)backend;
+}
+
+/*
+ * cmb_event_queue_backend_set - set global variable for all future inits
+ */
+void cmb_event_queue_backend_set(const enum cmb_event_queue_backend backend)
+{
+    cmb_assert_release((backend == CMB_EVENT_QUEUE_HEAP)
+                       || (backend == CMB_EVENT_QUEUE_LADDER)
+                       || (backend == CMB_EVENT_QUEUE_RADIX)
+                       || (backend == CMB_EVENT_QUEUE_AUTO));
+    __atomic_store_n(&queue_backend, (unsigned)backend, __ATOMIC_RELAXED);
+}
+
+/*
+ * cmb_event_queue_handoff - get global variable for all future inits
+ */
+bool cmb_event_queue_handoff(void)
+{
+    const bool handoff = __atomic_load_n(&queue_handoff, __ATOMIC_RELAXED);
+
+    return handoff;
+}
+
+/*
+ * cmb_event_queue_handoff_set - set global variable for all future inits
+ */
+void cmb_event_queue_handoff_set(const bool handoff)
+{
+    __atomic_store_n(&queue_handoff, handoff, __ATOMIC_RELAXED);
+}
+
+/*
+ * cmb_event_queue_capacity_hint - get global variable for all future inits
+ */
+uint64_t cmb_event_queue_capacity_hint(void)
+{
+    const uint64_t events = __atomic_load_n(&queue_capacity_hint, __ATOMIC_RELAXED);
+
+    return events;
+}
+
+/*
+ * cmb_event_queue_capacity_hint_set - set global variable for all future inits
+ */
+void cmb_event_queue_capacity_hint_set(const uint64_t events)
+{
+    __atomic_store_n(&queue_capacity_hint, events, __ATOMIC_RELAXED);
+}
+
+/*
+ * cmb_event_queue_retain_limit - get global variable for all future trials
+ */
+uint64_t cmb_event_queue_retain_limit(void)
+{
+    const uint64_t events = __atomic_load_n(&queue_retain_limit, __ATOMIC_RELAXED);
+
+    return events;
+}
+
+/*
+ * cmb_event_queue_retain_limit_set - set global variable for all future trials
+ */
+void cmb_event_queue_retain_limit_set(const uint64_t events)
+{
+    __atomic_store_n(&queue_retain_limit, events, __ATOMIC_RELAXED);
+}
+
+/*
+ * queue_free - Free whichever of the heap or ladder queue is in use, keeping
+ * the heap and the fast lane for the next trial in this thread.
+ */
+static void queue_free(void)
+{
+    if (event_queue != NULL) {
+        queue_keep(event_queue);
+        event_queue = NULL;
+    }
+
+    if (event_ladder != NULL) {
+        cmi_bucketqueue_terminate(event_ladder);
+        cmi_bucketqueue_destroy(event_ladder);
+        event_ladder = NULL;
+    }
+
+    if (event_lane != NULL) {
+        cmb_assert_debug(spare_lane == NULL);
+        cmi_fastlane_clear(event_lane);
+        spare_lane = event_lane;
+        event_lane = NULL;
     }
+
+    current_handle = UINT64_C(0);
+}
+
+/*
+ * cmb_event_queue_terminate - Clean up, deallocating or keeping space.
+ */
+void cmb_event_queue_terminate(void)
+{
+    cmb_assert_release((event_queue != NULL) || (event_ladder != NULL));
+
+    queue_free();
+    sim_time = 0.0;
 }
 
 /*
@@ -142,7 +513,15 @@ void cmb_event_queue_terminate(void)
  */
 void cmb_event_queue_clear(void)
 {
-    cmi_hashheap_clear(event_queue);
+    if (event_ladder != NULL) {
+        cmi_bucketqueue_clear(event_ladder);
+    }
+    else {
+        cmi_hashheap_clear(event_queue);
+    }
+
+    cmi_fastlane_clear(event_lane);
+    current_handle = UINT64_C(0);
 }
 
 /*
@@ -150,7 +529,7 @@ void cmb_event_queue_clear(void)
  */
 void cmi_event_queue_cleanup(void)
 {
-    if (event_queue != NULL) {
+    if ((event_queue != NULL) || (event_ladder != NULL)) {
         cmb_event_queue_terminate();
     }
 }
@@ -163,14 +542,12 @@ void cmi_event_queue_cleanup(void)
  *
  * Called by the worker-thread recovery path in cimba.c: a trial that abandons
  * itself with cmb_logger_error longjmp out without reaching cmb_event_queue_terminate,
- * leaving this thread's queue allocated. This frees it.
+ * leaving this thread's queue in use. This empties it for the next trial.
  */
 void cmi_event_queue_reset(void)
 {
-    if (event_queue != NULL) {
-        cmi_hashheap_terminate(event_queue);
-        cmi_hashheap_destroy(event_queue);
-        event_queue = NULL;
+    if ((event_queue != NULL) || (event_ladder != NULL)) {
+        queue_free();
         sim_time = 0.0;
     }
 }
@@ -180,7 +557,7 @@ void cmi_event_queue_reset(void)
  */
 bool cmb_event_queue_is_empty(void)
 {
-    return cmi_hashheap_is_empty(event_queue);
+    return (cmb_event_queue_count() == 0u);
 }
 
 /*
@@ -188,13 +565,276 @@ bool cmb_event_queue_is_empty(void)
  */
 extern uint64_t cmb_event_queue_count(void)
 {
-    return cmi_hashheap_count(event_queue);
+    const uint64_t lcnt = cmi_fastlane_count(event_lane);
+    if (event_ladder != NULL) {
+        return lcnt + cmi_bucketqueue_count(event_ladder);
+    }
+
+    return lcnt + cmi_hashheap_count(event_queue);
+}
+
+/*
+ * stats_note_enqueue - Count n events about to be scheduled, noting the peak
+ * depth that the queue is about to reach.
+ */
+static inline void stats_note_enqueue(const uint64_t n)
+{
+    queue_stats.enqueues += n;
+    const uint64_t depth = cmb_event_queue_count() + n;
+    if (depth > queue_stats.peak_depth) {
+        queue_stats.peak_depth = depth;
+    }
+}
+
+/*
+ * cmb_event_queue_stats - Fill in the statistics, adding up the heap figures
+ * from any retired heap and the one in use.
+ */
+void cmb_event_queue_stats(struct cmb_event_queue_stats *sp)
+{
+    cmb_assert_release(sp != NULL);
+
+    struct cmi_hashheap_stats hs = heap_retired;
+    if (event_queue != NULL) {
+        const struct cmi_hashheap_stats *cur = &(event_queue->stats);
+        hs.grows += cur->grows;
+        hs.lookups += cur->lookups;
+        hs.probes += cur->probes;
+        hs.probe_max = (cur->probe_max > hs.probe_max) ? cur->probe_max : hs.probe_max;
+        hs.sifts += cur->sifts;
+        hs.sift_levels += cur->sift_levels;
+    }
+
+    *sp = queue_stats;
+    sp->heap_grows = hs.grows;
+    sp->hash_lookups = hs.lookups;
+    sp->probe_mean = (hs.lookups > 0u) ? (double)hs.probes / (double)hs.lookups : 0.0;
+    sp->probe_max = hs.probe_max;
+    sp->heap_sifts = hs.sifts;
+    sp->sift_mean = (hs.sifts > 0u) ? (double)hs.sift_levels / (double)hs.sifts : 0.0;
+}
+
+/*
+ * The fast lane operations used below. With slot handles in the heap, each
+ * event in the lane has an item slot held for its handle in the heap, where
+ * the lane position and priority from the push are kept. The handle then leads
+ * straight to the event in the lane, and also straight to the heap item if the
+ * event moves there. Other handles are searched for in the lane.
+ */
+static bool lane_push(void *action,
+                      void *subject,
+                      void *object,
+                      const uint64_t handle,
+                      const int64_t priority)
+{
+    uint64_t pos;
+    if (!cmi_fastlane_push(event_lane, action, subject, object, NULL,
+                           handle, priority, &pos)) {
+        return false;
+    }
+
+    if (event_queue != NULL) {
+        void **rip = cmi_hashheap_reserved_item(event_queue, handle);
+        if (rip != NULL) {
+            rip[0] = (void *)(uintptr_t)pos;
+            rip[1] = (void *)(intptr_t)priority;
+        }
+    }
+
+    return true;
+}
+
+static struct cmi_fastlane_entry *lane_find(const uint64_t handle,
+                                            int64_t *priority)
+{
+    if (cmi_fastlane_count(event_lane) == 0u) {
+        return NULL;
+    }
+
+    if ((event_queue != NULL) && cmi_hashheap_is_slot_key(event_queue, handle)) {
+        void **rip = cmi_hashheap_reserved_item(event_queue, handle);
+        if (rip == NULL) {
+            return NULL;
+        }
+
+        const int64_t pri = (int64_t)(intptr_t)rip[1];
+        struct cmi_fastlane_entry *ep = cmi_fastlane_find_at(event_lane, handle, pri,
+                                                             (uint64_t)(uintptr_t)rip[0]);
+        if ((ep != NULL) && (priority != NULL)) {
+            *priority = pri;
+        }
+
+        return ep;
+    }
+
+    return cmi_fastlane_find(event_lane, handle, priority);
+}
+
+static bool lane_remove(const uint64_t handle)
+{
+    if (cmi_fastlane_count(event_lane) == 0u) {
+        return false;
+    }
+
+    if ((event_queue != NULL) && cmi_hashheap_is_slot_key(event_queue, handle)) {
+        void **rip = cmi_hashheap_reserved_item(event_queue, handle);
+        if (rip == NULL) {
+            return false;
+        }
+
+        return cmi_fastlane_remove_at(event_lane, handle,
+                                      (int64_t)(intptr_t)rip[1],
+                                      (uint64_t)(uintptr_t)rip[0]);
+    }
+
+    return cmi_fastlane_remove(event_lane, handle);
+}
+
+/* The event is done with the lane and will not go in the heap */
+static void lane_release(const uint64_t handle)
+{
+    if (event_queue != NULL) {
+        cmi_hashheap_key_release(event_queue, handle);
+    }
+}
+
+/*
+ * The small set of queue operations used below, dispatching to the fast lane if
+ * the event is there, otherwise to whichever of the heap or the ladder queue is
+ * in use. A handle for the lane is reserved in the heap, see above.
+ */
+static uint64_t queue_next_handle(void)
+{
+    if (event_ladder != NULL) {
+        return ++(event_ladder->item_counter);
+    }
+
+    return cmi_hashheap_key_reserve(event_queue);
+}
+
+static uint64_t queue_enqueue(void *action,
+                              void *subject,
+                              void *object,
+                              void *waiters,
+                              const uint64_t handle,
+                              const double time,
+                              const int64_t priority)
+{
+    if (event_ladder != NULL) {
+        return cmi_bucketqueue_enqueue(event_ladder,
+                                       action,
+                                       subject,
+                                       object,
+                                       waiters,
+                                       handle,
+                                       time,
+                                       priority);
+    }
+
+    return cmi_hashheap_enqueue(event_queue,
+                                action,
+                                subject,
+                                object,
+                                waiters,
+                                handle,
+                                time,
+                                priority);
+}
+
+static bool queue_is_enqueued(const uint64_t handle)
+{
+    if (lane_find(handle, NULL) != NULL) {
+        return true;
+    }
+
+    if (event_ladder != NULL) {
+        return cmi_bucketqueue_is_enqueued(event_ladder, handle);
+    }
+
+    return cmi_hashheap_is_enqueued(event_queue, handle);
+}
+
+static void **queue_item(const uint64_t handle)
+{
+    struct cmi_fastlane_entry *ep = lane_find(handle, NULL);
+    if (ep != NULL) {
+        return ep->item;
+    }
+
+    if (event_ladder != NULL) {
+        return cmi_bucketqueue_item(event_ladder, handle);
+    }
+
+    return cmi_hashheap_item(event_queue, handle);
+}
+
+static double queue_drank(const uint64_t handle)
+{
+    /* Everything in the fast lane is due now */
+    if (lane_find(handle, NULL) != NULL) {
+        return sim_time;
+    }
+
+    if (event_ladder != NULL) {
+        return cmi_bucketqueue_drank(event_ladder, handle);
+    }
+
+    return cmi_hashheap_drank(event_queue, handle);
+}
+
+static int64_t queue_irank(const uint64_t handle)
+{
+    int64_t priority;
+    if (lane_find(handle, &priority) != NULL) {
+        return priority;
+    }
+
+    if (event_ladder != NULL) {
+        return cmi_bucketqueue_irank(event_ladder, handle);
+    }
+
+    return cmi_hashheap_irank(event_queue, handle);
+}
+
+static void queue_reprioritize(const uint64_t handle,
+                               const double time,
+                               const int64_t priority)
+{
+    /* An event leaving its place in the fast lane goes to the main queue with
+     * its handle, where the ordering is the same, only slower to get at */
+    int64_t lane_pri;
+    const struct cmi_fastlane_entry *ep = lane_find(handle, &lane_pri);
+    if (ep != NULL) {
+        if ((time == sim_time) && (priority == lane_pri)) {
+            return;
+        }
+
+        const struct cmi_fastlane_entry tmp = *ep;
+        (void)lane_remove(handle);
+        (void)queue_enqueue(tmp.item[0],
+                            tmp.item[1],
+                            tmp.item[2],
+                            tmp.item[3],
+                            handle,
+                            time,
+                            priority);
+        return;
+    }
+
+    if (event_ladder != NULL) {
+        cmi_bucketqueue_reprioritize(event_ladder, handle, time, priority);
+    }
+    else {
+        cmi_hashheap_reprioritize(event_queue, handle, time, priority);
+    }
 }
 
 /*
  * cmb_event_schedule - Insert the event in the event queue as indicated by
  * activation time t and priority p, return a unique event handle.
- * Resizes hashheap if necessary.
+ * Events due right now go in the fast lane, unless it already has all the
+ * priorities it can hold. Everything else goes in the main event queue,
+ * resizing it if necessary.
  */
 uint64_t cmb_event_schedule(cmb_event_func *action,
                             void *subject,
@@ -203,16 +843,135 @@ uint64_t cmb_event_schedule(cmb_event_func *action,
                             const int64_t priority)
 {
     cmb_assert_release(time >= sim_time);
-    cmb_assert_release(event_queue != NULL);
+    cmb_assert_release(event_lane != NULL);
 
-    return cmi_hashheap_enqueue(event_queue,
-                                (void *)action,
-                                subject,
-                                object,
-                                NULL,
-                                0u,
-                                time,
-                                priority);
+    stats_note_enqueue(1u);
+    if (time == sim_time) {
+        const uint64_t handle = queue_next_handle();
+        if (lane_push((void *)action, subject, object, handle, priority)) {
+            return handle;
+        }
+
+        return queue_enqueue((void *)action, subject, object, NULL, handle, time, priority);
+    }
+
+    if (queue_auto && (event_queue->heap_count >= QUEUE_AUTO_LADDER)) {
+        queue_switch_to_ladder();
+    }
+
+    return queue_enqueue((void *)action, subject, object, NULL, 0u, time, priority);
+}
+
+/*
+ * cmb_event_schedule_periodic - Insert a recurring event in the main event
+ * queue, never in the fast lane, since it stays in the queue after executing.
+ * The period is kept in its item slot, zero for all other events.
+ */
+uint64_t cmb_event_schedule_periodic(cmb_event_func *action,
+                                     void *subject,
+                                     void *object,
+                                     const double first,
+                                     const double period,
+                                     const int64_t priority)
+{
+    cmb_assert_release(first >= sim_time);
+    cmb_assert_release(period > 0.0);
+    cmb_assert_release(event_lane != NULL);
+
+    stats_note_enqueue(1u);
+    if (queue_auto && (event_queue->heap_count >= QUEUE_AUTO_LADDER)) {
+        queue_switch_to_ladder();
+    }
+
+    if (event_ladder != NULL) {
+        return cmi_bucketqueue_enqueue_recurring(event_ladder,
+                                                 (void *)action,
+                                                 subject,
+                                                 object,
+                                                 NULL,
+                                                 0u,
+                                                 first,
+                                                 priority,
+                                                 period);
+    }
+
+    return cmi_hashheap_enqueue_recurring(event_queue,
+                                          (void *)action,
+                                          subject,
+                                          object,
+                                          NULL,
+                                          0u,
+                                          first,
+                                          priority,
+                                          period);
+}
+
+/*
+ * cmb_event_schedule_batch - Schedule n events in the given order. The heap
+ * takes them all in one batch, with the heap order restored once at the end.
+ * The bucket queues are O(1) per event anyway, and take them one at a time.
+ */
+void cmb_event_schedule_batch(const uint64_t n,
+                              const struct cmb_event_spec *specs,
+                              uint64_t *handles)
+{
+    cmb_assert_release((specs != NULL) || (n == 0u));
+    cmb_assert_release(event_lane != NULL);
+
+    if (queue_auto && (event_queue->heap_count + n >= QUEUE_AUTO_LADDER)) {
+        queue_switch_to_ladder();
+    }
+
+    if (event_ladder != NULL) {
+        for (uint64_t ui = 0u; ui < n; ui++) {
+            const struct cmb_event_spec *sp = &(specs[ui]);
+            const uint64_t handle = cmb_event_schedule(sp->action,
+                                                       sp->subject,
+                                                       sp->object,
+                                                       sp->time,
+                                                       sp->priority);
+            if (handles != NULL) {
+                handles[ui] = handle;
+            }
+        }
+
+        return;
+    }
+
+    stats_note_enqueue(n);
+    cmi_hashheap_batch_begin(event_queue, n);
+    for (uint64_t ui = 0u; ui < n; ui++) {
+        const struct cmb_event_spec *sp = &(specs[ui]);
+        cmb_assert_release(sp->time >= sim_time);
+
+        /* Same choice between the fast lane and the heap as for one event */
+        uint64_t handle = 0u;
+        if (sp->time == sim_time) {
+            handle = queue_next_handle();
+            if (lane_push((void *)sp->action, sp->subject, sp->object,
+                          handle, sp->priority)) {
+                if (handles != NULL) {
+                    handles[ui] = handle;
+                }
+
+                continue;
+            }
+        }
+
+        handle = cmi_hashheap_batch_append(event_queue,
+                                           (void *)sp->action,
+                                           sp->subject,
+                                           sp->object,
+                                           NULL,
+                                           handle,
+                                           sp->time,
+                                           sp->priority);
+        if (handles != NULL) {
+            handles[ui] = handle;
+        }
+    }
+
+    cmi_hashheap_batch_end(event_queue);
 }
 
 /*
@@ -220,9 +979,9 @@ uint64_t cmb_event_schedule(cmb_event_func *action,
  */
 bool cmb_event_is_scheduled(const uint64_t handle)
 {
-    cmb_assert_release(event_queue != NULL);
+    cmb_assert_release((event_queue != NULL) || (event_ladder != NULL));
 
-    return cmi_hashheap_is_enqueued(event_queue, handle);
+    return queue_is_enqueued(handle);
 }
 
 /*
@@ -230,9 +989,9 @@ bool cmb_event_is_scheduled(const uint64_t handle)
  */
 double cmb_event_time(const uint64_t handle)
 {
-    cmb_assert_release(event_queue != NULL);
+    cmb_assert_release((event_queue != NULL) || (event_ladder != NULL));
 
-    return cmi_hashheap_drank(event_queue, handle);
+    return queue_drank(handle);
 }
 
 /*
@@ -240,9 +999,9 @@ double cmb_event_time(const uint64_t handle)
  */
 int64_t cmb_event_priority(const uint64_t handle)
 {
-    cmb_assert_release(event_queue != NULL);
+    cmb_assert_release((event_queue != NULL) || (event_ladder != NULL));
 
-    return cmi_hashheap_irank(event_queue, handle);
+    return queue_irank(handle);
 }
 
 /*
@@ -362,38 +1121,207 @@ void cmi_event_cancel_wakeups(const struct cmb_process *pp)
 }
 
 /*
- * cmb_event_execute_next - Remove and execute the next event, update the clock.
- * cmi_hashheap_dequeue returns a pointer to the current location of the event.
- * This location is a temporary space, will be overwritten by the next event.
- * Execution must be atomic until the event is executed.
+ * lane_goes_first - Does the first event in the fast lane go before the first
+ * in the main event queue? Both are compared on the full ordering, since the
+ * main queue may hold events at the current time too, scheduled from earlier
+ * or moved there by a reschedule, and these go first if they have a higher
+ * priority or the same priority and an earlier handle. Sets *lane_pri to the
+ * priority of the first event in the lane, if any.
  */
-bool cmb_event_execute_next(void)
+static bool lane_goes_first(int64_t *lane_pri)
 {
-    if (cmb_event_queue_is_empty()) {
+    if (cmi_fastlane_count(event_lane) == 0u) {
+        return false;
+    }
+
+    const struct cmi_fastlane_entry *ep = cmi_fastlane_peek(event_lane, lane_pri);
+    if (ep == NULL) {
         return false;
     }
 
-    /* Pull off the next event and decode it */
-     struct event_peek ev = *(struct event_peek *)cmi_hashheap_dequeue(event_queue);
+    const struct cmi_heap_tag lane_tag = { .hash_key = ep->hash_key,
+                                           .rank_d64 = sim_time,
+                                           .rank_i64 = *lane_pri };
+    if (event_ladder != NULL) {
+        const struct cmi_bucket_node *np = cmi_bucketqueue_peek(event_ladder);
+        if (np == NULL) {
+            return true;
+        }
+
+        const struct cmi_heap_tag main_tag = { .hash_key = np->hash_key,
+                                               .rank_d64 = np->rank_d64,
+                                               .rank_i64 = np->rank_i64 };
+        return event_compare(&lane_tag, &main_tag);
+    }
+
+    if (cmi_hashheap_is_empty(event_queue)) {
+        return true;
+    }
+
+    return event_compare(&lane_tag, &(event_queue->heap[1]));
+}
 
-    /* Advance clock to the time of this event. Must happen before any enqueue,
-    * while heap slot 0 still holds the dequeued tag. */
-    const double new_time = event_queue->heap[0].rank_d64;
+/*
+ * queue_recur - Put the periodic event just taken off the front back in the
+ * main queue for its next occurrence, with the same handle. The heap gives its
+ * first tag the new time and sifts it down, without the item ever leaving. The
+ * ladder has already let go of it, and takes it back as a new item.
+ */
+static void queue_recur(cmb_event_func *action,
+                        void *subject,
+                        void *object,
+                        const double time,
+                        const int64_t priority,
+                        const double period)
+{
+    if (event_ladder != NULL) {
+        (void)cmi_bucketqueue_enqueue_recurring(event_ladder,
+                                                (void *)action,
+                                                subject,
+                                                object,
+                                                NULL,
+                                                current_handle,
+                                                time,
+                                                priority,
+                                                period);
+    }
+    else {
+        cmi_hashheap_requeue_first(event_queue, time);
+    }
+
+    queue_stats.reschedules++;
+}
+
+/*
+ * struct event_taken - What is needed from an event taken off the queue.
+ */
+struct event_taken {
+    cmb_event_func *action;
+    void *subject;
+    void *object;
+    int64_t priority;
+};
+
+/*
+ * queue_take - Remove the next event, update the clock, and schedule the
+ * wakeup calls for any processes waiting for it, everything but executing it.
+ * The dequeue returns a pointer to the event in its item slot, which stays put
+ * until the next dequeue, but may move if the event queue grows. Read what is
+ * needed from it before scheduling anything. A periodic event first in the
+ * heap is not dequeued at all, only given its next time before executing, so
+ * that the action can cancel or reschedule it like any other event.
+ * Precondition: The queue is not empty.
+ */
+static inline void queue_take(struct event_taken *etp)
+{
+    queue_stats.dequeues++;
+
+    /* Pull off the next event and decode it in place */
+    struct event_peek *evp;
+    double new_time;
+    int64_t new_pri;
+    double period = 0.0;
+    if (lane_goes_first(&new_pri)) {
+        evp = (struct event_peek *)cmi_fastlane_dequeue(event_lane);
+        new_time = sim_time;
+        current_handle = event_lane->last.hash_key;
+        lane_release(current_handle);
+    }
+    else if (event_ladder != NULL) {
+        struct cmi_bucket_node last;
+        evp = (struct event_peek *)cmi_bucketqueue_dequeue(event_ladder, &last);
+        new_time = last.rank_d64;
+        new_pri = last.rank_i64;
+        current_handle = last.hash_key;
+        period = event_ladder->items[last.item_slot].period;
+    }
+    else {
+        const struct cmi_heap_tag *first = &(event_queue->heap[1]);
+        period = event_queue->items[first->item_slot].period;
+        if (period > 0.0) {
+            /* Stays where it is, for now */
+            evp = (struct event_peek *)cmi_hashheap_peek_item(event_queue);
+            new_time = first->rank_d64;
+            new_pri = first->rank_i64;
+            current_handle = first->hash_key;
+        }
+        else {
+            /* Heap slot 0 holds the dequeued tag until the next dequeue */
+            evp = (struct event_peek *)cmi_hashheap_dequeue(event_queue);
+            new_time = event_queue->heap[0].rank_d64;
+            new_pri = event_queue->heap[0].rank_i64;
+            current_handle = event_queue->heap[0].hash_key;
+        }
+    }
+
+    etp->action = evp->action;
+    etp->subject = evp->subject;
+    etp->object = evp->object;
+    etp->priority = new_pri;
+
+    /* Advance clock to the time of this event, nothing left at the old time */
     cmb_assert_debug(new_time >= sim_time);
+    cmb_assert_debug((new_time == sim_time) || (cmi_fastlane_count(event_lane) == 0u));
     sim_time = new_time;
 
-    /* Schedule wakeup calls for any processes waiting for this event */
-    const uint64_t handle = event_queue->heap[0].hash_key;
-    if (!cmi_slist_is_empty(&(ev.waiters))) {
-        wake_event_waiters_occurred(&(ev.waiters), handle);
+    /* Detach the list of any processes waiting for this event before anything
+     * is scheduled, since the scheduling may move the item array */
+    struct cmi_slist_node waiters = evp->waiters;
+    if (!cmi_slist_is_empty(&waiters)) {
+        cmi_slist_initialize(&(evp->waiters));
+    }
+
+    if (period > 0.0) {
+        cmb_assert_debug(new_time + period > new_time);
+        queue_recur(etp->action, etp->subject, etp->object,
+                    new_time + period, new_pri, period);
+    }
+
+    /* Schedule wakeup calls for the waiting processes */
+    if (!cmi_slist_is_empty(&waiters)) {
+        wake_event_waiters_occurred(&waiters, current_handle);
+    }
+}
+
+/*
+ * cmb_event_execute_next - Remove and execute the next event, update the clock.
+ */
+bool cmb_event_execute_next(void)
+{
+    if (cmb_event_queue_is_empty()) {
+        return false;
+    }
+
+    struct event_taken ev;
+    queue_take(&ev);
+
+    /* Execute the event, tracing and timing it if asked to */
+    if (cmi_trace_on) {
+        cmi_trace_event(ev.action, ev.subject, ev.object, current_handle, ev.priority);
     }
 
-    /* Execute the event */
-    (*ev.action)(ev.subject, ev.object);
+    if (cmi_profiler_on) {
+        cmi_profiler_event(ev.action, ev.subject, ev.object);
+    }
+    else {
+        (*ev.action)(ev.subject, ev.object);
+    }
 
     return true;
 }
 
+/*
+ * run_begin - Set the limits of a run by one of the cmb_event_queue_execute
+ * functions, and allow handoffs if turned on and not profiling, since the
+ * profiler times each event by executing it.
+ */
+static void run_begin(const double t, const uint64_t n)
+{
+    run_until = t;
+    run_left = n;
+    run_handoff = handoff_on && !cmi_profiler_on;
+}
+
 /*
  * cmb_event_queue_execute - Execute event queue until empty.
  * Schedule an event containing cmb_event_queue_clear to terminate the
@@ -401,24 +1329,143 @@ bool cmb_event_execute_next(void)
  */
 void cmb_event_queue_execute(void)
 {
-    cmb_assert_release(event_queue != NULL);
+    cmb_assert_release((event_queue != NULL) || (event_ladder != NULL));
 
     cmb_logger_info(stdout, "Starting simulation run");
+    run_begin(INFINITY, UINT64_MAX);
     while (cmb_event_execute_next()) { }
+    run_handoff = false;
 
     cmb_logger_info(stdout, "No more events in queue");
 }
 
+/*
+ * queue_next_time - The time of the first event in the queue. The fast lane
+ * only holds events at the current time, and nothing can come before those.
+ * Precondition: The queue is not empty.
+ */
+static double queue_next_time(void)
+{
+    if (cmi_fastlane_count(event_lane) > 0u) {
+        return sim_time;
+    }
+
+    if (event_ladder != NULL) {
+        const struct cmi_bucket_node *np = cmi_bucketqueue_peek(event_ladder);
+        cmb_assert_debug(np != NULL);
+        return np->rank_d64;
+    }
+
+    return cmi_hashheap_peek_drank(event_queue);
+}
+
+/*
+ * cmb_event_queue_execute_until - Execute events up to and including time t,
+ * then move the clock to t. Nothing is left in the fast lane at the old time,
+ * since anything there would have been at or before t.
+ */
+uint64_t cmb_event_queue_execute_until(const double t)
+{
+    cmb_assert_release((event_queue != NULL) || (event_ladder != NULL));
+    cmb_assert_release(t >= sim_time);
+
+    cmb_logger_info(stdout, "Running until %g", t);
+    run_begin(t, UINT64_MAX);
+    while (!cmb_event_queue_is_empty() && (queue_next_time() <= t)) {
+        run_left--;
+        (void)cmb_event_execute_next();
+    }
+
+    run_handoff = false;
+    const uint64_t cnt = UINT64_MAX - run_left;
+
+    cmb_assert_debug(cmi_fastlane_count(event_lane) == 0u);
+    sim_time = t;
+    cmb_logger_info(stdout, "Stopped after %" PRIu64 " events", cnt);
+
+    return cnt;
+}
+
+/*
+ * cmb_event_queue_execute_n - Execute at most n events.
+ */
+uint64_t cmb_event_queue_execute_n(const uint64_t n)
+{
+    cmb_assert_release((event_queue != NULL) || (event_ladder != NULL));
+
+    cmb_logger_info(stdout, "Running %" PRIu64 " events", n);
+    run_begin(INFINITY, n);
+    while ((run_left > 0u) && !cmb_event_queue_is_empty()) {
+        run_left--;
+        (void)cmb_event_execute_next();
+    }
+
+    run_handoff = false;
+    const uint64_t cnt = n - run_left;
+
+    cmb_logger_info(stdout, "Stopped after %" PRIu64 " events", cnt);
+
+    return cnt;
+}
+
+/*
+ * queue_next_action - The action of the first event in the queue.
+ * Precondition: The queue is not empty.
+ */
+static void *queue_next_action(void)
+{
+    int64_t lane_pri;
+    if (lane_goes_first(&lane_pri)) {
+        const struct cmi_fastlane_entry *ep = cmi_fastlane_peek(event_lane, &lane_pri);
+        return ep->item[0];
+    }
+
+    if (event_ladder != NULL) {
+        const struct cmi_bucket_node *np = cmi_bucketqueue_peek(event_ladder);
+        cmb_assert_debug(np != NULL);
+        return event_ladder->items[np->item_slot].item[0];
+    }
+
+    return cmi_hashheap_peek_item(event_queue)[0];
+}
+
+/*
+ * cmi_event_handoff - Called by a process about to yield to the dispatcher. If
+ * the running cmb_event_queue_execute function allows it and the next event is
+ * a call to the given action, take it off the queue here, just as the
+ * dispatcher would have done, and return its subject for the process to
+ * transfer control to directly. The action itself is left for the caller to
+ * carry out. Returns NULL if the process should yield to the dispatcher.
+ */
+void *cmi_event_handoff(cmb_event_func *action)
+{
+    if (!run_handoff || (run_left == 0u) || cmb_event_queue_is_empty()) {
+        return NULL;
+    }
+
+    if ((queue_next_action() != (void *)action) || (queue_next_time() > run_until)) {
+        return NULL;
+    }
+
+    run_left--;
+    struct event_taken ev;
+    queue_take(&ev);
+    if (cmi_trace_on) {
+        cmi_trace_event(ev.action, ev.subject, ev.object, current_handle, ev.priority);
+    }
+
+    return ev.subject;
+}
+
 /*
  * cmb_event_current - Return the handle of the current (most recently dequeued)
  * event, zero if no events have occurred.
  */
 uint64_t cmb_event_current(void)
 {
-    cmb_assert_release(event_queue != NULL);
-    cmb_assert_debug(event_queue->heap != NULL);
+    cmb_assert_release((event_queue != NULL) || (event_ladder != NULL));
 
-    return event_queue->heap[0].hash_key;
+    return current_handle;
 }
 
 /*
@@ -427,16 +1474,25 @@ uint64_t cmb_event_current(void)
  */
 bool cmb_event_cancel(const uint64_t handle)
 {
-    cmb_assert_release(event_queue != NULL);
+    cmb_assert_release((event_queue != NULL) || (event_ladder != NULL));
 
-    if (!cmi_hashheap_is_enqueued(event_queue, handle)) {
+    if (!queue_is_enqueued(handle)) {
         return false;
     }
 
-    struct event_peek tmp = *(struct event_peek *)cmi_hashheap_item(event_queue, handle);
+    struct event_peek tmp = *(struct event_peek *)queue_item(handle);
 
-    (void)cmi_hashheap_cancel(event_queue, handle);
+    if (lane_remove(handle)) {
+        lane_release(handle);
+    }
+    else if (event_ladder != NULL) {
+        (void)cmi_bucketqueue_remove(event_ladder, handle);
+    }
+    else {
+        (void)cmi_hashheap_cancel(event_queue, handle);
+    }
 
+    queue_stats.cancels++;
     if (!cmi_slist_is_empty(&(tmp.waiters))) {
         wake_event_waiters_cancelled(&(tmp.waiters), handle);
     }
@@ -451,16 +1507,17 @@ bool cmb_event_cancel(const uint64_t handle)
 bool cmb_event_reschedule(const uint64_t handle, const double time)
 {
     cmb_assert_release(time >= sim_time);
-    cmb_assert_release(event_queue != NULL);
+    cmb_assert_release((event_queue != NULL) || (event_ladder != NULL));
 
-    if (!cmi_hashheap_is_enqueued(event_queue, handle)) {
+    if (!queue_is_enqueued(handle)) {
         return false;
     }
 
     /* Do not change the priority rank_i64 */
-    const int64_t pri = cmi_hashheap_irank(event_queue, handle);
+    const int64_t pri = queue_irank(handle);
 
-    cmi_hashheap_reprioritize(event_queue, handle, time, pri);
+    queue_reprioritize(handle, time, pri);
+    queue_stats.reschedules++;
 
     return true;
 }
@@ -472,20 +1529,57 @@ bool cmb_event_reschedule(const uint64_t handle, const double time)
 bool cmb_event_reprioritize(const uint64_t handle,
                             const int64_t priority)
 {
-    cmb_assert_release(event_queue != NULL);
+    cmb_assert_release((event_queue != NULL) || (event_ladder != NULL));
 
-    if (!cmi_hashheap_is_enqueued(event_queue, handle)) {
+    if (!queue_is_enqueued(handle)) {
         return false;
     }
 
-    const double time = cmi_hashheap_drank(event_queue, handle);
+    const double time = queue_drank(handle);
     cmb_assert_debug(time >= sim_time);
 
-    cmi_hashheap_reprioritize(event_queue, handle, time, priority);
+    queue_reprioritize(handle, time, priority);
+    queue_stats.reschedules++;
 
     return true;
 }
 
+/*
+ * lane_pattern_match - Scan the fast lane for events matching the pattern,
+ * with the CMB_ANY_* constants as wildcards. If cntp is NULL, returns the handle
+ * of the first match found, zero if none. Otherwise, counts all matches into
+ * *cntp, also recording their handles in match_buf if it is large enough.
+ */
+static uint64_t lane_pattern_match(cmb_event_func *action,
+                                   const void *subject,
+                                   const void *object,
+                                   uint64_t *cntp)
+{
+    const void *vaction = *(void**)&action;
+    for (unsigned ui = 0u; ui < event_lane->ring_count; ui++) {
+        const struct cmi_fastlane_ring *rp = &(event_lane->rings[ui]);
+        for (uint64_t pos = rp->head; pos < rp->tail; pos++) {
+            const struct cmi_fastlane_entry *ep = cmi_fastlane_entry_at(rp, pos);
+            if ((ep->live != 0u)
+                && ((action == CMB_ANY_ACTION) || (vaction == ep->item[0]))
+                && ((subject == CMB_ANY_SUBJECT) || (subject == ep->item[1]))
+                && ((object == CMB_ANY_OBJECT) || (object == ep->item[2]))) {
+                if (cntp == NULL) {
+                    return ep->hash_key;
+                }
+
+                if (*cntp < match_buf_size) {
+                    match_buf[*cntp] = ep->hash_key;
+                }
+
+                (*cntp)++;
+            }
+        }
+    }
+
+    return 0u;
+}
+
 /*
  * cmb_event_pattern_find - Locate a specific event, using the CMB_ANY_*
  * constants as wildcards in the respective positions. Returns the handle of
@@ -495,14 +1589,30 @@ uint64_t cmb_event_pattern_find(cmb_event_func *action,
                         const void *subject,
                         const void *object)
 {
-    cmb_assert_release(event_queue != NULL);
+    cmb_assert_release((event_queue != NULL) || (event_ladder != NULL));
 
     const void *vaction = *(void**)&action;
-    return cmi_hashheap_pattern_find(event_queue,
-                                     vaction,
-                                     subject,
-                                     object,
-                                     CMI_ANY_ITEM);
+    uint64_t handle;
+    if (event_ladder != NULL) {
+        handle = cmi_bucketqueue_pattern_find(event_ladder,
+                                              vaction,
+                                              subject,
+                                              object,
+                                              CMI_ANY_ITEM);
+    }
+    else {
+        handle = cmi_hashheap_pattern_find(event_queue,
+                                           vaction,
+                                           subject,
+                                           object,
+                                           CMI_ANY_ITEM);
+    }
+
+    if (handle == 0u) {
+        handle = lane_pattern_match(action, subject, object, NULL);
+    }
+
+    return handle;
 }
 
 /*
@@ -513,20 +1623,31 @@ uint64_t cmb_event_pattern_count(cmb_event_func *action,
                         const void *subject,
                         const void *object)
 {
-    cmb_assert_release(event_queue != NULL);
+    cmb_assert_release((event_queue != NULL) || (event_ladder != NULL));
 
     const void *vaction = *(void**)&action;
-    return cmi_hashheap_pattern_count(event_queue,
-                                      vaction,
-                                      subject,
-                                      object,
-                                      CMI_ANY_ITEM);
+    uint64_t cnt = 0u;
+    (void)lane_pattern_match(action, subject, object, &cnt);
+    if (event_ladder != NULL) {
+        return cnt + cmi_bucketqueue_pattern_count(event_ladder,
+                                                   vaction,
+                                                   subject,
+                                                   object,
+                                                   CMI_ANY_ITEM);
+    }
+
+    return cnt + cmi_hashheap_pattern_count(event_queue,
+                                            vaction,
+                                            subject,
+                                            object,
+                                            CMI_ANY_ITEM);
 }
 
 /*
  * cmb_event_cancel_all - Cancel all matching events.
  * Two-pass approach: Allocate temporary storage for the list of matching
- * handles in the first pass, then cancel these in the second pass.
+ * handles in the first pass, then cancel these in the second pass, in one
+ * batch for those in the heap.
  * Returns the number of events canceled, possibly zero.
  *
  * Partially duplicates code from cmi_hashheap to be able to cancel any
@@ -538,19 +1659,19 @@ uint64_t cmb_event_pattern_cancel(cmb_event_func *action,
                                   const void *subject,
                                   const void *object)
 {
-    cmb_assert_release(event_queue != NULL);
+    cmb_assert_release((event_queue != NULL) || (event_ladder != NULL));
 
-    if ((event_queue->heap == NULL) || (event_queue->heap_count == 0u)) {
+    if (cmb_event_queue_is_empty()) {
         return 0u;
     }
 
-    /* Make sure the buffer is large enough to match everything in the heap */
-    const uint64_t hsz = event_queue->heap_size;
-    if (hsz > match_buf_size) {
+    /* Make sure the buffer is large enough to match everything in the queue */
+    const uint64_t qcnt = cmb_event_queue_count();
+    if (qcnt > match_buf_size) {
         /* Safe also for initial call, since realloc reverts to malloc if target
          * is NULL, and our cmb_calloc wrapper includes the return value test */
-        match_buf = (uint64_t*)cmi_realloc(match_buf, hsz);
-        match_buf_size = hsz;
+        match_buf = (uint64_t*)cmi_realloc(match_buf, qcnt * sizeof(*match_buf));
+        match_buf_size = qcnt;
     }
 
     /* Convoluted type cast to circumvent the C language barrier between
@@ -561,21 +1682,80 @@ uint64_t cmb_event_pattern_cancel(cmb_event_func *action,
 
     /* First pass, recording the matches */
     uint64_t cnt = 0u;
-    for (uint64_t ui = 1; ui <= event_queue->heap_count; ui++) {
-        const struct cmi_heap_tag *htp = &(event_queue->heap[ui]);
-        if (((action == CMB_ANY_ACTION) || (vaction == htp->item[0]))
-            && ((subject == CMB_ANY_SUBJECT) || (subject == htp->item[1]))
-            && ((object == CMB_ANY_OBJECT) || (object == htp->item[2]))) {
-            /* Matched, note it in the index buffer */
-            match_buf[cnt++] = event_queue->heap[ui].hash_key;
+    (void)lane_pattern_match(action, subject, object, &cnt);
+    const struct cmi_subjectindex *sip = (event_ladder != NULL) ? event_ladder->subjects
+                                                                : event_queue->subjects;
+    if ((sip != NULL) && (subject != CMB_ANY_SUBJECT)) {
+        /* Only the events for this subject, from either backend */
+        for (uint64_t slot = cmi_subjectindex_first(sip, subject);
+             slot != 0u;
+             slot = cmi_subjectindex_next(sip, slot)) {
+            void **item = (event_ladder != NULL) ? event_ladder->items[slot].item
+                                                 : event_queue->items[slot].item;
+            if (((action == CMB_ANY_ACTION) || (vaction == item[0]))
+                && ((object == CMB_ANY_OBJECT) || (object == item[2]))) {
+                match_buf[cnt++] = (event_ladder != NULL) ? event_ladder->items[slot].hash_key
+                                                          : event_queue->items[slot].hash_key;
+            }
+        }
+    }
+    else if (event_ladder != NULL) {
+        for (uint64_t slot = 1u; slot <= event_ladder->item_top; slot++) {
+            if (!cmi_bucketqueue_slot_is_live(event_ladder, slot)) {
+                continue;
+            }
+
+            void **item = cmi_bucketqueue_item_at(event_ladder, slot);
+            if (((action == CMB_ANY_ACTION) || (vaction == item[0]))
+                && ((subject == CMB_ANY_SUBJECT) || (subject == item[1]))
+                && ((object == CMB_ANY_OBJECT) || (object == item[2]))) {
+                match_buf[cnt++] = event_ladder->items[slot].hash_key;
+            }
+        }
+    }
+    else {
+        for (uint64_t ui = 1; ui <= event_queue->heap_count; ui++) {
+            void **item = cmi_hashheap_item_at(event_queue, ui);
+            if (((action == CMB_ANY_ACTION) || (vaction == item[0]))
+                && ((subject == CMB_ANY_SUBJECT) || (subject == item[1]))
+                && ((object == CMB_ANY_OBJECT) || (object == item[2]))) {
+                /* Matched, note it in the index buffer */
+                match_buf[cnt++] = event_queue->heap[ui].hash_key;
+            }
         }
     }
 
     /* Second pass, cancel the matching events */
+    if (event_ladder != NULL) {
+        for (uint64_t ui = 0u; ui < cnt; ui++) {
+            cmb_event_cancel(match_buf[ui]);
+        }
+
+        return cnt;
+    }
+
+    /* The heap events nobody is waiting for are removed in one batch, with
+     * one rebuild of the heap if there are many of them */
+    uint64_t nbatch = 0u;
     for (uint64_t ui = 0u; ui < cnt; ui++) {
-        cmb_event_cancel(match_buf[ui]);
+        const uint64_t handle = match_buf[ui];
+        if (lane_find(handle, NULL) != NULL) {
+            cmb_event_cancel(handle);
+            continue;
+        }
+
+        const struct event_peek *ep = (struct event_peek *)cmi_hashheap_item(event_queue,
+                                                                             handle);
+        if (!cmi_slist_is_empty(&(ep->waiters))) {
+            cmb_event_cancel(handle);
+        }
+        else {
+            match_buf[nbatch++] = handle;
+        }
     }
 
+    queue_stats.cancels += cmi_hashheap_remove_batch(event_queue, match_buf, nbatch);
+
     return cnt;
 }
 
@@ -596,23 +1776,61 @@ static const char *default_formatter(cmb_event_func *a, const void *s, const voi
  */
 void cmb_event_queue_print(FILE *fp, cmb_event_print_formatter *epf)
 {
-    cmb_assert_release(event_queue != NULL);
+    cmb_assert_release((event_queue != NULL) || (event_ladder != NULL));
     cmb_assert_release(fp != NULL);
 
     if (epf == NULL) {
         epf = default_formatter;
     }
 
-    const uint64_t hcnt = event_queue->heap_count;
     fprintf(fp, "--------------------- Event queue ---------------------\n");
+    for (unsigned ui = 0u; ui < event_lane->ring_count; ui++) {
+        const struct cmi_fastlane_ring *rp = &(event_lane->rings[ui]);
+        for (uint64_t pos = rp->head; pos < rp->tail; pos++) {
+            const struct cmi_fastlane_entry *ep = cmi_fastlane_entry_at(rp, pos);
+            if (ep->live != 0u) {
+                fprintf(fp,
+                        "time %#8.4g prio %" PRIi64 ": hash_key %" PRIu64 "\t%s\n",
+                        sim_time,
+                        rp->priority,
+                        ep->hash_key,
+                        (*epf)(ep->item[0], ep->item[1], ep->item[2]));
+            }
+        }
+    }
+
+    if (event_ladder != NULL) {
+        /* In item slot order, not in event order */
+        for (uint64_t slot = 1u; slot <= event_ladder->item_top; slot++) {
+            if (!cmi_bucketqueue_slot_is_live(event_ladder, slot)) {
+                continue;
+            }
+
+            const struct cmi_bucket_node *np = cmi_bucketqueue_node_at(event_ladder, slot);
+            void **item = cmi_bucketqueue_item_at(event_ladder, slot);
+            fprintf(fp,
+                    "time %#8.4g prio %" PRIi64 ": hash_key %" PRIu64 "\t%s\n",
+                    np->rank_d64,
+                    np->rank_i64,
+                    np->hash_key,
+                    (*epf)(item[0], item[1], item[2]));
+        }
+
+        fprintf(fp, "-------------------------------------------------------\n");
+        fflush(fp);
+        return;
+    }
+
+    const uint64_t hcnt = event_queue->heap_count;
     for (uint64_t ui = 1u; ui <= hcnt; ui++) {
         const struct cmi_heap_tag *htp = &(event_queue->heap[ui]);
+        void **item = cmi_hashheap_item_at(event_queue, ui);
         fprintf(fp,
                 "time %#8.4g prio %" PRIi64 ": hash_key %" PRIu64 "\t%s\n",
                 htp->rank_d64,
                 htp->rank_i64,
                 htp->hash_key,
-                (*epf)(htp->item[0], htp->item[1], htp->item[2]));
+                (*epf)(item[0], item[1], item[2]));
     }
     fprintf(fp, "-------------------------------------------------------\n");
     fflush(fp);
@@ -623,14 +1841,14 @@ void cmb_event_queue_print(FILE *fp, cmb_event_print_formatter *epf)
  */
 void cmi_event_add_waiter(const uint64_t key, struct cmb_process *pp)
 {
-    cmb_assert_release(event_queue != NULL);
-    cmb_assert_release(cmi_hashheap_count(event_queue) > 0u);
-    cmb_assert_release(cmi_hashheap_is_enqueued(event_queue, key));
+    cmb_assert_release((event_queue != NULL) || (event_ladder != NULL));
+    cmb_assert_release(cmb_event_queue_count() > 0u);
+    cmb_assert_release(queue_is_enqueued(key));
 
     struct cmi_process_waiter *tag = cmi_mempool_alloc(&cmi_process_waitertags);
     tag->proc = pp;
 
-    struct event_peek *tmp = (struct event_peek *)cmi_hashheap_item(event_queue, key);
+    struct event_peek *tmp = (struct event_peek *)queue_item(key);
     cmi_slist_push(&(tmp->waiters), &(tag->listhead));
 }
 
@@ -639,13 +1857,13 @@ void cmi_event_add_waiter(const uint64_t key, struct cmb_process *pp)
  */
 bool cmi_event_remove_waiter(const uint64_t key, const struct cmb_process *pp)
 {
-    cmb_assert_release(event_queue != NULL);
+    cmb_assert_release((event_queue != NULL) || (event_ladder != NULL));
 
-    if (!cmi_hashheap_is_enqueued(event_queue, key)) {
+    if (!queue_is_enqueued(key)) {
         return false;
     }
 
-    struct event_peek *tmp = (struct event_peek *)cmi_hashheap_item(event_queue, key);
+    struct event_peek *tmp = (struct event_peek *)queue_item(key);
     struct cmi_slist_node *whead = &(tmp->waiters);
     while (whead->next != NULL) {
         struct cmi_process_waiter *pw = cmi_container_of(whead->next,
@@ -668,5 +1886,36 @@ void cmi_event_thread_cleanup(void)
 {
     if (match_buf != NULL) {
         cmi_free(match_buf);
+        match_buf = NULL;
+        match_buf_size = UINT64_C(0);
+    }
+
+    queue_spare_free();
+    if (spare_lane != NULL) {
+        cmi_fastlane_terminate(spare_lane);
+        cmi_fastlane_destroy(spare_lane);
+        spare_lane = NULL;
     }
-}
\ No newline at end of file
+
+    queue_peak = UINT64_C(0);
+}
+
+/*
+ * cmi_event_snapshot_regions - Add the thread local clock and event queue to the snapshot.
+ */
+void cmi_event_snapshot_regions(struct cmb_snapshot *sp)
+{
+    cmi_snapshot_add(sp, &sim_time, sizeof(sim_time));
+    cmi_snapshot_add(sp, &event_queue, sizeof(event_queue));
+    cmi_snapshot_add(sp, &event_ladder, sizeof(event_ladder));
+    cmi_snapshot_add(sp, &event_lane, sizeof(event_lane));
+    cmi_snapshot_add(sp, &spare_queue, sizeof(spare_queue));
+    cmi_snapshot_add(sp, &spare_lane, sizeof(spare_lane));
+    cmi_snapshot_add(sp, &queue_peak, sizeof(queue_peak));
+    cmi_snapshot_add(sp, &queue_stats, sizeof(queue_stats));
+    cmi_snapshot_add(sp, &heap_retired, sizeof(heap_retired));
+    cmi_snapshot_add(sp, &queue_auto, sizeof(queue_auto));
+    cmi_snapshot_add(sp, &current_handle, sizeof(current_handle));
+    cmi_snapshot_add(sp, &match_buf, sizeof(match_buf));
+    cmi_snapshot_add(sp, &match_buf_size, sizeof(match_buf_size));
+}
@@ -0,0 +1,176 @@
+/*
+ * cmb_generator.c - A stackless process, a step function called from the event
+ * dispatcher at the times it asks for, with no coroutine of its own.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include "cmb_assert.h"
+#include "cmb_event.h"
+#include "cmb_generator.h"
+#include "cmb_logger.h"
+
+#include "cmi_memutils.h"
+
+/*
+ * cmb_generator_create - Allocate memory for the generator.
+ */
+struct cmb_generator *cmb_generator_create(void)
+{
+    struct cmb_generator *gp = cmi_malloc(sizeof(*gp));
+    cmi_memset(gp, 0, sizeof(*gp));
+    gp->status = CMB_PROCESS_UNINITIALIZED;
+
+    /* Add teardown function to the memregistry in case we need to bail out */
+    cmi_dlist_initialize(&(gp->destroy.node));
+    gp->destroy.teardown = (cmi_teardown_func *)cmb_generator_destroy;
+    gp->destroy.object = gp;
+    cmi_memregistry_add(&(gp->destroy));
+
+    cmb_assert_debug(gp->status == CMB_PROCESS_UNINITIALIZED);
+    return gp;
+}
+
+/*
+ * cmb_generator_initialize - Set up the generator, not started yet.
+ */
+void cmb_generator_initialize(struct cmb_generator *gp,
+                              const char *name,
+                              cmb_generator_func *stepfunc,
+                              void *context,
+                              const int64_t priority)
+{
+    cmb_assert_release(gp != NULL);
+    cmb_assert_release(name != NULL);
+    cmb_assert_release(stepfunc != NULL);
+
+    gp->step = stepfunc;
+    gp->context = context;
+    gp->priority = priority;
+    gp->event = 0u;
+    gp->steps = 0u;
+    const int r = snprintf(gp->name, CMB_PROCESS_NAMEBUF_SZ, "%s", name);
+    cmb_assert_release((r >= 0) && (r < CMB_PROCESS_NAMEBUF_SZ));
+    gp->status = CMB_PROCESS_INITIALIZED;
+
+    /* Add teardown function to the memregistry in case we need to bail out */
+    cmi_dlist_initialize(&(gp->terminate.node));
+    gp->terminate.teardown = (cmi_teardown_func *)cmb_generator_terminate;
+    gp->terminate.object = gp;
+    cmi_memregistry_add(&(gp->terminate));
+
+    cmb_assert_debug(gp->status == CMB_PROCESS_INITIALIZED);
+}
+
+/*
+ * step_event - Take one step, and schedule the next one at the time the step
+ * function asks for, unless it is done or was stopped along the way.
+ */
+static void step_event(void *vp, void *arg)
+{
+    cmb_assert_debug(vp != NULL);
+    cmb_unused(arg);
+
+    struct cmb_generator *gp = vp;
+    cmb_assert_debug(gp->status == CMB_PROCESS_RUNNING);
+    gp->event = 0u;
+
+    const double dt = (*gp->step)(gp, gp->context);
+    gp->steps++;
+    if (gp->status != CMB_PROCESS_RUNNING) {
+        /* Stopped itself */
+        return;
+    }
+
+    if (dt < 0.0) {
+        cmb_logger_info(stdout, "Generator %s done after %" PRIu64 " steps",
+                        gp->name, gp->steps);
+        gp->status = CMB_PROCESS_FINISHED;
+        return;
+    }
+
+    gp->event = cmb_event_schedule(step_event, gp, NULL, cmb_time() + dt, gp->priority);
+}
+
+/*
+ * cmb_generator_start - Schedule its first step now
+ */
+void cmb_generator_start(struct cmb_generator *gp)
+{
+    cmb_assert_release(gp != NULL);
+    cmb_assert_release(gp->status == CMB_PROCESS_INITIALIZED);
+
+    gp->status = CMB_PROCESS_RUNNING;
+    gp->event = cmb_event_schedule(step_event, gp, NULL, cmb_time(), gp->priority);
+}
+
+/*
+ * cmb_generator_stop - Cancel the next step, if any, and mark it finished
+ */
+void cmb_generator_stop(struct cmb_generator *gp)
+{
+    cmb_assert_release(gp != NULL);
+
+    if (gp->status != CMB_PROCESS_RUNNING) {
+        return;
+    }
+
+    cmb_logger_info(stdout, "Stops generator %s", gp->name);
+    if (gp->event != 0u) {
+        (void)cmb_event_cancel(gp->event);
+        gp->event = 0u;
+    }
+
+    gp->status = CMB_PROCESS_FINISHED;
+}
+
+/*
+ * cmb_generator_terminate - Stop it if running, and un-initialize
+ */
+void cmb_generator_terminate(struct cmb_generator *gp)
+{
+    cmb_assert_release(gp != NULL);
+
+    if (!cmi_memregistry_is_demolishing) {
+        cmb_generator_stop(gp);
+        if (gp->status != CMB_PROCESS_UNINITIALIZED) {
+            /* Terminating normally, remove from register */
+            cmi_memregistry_remove(&(gp->terminate));
+        }
+    }
+
+    gp->event = 0u;
+    gp->status = CMB_PROCESS_UNINITIALIZED;
+}
+
+/*
+ * cmb_generator_destroy - Free the generator object
+ */
+void cmb_generator_destroy(struct cmb_generator *gp)
+{
+    cmb_assert_release(gp != NULL);
+    /* Call cmb_generator_terminate first, please */
+    cmb_assert_release((gp->status == CMB_PROCESS_UNINITIALIZED)
+                       || cmi_memregistry_is_demolishing);
+
+    if (!cmi_memregistry_is_demolishing) {
+        /* Destroying normally, remove from register */
+        cmi_memregistry_remove(&(gp->destroy));
+    }
+
+    cmi_free(gp);
+}
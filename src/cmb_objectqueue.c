@@ -37,6 +37,7 @@
 
 #include "cmi_mempool.h"
 #include "cmi_memutils.h"
+#include "cmi_snapshot.h"
 
 /*
  * struct queue_tag - A tag for the singly linked list that is a queue.
@@ -370,3 +371,11 @@ uint64_t cmb_objectqueue_position(struct cmb_objectqueue *oqp, void *object)
 
     return 0u;
 }
+
+/*
+ * cmi_objectqueue_snapshot_regions - Add the thread local tag pool to the snapshot.
+ */
+void cmi_objectqueue_snapshot_regions(struct cmb_snapshot *sp)
+{
+    cmi_snapshot_add(sp, &objectqueue_tags, sizeof(objectqueue_tags));
+}
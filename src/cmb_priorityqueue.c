@@ -36,22 +36,8 @@
 /* The initial heap size will be 2^INITIAL_QUEUE_SIZE */
 #define INITIAL_QUEUE_SIZE 3u
 
-/*
- * compare_func - Test if heap_tag *a should go before *b. If so, return true.
- * Order by rank_i64 (priority), then FIFO by hash_key for ties.
- */
-static bool compare_func(const struct cmi_heap_tag *a, const struct cmi_heap_tag *b)
-{
-    cmb_assert_debug(a != NULL);
-    cmb_assert_debug(b != NULL);
-
-    if (a->rank_i64 != b->rank_i64) {
-        return (a->rank_i64 > b->rank_i64);
-    }
-
-    /* Stable FIFO within identical priority: earlier hash_key goes first. */
-    return (a->hash_key < b->hash_key);
-}
+/* Default branching factor of the heap, binary unless told otherwise */
+static unsigned default_arity = 2u;
 
 struct cmb_priorityqueue *cmb_priorityqueue_create(void)
 {
@@ -94,7 +80,13 @@ void cmb_priorityqueue_initialize(struct cmb_priorityqueue *pqp,
     cmb_resourceguard_initialize(&(pqp->rear_guard), &(pqp->base));
 
     /* Initialize the queue itself */
-    cmi_hashheap_initialize(&(pqp->queue), INITIAL_QUEUE_SIZE, compare_func);
+    const unsigned arity = __atomic_load_n(&default_arity, __ATOMIC_RELAXED);
+    /* Order by rank_i64 (priority), then FIFO by hash_key for ties */
+    cmi_hashheap_initialize_wflags(&(pqp->queue),
+                                   INITIAL_QUEUE_SIZE,
+                                   NULL,
+                                   cmi_hashheap_arity_flag(arity)
+                                   | CMI_HASHHEAP_ORDER_PRIORITY);
     pqp->capacity = capacity;
 
     /* Initialize data collector */
@@ -125,6 +117,25 @@ void cmb_priorityqueue_terminate(struct cmb_priorityqueue *pqp)
     cmb_assert_debug(pqp->base.cookie == CMI_UNINITIALIZED);
 }
 
+/*
+ * cmb_priorityqueue_default_arity - get global variable for all future inits
+ */
+unsigned cmb_priorityqueue_default_arity(void)
+{
+    const unsigned arity = __atomic_load_n(&default_arity, __ATOMIC_RELAXED);
+
+    return arity;
+}
+
+/*
+ * cmb_priorityqueue_default_arity_set - set global variable for all future inits
+ */
+void cmb_priorityqueue_default_arity_set(const unsigned arity)
+{
+    cmb_assert_release((arity == 2u) || (arity == 4u) || (arity == 8u));
+    __atomic_store_n(&default_arity, arity, __ATOMIC_RELAXED);
+}
+
 void cmb_priorityqueue_destroy(struct cmb_priorityqueue *pqp)
 {
     cmb_assert_release(pqp != NULL);
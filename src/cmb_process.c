@@ -26,6 +26,9 @@
 #include "cmi_mempool.h"
 #include "cmi_memutils.h"
 #include "cmi_process.h"
+#include "cmi_profiler.h"
+#include "cmi_snapshot.h"
+#include "cmi_trace.h"
 #include "cmb_resource.h"
 
 /*
@@ -46,6 +49,25 @@ static CMB_THREAD_LOCAL uint64_t handle_counter = 0u;
 /* Default stack size, unless told otherwise */
 static size_t default_stacksize = CMI_COROUTINE_DEFAULT_STACKSIZE;
 
+/* Stack measurement and sizing from the measurements, off unless told otherwise */
+static bool stack_measure = false;
+static bool stack_autosize = false;
+static double stack_margin = CMB_PROCESS_STACK_MARGIN;
+
+/*
+ * struct stack_record - The largest stack use seen for a process function.
+ * The records are in a fixed size open addressing table shared by all threads,
+ * claimed and raised by atomic compare-and-swap, and never removed except by
+ * clearing the whole table.
+ */
+struct stack_record {
+    uintptr_t func;
+    size_t peak;
+};
+
+#define STACK_RECORDS 1024u
+static struct stack_record stack_records[STACK_RECORDS];
+
 /* Friendly function in cmb_event.c, not part of the public interface */
 void cmi_event_cancel_wakeups(const struct cmb_process *pp);
 
@@ -59,6 +81,10 @@ extern bool cmi_resourceguard_remove_key(struct cmb_resourceguard *rgp, uint64_t
 /* Friendly functions in cmi_event.c, not part of the public interface */
 extern void cmi_event_add_waiter(uint64_t key, struct cmb_process *pp);
 extern bool cmi_event_remove_waiter(uint64_t key, const struct cmb_process *pp);
+extern void *cmi_event_handoff(cmb_event_func *action);
+
+/* Friendly function in cmb_processpool.c, not part of the public interface */
+extern void cmi_processpool_release(struct cmb_processpool *ppp, struct cmb_process *pp);
 
 /* Forward declarations */
 static void cmi_process_drop_resources(struct cmb_process *pp);
@@ -66,6 +92,9 @@ static void wake_process_waiters(struct cmi_slist_node *waiters, int64_t signal)
 static void wakeup_event_interrupt(void *vp, void *arg);
 static void wakeup_event_process(void *vp, void *arg);
 static void resume_event(void *vp, void *arg);
+static void start_event(void *vp, void *arg);
+static void stack_record_raise(uintptr_t func, size_t peak);
+static void process_setup(struct cmb_process *pp, const char *name, int64_t priority);
 
 static_assert((int)CMB_PROCESS_UNINITIALIZED == (int)CMI_COROUTINE_UNINITIALIZED);
 static_assert((int)CMB_PROCESS_INITIALIZED == (int)CMI_COROUTINE_INITIALIZED);
@@ -113,9 +142,49 @@ void cmb_process_initialize_wssz(struct cmb_process *pp,
                        (cmi_coroutine_exit_func *)cmb_process_exit,
                        stacksize);
 
+    if (__atomic_load_n(&stack_measure, __ATOMIC_RELAXED)) {
+        cmi_coroutine_stack_paint((struct cmi_coroutine *)pp);
+    }
+
+    process_setup(pp, name, priority);
+}
+
+/*
+ * cmb_process_initialize_shared - Initialize, running on the stack shared by
+ * the processes of this thread initialized this way, copied in and out when
+ * switching. Does not start the process yet.
+ */
+void cmb_process_initialize_shared(struct cmb_process *pp,
+                                   const char *name,
+                                   cmb_process_func procfunc,
+                                   void *context,
+                                   const int64_t priority)
+{
+    cmb_assert_release(pp != NULL);
+
+    cmi_coroutine_initialize_shared((struct cmi_coroutine *)pp,
+                                    (cmi_coroutine_func *)procfunc,
+                                    context,
+                                    (cmi_coroutine_exit_func *)cmb_process_exit);
+
+    process_setup(pp, name, priority);
+}
+
+/*
+ * process_setup - The process part of initializing, after the coroutine part
+ */
+static void process_setup(struct cmb_process *pp,
+                          const char *name,
+                          const int64_t priority)
+{
     pp->handle = ++handle_counter;
     pp->priority = priority;
+    pp->hold = 0u;
+    pp->pool = NULL;
     cmb_process_name_set(pp, name);
+    if (cmi_profiler_on) {
+        cmi_profiler_process_label(&(pp->core), pp->name);
+    }
 
     cmi_slist_initialize(&pp->awaits);
     cmi_slist_initialize(&pp->waiters);
@@ -141,7 +210,23 @@ void cmb_process_initialize(struct cmb_process *pp,
                             void *context,
                             const int64_t priority)
 {
-    const size_t stack_size = __atomic_load_n(&default_stacksize, __ATOMIC_RELAXED);
+    size_t stack_size = __atomic_load_n(&default_stacksize, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&stack_autosize, __ATOMIC_RELAXED)) {
+        size_t peak = cmb_process_stack_peak(procfunc);
+        if (peak > 0u) {
+            /* The pilot may not have gone down the logger or assert paths */
+            if (peak < CMB_PROCESS_STACK_MIN) {
+                peak = CMB_PROCESS_STACK_MIN;
+            }
+
+            double margin;
+            __atomic_load(&stack_margin, &margin, __ATOMIC_RELAXED);
+            const size_t pagesz = cmi_pagesize();
+            const size_t want = (size_t)((double)peak * margin);
+            stack_size = (want + pagesz - 1u) & ~(pagesz - 1u);
+        }
+    }
+
     cmb_process_initialize_wssz(pp, name, procfunc, context, priority, stack_size);
     cmb_assert_debug(cmb_process_status(pp) == CMB_PROCESS_INITIALIZED);
 }
@@ -172,7 +257,7 @@ extern void cmb_process_terminate(struct cmb_process *pp)
         cmi_slist_terminate(&pp->waiters);
 
         /* Should not have any waiters or hold any resources either, but check. */
-        if (!cmi_slist_is_empty(&pp->awaits)) {
+        if (!cmi_slist_is_empty(&pp->awaits) || (pp->hold != 0u)) {
             cmb_logger_warning(stdout,
                 "Terminating %s while still awaiting something", pp->name);
             cmi_process_cancel_awaiteds(pp);
@@ -191,6 +276,11 @@ extern void cmb_process_terminate(struct cmb_process *pp)
     }
 
     if (cmb_process_status(pp) != CMB_PROCESS_UNINITIALIZED) {
+        if (pp->core.stack_painted) {
+            stack_record_raise((uintptr_t)pp->core.cr_function,
+                               cmi_coroutine_stack_peak((struct cmi_coroutine *)pp));
+        }
+
         pp->handle = 0u;
         /* Will set status CMI_COROUTINE_UNINITIALIZED */
         cmi_coroutine_terminate((struct cmi_coroutine *)pp);
@@ -220,6 +310,7 @@ void cmb_process_destroy(struct cmb_process *pp)
         cmb_event_pattern_cancel(wakeup_event_interrupt, pp, CMB_ANY_OBJECT);
         cmb_event_pattern_cancel(wakeup_event_process, pp, CMB_ANY_OBJECT);
         cmb_event_pattern_cancel(resume_event, pp, CMB_ANY_OBJECT);
+        cmb_event_pattern_cancel(start_event, pp, CMB_ANY_OBJECT);
 
         /* Destroying normally, remove from register */
         cmi_memregistry_remove(&(pp->destroy));
@@ -254,6 +345,48 @@ void cmb_process_start(struct cmb_process *pp)
     (void)cmb_event_schedule(start_event, pp, NULL, t, pri);
 }
 
+/*
+ * cmi_process_respawn - Start a finished process over again with another
+ * process function and context, keeping its stack, name, and registry items.
+ * Friendly function for cmb_processpool.c, not part of the public interface.
+ */
+void cmi_process_respawn(struct cmb_process *pp,
+                         cmb_process_func procfunc,
+                         void *context,
+                         const int64_t priority)
+{
+    cmb_assert_debug(pp != NULL);
+    cmb_assert_debug(cmb_process_status(pp) == CMB_PROCESS_FINISHED);
+    cmb_assert_debug(cmi_slist_is_empty(&(pp->awaits)));
+    cmb_assert_debug(cmi_slist_is_empty(&(pp->resources)));
+    cmb_assert_debug(cmi_slist_is_empty(&(pp->waiters)));
+
+    struct cmi_coroutine *cp = (struct cmi_coroutine *)pp;
+    if (cp->stack_painted) {
+        /* Record the life just ended before the stack is used again */
+        stack_record_raise((uintptr_t)cp->cr_function, cmi_coroutine_stack_peak(cp));
+        cp->stack_painted = false;
+    }
+
+    cmi_coroutine_reset(cp);
+    cp->cr_function = (cmi_coroutine_func *)procfunc;
+    if (__atomic_load_n(&stack_measure, __ATOMIC_RELAXED)) {
+        cmi_coroutine_stack_paint(cp);
+    }
+
+    cp->context = context;
+
+    /* A new handle, the same as a new process would get */
+    pp->handle = ++handle_counter;
+    pp->priority = priority;
+    pp->hold = 0u;
+    if (cmi_trace_on) {
+        cmi_trace_process_name(pp, pp->handle, pp->name);
+    }
+
+    cmb_process_start(pp);
+}
+
 /*
  * cmb_process_name_set - Change the process name
  */
@@ -264,6 +397,9 @@ void cmb_process_name_set(struct cmb_process *pp, const char *name)
 
     const int r = snprintf(pp->name, CMB_PROCESS_NAMEBUF_SZ, "%s", name);
     cmb_assert_release((r >= 0) && (r < CMB_PROCESS_NAMEBUF_SZ));
+    if (cmi_trace_on) {
+        cmi_trace_process_name(pp, pp->handle, pp->name);
+    }
 }
 
 void cmb_process_priority_set(struct cmb_process *pp, const int64_t pri)
@@ -274,6 +410,10 @@ void cmb_process_priority_set(struct cmb_process *pp, const int64_t pri)
                     pp->priority, pri);
     pp->priority = pri;
 
+    if (pp->hold != 0u) {
+        cmb_event_reprioritize(pp->hold, pri);
+    }
+
     /* Any priority queues containing this process? */
     const struct cmi_slist_node *ahead = &(pp->awaits);
     while (ahead->next != NULL) {
@@ -337,6 +477,200 @@ void cmb_process_default_stacksize_set(const size_t stacksize)
     __atomic_store_n(&default_stacksize, stacksize, __ATOMIC_RELAXED);
 }
 
+/*
+ * cmb_process_stack_slabs - get global variable for all future inits
+ */
+bool cmb_process_stack_slabs(void)
+{
+    return cmi_coroutine_stack_slabs();
+}
+
+/*
+ * cmb_process_stack_slabs_set - set global variable for all future inits,
+ * kept with the coroutines, where the stacks are allocated
+ */
+void cmb_process_stack_slabs_set(const bool on)
+{
+    cmi_coroutine_stack_slabs_set(on);
+}
+
+/*
+ * cmb_process_stacks_prewarm - Fill the stack pool of this thread
+ */
+void cmb_process_stacks_prewarm(const uint64_t n, size_t sz)
+{
+    cmb_assert_release(n > 0u);
+
+    if (sz == 0u) {
+        sz = __atomic_load_n(&default_stacksize, __ATOMIC_RELAXED);
+    }
+
+    cmi_coroutine_stacks_prewarm(n, sz);
+}
+
+/*
+ * cmb_process_stack_retention - get global variable for all threads
+ */
+size_t cmb_process_stack_retention(void)
+{
+    return cmi_coroutine_stack_retention();
+}
+
+/*
+ * cmb_process_stack_retention_set - set global variable for all threads
+ */
+void cmb_process_stack_retention_set(const size_t sz)
+{
+    cmi_coroutine_stack_retention_set(sz);
+}
+
+/*
+ * cmb_process_stacks_pooled - bytes kept by this thread
+ */
+size_t cmb_process_stacks_pooled(void)
+{
+    return cmi_coroutine_stack_pooled();
+}
+
+/*
+ * stack_record_index - Where to start looking for the record of a function
+ */
+static uint32_t stack_record_index(const uintptr_t func)
+{
+    const uint64_t h = (uint64_t)func * UINT64_C(0x9E3779B97F4A7C15);
+
+    return (uint32_t)(h >> 32) & (STACK_RECORDS - 1u);
+}
+
+/*
+ * stack_record_raise - Record the peak for the function, unless a larger one
+ * is already there. Claims an empty slot for a function not seen before.
+ */
+static void stack_record_raise(const uintptr_t func, const size_t peak)
+{
+    cmb_assert_debug(func != 0u);
+
+    uint32_t idx = stack_record_index(func);
+    for (uint32_t ui = 0u; ui < STACK_RECORDS; ui++) {
+        struct stack_record *rp = &(stack_records[idx]);
+        uintptr_t key = __atomic_load_n(&(rp->func), __ATOMIC_ACQUIRE);
+        if (key == 0u) {
+            /* Try to claim it, or see who beat us to it */
+            if (__atomic_compare_exchange_n(&(rp->func), &key, func, false,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                key = func;
+            }
+        }
+
+        if (key == func) {
+            size_t old = __atomic_load_n(&(rp->peak), __ATOMIC_RELAXED);
+            while ((peak > old)
+                   && !__atomic_compare_exchange_n(&(rp->peak), &old, peak, false,
+                                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                /* old now has the value someone else put there, try again */
+            }
+
+            return;
+        }
+
+        idx = (idx + 1u) & (STACK_RECORDS - 1u);
+    }
+
+    cmb_logger_warning(stdout, "Stack records full, peak %zu bytes not recorded", peak);
+}
+
+/*
+ * cmb_process_stack_peak - The recorded peak for the function, zero if none
+ */
+size_t cmb_process_stack_peak(cmb_process_func procfunc)
+{
+    cmb_assert_release(procfunc != NULL);
+
+    const uintptr_t func = (uintptr_t)procfunc;
+    uint32_t idx = stack_record_index(func);
+    for (uint32_t ui = 0u; ui < STACK_RECORDS; ui++) {
+        const struct stack_record *rp = &(stack_records[idx]);
+        const uintptr_t key = __atomic_load_n(&(rp->func), __ATOMIC_ACQUIRE);
+        if (key == func) {
+            return __atomic_load_n(&(rp->peak), __ATOMIC_RELAXED);
+        }
+        else if (key == 0u) {
+            break;
+        }
+
+        idx = (idx + 1u) & (STACK_RECORDS - 1u);
+    }
+
+    return 0u;
+}
+
+/*
+ * cmb_process_stack_peaks_clear - Empty the table
+ */
+void cmb_process_stack_peaks_clear(void)
+{
+    for (uint32_t ui = 0u; ui < STACK_RECORDS; ui++) {
+        __atomic_store_n(&(stack_records[ui].peak), 0u, __ATOMIC_RELAXED);
+        __atomic_store_n(&(stack_records[ui].func), 0u, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+ * cmb_process_stack_measure - get global variable for all future inits
+ */
+bool cmb_process_stack_measure(void)
+{
+    const bool on = __atomic_load_n(&stack_measure, __ATOMIC_RELAXED);
+
+    return on;
+}
+
+/*
+ * cmb_process_stack_measure_set - set global variable for all future inits
+ */
+void cmb_process_stack_measure_set(const bool on)
+{
+    __atomic_store_n(&stack_measure, on, __ATOMIC_RELAXED);
+}
+
+/*
+ * cmb_process_stack_autosize - get global variable for all future inits
+ */
+bool cmb_process_stack_autosize(void)
+{
+    const bool on = __atomic_load_n(&stack_autosize, __ATOMIC_RELAXED);
+
+    return on;
+}
+
+/*
+ * cmb_process_stack_autosize_set - set global variable for all future inits
+ */
+void cmb_process_stack_autosize_set(const bool on)
+{
+    __atomic_store_n(&stack_autosize, on, __ATOMIC_RELAXED);
+}
+
+/*
+ * cmb_process_stack_margin - get global variable for all future inits
+ */
+double cmb_process_stack_margin(void)
+{
+    double margin;
+    __atomic_load(&stack_margin, &margin, __ATOMIC_RELAXED);
+
+    return margin;
+}
+
+/*
+ * cmb_process_stack_margin_set - set global variable for all future inits
+ */
+void cmb_process_stack_margin_set(const double margin)
+{
+    cmb_assert_release(margin >= 1.0);
+    __atomic_store(&stack_margin, &margin, __ATOMIC_RELAXED);
+}
+
 /*
  * cmb_process_exit_value - Returns the stored exit value from the process,
  * as set by cmb_process_exit, cmb_process_stop, or simply returned by the
@@ -449,25 +783,103 @@ bool cmi_process_remove_awaitable(struct cmb_process *pp,
     return false;
 }
 
+/*
+ * wakeup_event_hold - The event that resumes the process at the end of a
+ * cmb_process_hold, unless cancelled before that.
+ */
+static void wakeup_event_hold(void *vp, void *arg)
+{
+    cmb_assert_debug(vp != NULL);
+    cmb_unused(arg);
+
+    struct cmb_process *pp = (struct cmb_process *)vp;
+    cmb_assert_debug(pp->hold == cmb_event_current());
+    pp->hold = 0u;
+
+    struct cmi_coroutine *cp = (struct cmi_coroutine *)pp;
+    if (cp->status == CMI_COROUTINE_RUNNING) {
+        (void)cmi_coroutine_resume(cp, (void *)CMB_PROCESS_SUCCESS);
+    }
+    else {
+        cmb_logger_warning(stdout,
+                          "Hold wakeup call found process %s dead",
+                          cmb_process_name(pp));
+    }
+}
+
+/*
+ * cmi_process_yield - Suspend the calling process until something resumes it,
+ * returning the signal it was resumed with. If the event queue allows, the end
+ * of the next hold is handled right here, transferring control directly to the
+ * process that was holding, or just returning if that is this one. Otherwise,
+ * control goes to the dispatcher. Always explicitly to the dispatcher rather
+ * than by cmi_coroutine_yield, since after a handoff the coroutine that last
+ * transferred control here is some other process, not the dispatcher.
+ */
+void *cmi_process_yield(void)
+{
+    struct cmb_process *tgt = cmi_event_handoff(wakeup_event_hold);
+    if (tgt != NULL) {
+        cmb_assert_debug(tgt->hold == cmb_event_current());
+        tgt->hold = 0u;
+        if (tgt == cmb_process_current()) {
+            return (void *)CMB_PROCESS_SUCCESS;
+        }
+
+        struct cmi_coroutine *cp = (struct cmi_coroutine *)tgt;
+        if (cp->status == CMI_COROUTINE_RUNNING) {
+            return cmi_coroutine_transfer(cp, (void *)CMB_PROCESS_SUCCESS);
+        }
+
+        cmb_logger_warning(stdout,
+                           "Hold handoff found process %s dead",
+                           cmb_process_name(tgt));
+    }
+
+    return cmi_coroutine_transfer(cmi_coroutine_main(), NULL);
+}
+
+/*
+ * cmb_process_yield - Unconditionally yield control.
+ */
+int64_t cmb_process_yield(void)
+{
+    cmb_assert_release(cmb_process_current() != NULL);
+
+    const int64_t sig = (int64_t)cmi_process_yield();
+
+    return sig;
+}
+
+/*
+ * cmb_process_hold - Sleep for dur time units. The wakeup call is kept in the
+ * process itself rather than in the awaits list, since a hold waits for nothing
+ * else, saving the awaitable tag and the list search on the way back.
+ */
 int64_t cmb_process_hold(const double dur)
 {
     cmb_assert_release(dur >= 0.0);
 
     cmb_logger_info(stdout, "Holding for %f time units", dur);
 
-    /* Set ourselves a wakeup call, leaving any previous timers in place */
     struct cmb_process *pp = cmb_process_current();
     cmb_assert_debug(pp != NULL);
-    const uint64_t handle = cmb_process_timer_add(pp, dur, CMB_PROCESS_SUCCESS);
+    cmb_assert_debug(pp->hold == 0u);
+    pp->hold = cmb_event_schedule(wakeup_event_hold, pp, NULL,
+                                  cmb_time() + dur, pp->priority);
 
     /* Yield to the dispatcher and collect the return signal value when back */
-    const int64_t sig = (int64_t)cmi_coroutine_yield(NULL);
+    const int64_t sig = (int64_t)cmi_process_yield();
 
-    /* Back here again, possibly much later. */
+    /* Back here again, possibly much later. If whatever woke us up was not
+     * the scheduled wakeup call, cancel it unless that is already done. */
     if (sig != CMB_PROCESS_SUCCESS) {
-        /* Whatever woke us up was not the scheduled wakeup call, cancel it */
         cmb_logger_info(stdout, "Woken up by signal %" PRIi64, sig);
-        cmb_process_timer_cancel(pp, handle);
+    }
+
+    if (pp->hold != 0u) {
+        (void)cmb_event_cancel(pp->hold);
+        pp->hold = 0u;
     }
 
     return sig;
@@ -553,6 +965,12 @@ void cmb_process_timers_clear(struct cmb_process *pp)
 {
     cmb_assert_debug(pp != NULL);
 
+    if (pp->hold != 0u) {
+        cmb_logger_info(stdout, "Cancels hold event %" PRIu64, pp->hold);
+        (void)cmb_event_cancel(pp->hold);
+        pp->hold = 0u;
+    }
+
     struct cmi_slist_node *awaits = &(pp->awaits);
     while (!cmi_slist_is_empty(awaits)) {
         struct cmi_slist_node *head = awaits->next;
@@ -648,7 +1066,7 @@ int64_t cmb_process_wait_process(struct cmb_process *awaited)
         add_waiter_tag(&(awaited->waiters), me);
 
         /* Yield to the dispatcher and collect the return signal value */
-        const int64_t sig = (int64_t)cmi_coroutine_yield(NULL);
+        const int64_t sig = (int64_t)cmi_process_yield();
 
         /* Possibly much later, no longer waiting on that process.
          * Drop our tag from its waiter list (if not already done) and
@@ -682,7 +1100,7 @@ int64_t cmb_process_wait_event(const uint64_t ev_handle)
     cmi_process_add_awaitable(me, CMI_PROCESS_AWAITABLE_EVENT, (void *)ev_handle);
 
     /* Yield to the dispatcher and collect the return signal value */
-    const int64_t ret = (int64_t)cmi_coroutine_yield(NULL);
+    const int64_t ret = (int64_t)cmi_process_yield();
 
     /* Back here, possibly much later.
      * Evidently, we are no longer waiting for this event.
@@ -869,6 +1287,11 @@ void cmi_process_cancel_awaiteds(struct cmb_process *pp)
 {
     cmb_assert_debug(pp != NULL);
 
+    if (pp->hold != 0u) {
+        (void)cmb_event_cancel(pp->hold);
+        pp->hold = 0u;
+    }
+
     struct cmi_slist_node *awaits = &(pp->awaits);
     while (!cmi_slist_is_empty(awaits)) {
         struct cmi_slist_node *head = cmi_slist_pop(awaits);
@@ -959,6 +1382,11 @@ void cmb_process_exit(void *retval)
     cmi_process_drop_resources(pp);
     cmi_process_cancel_awaiteds(pp);
     wake_process_waiters(&(pp->waiters), CMB_PROCESS_SUCCESS);
+    if (pp->pool != NULL) {
+        /* Nothing can take it from the pool before it has switched out */
+        cmi_processpool_release(pp->pool, pp);
+    }
+
     cmi_coroutine_exit(retval);
     /* Not reached */
     cmb_assert_debug(false);
@@ -999,6 +1427,9 @@ int64_t cmb_process_stop(struct cmb_process *tgt, void *retval)
     cmi_process_cancel_awaiteds(tgt);
     cmi_process_drop_resources(tgt);
     wake_process_waiters(&(tgt->waiters), CMB_PROCESS_STOPPED);
+    if (tgt->pool != NULL) {
+        cmi_processpool_release(tgt->pool, tgt);
+    }
 
     return CMB_PROCESS_SUCCESS;
 }
@@ -1044,3 +1475,14 @@ void cmb_process_resume(struct cmb_process *pp, const int64_t sig)
                                              cmb_time(), pp->priority);
     cmb_assert_debug(hndl != 0u);
 }
+
+/*
+ * cmi_process_snapshot_regions - Add the thread local tag pools and the handle counter to the snapshot.
+ */
+void cmi_process_snapshot_regions(struct cmb_snapshot *sp)
+{
+    cmi_snapshot_add(sp, &cmi_process_awaitabletags, sizeof(cmi_process_awaitabletags));
+    cmi_snapshot_add(sp, &cmi_process_holdabletags, sizeof(cmi_process_holdabletags));
+    cmi_snapshot_add(sp, &cmi_process_waitertags, sizeof(cmi_process_waitertags));
+    cmi_snapshot_add(sp, &handle_counter, sizeof(handle_counter));
+}
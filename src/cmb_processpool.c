@@ -0,0 +1,203 @@
+/*
+ * cmb_processpool.c - A pool of processes for short-lived entities, keeping
+ * the finished ones ready to start again with another function and context.
+ *
+ * The pool keeps two growing arrays, all the processes it has made, for the
+ * cleanup, and the finished ones, used as a stack. A spawned process marks
+ * itself as belonging to the pool, and cmb_process.c hands it back here when
+ * it exits or is stopped.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include "cmb_assert.h"
+#include "cmb_logger.h"
+#include "cmb_processpool.h"
+
+#include "cmi_memutils.h"
+
+/* Initial length of the process arrays, growing as needed */
+#define POOL_INIT 16u
+
+/* Friendly function in cmb_process.c, not part of the public interface */
+extern void cmi_process_respawn(struct cmb_process *pp,
+                                cmb_process_func procfunc,
+                                void *context,
+                                int64_t priority);
+
+/*
+ * cmb_processpool_create - Allocate memory for the pool.
+ */
+struct cmb_processpool *cmb_processpool_create(void)
+{
+    struct cmb_processpool *ppp = cmi_malloc(sizeof(*ppp));
+    cmi_memset(ppp, 0, sizeof(*ppp));
+    ppp->initialized = false;
+
+    /* Add teardown function to the memregistry in case we need to bail out */
+    cmi_dlist_initialize(&(ppp->destroy.node));
+    ppp->destroy.teardown = (cmi_teardown_func *)cmb_processpool_destroy;
+    ppp->destroy.object = ppp;
+    cmi_memregistry_add(&(ppp->destroy));
+
+    return ppp;
+}
+
+/*
+ * cmb_processpool_initialize - Set up an empty pool.
+ */
+void cmb_processpool_initialize(struct cmb_processpool *ppp,
+                                const char *name,
+                                const int64_t priority)
+{
+    cmb_assert_release(ppp != NULL);
+    cmb_assert_release(name != NULL);
+
+    const int r = snprintf(ppp->name, CMB_PROCESS_NAMEBUF_SZ, "%s", name);
+    cmb_assert_release((r >= 0) && (r < CMB_PROCESS_NAMEBUF_SZ));
+    ppp->priority = priority;
+    ppp->all = NULL;
+    ppp->all_cnt = 0u;
+    ppp->all_len = 0u;
+    ppp->free = NULL;
+    ppp->free_cnt = 0u;
+    ppp->free_len = 0u;
+    ppp->spawned = 0u;
+    ppp->initialized = true;
+
+    /* Add teardown function to the memregistry in case we need to bail out */
+    cmi_dlist_initialize(&(ppp->terminate.node));
+    ppp->terminate.teardown = (cmi_teardown_func *)cmb_processpool_terminate;
+    ppp->terminate.object = ppp;
+    cmi_memregistry_add(&(ppp->terminate));
+}
+
+/*
+ * cmb_processpool_terminate - Stop, terminate, and destroy all its processes.
+ * When bailing out, the memregistry takes care of the processes themselves,
+ * and the pool only lets go of its arrays.
+ */
+void cmb_processpool_terminate(struct cmb_processpool *ppp)
+{
+    cmb_assert_release(ppp != NULL);
+    cmb_assert_release(ppp->initialized || cmi_memregistry_is_demolishing);
+
+    if (!cmi_memregistry_is_demolishing) {
+        for (uint64_t ui = 0u; ui < ppp->all_cnt; ui++) {
+            struct cmb_process *pp = ppp->all[ui];
+            cmb_assert_release(pp != cmb_process_current());
+            if (cmb_process_status(pp) == CMB_PROCESS_RUNNING) {
+                (void)cmb_process_stop(pp, NULL);
+            }
+
+            cmb_process_terminate(pp);
+            cmb_process_destroy(pp);
+        }
+
+        /* Terminating normally, remove from register */
+        cmi_memregistry_remove(&(ppp->terminate));
+    }
+
+    if (ppp->all != NULL) {
+        cmi_free(ppp->all);
+    }
+
+    if (ppp->free != NULL) {
+        cmi_free(ppp->free);
+    }
+
+    ppp->all = NULL;
+    ppp->all_cnt = 0u;
+    ppp->all_len = 0u;
+    ppp->free = NULL;
+    ppp->free_cnt = 0u;
+    ppp->free_len = 0u;
+    ppp->initialized = false;
+}
+
+/*
+ * cmb_processpool_destroy - Free the pool object
+ */
+void cmb_processpool_destroy(struct cmb_processpool *ppp)
+{
+    cmb_assert_release(ppp != NULL);
+    /* Call cmb_processpool_terminate first, please */
+    cmb_assert_release(!ppp->initialized || cmi_memregistry_is_demolishing);
+
+    if (!cmi_memregistry_is_demolishing) {
+        /* Destroying normally, remove from register */
+        cmi_memregistry_remove(&(ppp->destroy));
+    }
+
+    cmi_free(ppp);
+}
+
+/*
+ * cmb_processpool_spawn - Restart a finished process from the top of the
+ * stack, or make a new one if there is none.
+ */
+struct cmb_process *cmb_processpool_spawn(struct cmb_processpool *ppp,
+                                          cmb_process_func procfunc,
+                                          void *context)
+{
+    cmb_assert_release(ppp != NULL);
+    cmb_assert_release(ppp->initialized);
+    cmb_assert_release(procfunc != NULL);
+
+    ppp->spawned++;
+    if (ppp->free_cnt > 0u) {
+        struct cmb_process *pp = ppp->free[--ppp->free_cnt];
+        cmb_assert_debug(pp->pool == ppp);
+        cmi_process_respawn(pp, procfunc, context, ppp->priority);
+
+        return pp;
+    }
+
+    if (ppp->all_cnt == ppp->all_len) {
+        ppp->all_len = (ppp->all_len == 0u) ? POOL_INIT : 2u * ppp->all_len;
+        ppp->all = cmi_realloc(ppp->all, ppp->all_len * sizeof(*(ppp->all)));
+    }
+
+    struct cmb_process *pp = cmb_process_create();
+    cmb_process_initialize_wssz(pp, ppp->name, procfunc, context, ppp->priority,
+                                cmb_process_default_stacksize());
+    pp->pool = ppp;
+    ppp->all[ppp->all_cnt++] = pp;
+    cmb_logger_info(stdout, "Pool %s has %" PRIu64 " processes", ppp->name, ppp->all_cnt);
+    cmb_process_start(pp);
+
+    return pp;
+}
+
+/*
+ * cmi_processpool_release - Take back a process that has just finished.
+ * Friendly function for cmb_process.c, not part of the public interface.
+ */
+void cmi_processpool_release(struct cmb_processpool *ppp, struct cmb_process *pp)
+{
+    cmb_assert_debug(ppp != NULL);
+    cmb_assert_debug(pp != NULL);
+    cmb_assert_debug(pp->pool == ppp);
+
+    if (ppp->free_cnt == ppp->free_len) {
+        ppp->free_len = (ppp->free_len == 0u) ? POOL_INIT : 2u * ppp->free_len;
+        ppp->free = cmi_realloc(ppp->free, ppp->free_len * sizeof(*(ppp->free)));
+    }
+
+    ppp->free[ppp->free_cnt++] = pp;
+    cmb_assert_debug(ppp->free_cnt <= ppp->all_cnt);
+}
@@ -0,0 +1,479 @@
+/*
+ * cmb_profiler.c - The built-in profiler, adding up the time stamp counter
+ * cycles spent in each event function, each process function, and the
+ * coroutine context switches.
+ *
+ * Each thread has its own table, an open addressing hash map keyed by the
+ * function address and whether it is an event or a process function, so that
+ * the threads never wait for each other while profiling. A worker thread
+ * merges its table into the common one under a mutex when it exits at the end
+ * of cimba_run. The reports add the calling thread's table on top, for
+ * single-threaded models that never go through cimba_run.
+ *
+ * The time is measured exclusively. The cycles spent in coroutines and context
+ * switches during an event are added up in inner_cycles, and subtracted from
+ * the event's own total, so that the event that resumes a process is not
+ * charged for the process.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cmb_assert.h"
+#include "cmb_profiler.h"
+
+#include "cmi_config.h"
+#include "cmi_coroutine.h"
+#include "cmi_memutils.h"
+#include "cmi_profiler.h"
+
+/* Only used from here, no header file needed */
+extern bool cmi_symbol_name(const void *addr, char *buf, size_t len);
+
+/* The initial table size is 2^TABLE_INIT_EXP entries, doubling when half full */
+#define TABLE_INIT_EXP 6u
+
+/* Longest function name printed */
+#define NAME_BUF_SZ 96
+
+/* The two kinds of table entries, zero marking a free entry */
+enum profile_kind {
+    PROFILE_FREE = 0,
+    PROFILE_EVENT,
+    PROFILE_PROCESS
+};
+
+/*
+ * struct profile_entry - The counts for one function, with the name of the
+ * first process seen running it, if a process function.
+ */
+struct profile_entry {
+    const void *func;
+    uint64_t calls;
+    uint64_t cycles;
+    unsigned kind;
+    char label[CMB_PROCESS_NAMEBUF_SZ];
+};
+
+/*
+ * struct profile_table - The hash map of entries, size a power of two, and
+ * the counts for the context switches.
+ */
+struct profile_table {
+    struct profile_entry *entries;
+    uint64_t size;
+    uint64_t used;
+    struct cmb_profiler_count switches;
+};
+
+/* Profile future trials? Read at the start of each trial in each thread. */
+static bool profiler_enabled = false;
+
+/* The common table for the threads that are done, behind the mutex */
+static struct profile_table merged_table = { 0 };
+static pthread_mutex_t merged_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* This thread's table */
+static CMB_THREAD_LOCAL struct profile_table thread_table = { 0 };
+
+CMB_THREAD_LOCAL bool cmi_profiler_on = false;
+
+/*
+ * segment_start - When the running coroutine was switched in, zero if not
+ * measured. switch_start - When the ongoing context switch started, zero if
+ * none. inner_cycles - Running total of the cycles spent in coroutines and
+ * context switches, for taking them out of the events they happen in.
+ */
+static CMB_THREAD_LOCAL uint64_t segment_start = UINT64_C(0);
+static CMB_THREAD_LOCAL uint64_t switch_start = UINT64_C(0);
+static CMB_THREAD_LOCAL uint64_t inner_cycles = UINT64_C(0);
+
+/*
+ * table_home - Fibonacci hash of the function address and the kind.
+ */
+static uint64_t table_home(const struct profile_table *tp,
+                           const unsigned kind,
+                           const void *func)
+{
+    cmb_assert_debug(tp != NULL);
+    cmb_assert_debug(tp->size > 0u);
+
+    const uint64_t h = ((uint64_t)(uintptr_t)func ^ kind) * UINT64_C(11400714819323198485);
+
+    return h & (tp->size - 1u);
+}
+
+/*
+ * table_lookup - The entry for the function, NULL if not in the table.
+ */
+static struct profile_entry *table_lookup(const struct profile_table *tp,
+                                          const unsigned kind,
+                                          const void *func)
+{
+    cmb_assert_debug(tp != NULL);
+
+    if (tp->entries == NULL) {
+        return NULL;
+    }
+
+    const uint64_t mask = tp->size - 1u;
+    for (uint64_t idx = table_home(tp, kind, func); ; idx = (idx + 1u) & mask) {
+        struct profile_entry *ep = &(tp->entries[idx]);
+        if (ep->kind == PROFILE_FREE) {
+            return NULL;
+        }
+
+        if ((ep->kind == kind) && (ep->func == func)) {
+            return ep;
+        }
+    }
+}
+
+/*
+ * table_place - Put a new entry in its first free position from home.
+ */
+static struct profile_entry *table_place(struct profile_table *tp,
+                                         const unsigned kind,
+                                         const void *func)
+{
+    cmb_assert_debug(tp != NULL);
+
+    const uint64_t mask = tp->size - 1u;
+    uint64_t idx = table_home(tp, kind, func);
+    while (tp->entries[idx].kind != PROFILE_FREE) {
+        idx = (idx + 1u) & mask;
+    }
+
+    struct profile_entry *ep = &(tp->entries[idx]);
+    ep->kind = kind;
+    ep->func = func;
+    tp->used++;
+
+    return ep;
+}
+
+/*
+ * table_grow - Double the table, or allocate it if not there yet.
+ */
+static void table_grow(struct profile_table *tp)
+{
+    cmb_assert_debug(tp != NULL);
+
+    struct profile_entry *old = tp->entries;
+    const uint64_t old_size = tp->size;
+
+    tp->size = (old_size > 0u) ? 2u * old_size : (UINT64_C(1) << TABLE_INIT_EXP);
+    tp->entries = cmi_calloc_heap(tp->size, sizeof(*(tp->entries)));
+    tp->used = 0u;
+    for (uint64_t ui = 0u; ui < old_size; ui++) {
+        if (old[ui].kind != PROFILE_FREE) {
+            struct profile_entry *ep = table_place(tp, old[ui].kind, old[ui].func);
+            *ep = old[ui];
+        }
+    }
+
+    if (old != NULL) {
+        cmi_free_heap(old);
+    }
+}
+
+/*
+ * table_find - The entry for the function, added if not there.
+ */
+static struct profile_entry *table_find(struct profile_table *tp,
+                                        const unsigned kind,
+                                        const void *func)
+{
+    cmb_assert_debug(tp != NULL);
+
+    struct profile_entry *ep = table_lookup(tp, kind, func);
+    if (ep != NULL) {
+        return ep;
+    }
+
+    if (2u * (tp->used + 1u) > tp->size) {
+        table_grow(tp);
+    }
+
+    return table_place(tp, kind, func);
+}
+
+/*
+ * table_merge - Add the counts in src to dst, keeping any label in dst.
+ */
+static void table_merge(struct profile_table *dst, const struct profile_table *src)
+{
+    cmb_assert_debug(dst != NULL);
+    cmb_assert_debug(src != NULL);
+
+    for (uint64_t ui = 0u; ui < src->size; ui++) {
+        const struct profile_entry *sp = &(src->entries[ui]);
+        if (sp->kind == PROFILE_FREE) {
+            continue;
+        }
+
+        struct profile_entry *dp = table_find(dst, sp->kind, sp->func);
+        dp->calls += sp->calls;
+        dp->cycles += sp->cycles;
+        if (dp->label[0] == '\0') {
+            memcpy(dp->label, sp->label, sizeof(dp->label));
+        }
+    }
+
+    dst->switches.calls += src->switches.calls;
+    dst->switches.cycles += src->switches.cycles;
+}
+
+/*
+ * table_free - Free the entries, back to an empty table.
+ */
+static void table_free(struct profile_table *tp)
+{
+    cmb_assert_debug(tp != NULL);
+
+    if (tp->entries != NULL) {
+        cmi_free_heap(tp->entries);
+    }
+
+    cmi_memset(tp, 0u, sizeof(*tp));
+}
+
+bool cmb_profiler_enabled(void)
+{
+    const bool on = __atomic_load_n(&profiler_enabled, __ATOMIC_RELAXED);
+
+    return on;
+}
+
+void cmb_profiler_enabled_set(const bool on)
+{
+    __atomic_store_n(&profiler_enabled, on, __ATOMIC_RELAXED);
+}
+
+void cmi_profiler_trial_start(void)
+{
+    cmi_profiler_on = __atomic_load_n(&profiler_enabled, __ATOMIC_RELAXED);
+    segment_start = 0u;
+    switch_start = 0u;
+}
+
+void cmi_profiler_event(cmb_event_func *action, void *subject, void *object)
+{
+    cmb_assert_debug(action != NULL);
+
+    const uint64_t inner0 = inner_cycles;
+    const uint64_t t0 = cmi_profiler_clock();
+    (*action)(subject, object);
+    const uint64_t total = cmi_profiler_clock() - t0;
+    const uint64_t inner = inner_cycles - inner0;
+
+    struct profile_entry *ep = table_find(&thread_table, PROFILE_EVENT, cmi_func_key(action));
+    ep->calls++;
+    ep->cycles += (total > inner) ? total - inner : 0u;
+}
+
+void cmi_profiler_switch_out(const struct cmi_coroutine *from)
+{
+    cmb_assert_debug(from != NULL);
+
+    const uint64_t now = cmi_profiler_clock();
+    if ((from != cmi_coroutine_main()) && (segment_start != 0u)) {
+        const uint64_t cycles = now - segment_start;
+        struct profile_entry *ep = table_find(&thread_table,
+                                              PROFILE_PROCESS,
+                                              cmi_func_key(from->cr_function));
+        ep->calls++;
+        ep->cycles += cycles;
+        inner_cycles += cycles;
+    }
+
+    switch_start = now;
+}
+
+void cmi_profiler_switch_in(void)
+{
+    const uint64_t now = cmi_profiler_clock();
+    if (switch_start != 0u) {
+        const uint64_t cycles = now - switch_start;
+        thread_table.switches.calls++;
+        thread_table.switches.cycles += cycles;
+        inner_cycles += cycles;
+        switch_start = 0u;
+    }
+
+    segment_start = now;
+}
+
+void cmi_profiler_process_label(const struct cmi_coroutine *cp, const char *name)
+{
+    cmb_assert_debug(cp != NULL);
+    cmb_assert_debug(name != NULL);
+
+    struct profile_entry *ep = table_find(&thread_table,
+                                          PROFILE_PROCESS,
+                                          cmi_func_key(cp->cr_function));
+    if (ep->label[0] == '\0') {
+        (void)snprintf(ep->label, sizeof(ep->label), "%s", name);
+    }
+}
+
+void cmi_profiler_thread_cleanup(void)
+{
+    if (thread_table.entries != NULL) {
+        pthread_mutex_lock(&merged_mutex);
+        table_merge(&merged_table, &thread_table);
+        pthread_mutex_unlock(&merged_mutex);
+    }
+
+    table_free(&thread_table);
+    cmi_profiler_on = false;
+}
+
+/*
+ * profile_get - The counts for the function in the common table and this
+ * thread's table together.
+ */
+static bool profile_get(const unsigned kind,
+                        const void *func,
+                        struct cmb_profiler_count *pc)
+{
+    cmb_assert_release(pc != NULL);
+
+    pc->calls = 0u;
+    pc->cycles = 0u;
+    pthread_mutex_lock(&merged_mutex);
+    const struct profile_entry *mp = table_lookup(&merged_table, kind, func);
+    if (mp != NULL) {
+        pc->calls += mp->calls;
+        pc->cycles += mp->cycles;
+    }
+
+    pthread_mutex_unlock(&merged_mutex);
+    const struct profile_entry *tp = table_lookup(&thread_table, kind, func);
+    if (tp != NULL) {
+        pc->calls += tp->calls;
+        pc->cycles += tp->cycles;
+    }
+
+    return (pc->calls > 0u);
+}
+
+bool cmb_profiler_event(cmb_event_func *action, struct cmb_profiler_count *pc)
+{
+    cmb_assert_release(action != NULL);
+
+    return profile_get(PROFILE_EVENT, cmi_func_key(action), pc);
+}
+
+bool cmb_profiler_process(cmb_process_func *func, struct cmb_profiler_count *pc)
+{
+    cmb_assert_release(func != NULL);
+
+    return profile_get(PROFILE_PROCESS, cmi_func_key(func), pc);
+}
+
+void cmb_profiler_switches(struct cmb_profiler_count *pc)
+{
+    cmb_assert_release(pc != NULL);
+
+    pthread_mutex_lock(&merged_mutex);
+    *pc = merged_table.switches;
+    pthread_mutex_unlock(&merged_mutex);
+    pc->calls += thread_table.switches.calls;
+    pc->cycles += thread_table.switches.cycles;
+}
+
+/*
+ * entry_order - Sort order for the report, most cycles first.
+ */
+static int entry_order(const void *a, const void *b)
+{
+    const struct profile_entry *ea = a;
+    const struct profile_entry *eb = b;
+    if (ea->cycles > eb->cycles) {
+        return -1;
+    }
+
+    return (ea->cycles < eb->cycles) ? 1 : 0;
+}
+
+void cmb_profiler_print(FILE *fp)
+{
+    cmb_assert_release(fp != NULL);
+
+    /* Take a copy of everything to sort and print at leisure */
+    struct profile_table all = { 0 };
+    pthread_mutex_lock(&merged_mutex);
+    table_merge(&all, &merged_table);
+    pthread_mutex_unlock(&merged_mutex);
+    table_merge(&all, &thread_table);
+
+    uint64_t cnt = 0u;
+    uint64_t total = all.switches.cycles;
+    for (uint64_t ui = 0u; ui < all.size; ui++) {
+        if ((all.entries[ui].kind != PROFILE_FREE) && (all.entries[ui].calls > 0u)) {
+            total += all.entries[ui].cycles;
+            all.entries[cnt++] = all.entries[ui];
+        }
+    }
+
+    if (cnt > 0u) {
+        qsort(all.entries, cnt, sizeof(*(all.entries)), entry_order);
+    }
+
+    const double share = (total > 0u) ? 100.0 / (double)total : 0.0;
+    fprintf(fp, "Profile: %" PRIu64 " cycles in total\n", total);
+    fprintf(fp, "%14s %18s %12s %7s  %s\n", "calls", "cycles", "cycles/call", "share", "function");
+    for (uint64_t ui = 0u; ui < cnt; ui++) {
+        const struct profile_entry *ep = &(all.entries[ui]);
+        char name[NAME_BUF_SZ];
+        if (!cmi_symbol_name(ep->func, name, sizeof(name))) {
+            (void)snprintf(name, sizeof(name), "%p", ep->func);
+        }
+
+        fprintf(fp, "%14" PRIu64 " %18" PRIu64 " %12.1f %6.2f%%  %s %s",
+                ep->calls, ep->cycles, (double)ep->cycles / (double)ep->calls,
+                (double)ep->cycles * share,
+                (ep->kind == PROFILE_EVENT) ? "event" : "process", name);
+        if (ep->label[0] != '\0') {
+            fprintf(fp, " (%s)", ep->label);
+        }
+
+        fprintf(fp, "\n");
+    }
+
+    if (all.switches.calls > 0u) {
+        fprintf(fp, "%14" PRIu64 " %18" PRIu64 " %12.1f %6.2f%%  context switches\n",
+                all.switches.calls, all.switches.cycles,
+                (double)all.switches.cycles / (double)all.switches.calls,
+                (double)all.switches.cycles * share);
+    }
+
+    table_free(&all);
+}
+
+void cmb_profiler_reset(void)
+{
+    pthread_mutex_lock(&merged_mutex);
+    table_free(&merged_table);
+    pthread_mutex_unlock(&merged_mutex);
+    table_free(&thread_table);
+}
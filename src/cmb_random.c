@@ -30,6 +30,7 @@
 
 #include "cmi_config.h"
 #include "cmi_memutils.h"
+#include "cmi_snapshot.h"
 
 /*
  * Thread-local pseudo-random generator state, i.e., each thread has its own
@@ -538,18 +539,19 @@ double cmb_random_PERT_mod(const double min,
     return x;
 }
 
+/* The bits cached by cmb_random_flip, part of the generator state */
+static CMB_THREAD_LOCAL uint64_t flip_bits = 0u;
+static CMB_THREAD_LOCAL uint8_t flip_bitpos = 0u;
+
 /* Simple flip of a fair unbiased coin, caching bits for efficiency */
 int cmb_random_flip(void)
 {
-    static CMB_THREAD_LOCAL uint64_t bits;
-    static CMB_THREAD_LOCAL uint8_t bitpos = 0;
-
-    if (bitpos == 0) {
-        bits = cmb_random_sfc64();
-        bitpos = 64;
+    if (flip_bitpos == 0) {
+        flip_bits = cmb_random_sfc64();
+        flip_bitpos = 64;
     }
 
-    return ((bits >> --bitpos) & 1) ? 1 : 0;
+    return ((flip_bits >> --flip_bitpos) & 1) ? 1 : 0;
 }
 
 /*
@@ -826,4 +828,16 @@ void cmb_random_alias_destroy(struct cmb_random_alias *ap)
     cmi_free(ap->uprob);
     cmi_free(ap->alias);
     cmi_free(ap);
-}
\ No newline at end of file
+}
+
+/*
+ * cmi_random_snapshot_regions - Add the generator state to the snapshot.
+ */
+void cmi_random_snapshot_regions(struct cmb_snapshot *sp)
+{
+    cmi_snapshot_add(sp, &prng_state, sizeof(prng_state));
+    cmi_snapshot_add(sp, &initial_seed, sizeof(initial_seed));
+    cmi_snapshot_add(sp, &splitmix_state, sizeof(splitmix_state));
+    cmi_snapshot_add(sp, &flip_bits, sizeof(flip_bits));
+    cmi_snapshot_add(sp, &flip_bitpos, sizeof(flip_bitpos));
+}
@@ -41,6 +41,7 @@
 
 #include "cmi_process.h"
 #include "cmi_resourcebase.h"
+#include "cmi_snapshot.h"
 
 /* The memory layout of an entry */
 struct entry_peek {
@@ -63,43 +64,26 @@ static CMB_THREAD_LOCAL struct cmi_mempool observer_tagpool
 /* Counter for assigning hash map handles and ensuring FIFO order */
 static CMB_THREAD_LOCAL uint64_t enqueue_seq = 0u;
 
-/*
- * guard_queue_check - Test if heap_tag *a should go before *b. If so, return true.
- * Higher priority (rank_i64) first, then earlier entry time (rank_d64) for FIFO,
- * then lower enqueue key (hash_key) as a stable tie-break.
- */
-static bool guard_queue_check(const struct cmi_heap_tag *a,
-                              const struct cmi_heap_tag *b)
-{
-    cmb_assert_debug(a != NULL);
-    cmb_assert_debug(b != NULL);
-
-    /* Higher priority goes first */
-    if (a->rank_i64 != b->rank_i64) {
-        return a->rank_i64 > b->rank_i64;
-    }
-
-    /* Same priority: earlier queue entry time goes first (FIFO by arrival) */
-    if (a->rank_d64 != b->rank_d64) {
-        return a->rank_d64 < b->rank_d64;
-    }
-
-    /* Same arrival time: lower enqueue key goes first (stable FIFO tie-break) */
-    return a->hash_key < b->hash_key;
-}
-
 /* Start very small and fast, 2^GUARD_INIT_EXP = 8 slots in the initial queue */
 #define GUARD_INIT_EXP 3u
 
+/* Default branching factor of the queue heap, binary unless told otherwise */
+static unsigned default_arity = 2u;
+
 void cmb_resourceguard_initialize(struct cmb_resourceguard *rgp,
                                   struct cmi_resourcebase *rbp)
 {
     cmb_assert_release(rgp != NULL);
     cmb_assert_release(rbp != NULL);
 
-    cmi_hashheap_initialize((struct cmi_hashheap *)rgp,
-                            GUARD_INIT_EXP,
-                            guard_queue_check);
+    const unsigned arity = __atomic_load_n(&default_arity, __ATOMIC_RELAXED);
+    /* Higher priority (rank_i64) first, then earlier entry time (rank_d64) for
+     * FIFO, then lower enqueue key (hash_key) as a stable tie-break. */
+    cmi_hashheap_initialize_wflags((struct cmi_hashheap *)rgp,
+                                   GUARD_INIT_EXP,
+                                   NULL,
+                                   cmi_hashheap_arity_flag(arity)
+                                   | CMI_HASHHEAP_ORDER_PRIORITY_TIME);
 
     rgp->guarded_resource = rbp;
     cmi_slist_initialize(&(rgp->observers));
@@ -112,6 +96,25 @@ void cmb_resourceguard_terminate(struct cmb_resourceguard *rgp)
     cmi_hashheap_terminate((struct cmi_hashheap *)rgp);
 }
 
+/*
+ * cmb_resourceguard_default_arity - get global variable for all future inits
+ */
+unsigned cmb_resourceguard_default_arity(void)
+{
+    const unsigned arity = __atomic_load_n(&default_arity, __ATOMIC_RELAXED);
+
+    return arity;
+}
+
+/*
+ * cmb_resourceguard_default_arity_set - set global variable for all future inits
+ */
+void cmb_resourceguard_default_arity_set(const unsigned arity)
+{
+    cmb_assert_release((arity == 2u) || (arity == 4u) || (arity == 8u));
+    __atomic_store_n(&default_arity, arity, __ATOMIC_RELAXED);
+}
+
 /*
  * cmb_resourceguard_wait - Enqueue and suspend the calling process until it
  * reaches the front of the priority queue and its demand function returns true.
@@ -158,7 +161,7 @@ int64_t cmb_resourceguard_wait(struct cmb_resourceguard *rgp,
     cmb_logger_info(stdout, "Waits for %s", rgp->guarded_resource->name);
 
     /* Yield to the dispatcher, collect the return signal value when resumed */
-    const int64_t sig = (int64_t)cmi_coroutine_yield(NULL);
+    const int64_t sig = (int64_t)cmi_process_yield();
 
     /* Back here, possibly much later. Clearly not waiting for this anymore. */
     (void)cmi_process_remove_awaitable(pp, CMI_PROCESS_AWAITABLE_RESOURCE, rgp);
@@ -407,3 +410,11 @@ bool cmb_resourceguard_unregister(struct cmb_resourceguard *rgp,
     return false;
 }
 
+/*
+ * cmi_resourceguard_snapshot_regions - Add the thread local tag pool and the enqueue sequence counter to the snapshot.
+ */
+void cmi_resourceguard_snapshot_regions(struct cmb_snapshot *sp)
+{
+    cmi_snapshot_add(sp, &observer_tagpool, sizeof(observer_tagpool));
+    cmi_snapshot_add(sp, &enqueue_seq, sizeof(enqueue_seq));
+}
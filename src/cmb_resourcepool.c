@@ -130,7 +130,7 @@ static void resourcepool_drop_holder(struct cmi_holdable *rhp,
     const uint64_t heapidx = cmi_hash_find_index(hhp, key);
 
     if (heapidx != 0u) {
-        const struct pool_item *pi = (struct pool_item *)(hhp->heap[heapidx].item);
+        const struct pool_item *pi = (struct pool_item *)cmi_hashheap_item_at(hhp, heapidx);
         cmb_assert_debug(pi->holder == pp);
         cmb_assert_debug(pi->amount > 0u);
         cmb_assert_debug(pi->amount <= rpp->in_use);
@@ -363,7 +363,7 @@ uint64_t cmb_resourcepool_held(struct cmb_resourcepool *rpp,
     struct cmi_hashheap *hhp = &(rpp->holders);
     const uint64_t heapidx = cmi_hash_find_index(hhp, key);
     if (heapidx != 0u) {
-        const struct pool_item *pi = (struct pool_item *)(hhp->heap[heapidx].item);
+        const struct pool_item *pi = (struct pool_item *)cmi_hashheap_item_at(hhp, heapidx);
 
         return pi->amount;
     }
@@ -387,7 +387,7 @@ static void update_record(struct cmb_resourcepool *rpp,
     const uint64_t heapidx = cmi_hash_find_index(hhp, key);
     if (heapidx != 0u) {
         /* Must hold some already, add to the existing entry */
-        struct pool_item *pi = (struct pool_item *)(hhp->heap[heapidx].item);
+        struct pool_item *pi = (struct pool_item *)cmi_hashheap_item_at(hhp, heapidx);
         pi->amount += amount;
     }
     else {
@@ -412,8 +412,8 @@ static uint64_t sum_holder_items(const struct cmi_hashheap *hhp)
 
     uint64_t sum = 0u;
     for (uint64_t ui = 1u; ui <= hhp->heap_count; ui++) {
-        const struct cmi_heap_tag *htp = &(hhp->heap[ui]);
-        sum += (uint64_t)(htp->item[1]);
+        void **item = cmi_hashheap_item_at(hhp, ui);
+        sum += (uint64_t)(item[1]);
     }
 
     return sum;
@@ -441,7 +441,7 @@ static int64_t acquire_inner(struct cmb_resourcepool *rpp,
     const uint64_t heapidx = cmi_hash_find_index(hhp, key);
     if (heapidx != 0u) {
         /* It does. Note the amount in case we need to roll back to here */
-        initially_held = (uint64_t)(hhp->heap[heapidx].item[1]);
+        initially_held = (uint64_t)(cmi_hashheap_item_at(hhp, heapidx)[1]);
     }
 
     const struct cmi_resourcebase *rbp = &(rpp->core.base);
@@ -0,0 +1,278 @@
+/*
+ * cmb_snapshot.c - Snapshot and restore of the simulation state of a thread.
+ *
+ * The state is in three kinds of places: The arena, holding everything Cimba
+ * allocated in the thread since the arena was turned on, the thread local
+ * variables of the Cimba modules, and any memory the model added itself. A
+ * snapshot is a list of address ranges and one buffer with a copy of each, the
+ * used part of the arena first. Restoring is copying them all back.
+ *
+ * The list is made up anew each time the snapshot is taken, since some of the
+ * ranges, e.g., the memory pool chunks outside the arena, may come and go.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cmb_assert.h"
+#include "cmb_snapshot.h"
+
+#include "cmi_arena.h"
+#include "cmi_config.h"
+#include "cmi_coroutine.h"
+#include "cmi_memutils.h"
+#include "cmi_sanitizer.h"
+#include "cmi_snapshot.h"
+
+/* Only used from here, no header file needed */
+extern void cmi_event_thread_cleanup(void);
+extern void cmi_coroutine_stack_cleanup(void);
+extern void cmi_coroutine_snapshot_regions(struct cmb_snapshot *sp);
+extern void cmi_event_snapshot_regions(struct cmb_snapshot *sp);
+extern void cmi_hashheap_snapshot_regions(struct cmb_snapshot *sp);
+extern void cmi_mempool_snapshot_regions(struct cmb_snapshot *sp);
+extern void cmi_memregistry_snapshot_regions(struct cmb_snapshot *sp);
+extern void cmi_objectqueue_snapshot_regions(struct cmb_snapshot *sp);
+extern void cmi_process_snapshot_regions(struct cmb_snapshot *sp);
+extern void cmi_random_snapshot_regions(struct cmb_snapshot *sp);
+extern void cmi_resourceguard_snapshot_regions(struct cmb_snapshot *sp);
+
+/* Initial length of the region lists, growing as needed */
+#define REGIONS_INIT 64u
+
+/* The global settings */
+static bool snapshot_enabled = false;
+static size_t snapshot_arena_size = CMB_SNAPSHOT_ARENA_DEFAULT;
+
+/*
+ * struct snapshot_region - An address range and where its copy is in the
+ * buffer.
+ */
+struct snapshot_region {
+    void *addr;
+    size_t size;
+    size_t offset;
+};
+
+/*
+ * struct region_list - A growing array of regions.
+ */
+struct region_list {
+    struct snapshot_region *regions;
+    uint64_t cnt;
+    uint64_t len;
+};
+
+/*
+ * struct cmb_snapshot - The regions added by the model, the full list as of
+ * the last take, and the copy.
+ */
+struct cmb_snapshot {
+    struct region_list user;
+    struct region_list taken;
+    unsigned char *arena_base;
+    size_t arena_used;
+    unsigned char *data;
+    size_t data_size;
+};
+
+/*
+ * region_append - Add a region to the end of the list.
+ */
+static void region_append(struct region_list *rlp, void *p, const size_t sz)
+{
+    cmb_assert_debug(rlp != NULL);
+
+    if (rlp->cnt == rlp->len) {
+        rlp->len = (rlp->len == 0u) ? REGIONS_INIT : 2u * rlp->len;
+        rlp->regions = cmi_realloc_heap(rlp->regions, rlp->len * sizeof(*(rlp->regions)));
+    }
+
+    struct snapshot_region *rp = &(rlp->regions[rlp->cnt++]);
+    rp->addr = p;
+    rp->size = sz;
+    rp->offset = 0u;
+}
+
+/*
+ * snapshot_copy - The ranges include coroutine stacks, where ASan leaves the
+ * redzones of suspended frames poisoned. Unpoison both sides before copying.
+ */
+static void snapshot_copy(void *dst, const void *src, const size_t size)
+{
+    cmi_asan_unpoison(dst, size);
+    cmi_asan_unpoison(src, size);
+    memcpy(dst, src, size);
+}
+
+bool cmb_snapshot_enabled(void)
+{
+    const bool on = __atomic_load_n(&snapshot_enabled, __ATOMIC_RELAXED);
+
+    return on;
+}
+
+void cmb_snapshot_enabled_set(const bool on)
+{
+    __atomic_store_n(&snapshot_enabled, on, __ATOMIC_RELAXED);
+}
+
+void cmb_snapshot_arena_size_set(const size_t sz)
+{
+    cmb_assert_release(sz > 0u);
+
+    __atomic_store_n(&snapshot_arena_size, sz, __ATOMIC_RELAXED);
+}
+
+struct cmb_snapshot *cmb_snapshot_create(void)
+{
+    struct cmb_snapshot *sp = cmi_calloc_heap(1u, sizeof(*sp));
+
+    return sp;
+}
+
+void cmb_snapshot_region_add(struct cmb_snapshot *sp, void *p, const size_t sz)
+{
+    cmb_assert_release(sp != NULL);
+    cmb_assert_release(p != NULL);
+    cmb_assert_release(sz > 0u);
+
+    region_append(&(sp->user), p, sz);
+}
+
+void cmi_snapshot_add(struct cmb_snapshot *sp, void *p, const size_t sz)
+{
+    cmb_assert_debug(sp != NULL);
+    cmb_assert_debug(p != NULL);
+    cmb_assert_debug(sz > 0u);
+
+    region_append(&(sp->taken), p, sz);
+}
+
+void cmb_snapshot_take(struct cmb_snapshot *sp)
+{
+    cmb_assert_release(sp != NULL);
+    cmb_assert_release(cmi_arena.on);
+    cmb_assert_release(cmi_coroutine_current() == cmi_coroutine_main());
+
+    /* Collect the regions outside the arena */
+    sp->taken.cnt = 0u;
+    cmi_coroutine_snapshot_regions(sp);
+    cmi_event_snapshot_regions(sp);
+    cmi_hashheap_snapshot_regions(sp);
+    cmi_mempool_snapshot_regions(sp);
+    cmi_memregistry_snapshot_regions(sp);
+    cmi_objectqueue_snapshot_regions(sp);
+    cmi_process_snapshot_regions(sp);
+    cmi_random_snapshot_regions(sp);
+    cmi_resourceguard_snapshot_regions(sp);
+    for (uint64_t ui = 0u; ui < sp->user.cnt; ui++) {
+        const struct snapshot_region *rp = &(sp->user.regions[ui]);
+        region_append(&(sp->taken), rp->addr, rp->size);
+    }
+
+    /* Lay them out in the buffer after the arena */
+    sp->arena_base = cmi_arena.base;
+    sp->arena_used = cmi_arena_used();
+    size_t total = sp->arena_used;
+    for (uint64_t ui = 0u; ui < sp->taken.cnt; ui++) {
+        struct snapshot_region *rp = &(sp->taken.regions[ui]);
+        rp->offset = total;
+        total += rp->size;
+    }
+
+    if (total > sp->data_size) {
+        if (sp->data != NULL) {
+            cmi_free_heap(sp->data);
+        }
+
+        sp->data = cmi_calloc_heap(1u, total);
+        sp->data_size = total;
+    }
+
+    snapshot_copy(sp->data, sp->arena_base, sp->arena_used);
+    for (uint64_t ui = 0u; ui < sp->taken.cnt; ui++) {
+        const struct snapshot_region *rp = &(sp->taken.regions[ui]);
+        snapshot_copy(sp->data + rp->offset, rp->addr, rp->size);
+    }
+}
+
+void cmb_snapshot_restore(const struct cmb_snapshot *sp)
+{
+    cmb_assert_release(sp != NULL);
+    cmb_assert_release(sp->data != NULL);
+    cmb_assert_release(cmi_coroutine_current() == cmi_coroutine_main());
+    /* The same thread, with the arena still on */
+    cmb_assert_release(sp->arena_base == cmi_arena.base);
+    cmb_assert_release(cmi_arena.on);
+
+    snapshot_copy(sp->arena_base, sp->data, sp->arena_used);
+    for (uint64_t ui = 0u; ui < sp->taken.cnt; ui++) {
+        const struct snapshot_region *rp = &(sp->taken.regions[ui]);
+        snapshot_copy(rp->addr, sp->data + rp->offset, rp->size);
+    }
+}
+
+size_t cmb_snapshot_size(const struct cmb_snapshot *sp)
+{
+    cmb_assert_release(sp != NULL);
+
+    size_t total = sp->arena_used;
+    for (uint64_t ui = 0u; ui < sp->taken.cnt; ui++) {
+        total += sp->taken.regions[ui].size;
+    }
+
+    return total;
+}
+
+void cmb_snapshot_destroy(struct cmb_snapshot *sp)
+{
+    cmb_assert_release(sp != NULL);
+
+    if (sp->user.regions != NULL) {
+        cmi_free_heap(sp->user.regions);
+    }
+
+    if (sp->taken.regions != NULL) {
+        cmi_free_heap(sp->taken.regions);
+    }
+
+    if (sp->data != NULL) {
+        cmi_free_heap(sp->data);
+    }
+
+    cmi_free_heap(sp);
+}
+
+void cmi_snapshot_trial_start(void)
+{
+    const bool on = __atomic_load_n(&snapshot_enabled, __ATOMIC_RELAXED);
+    if (on && !cmi_arena.on) {
+        /* Let go of the event queue and the stacks kept from earlier trials,
+         * to have them allocated again inside the arena */
+        cmi_event_thread_cleanup();
+        cmi_coroutine_stack_cleanup();
+        cmi_arena_open(__atomic_load_n(&snapshot_arena_size, __ATOMIC_RELAXED));
+    }
+
+    cmi_arena.on = on;
+}
+
+void cmi_snapshot_thread_cleanup(void)
+{
+    cmi_arena.on = false;
+}
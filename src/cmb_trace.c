@@ -0,0 +1,328 @@
+/*
+ * cmb_trace.c - The binary event trace, writing fixed-size records into a
+ * memory-mapped ring buffer file per thread.
+ *
+ * Each thread opens its own file at the start of its first traced trial and
+ * keeps it until the thread exits, so that the threads never wait for each
+ * other while tracing. Writing a record is a copy into the mapped memory and
+ * an update of the running count in the file header, nothing more.
+ *
+ * The event function names are looked up the first time each function is
+ * seen in this thread and written as symbol records ahead of the event. A
+ * small direct-mapped cache of the function addresses already written keeps
+ * this off the common path. It is cleared each time the ring wraps around, so
+ * that the names come again after the older records are overwritten.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cmb_assert.h"
+#include "cmb_event.h"
+#include "cmb_logger.h"
+#include "cmb_trace.h"
+
+#include "cmi_config.h"
+#include "cmi_coroutine.h"
+#include "cmi_memutils.h"
+#include "cmi_trace.h"
+
+/* Only used from here, no header file needed */
+extern void *cmi_filemap_open(const char *path, size_t sz);
+extern void cmi_filemap_close(void *p, size_t sz);
+extern bool cmi_symbol_name(const void *addr, char *buf, size_t len);
+extern CMB_THREAD_LOCAL uint64_t cmi_thread_id;
+extern CMB_THREAD_LOCAL uint64_t cmi_logger_trial_idx;
+
+static_assert(sizeof(struct cmb_trace_header) == 64u);
+static_assert(sizeof(struct cmb_trace_record) == 64u);
+
+/* Longest path prefix accepted for the trace files */
+#define PREFIX_BUF_SZ 256
+
+/* Number of entries in the direct-mapped cache of function names written */
+#define SYMBOL_CACHE_EXP 6u
+#define SYMBOL_CACHE_SZ (1u << SYMBOL_CACHE_EXP)
+
+/*
+ * The global settings, behind the mutex. The generation counts the calls to
+ * cmb_trace_start, for the threads to notice a new prefix or capacity and
+ * open a new file. The file count numbers the file names.
+ */
+static bool trace_enabled = false;
+static char trace_prefix[PREFIX_BUF_SZ] = { '\0' };
+static uint64_t trace_capacity = 0u;
+static uint64_t trace_generation = 0u;
+static uint64_t trace_file_count = 0u;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * struct trace_file - This thread's file, the header and records in the
+ * mapped memory, and the settings it was opened with.
+ */
+struct trace_file {
+    struct cmb_trace_header *header;
+    struct cmb_trace_record *records;
+    uint64_t mask;
+    size_t size;
+    uint64_t generation;
+};
+
+static CMB_THREAD_LOCAL struct trace_file trace_file = { 0 };
+static CMB_THREAD_LOCAL uintptr_t symbol_cache[SYMBOL_CACHE_SZ] = { 0 };
+
+CMB_THREAD_LOCAL bool cmi_trace_on = false;
+
+/*
+ * trace_next - The next record in the ring, counted as written. Clears the
+ * symbol cache when wrapping around to the start of the ring.
+ */
+static struct cmb_trace_record *trace_next(void)
+{
+    struct cmb_trace_header *hp = trace_file.header;
+    cmb_assert_debug(hp != NULL);
+
+    const uint64_t idx = hp->written & trace_file.mask;
+    if ((idx == 0u) && (hp->written > 0u)) {
+        cmi_memset(symbol_cache, 0, sizeof(symbol_cache));
+    }
+
+    hp->written++;
+
+    return &(trace_file.records[idx]);
+}
+
+/*
+ * trace_open - Create and map this thread's file with the current settings.
+ * Returns false if it cannot be done.
+ */
+static bool trace_open(void)
+{
+    cmb_assert_debug(trace_file.header == NULL);
+
+    char path[PREFIX_BUF_SZ + 32];
+    pthread_mutex_lock(&trace_mutex);
+    const uint64_t capacity = trace_capacity;
+    const uint64_t generation = trace_generation;
+    (void)snprintf(path, sizeof(path), "%s.%" PRIu64 ".cmbtrace",
+                   trace_prefix, trace_file_count++);
+    pthread_mutex_unlock(&trace_mutex);
+
+    const size_t sz = sizeof(struct cmb_trace_header)
+                      + capacity * sizeof(struct cmb_trace_record);
+    void *p = cmi_filemap_open(path, sz);
+    if (p == NULL) {
+        return false;
+    }
+
+    struct cmb_trace_header *hp = p;
+    cmi_memset(hp, 0, sizeof(*hp));
+    hp->magic = CMB_TRACE_MAGIC;
+    hp->version = CMB_TRACE_VERSION;
+    hp->record_size = sizeof(struct cmb_trace_record);
+    hp->capacity = capacity;
+    hp->thread_id = cmi_thread_id;
+
+    trace_file.header = hp;
+    trace_file.records = (struct cmb_trace_record *)(hp + 1);
+    trace_file.mask = capacity - 1u;
+    trace_file.size = sz;
+    trace_file.generation = generation;
+    cmi_memset(symbol_cache, 0, sizeof(symbol_cache));
+
+    return true;
+}
+
+/*
+ * trace_close - Unmap this thread's file, if open.
+ */
+static void trace_close(void)
+{
+    if (trace_file.header != NULL) {
+        cmi_filemap_close(trace_file.header, trace_file.size);
+        cmi_memset(&trace_file, 0, sizeof(trace_file));
+    }
+}
+
+/*
+ * trace_symbol - Write a symbol record for the function unless the cache says
+ * it was written already.
+ */
+static void trace_symbol(const uint64_t addr)
+{
+    const uint64_t idx = (addr * UINT64_C(11400714819323198485)) >> (64u - SYMBOL_CACHE_EXP);
+    if (symbol_cache[idx] == addr) {
+        return;
+    }
+
+    symbol_cache[idx] = addr;
+    char name[CMB_TRACE_SYMBOL_SZ];
+    if (!cmi_symbol_name((const void *)(uintptr_t)addr, name, sizeof(name))) {
+        return;
+    }
+
+    struct cmb_trace_record *rp = trace_next();
+    rp->kind = CMB_TRACE_SYMBOL;
+    rp->reserved = 0u;
+    rp->time = cmb_time();
+    rp->u.symbol.address = addr;
+    memcpy(rp->u.symbol.name, name, sizeof(name));
+}
+
+/*
+ * trace_process - Write a process record of the given kind.
+ */
+static void trace_process(const enum cmb_trace_kind kind, const void *pp)
+{
+    struct cmb_trace_record *rp = trace_next();
+    rp->kind = kind;
+    rp->reserved = 0u;
+    rp->time = cmb_time();
+    rp->u.process.process = (uint64_t)(uintptr_t)pp;
+    rp->u.process.handle = 0u;
+    rp->u.process.name[0] = '\0';
+}
+
+bool cmb_trace_enabled(void)
+{
+    const bool on = __atomic_load_n(&trace_enabled, __ATOMIC_RELAXED);
+
+    return on;
+}
+
+void cmb_trace_start(const char *prefix, const uint64_t capacity)
+{
+    cmb_assert_release(prefix != NULL);
+    cmb_assert_release(strlen(prefix) < PREFIX_BUF_SZ);
+    cmb_assert_release(capacity > 0u);
+    cmb_assert_release(capacity <= (UINT64_C(1) << 40));
+
+    uint64_t cap = 1u;
+    while (cap < capacity) {
+        cap <<= 1u;
+    }
+
+    pthread_mutex_lock(&trace_mutex);
+    (void)snprintf(trace_prefix, sizeof(trace_prefix), "%s", prefix);
+    trace_capacity = cap;
+    trace_generation++;
+    pthread_mutex_unlock(&trace_mutex);
+
+    __atomic_store_n(&trace_enabled, true, __ATOMIC_RELAXED);
+}
+
+void cmb_trace_stop(void)
+{
+    __atomic_store_n(&trace_enabled, false, __ATOMIC_RELAXED);
+    cmi_trace_on = false;
+    trace_close();
+}
+
+void cmi_trace_trial_start(void)
+{
+    cmi_trace_on = __atomic_load_n(&trace_enabled, __ATOMIC_RELAXED);
+    if (!cmi_trace_on) {
+        return;
+    }
+
+    pthread_mutex_lock(&trace_mutex);
+    const uint64_t generation = trace_generation;
+    pthread_mutex_unlock(&trace_mutex);
+    if ((trace_file.header != NULL) && (trace_file.generation != generation)) {
+        trace_close();
+    }
+
+    if ((trace_file.header == NULL) && !trace_open()) {
+        cmb_logger_warning(stderr, "Cannot open trace file, not tracing");
+        cmi_trace_on = false;
+        return;
+    }
+
+    struct cmb_trace_record *rp = trace_next();
+    rp->kind = CMB_TRACE_TRIAL;
+    rp->reserved = 0u;
+    rp->time = cmb_time();
+    rp->u.event.priority = 0;
+    rp->u.event.handle = cmi_logger_trial_idx;
+    rp->u.event.action = 0u;
+    rp->u.event.subject = 0u;
+    rp->u.event.object = 0u;
+}
+
+void cmi_trace_event(cmb_event_func *action,
+                     const void *subject,
+                     const void *object,
+                     const uint64_t handle,
+                     const int64_t priority)
+{
+    cmb_assert_debug(action != NULL);
+
+    const uint64_t addr = (uint64_t)(uintptr_t)cmi_func_key(action);
+    trace_symbol(addr);
+
+    struct cmb_trace_record *rp = trace_next();
+    rp->kind = CMB_TRACE_EVENT;
+    rp->reserved = 0u;
+    rp->time = cmb_time();
+    rp->u.event.priority = priority;
+    rp->u.event.handle = handle;
+    rp->u.event.action = addr;
+    rp->u.event.subject = (uint64_t)(uintptr_t)subject;
+    rp->u.event.object = (uint64_t)(uintptr_t)object;
+}
+
+void cmi_trace_switch(const struct cmi_coroutine *from,
+                      const struct cmi_coroutine *to)
+{
+    cmb_assert_debug(from != NULL);
+    cmb_assert_debug(to != NULL);
+
+    const struct cmi_coroutine *main_cp = cmi_coroutine_main();
+    if (from != main_cp) {
+        const enum cmb_trace_kind kind = (from->status == CMI_COROUTINE_FINISHED)
+                                         ? CMB_TRACE_PROCESS_EXIT
+                                         : CMB_TRACE_PROCESS_YIELD;
+        trace_process(kind, from);
+    }
+
+    if (to != main_cp) {
+        trace_process(CMB_TRACE_PROCESS_RUN, to);
+    }
+}
+
+void cmi_trace_process_name(const void *pp, const uint64_t handle, const char *name)
+{
+    cmb_assert_debug(pp != NULL);
+    cmb_assert_debug(name != NULL);
+
+    struct cmb_trace_record *rp = trace_next();
+    rp->kind = CMB_TRACE_PROCESS_NAME;
+    rp->reserved = 0u;
+    rp->time = cmb_time();
+    rp->u.process.process = (uint64_t)(uintptr_t)pp;
+    rp->u.process.handle = handle;
+    (void)snprintf(rp->u.process.name, sizeof(rp->u.process.name), "%s", name);
+}
+
+void cmi_trace_thread_cleanup(void)
+{
+    cmi_trace_on = false;
+    trace_close();
+}
@@ -0,0 +1,222 @@
+/*
+ * cmi_arena.c - The per-thread snapshot arena, a simple power-of-two size
+ * class allocator on top of a bump pointer.
+ *
+ * Each block is a power of two in size, from 32 bytes up. A small tag just
+ * before the returned pointer holds the size class and the offset back to the
+ * start of the block, allowing any alignment up to the size of the block.
+ * Freed blocks go on the free list for their size class and are reused as is,
+ * never split or merged. This wastes some memory, but keeps the allocator
+ * fast and simple, and all its state in a few words at the start of the arena.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cmb_assert.h"
+#include "cmb_logger.h"
+
+#include "cmi_arena.h"
+#include "cmi_memutils.h"
+
+/* The smallest block, 32 bytes, and the number of size classes */
+#define CLASS_MIN 5u
+#define CLASS_NUM 48u
+
+/* The granularity of committing memory to the arena, on systems that care */
+#define COMMIT_STEP (UINT64_C(1) << 20)
+
+/*
+ * struct arena_head - The bookkeeping at the start of the arena.
+ */
+struct arena_head {
+    size_t top;
+    size_t committed;
+    void *free_list[CLASS_NUM];
+};
+
+/*
+ * struct arena_tag - In front of each allocation, where the block starts and
+ * which size class it is.
+ */
+struct arena_tag {
+    uint32_t sclass;
+    uint32_t offset;
+    uint64_t reserved;
+};
+
+static_assert(sizeof(struct arena_tag) == 16u);
+
+CMB_THREAD_LOCAL struct cmi_arena cmi_arena = { NULL, 0u, false };
+
+/* The block size class needed for sz bytes aligned to align */
+static uint32_t arena_class(const size_t align, const size_t sz)
+{
+    const size_t need = sz + ((align > sizeof(struct arena_tag)) ? align
+                                                                 : sizeof(struct arena_tag));
+    uint32_t c = CLASS_MIN;
+    while (((size_t)1 << c) < need) {
+        c++;
+    }
+
+    cmb_assert_release(c < CLASS_NUM);
+
+    return c;
+}
+
+/* A fresh block of the size class from the top of the arena */
+static unsigned char *arena_grow(struct arena_head *ahp, const uint32_t c)
+{
+    const size_t bsz = (size_t)1 << c;
+    if (bsz > cmi_arena.size - ahp->top) {
+        cmb_logger_fatal(stderr, "Snapshot arena full, %zu bytes", cmi_arena.size);
+    }
+
+    unsigned char *bp = cmi_arena.base + ahp->top;
+    ahp->top += bsz;
+    if (ahp->top > ahp->committed) {
+        size_t want = (ahp->top + COMMIT_STEP - 1u) & ~(COMMIT_STEP - 1u);
+        if (want > cmi_arena.size) {
+            want = cmi_arena.size;
+        }
+
+        cmi_vm_commit(cmi_arena.base + ahp->committed, want - ahp->committed);
+        ahp->committed = want;
+    }
+
+    return bp;
+}
+
+void cmi_arena_open(const size_t sz)
+{
+    if (cmi_arena.base != NULL) {
+        return;
+    }
+
+    const size_t pagesz = cmi_pagesize();
+    const size_t size_rnd = (sz + pagesz - 1u) & ~(pagesz - 1u);
+    cmb_assert_release(size_rnd > sizeof(struct arena_head));
+
+    unsigned char *base = cmi_vm_reserve(size_rnd);
+    const size_t head_sz = (sizeof(struct arena_head) + 15u) & ~(size_t)15u;
+    const size_t commit_sz = (COMMIT_STEP < size_rnd) ? COMMIT_STEP : size_rnd;
+    cmi_vm_commit(base, commit_sz);
+
+    struct arena_head *ahp = (struct arena_head *)base;
+    cmi_memset(ahp, 0, sizeof(*ahp));
+    ahp->top = head_sz;
+    ahp->committed = commit_sz;
+
+    cmi_arena.base = base;
+    cmi_arena.size = size_rnd;
+    cmi_arena.on = false;
+}
+
+size_t cmi_arena_used(void)
+{
+    cmb_assert_debug(cmi_arena.base != NULL);
+
+    const struct arena_head *ahp = (const struct arena_head *)cmi_arena.base;
+
+    return ahp->top;
+}
+
+void *cmi_arena_alloc(size_t align, const size_t sz)
+{
+    cmb_assert_debug(cmi_arena.base != NULL);
+    cmb_assert_debug(cmi_is_power_of_two(align));
+    cmb_assert_debug(sz > 0u);
+
+    if (align < sizeof(struct arena_tag)) {
+        align = sizeof(struct arena_tag);
+    }
+
+    struct arena_head *ahp = (struct arena_head *)cmi_arena.base;
+    const uint32_t c = arena_class(align, sz);
+    unsigned char *bp = ahp->free_list[c];
+    if (bp != NULL) {
+        ahp->free_list[c] = *(void **)bp;
+    }
+    else {
+        bp = arena_grow(ahp, c);
+    }
+
+    const uintptr_t first = (uintptr_t)bp + sizeof(struct arena_tag);
+    unsigned char *rp = (unsigned char *)((first + align - 1u) & ~(uintptr_t)(align - 1u));
+    struct arena_tag *tp = (struct arena_tag *)rp - 1;
+    tp->sclass = c;
+    tp->offset = (uint32_t)(rp - bp);
+    tp->reserved = 0u;
+
+    return rp;
+}
+
+void cmi_arena_free(void *p)
+{
+    cmb_assert_debug(cmi_arena_owns(p));
+
+    struct arena_head *ahp = (struct arena_head *)cmi_arena.base;
+    const struct arena_tag *tp = (struct arena_tag *)p - 1;
+    const uint32_t c = tp->sclass;
+    cmb_assert_debug((c >= CLASS_MIN) && (c < CLASS_NUM));
+
+    unsigned char *bp = (unsigned char *)p - tp->offset;
+    *(void **)bp = ahp->free_list[c];
+    ahp->free_list[c] = bp;
+}
+
+void *cmi_arena_realloc(void *p, const size_t align, const size_t sz)
+{
+    cmb_assert_debug(sz > 0u);
+
+    const size_t blk_align = (align > sizeof(struct arena_tag)) ? align
+                                                                : sizeof(struct arena_tag);
+    if (p == NULL) {
+        return cmi_arena_alloc(blk_align, sz);
+    }
+
+    size_t old_sz;
+    const bool owned = cmi_arena_owns(p);
+    if (owned) {
+        const struct arena_tag *tp = (struct arena_tag *)p - 1;
+        old_sz = ((size_t)1 << tp->sclass) - tp->offset;
+        if ((sz <= old_sz) && (((uintptr_t)p & (uintptr_t)(blk_align - 1u)) == 0u)) {
+            return p;
+        }
+    }
+    else {
+        old_sz = cmi_usable_size(p, align);
+    }
+
+    void *rp = cmi_arena_alloc(blk_align, sz);
+    memcpy(rp, p, (old_sz < sz) ? old_sz : sz);
+    if (owned) {
+        cmi_arena_free(p);
+    }
+
+    return rp;
+}
+
+void cmi_arena_thread_cleanup(void)
+{
+    if (cmi_arena.base != NULL) {
+        cmi_vm_release(cmi_arena.base, cmi_arena.size);
+        cmi_arena.base = NULL;
+        cmi_arena.size = 0u;
+        cmi_arena.on = false;
+    }
+}
@@ -0,0 +1,95 @@
+/*
+ * cmi_arena.h - A per-thread memory arena at a fixed address, for the
+ * snapshots of a trial, see cmb_snapshot.h. While the arena is on, the memory
+ * wrappers in cmi_memutils.h allocate from it instead of from the heap, so
+ * that all the simulation state of the thread is within one contiguous range
+ * of addresses that can be copied out and back in again.
+ *
+ * The arena reserves its address range from the operating system once and
+ * keeps it until the thread exits, even if turned off in between. Its own
+ * bookkeeping, the bump pointer and the free lists, is kept at the start of
+ * the arena, so that copying the arena back also restores the allocator.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CIMBA_CMI_ARENA_H
+#define CIMBA_CMI_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cmi_config.h"
+
+/*
+ * struct cmi_arena - The address range of this thread's arena, if any, and
+ * whether allocations currently go there.
+ */
+struct cmi_arena {
+    unsigned char *base;
+    size_t size;
+    bool on;
+};
+
+extern CMB_THREAD_LOCAL struct cmi_arena cmi_arena;
+
+/*
+ * cmi_arena_owns - Is p inside the arena of this thread?
+ */
+CMB_MAYBE_UNUSED
+static inline bool cmi_arena_owns(const void *p)
+{
+    return ((uintptr_t)p - (uintptr_t)cmi_arena.base) < cmi_arena.size;
+}
+
+/*
+ * cmi_arena_open - Reserve the address range for the arena of this thread,
+ * sz bytes, unless it already has one. Does not turn it on.
+ */
+extern void cmi_arena_open(size_t sz);
+
+/*
+ * cmi_arena_used - The number of bytes from the start of the arena that are or
+ * have been in use, including the bookkeeping.
+ */
+extern size_t cmi_arena_used(void);
+
+/*
+ * cmi_arena_alloc - Allocate sz bytes aligned to align, a power of two no less
+ * than 16. Fatal error if the arena is full.
+ */
+extern void *cmi_arena_alloc(size_t align, size_t sz);
+
+/*
+ * cmi_arena_free - Return an arena allocation to its free list.
+ */
+extern void cmi_arena_free(void *p);
+
+/*
+ * cmi_arena_realloc - Resize an allocation, moving it into the arena if it is
+ * not there already. A heap allocation moved in this way is not freed, since a
+ * snapshot restore may bring back a pointer to it. align is zero for memory
+ * from malloc, otherwise the alignment it was allocated with.
+ */
+extern void *cmi_arena_realloc(void *p, size_t align, size_t sz);
+
+/*
+ * cmi_arena_thread_cleanup - Release the address range of the arena. Call
+ * last, when nothing in the arena is needed anymore.
+ */
+extern void cmi_arena_thread_cleanup(void);
+
+#endif /* CIMBA_CMI_ARENA_H */
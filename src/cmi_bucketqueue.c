@@ -0,0 +1,1301 @@
+/*
+ * cmi_bucketqueue.c - Implements the bucket queue, a ladder queue or a radix
+ * heap of unsorted buckets in front of a short sorted bottom list, with a
+ * stable item array and an open addressing hash map from key to item slot.
+ *
+ * The hash map uses the same Fibonacci hash as the hashheap, with linear
+ * probing and backward shift deletion, so that it needs no tombstones and
+ * never has to be compacted. It is rebuilt whenever the item array grows.
+ *
+ * Every item that reaches the bottom list is in the right order relative to
+ * everything still in the rungs and the top, since each level only holds
+ * items later than the level below it. A rung accepts an item if it falls
+ * into one of its buckets not yet passed on, computed with the same floating
+ * point expression each time, so that equal times always end up together.
+ *
+ * The radix heap instead buckets the items by the highest bit where their
+ * time, as an ordered 64-bit integer, differs from the time of the last item
+ * dequeued. An item only ever moves to lower buckets, at most 64 times, and
+ * the bottom list holds the items at exactly the last time dequeued, sorted by
+ * priority and key.
+ *
+ * See also: Tang, Goh & Thng (2005), "Ladder Queue: An O(1) Priority Queue
+ *   Structure for Large-Scale Discrete Event Simulation", ACM TOMACS 15(3).
+ *   Ahuja, Mehlhorn, Orlin & Tarjan (1990), "Faster Algorithms for the
+ *   Shortest Path Problem", Journal of the ACM 37(2).
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cmi_bucketqueue.h"
+#include "cmi_memutils.h"
+#include "cmi_subjectindex.h"
+
+/*
+ * A bucket (or the top) holding more than this many items is spread over a new
+ * rung instead of being sorted into the bottom, and a bottom list growing past
+ * it is turned into a new rung as well. The value is from Tang et al.
+ */
+#define BUCKET_THRES 50u
+
+/*
+ * cmi_bucketqueue_create - Allocate memory for a new bucket queue struct.
+ */
+struct cmi_bucketqueue *cmi_bucketqueue_create(void)
+{
+    struct cmi_bucketqueue *bq = cmi_malloc(sizeof(*bq));
+    cmi_memset(bq, 0u, sizeof(*bq));
+
+    return bq;
+}
+
+/*
+ * ladder_reset - Empty the top, rungs, radix buckets, and bottom, keeping the
+ * rung bucket arrays.
+ */
+static void ladder_reset(struct cmi_bucketqueue *bq)
+{
+    cmb_assert_debug(bq != NULL);
+
+    bq->top.head = 0u;
+    bq->top.tail = 0u;
+    bq->top.count = 0u;
+    bq->top_start = -INFINITY;
+    bq->top_min = INFINITY;
+    bq->top_max = -INFINITY;
+    bq->rung_count = 0u;
+    bq->bottom.head = 0u;
+    bq->bottom.tail = 0u;
+    bq->bottom.count = 0u;
+    cmi_memset(bq->radix, 0u, sizeof(bq->radix));
+    bq->radix_mask = 0u;
+    bq->radix_last = 0u;
+    bq->radix_bottom_max = 0u;
+}
+
+/*
+ * cmi_bucketqueue_initialize - Allocate the initial node, item, and hash arrays.
+ */
+void cmi_bucketqueue_initialize(struct cmi_bucketqueue *bq,
+                                const uint16_t iexp,
+                                const enum cmi_bucketqueue_strategy strategy)
+{
+    cmb_assert_release(bq != NULL);
+    cmb_assert_release(bq->items == NULL);
+    cmb_assert_release((iexp > 0u) && (iexp < 31u));
+    cmb_assert_release((strategy == CMI_BUCKETQUEUE_LADDER)
+                       || (strategy == CMI_BUCKETQUEUE_RADIX));
+
+    bq->strategy = strategy;
+    bq->item_size = UINT64_C(1) << iexp;
+    bq->items = cmi_malloc(bq->item_size * sizeof(struct cmi_bucket_item));
+    bq->node_size = bq->item_size;
+    bq->nodes = cmi_malloc(bq->node_size * sizeof(struct cmi_bucket_node));
+    bq->hash_exp = (uint16_t)(iexp + 1u);
+    bq->hash_size = UINT64_C(1) << bq->hash_exp;
+    bq->hash_map = cmi_calloc(bq->hash_size, sizeof(struct cmi_hash_tag));
+
+    bq->node_top = 0u;
+    bq->node_free = 0u;
+    bq->item_top = 0u;
+    bq->item_free = 0u;
+    bq->item_current = 0u;
+    bq->count = 0u;
+    bq->item_counter = 0u;
+    ladder_reset(bq);
+}
+
+/*
+ * cmi_bucketqueue_index_subjects - Create the subject index and enter the
+ * items already in the queue.
+ */
+void cmi_bucketqueue_index_subjects(struct cmi_bucketqueue *bq)
+{
+    cmb_assert_release(bq != NULL);
+    cmb_assert_release(bq->items != NULL);
+    cmb_assert_release(bq->subjects == NULL);
+
+    bq->subjects = cmi_subjectindex_create();
+    cmi_subjectindex_initialize(bq->subjects, bq->item_size);
+    for (uint64_t slot = 1u; slot <= bq->item_top; slot++) {
+        const struct cmi_bucket_item *itp = &(bq->items[slot]);
+        if (itp->node != 0u) {
+            cmi_subjectindex_insert(bq->subjects, itp->item[1], slot);
+        }
+    }
+}
+
+/*
+ * cmi_bucketqueue_clear - Empty the queue, keeping the allocated arrays.
+ */
+void cmi_bucketqueue_clear(struct cmi_bucketqueue *bq)
+{
+    cmb_assert_release(bq != NULL);
+    cmb_assert_release(bq->items != NULL);
+
+    cmi_memset(bq->hash_map, 0u, bq->hash_size * sizeof(struct cmi_hash_tag));
+    bq->node_top = 0u;
+    bq->node_free = 0u;
+    bq->item_top = 0u;
+    bq->item_free = 0u;
+    bq->item_current = 0u;
+    bq->count = 0u;
+    ladder_reset(bq);
+
+    if (bq->subjects != NULL) {
+        cmi_subjectindex_clear(bq->subjects);
+    }
+}
+
+/*
+ * cmi_bucketqueue_terminate - Free the arrays, back to the newly created state.
+ */
+void cmi_bucketqueue_terminate(struct cmi_bucketqueue *bq)
+{
+    cmb_assert_release(bq != NULL);
+
+    for (unsigned ui = 0u; ui < CMI_BUCKETQUEUE_RUNGS; ui++) {
+        if (bq->rungs[ui].buckets != NULL) {
+            cmi_free(bq->rungs[ui].buckets);
+        }
+    }
+
+    if (bq->items != NULL) {
+        cmi_free(bq->nodes);
+        cmi_free(bq->items);
+        cmi_free(bq->hash_map);
+    }
+
+    if (bq->subjects != NULL) {
+        cmi_subjectindex_destroy(bq->subjects);
+    }
+
+    cmi_memset(bq, 0u, sizeof(*bq));
+}
+
+/*
+ * cmi_bucketqueue_destroy - Free the bucket queue struct itself.
+ */
+void cmi_bucketqueue_destroy(struct cmi_bucketqueue *bq)
+{
+    cmb_assert_release(bq != NULL);
+
+    if (bq->items != NULL) {
+        cmi_bucketqueue_terminate(bq);
+    }
+
+    cmi_free(bq);
+}
+
+/*
+ * hash_home - Fibonacci hash of the key, the preferred position in the map.
+ */
+static uint64_t hash_home(const struct cmi_bucketqueue *bq, const uint64_t key)
+{
+    cmb_assert_debug(bq != NULL);
+
+    return (key * UINT64_C(11400714819323198485)) >> (64u - bq->hash_exp);
+}
+
+/*
+ * hash_insert - Enter the key and item slot in the first free position from
+ * its home position onwards.
+ */
+static void hash_insert(const struct cmi_bucketqueue *bq,
+                        const uint64_t key,
+                        const uint64_t slot)
+{
+    cmb_assert_debug(bq != NULL);
+    cmb_assert_debug(slot != 0u);
+
+    struct cmi_hash_tag *hm = bq->hash_map;
+    const uint64_t mask = bq->hash_size - 1u;
+    uint64_t idx = hash_home(bq, key);
+    while (hm[idx].item_slot != 0u) {
+        idx = (idx + 1u) & mask;
+    }
+
+    hm[idx].hash_key = key;
+    hm[idx].item_slot = slot;
+    bq->items[slot].hash_index = idx;
+}
+
+/*
+ * hash_delete - Remove the entry at idx, shifting any following entries in
+ * the same probe run back into the hole if that brings them closer to home.
+ */
+static void hash_delete(const struct cmi_bucketqueue *bq, uint64_t idx)
+{
+    cmb_assert_debug(bq != NULL);
+    cmb_assert_debug(bq->hash_map[idx].item_slot != 0u);
+
+    struct cmi_hash_tag *hm = bq->hash_map;
+    const uint64_t mask = bq->hash_size - 1u;
+    uint64_t nxt = idx;
+    for (;;) {
+        nxt = (nxt + 1u) & mask;
+        if (hm[nxt].item_slot == 0u) {
+            break;
+        }
+
+        /* Stays put if its home is cyclically in (idx, nxt] */
+        const uint64_t home = hash_home(bq, hm[nxt].hash_key);
+        const bool stays = (idx <= nxt) ? ((idx < home) && (home <= nxt))
+                                        : ((idx < home) || (home <= nxt));
+        if (!stays) {
+            hm[idx] = hm[nxt];
+            bq->items[hm[idx].item_slot].hash_index = idx;
+            idx = nxt;
+        }
+    }
+
+    hm[idx].hash_key = 0u;
+    hm[idx].item_slot = 0u;
+}
+
+/*
+ * cmi_bucketqueue_find_slot - Look up the item slot for the key, zero if none.
+ */
+uint64_t cmi_bucketqueue_find_slot(const struct cmi_bucketqueue *bq,
+                                   const uint64_t hashkey)
+{
+    cmb_assert_debug(bq != NULL);
+    cmb_assert_debug(bq->hash_map != NULL);
+
+    const struct cmi_hash_tag *hm = bq->hash_map;
+    const uint64_t mask = bq->hash_size - 1u;
+    uint64_t idx = hash_home(bq, hashkey);
+    while (hm[idx].item_slot != 0u) {
+        if (hm[idx].hash_key == hashkey) {
+            return hm[idx].item_slot;
+        }
+
+        idx = (idx + 1u) & mask;
+    }
+
+    return 0u;
+}
+
+/*
+ * items_grow - Double the item array and rebuild the hash map at twice that.
+ */
+static void items_grow(struct cmi_bucketqueue *bq)
+{
+    cmb_assert_debug(bq != NULL);
+    cmb_assert_release(bq->item_size < (UINT64_C(1) << 31u));
+
+    bq->item_size <<= 1u;
+    bq->items = cmi_realloc(bq->items, bq->item_size * sizeof(struct cmi_bucket_item));
+
+    cmi_free(bq->hash_map);
+    bq->hash_exp++;
+    bq->hash_size = UINT64_C(1) << bq->hash_exp;
+    bq->hash_map = cmi_calloc(bq->hash_size, sizeof(struct cmi_hash_tag));
+    for (uint64_t slot = 1u; slot <= bq->item_top; slot++) {
+        const struct cmi_bucket_item *itp = &(bq->items[slot]);
+        if (itp->node != 0u) {
+            hash_insert(bq, itp->hash_key, slot);
+        }
+    }
+
+    if (bq->subjects != NULL) {
+        cmi_subjectindex_reserve(bq->subjects, bq->item_size);
+    }
+}
+
+/*
+ * item_alloc - Get a free item slot, reusing the most recently freed first.
+ */
+static uint64_t item_alloc(struct cmi_bucketqueue *bq)
+{
+    cmb_assert_debug(bq != NULL);
+
+    uint64_t slot = bq->item_free;
+    if (slot != 0u) {
+        bq->item_free = bq->items[slot].next_free;
+    }
+    else {
+        if (bq->item_top + 1u >= bq->item_size) {
+            items_grow(bq);
+        }
+
+        slot = ++bq->item_top;
+    }
+
+    return slot;
+}
+
+/*
+ * item_release - Return a slot to the free list. Any node still pointing to
+ * it is stale from now on.
+ */
+static void item_release(struct cmi_bucketqueue *bq, const uint64_t slot)
+{
+    cmb_assert_debug(bq != NULL);
+    cmb_assert_debug((slot > 0u) && (slot <= bq->item_top));
+
+    struct cmi_bucket_item *itp = &(bq->items[slot]);
+    itp->hash_key = 0u;
+    itp->node = 0u;
+    itp->next_free = bq->item_free;
+    bq->item_free = slot;
+}
+
+/*
+ * node_alloc - Get a free node, growing the node array if needed. The array
+ * may move, do not hold on to node pointers across this call.
+ */
+static uint32_t node_alloc(struct cmi_bucketqueue *bq)
+{
+    cmb_assert_debug(bq != NULL);
+
+    uint64_t n = bq->node_free;
+    if (n != 0u) {
+        bq->node_free = bq->nodes[n].next;
+    }
+    else {
+        if (bq->node_top + 1u >= bq->node_size) {
+            cmb_assert_release(bq->node_size < (UINT64_C(1) << 31u));
+            bq->node_size <<= 1u;
+            bq->nodes = cmi_realloc(bq->nodes,
+                                    bq->node_size * sizeof(struct cmi_bucket_node));
+        }
+
+        n = ++bq->node_top;
+    }
+
+    return (uint32_t)n;
+}
+
+/*
+ * node_free - Return a node, already unlinked from its list, to the free list.
+ */
+static void node_free(struct cmi_bucketqueue *bq, const uint32_t n)
+{
+    cmb_assert_debug(bq != NULL);
+    cmb_assert_debug((n > 0u) && (n <= bq->node_top));
+
+    bq->nodes[n].next = (uint32_t)bq->node_free;
+    bq->node_free = n;
+}
+
+/*
+ * node_is_live - Is this node the current one for its item?
+ */
+static bool node_is_live(const struct cmi_bucketqueue *bq, const uint32_t n)
+{
+    cmb_assert_debug(bq != NULL);
+
+    return (bq->items[bq->nodes[n].item_slot].node == n);
+}
+
+/*
+ * node_before - The event queue order: Earlier time, then higher priority,
+ * then lower key (FIFO).
+ */
+static bool node_before(const struct cmi_bucket_node *a,
+                        const struct cmi_bucket_node *b)
+{
+    cmb_assert_debug(a != NULL);
+    cmb_assert_debug(b != NULL);
+
+    if (a->rank_d64 != b->rank_d64) {
+        return (a->rank_d64 < b->rank_d64);
+    }
+    if (a->rank_i64 != b->rank_i64) {
+        return (a->rank_i64 > b->rank_i64);
+    }
+
+    return (a->hash_key < b->hash_key);
+}
+
+/*
+ * list_push - Append node n at the tail of the list.
+ */
+static void list_push(struct cmi_bucket_node *nodes,
+                      struct cmi_bucket_list *lp,
+                      const uint32_t n)
+{
+    cmb_assert_debug(nodes != NULL);
+    cmb_assert_debug(lp != NULL);
+
+    nodes[n].next = 0u;
+    if (lp->tail == 0u) {
+        lp->head = n;
+    }
+    else {
+        nodes[lp->tail].next = n;
+    }
+
+    lp->tail = n;
+    lp->count++;
+}
+
+/*
+ * list_pop - Unlink and return the head of a non-empty list.
+ */
+static uint32_t list_pop(struct cmi_bucket_node *nodes, struct cmi_bucket_list *lp)
+{
+    cmb_assert_debug(nodes != NULL);
+    cmb_assert_debug((lp != NULL) && (lp->head != 0u));
+
+    const uint32_t n = lp->head;
+    lp->head = nodes[n].next;
+    if (lp->head == 0u) {
+        lp->tail = 0u;
+    }
+
+    lp->count--;
+    return n;
+}
+
+/*
+ * list_merge - Merge two sorted chains of nodes into one.
+ */
+static uint32_t list_merge(struct cmi_bucket_node *nodes, uint32_t a, uint32_t b)
+{
+    cmb_assert_debug(nodes != NULL);
+
+    uint32_t head = 0u;
+    uint32_t tail = 0u;
+    while ((a != 0u) && (b != 0u)) {
+        uint32_t n;
+        if (node_before(&(nodes[b]), &(nodes[a]))) {
+            n = b;
+            b = nodes[b].next;
+        }
+        else {
+            n = a;
+            a = nodes[a].next;
+        }
+
+        if (tail == 0u) {
+            head = n;
+        }
+        else {
+            nodes[tail].next = n;
+        }
+
+        tail = n;
+    }
+
+    const uint32_t rest = (a != 0u) ? a : b;
+    if (tail == 0u) {
+        head = rest;
+    }
+    else {
+        nodes[tail].next = rest;
+    }
+
+    return head;
+}
+
+/*
+ * list_sort - Merge sort a chain of cnt nodes, returning the new head.
+ */
+static uint32_t list_sort(struct cmi_bucket_node *nodes,
+                          const uint32_t head,
+                          const uint64_t cnt)
+{
+    cmb_assert_debug(nodes != NULL);
+
+    if (cnt <= 1u) {
+        return head;
+    }
+
+    const uint64_t half = cnt / 2u;
+    uint32_t mid = head;
+    for (uint64_t ui = 1u; ui < half; ui++) {
+        mid = nodes[mid].next;
+    }
+
+    const uint32_t second = nodes[mid].next;
+    nodes[mid].next = 0u;
+
+    return list_merge(nodes,
+                      list_sort(nodes, head, half),
+                      list_sort(nodes, second, cnt - half));
+}
+
+/*
+ * rung_bucket - The bucket index for time t in rung rp as a double, possibly
+ * negative or beyond the last bucket. Always the same expression, so that the
+ * same time always gives the same answer.
+ */
+static double rung_bucket(const struct cmi_bucket_rung *rp, const double t)
+{
+    cmb_assert_debug(rp != NULL);
+
+    return floor((t - rp->start) / rp->width);
+}
+
+/*
+ * can_spread - Is the time range wide enough to be divided into n buckets?
+ */
+static bool can_spread(const double tmin, const double tmax, const uint64_t n)
+{
+    const double width = (tmax - tmin) / (double)n;
+
+    return (isfinite(width) && (width > 0.0) && ((tmin + width) > tmin));
+}
+
+/*
+ * rung_spawn - Add a new rung at the bottom of the ladder and distribute the
+ * nodes from the list over it, discarding stale ones. The times in the list
+ * span [tmin, tmax], where tmin < tmax.
+ */
+static void rung_spawn(struct cmi_bucketqueue *bq,
+                       struct cmi_bucket_list *lp,
+                       const double tmin,
+                       const double tmax)
+{
+    cmb_assert_debug(bq != NULL);
+    cmb_assert_debug(lp != NULL);
+    cmb_assert_debug(bq->rung_count < CMI_BUCKETQUEUE_RUNGS);
+    cmb_assert_debug(tmin < tmax);
+
+    struct cmi_bucket_rung *rp = &(bq->rungs[bq->rung_count++]);
+    const uint64_t nb = lp->count + 1u;
+    if (nb > rp->bucket_cap) {
+        rp->buckets = cmi_realloc(rp->buckets, nb * sizeof(struct cmi_bucket_list));
+        rp->bucket_cap = nb;
+    }
+
+    cmi_memset(rp->buckets, 0u, nb * sizeof(struct cmi_bucket_list));
+    rp->bucket_count = nb;
+    rp->current = 0u;
+    rp->start = tmin;
+    rp->width = (tmax - tmin) / (double)lp->count;
+
+    const double last = (double)(nb - 1u);
+    struct cmi_bucket_node *nodes = bq->nodes;
+    uint32_t n = lp->head;
+    while (n != 0u) {
+        const uint32_t nxt = nodes[n].next;
+        if (node_is_live(bq, n)) {
+            double k = rung_bucket(rp, nodes[n].rank_d64);
+            cmb_assert_debug(k >= 0.0);
+            if (k > last) {
+                k = last;
+            }
+
+            list_push(nodes, &(rp->buckets[(uint64_t)k]), n);
+        }
+        else {
+            node_free(bq, n);
+        }
+
+        n = nxt;
+    }
+
+    lp->head = 0u;
+    lp->tail = 0u;
+    lp->count = 0u;
+}
+
+/*
+ * list_to_bottom - Move the nodes from the list to the empty bottom list,
+ * discarding stale ones and sorting the rest.
+ */
+static void list_to_bottom(struct cmi_bucketqueue *bq, struct cmi_bucket_list *lp)
+{
+    cmb_assert_debug(bq != NULL);
+    cmb_assert_debug(lp != NULL);
+    cmb_assert_debug(bq->bottom.count == 0u);
+
+    struct cmi_bucket_node *nodes = bq->nodes;
+    struct cmi_bucket_list live = { 0u, 0u, 0u };
+    uint32_t n = lp->head;
+    while (n != 0u) {
+        const uint32_t nxt = nodes[n].next;
+        if (node_is_live(bq, n)) {
+            list_push(nodes, &live, n);
+        }
+        else {
+            node_free(bq, n);
+        }
+
+        n = nxt;
+    }
+
+    lp->head = 0u;
+    lp->tail = 0u;
+    lp->count = 0u;
+
+    if (live.count > 0u) {
+        bq->bottom.head = list_sort(nodes, live.head, live.count);
+        bq->bottom.count = live.count;
+        n = bq->bottom.head;
+        while (nodes[n].next != 0u) {
+            n = nodes[n].next;
+        }
+
+        bq->bottom.tail = n;
+    }
+}
+
+/*
+ * bottom_insert - Insert node n in its sorted position in the bottom list,
+ * usually at the tail.
+ */
+static void bottom_insert(struct cmi_bucketqueue *bq, const uint32_t n)
+{
+    cmb_assert_debug(bq != NULL);
+
+    struct cmi_bucket_node *nodes = bq->nodes;
+    struct cmi_bucket_list *bl = &(bq->bottom);
+    if ((bl->tail == 0u) || !node_before(&(nodes[n]), &(nodes[bl->tail]))) {
+        list_push(nodes, bl, n);
+        return;
+    }
+
+    /* Somewhere before the tail, walk from the head */
+    uint32_t prev = 0u;
+    uint32_t cur = bl->head;
+    while (!node_before(&(nodes[n]), &(nodes[cur]))) {
+        prev = cur;
+        cur = nodes[cur].next;
+    }
+
+    nodes[n].next = cur;
+    if (prev == 0u) {
+        bl->head = n;
+    }
+    else {
+        nodes[prev].next = n;
+    }
+
+    bl->count++;
+}
+
+/*
+ * ladder_insert - Place node n in the top, the first rung that accepts it, or
+ * the bottom, in that order. If the bottom has grown too long, turn it into a
+ * new rung first.
+ */
+static void ladder_insert(struct cmi_bucketqueue *bq, const uint32_t n)
+{
+    cmb_assert_debug(bq != NULL);
+
+    const double t = bq->nodes[n].rank_d64;
+    if (t > bq->top_start) {
+        list_push(bq->nodes, &(bq->top), n);
+        if (t < bq->top_min) {
+            bq->top_min = t;
+        }
+        if (t > bq->top_max) {
+            bq->top_max = t;
+        }
+
+        return;
+    }
+
+    for (unsigned ur = 0u; ur < bq->rung_count; ur++) {
+        struct cmi_bucket_rung *rp = &(bq->rungs[ur]);
+        double k = rung_bucket(rp, t);
+        if ((k >= (double)rp->current) && (rp->current < rp->bucket_count)) {
+            const double last = (double)(rp->bucket_count - 1u);
+            if (k > last) {
+                k = last;
+            }
+
+            list_push(bq->nodes, &(rp->buckets[(uint64_t)k]), n);
+            return;
+        }
+    }
+
+    struct cmi_bucket_list *bl = &(bq->bottom);
+    if ((bl->count >= BUCKET_THRES) && (bq->rung_count < CMI_BUCKETQUEUE_RUNGS)) {
+        const double tmin = bq->nodes[bl->head].rank_d64;
+        const double tmax = bq->nodes[bl->tail].rank_d64;
+        if (can_spread(tmin, tmax, bl->count)) {
+            rung_spawn(bq, bl, tmin, tmax);
+            ladder_insert(bq, n);
+            return;
+        }
+    }
+
+    bottom_insert(bq, n);
+}
+
+/*
+ * ladder_prepare - Make sure the bottom list starts with a live node, if there
+ * is one anywhere, by discarding stale nodes and passing buckets downwards.
+ * Returns false if the queue holds no live nodes.
+ */
+static bool ladder_prepare(struct cmi_bucketqueue *bq)
+{
+    cmb_assert_debug(bq != NULL);
+
+    for (;;) {
+        while (bq->bottom.head != 0u) {
+            const uint32_t n = bq->bottom.head;
+            if (node_is_live(bq, n)) {
+                return true;
+            }
+
+            (void)list_pop(bq->nodes, &(bq->bottom));
+            node_free(bq, n);
+        }
+
+        if (bq->rung_count > 0u) {
+            struct cmi_bucket_rung *rp = &(bq->rungs[bq->rung_count - 1u]);
+            while ((rp->current < rp->bucket_count)
+                   && (rp->buckets[rp->current].count == 0u)) {
+                rp->current++;
+            }
+
+            if (rp->current == rp->bucket_count) {
+                /* This rung is used up */
+                bq->rung_count--;
+                continue;
+            }
+
+            struct cmi_bucket_list *bp = &(rp->buckets[rp->current]);
+            rp->current++;
+            if ((bp->count > BUCKET_THRES)
+                && (bq->rung_count < CMI_BUCKETQUEUE_RUNGS)) {
+                double tmin = INFINITY;
+                double tmax = -INFINITY;
+                for (uint32_t n = bp->head; n != 0u; n = bq->nodes[n].next) {
+                    const double t = bq->nodes[n].rank_d64;
+                    tmin = (t < tmin) ? t : tmin;
+                    tmax = (t > tmax) ? t : tmax;
+                }
+
+                if (can_spread(tmin, tmax, bp->count)) {
+                    rung_spawn(bq, bp, tmin, tmax);
+                    continue;
+                }
+            }
+
+            list_to_bottom(bq, bp);
+            continue;
+        }
+
+        if (bq->top.head != 0u) {
+            /* Only the top left, start a new ladder from it */
+            bq->top_start = bq->top_max;
+            if ((bq->top.count > BUCKET_THRES)
+                && can_spread(bq->top_min, bq->top_max, bq->top.count)) {
+                rung_spawn(bq, &(bq->top), bq->top_min, bq->top_max);
+            }
+            else {
+                list_to_bottom(bq, &(bq->top));
+            }
+
+            bq->top_min = INFINITY;
+            bq->top_max = -INFINITY;
+            continue;
+        }
+
+        return false;
+    }
+}
+
+/*
+ * radix_key - The IEEE 754 bit pattern of the time, mapped to an unsigned
+ * integer with the same ordering: Negative values have all bits flipped,
+ * others only the sign bit. Negative zero counts as zero, as it compares
+ * equal to it.
+ */
+static uint64_t radix_key(const double t)
+{
+    cmb_assert_debug(!isnan(t));
+
+    const double tz = (t == 0.0) ? 0.0 : t;
+    uint64_t bits;
+    cmi_memcpy(&bits, &tz, sizeof(bits));
+
+    return ((bits >> 63u) != 0u) ? ~bits : (bits | (UINT64_C(1) << 63u));
+}
+
+/*
+ * radix_bucket - Bucket number for key u, one more than the highest bit where
+ * it differs from the last key dequeued, zero if equal.
+ */
+static unsigned radix_bucket(const struct cmi_bucketqueue *bq, const uint64_t u)
+{
+    cmb_assert_debug(bq != NULL);
+    cmb_assert_debug(u >= bq->radix_last);
+
+    const uint64_t diff = u ^ bq->radix_last;
+
+    return (diff == 0u) ? 0u : (64u - (unsigned)__builtin_clzll(diff));
+}
+
+/*
+ * radix_insert - Place node n in its radix bucket, or in the bottom list if it
+ * is within the range of keys currently there.
+ */
+static void radix_insert(struct cmi_bucketqueue *bq, const uint32_t n)
+{
+    cmb_assert_debug(bq != NULL);
+
+    const uint64_t u = radix_key(bq->nodes[n].rank_d64);
+    const bool in_bottom = (bq->bottom.head != 0u) ? (u <= bq->radix_bottom_max)
+                                                   : (u == bq->radix_last);
+    if (in_bottom) {
+        bq->radix_bottom_max = (u > bq->radix_bottom_max) ? u : bq->radix_bottom_max;
+        bottom_insert(bq, n);
+    }
+    else {
+        const unsigned b = radix_bucket(bq, u);
+        cmb_assert_debug(b > 0u);
+        list_push(bq->nodes, &(bq->radix[b - 1u]), n);
+        bq->radix_mask |= UINT64_C(1) << (b - 1u);
+    }
+}
+
+/*
+ * radix_prepare - Make sure the bottom list starts with a live node, if there
+ * is one anywhere. When the bottom runs dry, the lowest non-empty bucket is
+ * emptied: Its smallest key becomes the new last key. A small bucket is sorted
+ * into the bottom list as it is, since everything in it goes before anything
+ * in the higher buckets. A larger one has its nodes moved to strictly lower
+ * buckets relative to the new last key, the ones at that exact time sorted
+ * into the bottom list. Returns false if the queue holds no live nodes.
+ */
+static bool radix_prepare(struct cmi_bucketqueue *bq)
+{
+    cmb_assert_debug(bq != NULL);
+
+    struct cmi_bucket_node *nodes = bq->nodes;
+    for (;;) {
+        while (bq->bottom.head != 0u) {
+            const uint32_t n = bq->bottom.head;
+            if (node_is_live(bq, n)) {
+                return true;
+            }
+
+            (void)list_pop(nodes, &(bq->bottom));
+            node_free(bq, n);
+        }
+
+        if (bq->radix_mask == 0u) {
+            return false;
+        }
+
+        const unsigned bi = (unsigned)__builtin_ctzll(bq->radix_mask);
+        struct cmi_bucket_list *bp = &(bq->radix[bi]);
+        if (bp->count <= BUCKET_THRES) {
+            bq->radix_mask &= ~(UINT64_C(1) << bi);
+            list_to_bottom(bq, bp);
+            if (bq->bottom.head != 0u) {
+                bq->radix_last = radix_key(nodes[bq->bottom.head].rank_d64);
+                bq->radix_bottom_max = radix_key(nodes[bq->bottom.tail].rank_d64);
+            }
+
+            continue;
+        }
+
+        uint64_t umin = UINT64_MAX;
+        for (uint32_t n = bp->head; n != 0u; n = nodes[n].next) {
+            if (node_is_live(bq, n)) {
+                const uint64_t u = radix_key(nodes[n].rank_d64);
+                umin = (u < umin) ? u : umin;
+            }
+        }
+
+        uint32_t n = bp->head;
+        bp->head = 0u;
+        bp->tail = 0u;
+        bp->count = 0u;
+        bq->radix_mask &= ~(UINT64_C(1) << bi);
+        if (umin == UINT64_MAX) {
+            /* Nothing but stale nodes */
+            while (n != 0u) {
+                const uint32_t nxt = nodes[n].next;
+                node_free(bq, n);
+                n = nxt;
+            }
+
+            continue;
+        }
+
+        bq->radix_last = umin;
+        bq->radix_bottom_max = umin;
+        struct cmi_bucket_list now = { 0u, 0u, 0u };
+        while (n != 0u) {
+            const uint32_t nxt = nodes[n].next;
+            if (!node_is_live(bq, n)) {
+                node_free(bq, n);
+            }
+            else {
+                const unsigned b = radix_bucket(bq, radix_key(nodes[n].rank_d64));
+                cmb_assert_debug(b <= bi);
+                if (b == 0u) {
+                    list_push(nodes, &now, n);
+                }
+                else {
+                    list_push(nodes, &(bq->radix[b - 1u]), n);
+                    bq->radix_mask |= UINT64_C(1) << (b - 1u);
+                }
+            }
+
+            n = nxt;
+        }
+
+        list_to_bottom(bq, &now);
+    }
+}
+
+/*
+ * queue_insert, queue_prepare - Dispatch to the ladder or radix version.
+ */
+static void queue_insert(struct cmi_bucketqueue *bq, const uint32_t n)
+{
+    if (bq->strategy == CMI_BUCKETQUEUE_RADIX) {
+        radix_insert(bq, n);
+    }
+    else {
+        ladder_insert(bq, n);
+    }
+}
+
+static bool queue_prepare(struct cmi_bucketqueue *bq)
+{
+    if (bq->strategy == CMI_BUCKETQUEUE_RADIX) {
+        return radix_prepare(bq);
+    }
+
+    return ladder_prepare(bq);
+}
+
+/*
+ * bucket_enqueue - Insert an item with the given period, return its key.
+ */
+static uint64_t bucket_enqueue(struct cmi_bucketqueue *bq,
+                               void *pl1,
+                               void *pl2,
+                               void *pl3,
+                               void *pl4,
+                               const uint64_t hashkey,
+                               const double rank_d64,
+                               const int64_t rank_i64,
+                               const double period)
+{
+    cmb_assert_release(bq != NULL);
+    cmb_assert_release(bq->items != NULL);
+
+    const uint64_t key = (hashkey != 0u) ? hashkey : ++(bq->item_counter);
+
+    const uint64_t slot = item_alloc(bq);
+    struct cmi_bucket_item *itp = &(bq->items[slot]);
+    itp->item[0] = pl1;
+    itp->item[1] = pl2;
+    itp->item[2] = pl3;
+    itp->item[3] = pl4;
+    itp->hash_key = key;
+    itp->period = period;
+    hash_insert(bq, key, slot);
+    if (bq->subjects != NULL) {
+        cmi_subjectindex_insert(bq->subjects, pl2, slot);
+    }
+
+    const uint32_t n = node_alloc(bq);
+    struct cmi_bucket_node *np = &(bq->nodes[n]);
+    np->hash_key = key;
+    np->rank_d64 = rank_d64;
+    np->rank_i64 = rank_i64;
+    np->item_slot = (uint32_t)slot;
+    np->next = 0u;
+    bq->items[slot].node = n;
+    queue_insert(bq, n);
+    bq->count++;
+
+    return key;
+}
+
+/*
+ * cmi_bucketqueue_enqueue - Insert an item, return its key.
+ */
+uint64_t cmi_bucketqueue_enqueue(struct cmi_bucketqueue *bq,
+                                 void *pl1,
+                                 void *pl2,
+                                 void *pl3,
+                                 void *pl4,
+                                 const uint64_t hashkey,
+                                 const double rank_d64,
+                                 const int64_t rank_i64)
+{
+    return bucket_enqueue(bq, pl1, pl2, pl3, pl4, hashkey, rank_d64, rank_i64, 0.0);
+}
+
+/*
+ * cmi_bucketqueue_enqueue_recurring - Insert an item with a period.
+ */
+uint64_t cmi_bucketqueue_enqueue_recurring(struct cmi_bucketqueue *bq,
+                                           void *pl1,
+                                           void *pl2,
+                                           void *pl3,
+                                           void *pl4,
+                                           const uint64_t hashkey,
+                                           const double rank_d64,
+                                           const int64_t rank_i64,
+                                           const double period)
+{
+    return bucket_enqueue(bq, pl1, pl2, pl3, pl4, hashkey, rank_d64, rank_i64, period);
+}
+
+/*
+ * cmi_bucketqueue_dequeue - Remove the first item, return pointer to payload.
+ */
+void **cmi_bucketqueue_dequeue(struct cmi_bucketqueue *bq,
+                               struct cmi_bucket_node *last)
+{
+    cmb_assert_release(bq != NULL);
+
+    if (bq->count == 0u) {
+        return NULL;
+    }
+
+    if (bq->item_current != 0u) {
+        item_release(bq, bq->item_current);
+        bq->item_current = 0u;
+    }
+
+    const bool found = queue_prepare(bq);
+    cmb_assert_release(found);
+
+    const uint32_t n = list_pop(bq->nodes, &(bq->bottom));
+    const struct cmi_bucket_node *np = &(bq->nodes[n]);
+    if (last != NULL) {
+        *last = *np;
+    }
+
+    const uint64_t slot = np->item_slot;
+    struct cmi_bucket_item *itp = &(bq->items[slot]);
+    hash_delete(bq, itp->hash_index);
+    if (bq->subjects != NULL) {
+        cmi_subjectindex_erase(bq->subjects, itp->item[1], slot);
+    }
+
+    itp->node = 0u;
+    bq->item_current = slot;
+    node_free(bq, n);
+    bq->count--;
+
+    return itp->item;
+}
+
+/*
+ * cmi_bucketqueue_peek - The sort keys of the first item, NULL if empty.
+ */
+const struct cmi_bucket_node *cmi_bucketqueue_peek(struct cmi_bucketqueue *bq)
+{
+    cmb_assert_release(bq != NULL);
+
+    if ((bq->count == 0u) || !queue_prepare(bq)) {
+        return NULL;
+    }
+
+    return &(bq->nodes[bq->bottom.head]);
+}
+
+/*
+ * cmi_bucketqueue_remove - Remove the item, leaving its node behind as stale.
+ */
+bool cmi_bucketqueue_remove(struct cmi_bucketqueue *bq, const uint64_t hashkey)
+{
+    cmb_assert_release(bq != NULL);
+
+    if (bq->count == 0u) {
+        return false;
+    }
+
+    const uint64_t slot = cmi_bucketqueue_find_slot(bq, hashkey);
+    if (slot == 0u) {
+        return false;
+    }
+
+    hash_delete(bq, bq->items[slot].hash_index);
+    if (bq->subjects != NULL) {
+        cmi_subjectindex_erase(bq->subjects, bq->items[slot].item[1], slot);
+    }
+
+    item_release(bq, slot);
+    bq->count--;
+
+    return true;
+}
+
+/*
+ * cmi_bucketqueue_item - Pointer to the payload of the given item.
+ */
+void **cmi_bucketqueue_item(const struct cmi_bucketqueue *bq, const uint64_t hashkey)
+{
+    cmb_assert_release(bq != NULL);
+
+    const uint64_t slot = cmi_bucketqueue_find_slot(bq, hashkey);
+    cmb_assert_release(slot != 0u);
+
+    return bq->items[slot].item;
+}
+
+/*
+ * cmi_bucketqueue_drank - The rank_d64 of the given item.
+ */
+double cmi_bucketqueue_drank(const struct cmi_bucketqueue *bq, const uint64_t hashkey)
+{
+    cmb_assert_release(bq != NULL);
+
+    const uint64_t slot = cmi_bucketqueue_find_slot(bq, hashkey);
+    cmb_assert_release(slot != 0u);
+
+    return cmi_bucketqueue_node_at(bq, slot)->rank_d64;
+}
+
+/*
+ * cmi_bucketqueue_irank - The rank_i64 of the given item.
+ */
+int64_t cmi_bucketqueue_irank(const struct cmi_bucketqueue *bq, const uint64_t hashkey)
+{
+    cmb_assert_release(bq != NULL);
+
+    const uint64_t slot = cmi_bucketqueue_find_slot(bq, hashkey);
+    cmb_assert_release(slot != 0u);
+
+    return cmi_bucketqueue_node_at(bq, slot)->rank_i64;
+}
+
+/*
+ * cmi_bucketqueue_reprioritize - Give the item a new node with the new sort
+ * keys, making the old one stale.
+ */
+void cmi_bucketqueue_reprioritize(struct cmi_bucketqueue *bq,
+                                  const uint64_t hashkey,
+                                  const double drank,
+                                  const int64_t irank)
+{
+    cmb_assert_release(bq != NULL);
+
+    const uint64_t slot = cmi_bucketqueue_find_slot(bq, hashkey);
+    cmb_assert_release(slot != 0u);
+
+    const uint32_t n = node_alloc(bq);
+    struct cmi_bucket_node *np = &(bq->nodes[n]);
+    np->hash_key = hashkey;
+    np->rank_d64 = drank;
+    np->rank_i64 = irank;
+    np->item_slot = (uint32_t)slot;
+    np->next = 0u;
+    bq->items[slot].node = n;
+    queue_insert(bq, n);
+}
+
+/*
+ * item_match - Wildcard search helper, as in the hashheap.
+ */
+static bool item_match(const struct cmi_bucket_item *itp,
+                       const void *val1,
+                       const void *val2,
+                       const void *val3,
+                       const void *val4)
+{
+    cmb_assert_debug(itp != NULL);
+
+    bool ret = true;
+    if ( ((val1 != itp->item[0]) && (val1 != CMI_ANY_ITEM))
+      || ((val2 != itp->item[1]) && (val2 != CMI_ANY_ITEM))
+      || ((val3 != itp->item[2]) && (val3 != CMI_ANY_ITEM))
+      || ((val4 != itp->item[3]) && (val4 != CMI_ANY_ITEM))) {
+        ret = false;
+    }
+
+    return ret;
+}
+
+/*
+ * cmi_bucketqueue_pattern_find - Linear search over the item slots for a
+ * matching item, returning its key, zero if none.
+ */
+uint64_t cmi_bucketqueue_pattern_find(const struct cmi_bucketqueue *bq,
+                                      const void *val1,
+                                      const void *val2,
+                                      const void *val3,
+                                      const void *val4)
+{
+    cmb_assert_debug(bq != NULL);
+
+    if (bq->count == 0u) {
+        return 0u;
+    }
+
+    if ((bq->subjects != NULL) && (val2 != CMI_ANY_ITEM)) {
+        for (uint64_t slot = cmi_subjectindex_first(bq->subjects, val2);
+             slot != 0u;
+             slot = cmi_subjectindex_next(bq->subjects, slot)) {
+            const struct cmi_bucket_item *itp = &(bq->items[slot]);
+            if (item_match(itp, val1, val2, val3, val4)) {
+                return itp->hash_key;
+            }
+        }
+
+        return 0u;
+    }
+
+    for (uint64_t slot = 1u; slot <= bq->item_top; slot++) {
+        const struct cmi_bucket_item *itp = &(bq->items[slot]);
+        if ((itp->node != 0u) && item_match(itp, val1, val2, val3, val4)) {
+            return itp->hash_key;
+        }
+    }
+
+    return 0u;
+}
+
+/*
+ * cmi_bucketqueue_pattern_count - Count the matching items.
+ */
+uint64_t cmi_bucketqueue_pattern_count(const struct cmi_bucketqueue *bq,
+                                       const void *val1,
+                                       const void *val2,
+                                       const void *val3,
+                                       const void *val4)
+{
+    cmb_assert_debug(bq != NULL);
+
+    if (bq->count == 0u) {
+        return 0u;
+    }
+
+    uint64_t cnt = 0u;
+    if ((bq->subjects != NULL) && (val2 != CMI_ANY_ITEM)) {
+        for (uint64_t slot = cmi_subjectindex_first(bq->subjects, val2);
+             slot != 0u;
+             slot = cmi_subjectindex_next(bq->subjects, slot)) {
+            if (item_match(&(bq->items[slot]), val1, val2, val3, val4)) {
+                cnt++;
+            }
+        }
+
+        return cnt;
+    }
+
+    for (uint64_t slot = 1u; slot <= bq->item_top; slot++) {
+        const struct cmi_bucket_item *itp = &(bq->items[slot]);
+        if ((itp->node != 0u) && item_match(itp, val1, val2, val3, val4)) {
+            cnt++;
+        }
+    }
+
+    return cnt;
+}
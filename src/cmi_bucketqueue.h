@@ -0,0 +1,352 @@
+/*
+ * cmi_bucketqueue.h - A bucket-based priority queue with the same item and
+ * handle semantics as the hashheap, but specialized for the event ordering:
+ * lower rank_d64 (time) first, then higher rank_i64 (priority), then lower
+ * hash_key (FIFO), and for monotone use, where nothing is ever enqueued
+ * earlier than the most recently dequeued item.
+ *
+ * The items are kept in buckets by time in a ladder queue (Tang, Goh & Thng,
+ * ACM TOMACS 2005): An unsorted top list for the far future, a few rungs of
+ * buckets spawned on demand, each rung subdividing one bucket of the rung
+ * above, and a short sorted bottom list that items are dequeued from. Only the
+ * bottom is ever sorted, and only a bucket's worth of items at a time, giving
+ * amortized O(1) enqueue and dequeue for large queues where the hashheap is
+ * O(log n). For small queues, the hashheap is faster.
+ *
+ * Alternatively, the items are kept in a radix heap (Ahuja et al. 1990) of 64
+ * buckets by the highest bit where the time differs from the last dequeued,
+ * with the times as 64-bit integers from their IEEE 754 bit patterns. Each
+ * item is redistributed at most 64 times on its way to the bottom list.
+ *
+ * The payloads live in a stable item array as in the hashheap, found from the
+ * hash_key through a hash map. Cancellation and reprioritization are lazy: The
+ * item slot points to its current node, and any other node pointing to the
+ * same slot is stale, to be discarded when it reaches the bottom. Hence, the
+ * node array may temporarily hold more nodes than there are items in queue.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CIMBA_CMI_BUCKETQUEUE_H
+#define CIMBA_CMI_BUCKETQUEUE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "cmb_assert.h"
+
+#include "cmi_hashheap.h"
+
+/*
+ * struct cmi_bucket_node - The sort keys of an item, linked into one of the
+ * top, rung bucket, or bottom lists. Nodes are referenced by their index in
+ * the node array, zero meaning none. 4 * 8 = 32 bytes, two to a cache line.
+ */
+struct cmi_bucket_node {
+    uint64_t hash_key;      /* The unique handle/ID, sorting tiebreaker */
+    double   rank_d64;      /* Primary sort, time */
+    int64_t  rank_i64;      /* Secondary sort, priority */
+    uint32_t item_slot;     /* Position of the payload in the item array */
+    uint32_t next;          /* Next node in the same list */
+};
+
+/*
+ * struct cmi_bucket_item - The payload of an item, staying in the same slot
+ * from enqueue until the next dequeue after its own. The node index is zero
+ * once the item has left the queue, 8 * 8 = 64 bytes, one cache line.
+ */
+struct cmi_bucket_item {
+    void    *item[4];       /* The actual payload items */
+    uint64_t hash_key;      /* The unique handle/ID, zero if slot is free */
+    uint64_t node;          /* Current node, any others for this slot are stale */
+    uint64_t hash_index;    /* Position in the hash map */
+    union {
+        uint64_t next_free; /* Next slot in the free list, if free */
+        double period;      /* Recurrence interval, if in use, as in the hashheap */
+    };
+};
+
+/*
+ * struct cmi_bucket_list - A bucket, or the top or bottom list, as an unsorted
+ * (bottom: sorted) singly linked list of nodes.
+ */
+struct cmi_bucket_list {
+    uint32_t head;
+    uint32_t tail;
+    uint64_t count;         /* Number of nodes, including any stale ones */
+};
+
+/*
+ * struct cmi_bucket_rung - One rung of the ladder, bucket_count buckets of
+ * equal width starting from start. Buckets before current have already been
+ * passed on downwards. The bucket array keeps its capacity between uses.
+ */
+struct cmi_bucket_rung {
+    struct cmi_bucket_list *buckets;
+    uint64_t bucket_count;
+    uint64_t bucket_cap;
+    uint64_t current;
+    double start;
+    double width;
+};
+
+/* The maximum number of rungs before the bottom list is left to grow */
+#define CMI_BUCKETQUEUE_RUNGS 8u
+
+/* The bucketing strategies, chosen at initialization */
+enum cmi_bucketqueue_strategy {
+    CMI_BUCKETQUEUE_LADDER = 0,
+    CMI_BUCKETQUEUE_RADIX
+};
+
+/*
+ * struct cmi_bucketqueue - The control structure. item_size is the number of
+ * slots in the item array, hash_size twice that, both powers of two.
+ */
+struct cmi_bucketqueue {
+    struct cmi_bucket_node *nodes;
+    struct cmi_bucket_item *items;
+    struct cmi_hash_tag *hash_map;
+    struct cmi_subjectindex *subjects;  /* Index by item[1], if asked for */
+    uint64_t node_size;     /* Allocated nodes */
+    uint64_t node_top;      /* Highest node used so far */
+    uint64_t node_free;     /* First node in the free list, zero if none */
+    uint64_t item_size;     /* Allocated item slots */
+    uint64_t item_top;      /* Highest item slot used so far */
+    uint64_t item_free;     /* First slot in the free list, zero if none */
+    uint64_t item_current;  /* Slot of the most recently dequeued item */
+    uint64_t hash_size;     /* Allocated hash map entries */
+    uint16_t hash_exp;      /* hash_size is 2^hash_exp */
+    uint64_t count;         /* Current number of (live) items */
+    uint64_t item_counter;  /* Running counter for issuing keys */
+    struct cmi_bucket_list top;
+    double top_start;       /* Items later than this go into top */
+    double top_min;
+    double top_max;
+    struct cmi_bucket_rung rungs[CMI_BUCKETQUEUE_RUNGS];
+    unsigned rung_count;
+    struct cmi_bucket_list bottom;
+    struct cmi_bucket_list radix[64];   /* Radix buckets 1 to 64, bottom is 0 */
+    uint64_t radix_mask;    /* Bit b - 1 set if radix bucket b is non-empty */
+    uint64_t radix_last;    /* Radix key the buckets are relative to */
+    uint64_t radix_bottom_max;  /* Highest radix key in the bottom list */
+    enum cmi_bucketqueue_strategy strategy;
+};
+
+/*
+ * cmi_bucketqueue_create - Allocate memory for a new bucket queue.
+ * Initializes the pointers to NULL, call cmi_bucketqueue_initialize next.
+ */
+extern struct cmi_bucketqueue *cmi_bucketqueue_create(void);
+
+/*
+ * cmi_bucketqueue_initialize - Allocate the initial arrays, 2^iexp item slots
+ * and as many nodes, 2^(iexp + 1) hash map entries, using the given strategy.
+ */
+extern void cmi_bucketqueue_initialize(struct cmi_bucketqueue *bq,
+                                       uint16_t iexp,
+                                       enum cmi_bucketqueue_strategy strategy);
+
+/*
+ * cmi_bucketqueue_index_subjects - Start keeping a secondary index from the
+ * second payload value, item[1], to the items holding it, for pattern find and
+ * count with a given val2, as with CMI_HASHHEAP_SUBJECT_INDEX for the hashheap.
+ * Indexes any items already in the queue.
+ */
+extern void cmi_bucketqueue_index_subjects(struct cmi_bucketqueue *bq);
+
+/*
+ * cmi_bucketqueue_clear - Empties the queue, keeping its capacity and the
+ * item counter for issuing new keys.
+ */
+extern void cmi_bucketqueue_clear(struct cmi_bucketqueue *bq);
+
+/*
+ * cmi_bucketqueue_terminate - Return the queue to a newly created state,
+ * freeing any allocated memory.
+ */
+extern void cmi_bucketqueue_terminate(struct cmi_bucketqueue *bq);
+
+/*
+ * cmi_bucketqueue_destroy - Free the queue, including *bq itself.
+ */
+extern void cmi_bucketqueue_destroy(struct cmi_bucketqueue *bq);
+
+/*
+ * cmi_bucketqueue_enqueue - Insert an item (pl1, pl2, pl3, pl4) with the
+ * priority keys rank_d64 and rank_i64. rank_d64 may not be earlier than the
+ * most recently dequeued item. If hashkey is zero, a new key is generated,
+ * otherwise the given one is used. Returns the key, non-zero.
+ */
+extern uint64_t cmi_bucketqueue_enqueue(struct cmi_bucketqueue *bq,
+                                        void *pl1,
+                                        void *pl2,
+                                        void *pl3,
+                                        void *pl4,
+                                        uint64_t hashkey,
+                                        double rank_d64,
+                                        int64_t rank_i64);
+
+/*
+ * cmi_bucketqueue_enqueue_recurring - As cmi_bucketqueue_enqueue, also setting
+ * the period of the new item, see struct cmi_bucket_item.
+ */
+extern uint64_t cmi_bucketqueue_enqueue_recurring(struct cmi_bucketqueue *bq,
+                                                  void *pl1,
+                                                  void *pl2,
+                                                  void *pl3,
+                                                  void *pl4,
+                                                  uint64_t hashkey,
+                                                  double rank_d64,
+                                                  int64_t rank_i64,
+                                                  double period);
+
+/*
+ * cmi_bucketqueue_dequeue - Remove the first item and return a pointer to its
+ * payload. Its sort keys are copied to *last. Both stay valid until the next
+ * dequeue, but the payload may move if an enqueue grows the item array.
+ */
+extern void **cmi_bucketqueue_dequeue(struct cmi_bucketqueue *bq,
+                                      struct cmi_bucket_node *last);
+
+/*
+ * cmi_bucketqueue_peek - Return a pointer to the sort keys of the first item,
+ * NULL if the queue is empty. May restructure the queue to find it.
+ */
+extern const struct cmi_bucket_node *cmi_bucketqueue_peek(struct cmi_bucketqueue *bq);
+
+/*
+ * cmi_bucketqueue_count - Returns the number of items currently in the queue.
+ */
+CMB_MAYBE_UNUSED
+static inline uint64_t cmi_bucketqueue_count(const struct cmi_bucketqueue *bq)
+{
+    cmb_assert_release(bq != NULL);
+
+    return bq->count;
+}
+
+/*
+ * cmi_bucketqueue_find_slot - Look up the item slot for a given key, zero if
+ * not in the queue.
+ */
+extern uint64_t cmi_bucketqueue_find_slot(const struct cmi_bucketqueue *bq,
+                                          uint64_t hashkey);
+
+/*
+ * cmi_bucketqueue_is_enqueued - Is the given item currently in the queue?
+ */
+CMB_MAYBE_UNUSED
+static inline bool cmi_bucketqueue_is_enqueued(const struct cmi_bucketqueue *bq,
+                                               const uint64_t hashkey)
+{
+    cmb_assert_release(bq != NULL);
+    cmb_assert_debug(hashkey != 0u);
+
+    if (bq->count == 0u) {
+        return false;
+    }
+    else {
+        return (cmi_bucketqueue_find_slot(bq, hashkey) != 0u);
+    }
+}
+
+/*
+ * cmi_bucketqueue_item_at - Returns a pointer to the payload in the given item
+ * slot, for iterating over all items in the queue together with
+ * cmi_bucketqueue_slot_is_live, 1 <= slot <= item_top.
+ */
+CMB_MAYBE_UNUSED
+static inline void **cmi_bucketqueue_item_at(const struct cmi_bucketqueue *bq,
+                                             const uint64_t slot)
+{
+    cmb_assert_debug(bq != NULL);
+    cmb_assert_debug((slot > 0u) && (slot <= bq->item_top));
+
+    return bq->items[slot].item;
+}
+
+/*
+ * cmi_bucketqueue_slot_is_live - Does the given item slot hold an item that is
+ * currently in the queue?
+ */
+CMB_MAYBE_UNUSED
+static inline bool cmi_bucketqueue_slot_is_live(const struct cmi_bucketqueue *bq,
+                                                const uint64_t slot)
+{
+    cmb_assert_debug(bq != NULL);
+    cmb_assert_debug((slot > 0u) && (slot <= bq->item_top));
+
+    return (bq->items[slot].node != 0u);
+}
+
+/*
+ * cmi_bucketqueue_item - Return a pointer to the payload of the given item.
+ * Precondition: The item is in the queue.
+ */
+extern void **cmi_bucketqueue_item(const struct cmi_bucketqueue *bq, uint64_t hashkey);
+
+/*
+ * cmi_bucketqueue_key/drank/irank - Get the sort keys for the given item slot
+ * or item. Precondition: The item is in the queue.
+ */
+CMB_MAYBE_UNUSED
+static inline const struct cmi_bucket_node *cmi_bucketqueue_node_at(
+                                                const struct cmi_bucketqueue *bq,
+                                                const uint64_t slot)
+{
+    cmb_assert_debug(cmi_bucketqueue_slot_is_live(bq, slot));
+
+    return &(bq->nodes[bq->items[slot].node]);
+}
+
+extern double cmi_bucketqueue_drank(const struct cmi_bucketqueue *bq,
+                                    uint64_t hashkey);
+extern int64_t cmi_bucketqueue_irank(const struct cmi_bucketqueue *bq,
+                                     uint64_t hashkey);
+
+/*
+ * cmi_bucketqueue_reprioritize - Change the sort keys of the given item.
+ * Precondition: The item is in the queue, drank not before the last dequeue.
+ */
+extern void cmi_bucketqueue_reprioritize(struct cmi_bucketqueue *bq,
+                                         uint64_t hashkey,
+                                         double drank,
+                                         int64_t irank);
+
+/*
+ * cmi_bucketqueue_remove - Remove the item from the queue. Returns true if
+ * found (and removed), false if not in the queue.
+ */
+extern bool cmi_bucketqueue_remove(struct cmi_bucketqueue *bq, uint64_t hashkey);
+
+/*
+ * cmi_bucketqueue_pattern_find/count - As for the hashheap, CMI_ANY_ITEM is a
+ * wildcard. The search order is unspecified.
+ */
+extern uint64_t cmi_bucketqueue_pattern_find(const struct cmi_bucketqueue *bq,
+                                             const void *val1,
+                                             const void *val2,
+                                             const void *val3,
+                                             const void *val4);
+
+extern uint64_t cmi_bucketqueue_pattern_count(const struct cmi_bucketqueue *bq,
+                                              const void *val1,
+                                              const void *val2,
+                                              const void *val3,
+                                              const void *val4);
+
+#endif /* CIMBA_CMI_BUCKETQUEUE_H */
@@ -17,16 +17,29 @@
  */
 
 #include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "cmb_assert.h"
 #include "cmi_coroutine.h"
+#include "cmi_arena.h"
 #include "cmi_config.h"
 #include "cmi_mempool.h"
 #include "cmi_memutils.h"
+#include "cmi_profiler.h"
 #include "cmi_sanitizer.h"
+#include "cmi_snapshot.h"
 #include "cmi_thread.h"
+#include "cmi_trace.h"
+
+/* The pattern for measuring stack use, unlikely to be written by chance */
+#define STACK_PAINT UINT64_C(0x5CA1AB1E5CA1AB1E)
+
+/* Global settings, take new stacks from reserved slabs rather than the heap,
+ * and keep no more than this many bytes of recycled stacks in each thread */
+static bool stack_slabs = false;
+static size_t stack_retention = CMI_COROUTINE_STACK_RETENTION;
 
 /* The main and current coroutine pointers */
 static CMB_THREAD_LOCAL struct cmi_coroutine *coroutine_main = NULL;
@@ -43,9 +56,35 @@ static CMB_THREAD_LOCAL struct cmi_coroutine coroutine_main_storage;
 /* Registry of active coroutines to ensure that all get freed even on error */
 static CMB_THREAD_LOCAL struct cmi_coroutine *coroutine_registry = NULL;
 
+/*
+ * struct shared_stack - The stack shared by the shared stack coroutines of
+ * this thread, the one of them currently on it, and where the relay coroutine
+ * is to take it next, with what message.
+ */
+struct shared_stack {
+    unsigned char *raw;
+    unsigned char *base;
+    unsigned char *limit;
+    struct cmi_coroutine *owner;
+    struct cmi_coroutine *relay_to;
+    void *relay_msg;
+};
+
+static CMB_THREAD_LOCAL struct shared_stack shared_stack = { NULL, NULL, NULL, NULL, NULL, NULL };
+
+/* The relay, on a stack of its own, swapping the shared stack contents when
+ * one shared stack coroutine transfers directly to another */
+static CMB_THREAD_LOCAL struct cmi_coroutine shared_relay;
+
 /* Assembly function, see src/port/x86-64/Linux/cmi_coroutine_context_*.asm */
 extern void *cmi_coroutine_context_switch(void **old, void **new, void *ret);
 
+/* Forward declarations */
+static void shared_take(struct cmi_coroutine *to);
+static inline void *coroutine_switch(struct cmi_coroutine *from,
+                                     struct cmi_coroutine *to,
+                                     void *msg);
+
 /* OS-specific C code, see src/arch/cmi_coroutine_context_*.c */
 
 /* Stack sanity check for use in asserts */
@@ -56,16 +95,21 @@ extern bool cmi_coroutine_registers_valid(const struct cmi_coroutine *cp);
 extern void cmi_coroutine_context_init(struct cmi_coroutine *cp);
 /* Get the stack base pointer (top of stack, grows downwards) */
 extern unsigned char *cmi_coroutine_stackbase(void);
+/* Add the recycled stack lists to a snapshot */
+extern void cmi_coroutine_stack_snapshot_regions(struct cmb_snapshot *sp);
 /* Get the stack limit pointer (bottom of stack) */
 extern unsigned char *cmi_coroutine_stacklimit(void);
 /* Get the raw memory address of the stack bottom */
 extern unsigned char *cmi_coroutine_stackraw(void);
 /* Allocate memory suitable for a stack */
 extern unsigned char *cmi_coroutine_stack_alloc(size_t size_req,
+                                                bool slab,
                                                 unsigned char **base,
                                                 unsigned char **limit);
 /* Free memory previously allocated for a stack */
-extern void cmi_coroutine_stack_free(unsigned char *stack_raw, size_t size);
+extern void cmi_coroutine_stack_free(unsigned char *stack_raw, size_t size, bool slab);
+/* Fill the stack pool with at least n stacks of the size */
+extern void cmi_coroutine_stack_prewarm(uint64_t n, size_t size_req, bool slab);
 /* Clean up any system-specific stack pool allocations */
 extern void cmi_coroutine_stack_cleanup(void);
 
@@ -102,6 +146,19 @@ static void coroutine_registry_remove(struct cmi_coroutine *cp)
     }
 }
 
+/*
+ * coroutine_stack_ready - Valid stack, or on the shared stack but not yet
+ * there for the first time
+ */
+static bool coroutine_stack_ready(const struct cmi_coroutine *cp)
+{
+    if (cp->stack_shared && (cp->stack_pointer == NULL)) {
+        return true;
+    }
+
+    return cmi_coroutine_stack_valid(cp);
+}
+
 /*
  * create_main - Helper function to set up the dummy main coroutine
  */
@@ -169,8 +226,16 @@ void cmi_coroutine_initialize(struct cmi_coroutine *cp,
     if (stack_size == 0u) {
         stack_size = CMI_COROUTINE_DEFAULT_STACKSIZE;
     }
-    cp->stack = cmi_coroutine_stack_alloc(stack_size, &(cp->stack_base), &(cp->stack_limit));
+    /* Not from slabs in the snapshot arena, where the stacks must be copyable */
+    cp->stack_slab = __atomic_load_n(&stack_slabs, __ATOMIC_RELAXED) && !cmi_arena.on;
+    cp->stack = cmi_coroutine_stack_alloc(stack_size, cp->stack_slab,
+                                          &(cp->stack_base), &(cp->stack_limit));
     cp->stack_size = stack_size;
+    cp->stack_painted = false;
+    cp->stack_shared = false;
+    cp->saved = NULL;
+    cp->saved_len = 0u;
+    cp->saved_cap = 0u;
     /* Will be set on first transfer */
     cp->stack_pointer = NULL;
 
@@ -184,6 +249,167 @@ void cmi_coroutine_initialize(struct cmi_coroutine *cp,
     coroutine_registry_add(cp);
 }
 
+/*
+ * shared_relay_loop - The relay coroutine function. Entered from a shared stack
+ * coroutine that has just switched out, it puts the next one on the shared
+ * stack and switches to it, then waits for the next time.
+ */
+static void *shared_relay_loop(struct cmi_coroutine *cp, void *context)
+{
+    cmb_unused(context);
+
+    while (true) {
+        struct cmi_coroutine *to = shared_stack.relay_to;
+        shared_take(to);
+        (void)coroutine_switch(cp, to, shared_stack.relay_msg);
+    }
+
+    /* Not reached */
+    return NULL;
+}
+
+/*
+ * shared_open - Allocate the shared stack of this thread and start up the
+ * relay coroutine, switched out and ready at the top of its loop.
+ */
+static void shared_open(void)
+{
+    cmb_assert_debug(shared_stack.raw == NULL);
+
+    shared_stack.raw = cmi_coroutine_stack_alloc(CMI_COROUTINE_SHARED_STACKSIZE, false,
+                                                 &(shared_stack.base),
+                                                 &(shared_stack.limit));
+    shared_stack.owner = NULL;
+
+    struct cmi_coroutine *rp = &shared_relay;
+    cmi_memset(rp, 0, sizeof(*rp));
+    rp->stack = cmi_coroutine_stack_alloc(CMI_COROUTINE_DEFAULT_STACKSIZE, false,
+                                          &(rp->stack_base), &(rp->stack_limit));
+    rp->stack_size = CMI_COROUTINE_DEFAULT_STACKSIZE;
+    rp->cr_function = shared_relay_loop;
+    rp->tsan_fiber = cmi_tsan_create_fiber();
+    cmi_coroutine_context_init(rp);
+    rp->status = CMI_COROUTINE_RUNNING;
+}
+
+/*
+ * shared_close - Free the shared stack and the relay, for thread cleanup
+ */
+static void shared_close(void)
+{
+    if (shared_stack.raw != NULL) {
+        cmi_coroutine_stack_free(shared_stack.raw, CMI_COROUTINE_SHARED_STACKSIZE, false);
+        cmi_coroutine_stack_free(shared_relay.stack, shared_relay.stack_size, false);
+        cmi_tsan_destroy_fiber(shared_relay.tsan_fiber);
+        cmi_memset(&shared_relay, 0, sizeof(shared_relay));
+        cmi_memset(&shared_stack, 0, sizeof(shared_stack));
+    }
+}
+
+/*
+ * shared_take - Copy the live part of the stack of the coroutine on the shared
+ * stack out to its buffer, and put the coroutine to on it instead, either its
+ * saved stack or a first stack frame if it has not run yet. Cannot be called
+ * from the shared stack itself.
+ */
+static void shared_take(struct cmi_coroutine *to)
+{
+    cmb_assert_debug(to->stack_shared);
+    cmb_assert_debug(!coroutine_current->stack_shared || (coroutine_current == to));
+
+    /* The frames of any coroutine that was on it may have left ASan redzones
+     * anywhere in it, not just in the part about to be copied */
+    cmi_asan_unpoison(shared_stack.limit,
+                      (size_t)(shared_stack.base - shared_stack.limit));
+
+    struct cmi_coroutine *owner = shared_stack.owner;
+    if ((owner != NULL) && (owner->status == CMI_COROUTINE_RUNNING)) {
+        const size_t len = (size_t)(owner->stack_base - owner->stack_pointer);
+        if (len > owner->saved_cap) {
+            owner->saved_cap = (len + 255u) & ~(size_t)255u;
+            owner->saved = cmi_realloc(owner->saved, owner->saved_cap);
+        }
+
+        cmi_memcpy(owner->saved, owner->stack_pointer, len);
+        owner->saved_len = len;
+    }
+
+    if (to->stack_pointer == NULL) {
+        cmi_coroutine_context_init(to);
+    }
+    else {
+        cmi_memcpy(to->stack_pointer, to->saved, to->saved_len);
+    }
+
+    shared_stack.owner = to;
+}
+
+/*
+ * cmi_coroutine_initialize_shared - The same as cmi_coroutine_initialize, but
+ * on the shared stack of the thread.
+ */
+void cmi_coroutine_initialize_shared(struct cmi_coroutine *cp,
+                                     cmi_coroutine_func *crfunction,
+                                     void *context,
+                                     cmi_coroutine_exit_func *crexit)
+{
+    cmb_assert_debug(cp != NULL);
+    cmb_assert_debug(crfunction != NULL);
+
+    if (coroutine_main == NULL) {
+        create_main();
+        cmb_assert_debug(coroutine_main != NULL);
+        cmb_assert_debug(coroutine_current == coroutine_main);
+    }
+
+    if (shared_stack.raw == NULL) {
+        shared_open();
+    }
+
+    cp->parent = NULL;
+    cp->caller = NULL;
+    cp->stack = shared_stack.raw;
+    cp->stack_base = shared_stack.base;
+    cp->stack_limit = shared_stack.limit;
+    cp->stack_size = CMI_COROUTINE_SHARED_STACKSIZE;
+    cp->stack_painted = false;
+    cp->stack_slab = false;
+    cp->stack_shared = true;
+    cp->saved = NULL;
+    cp->saved_len = 0u;
+    cp->saved_cap = 0u;
+    /* Set when it first goes on the shared stack */
+    cp->stack_pointer = NULL;
+
+    cp->status = CMI_COROUTINE_INITIALIZED;
+    cp->cr_function = crfunction;
+    cp->context = context;
+    cp->cr_exit = crexit;
+    cp->exit_value = NULL;
+    cp->tsan_fiber = cmi_tsan_create_fiber();
+
+    coroutine_registry_add(cp);
+}
+
+/*
+ * shared_drop - Let go of the shared stack and the saved copy
+ */
+static void shared_drop(struct cmi_coroutine *cp)
+{
+    cmb_assert_debug(cp->stack_shared);
+
+    if (shared_stack.owner == cp) {
+        shared_stack.owner = NULL;
+    }
+
+    if (cp->saved != NULL) {
+        cmi_free(cp->saved);
+        cp->saved = NULL;
+        cp->saved_len = 0u;
+        cp->saved_cap = 0u;
+    }
+}
+
 /*
  * cmi_coroutine_reset - Reset the coroutine to the initial state.
  * Can be restarted from the beginning by calling cmi_coroutine_start.
@@ -216,7 +442,12 @@ void cmi_coroutine_terminate(struct cmi_coroutine *cp)
     cmb_assert_debug(cp->stack != NULL);
     coroutine_registry_remove(cp);
     cmi_tsan_destroy_fiber(cp->tsan_fiber);
-    cmi_coroutine_stack_free(cp->stack, cp->stack_size);
+    if (cp->stack_shared) {
+        shared_drop(cp);
+    }
+    else {
+        cmi_coroutine_stack_free(cp->stack, cp->stack_size, cp->stack_slab);
+    }
 
     /* Preserve the pool allocation status for any thread cleanup handling */
     const bool pool_allocated = cp->pool_allocated;
@@ -227,6 +458,103 @@ void cmi_coroutine_terminate(struct cmi_coroutine *cp)
     cp->status = CMI_COROUTINE_UNINITIALIZED;
 }
 
+/*
+ * cmi_coroutine_stack_slabs - get global variable for all future inits
+ */
+bool cmi_coroutine_stack_slabs(void)
+{
+    const bool on = __atomic_load_n(&stack_slabs, __ATOMIC_RELAXED);
+
+    return on;
+}
+
+/*
+ * cmi_coroutine_stack_slabs_set - set global variable for all future inits
+ */
+void cmi_coroutine_stack_slabs_set(const bool on)
+{
+    __atomic_store_n(&stack_slabs, on, __ATOMIC_RELAXED);
+}
+
+/*
+ * cmi_coroutine_stack_retention - get global variable for all threads
+ */
+size_t cmi_coroutine_stack_retention(void)
+{
+    const size_t cap = __atomic_load_n(&stack_retention, __ATOMIC_RELAXED);
+
+    return cap;
+}
+
+/*
+ * cmi_coroutine_stack_retention_set - set global variable for all threads
+ */
+void cmi_coroutine_stack_retention_set(const size_t cap)
+{
+    __atomic_store_n(&stack_retention, cap, __ATOMIC_RELAXED);
+}
+
+/*
+ * cmi_coroutine_stacks_prewarm - Allocate the stacks the way
+ * cmi_coroutine_initialize would, and put them in the pool.
+ */
+void cmi_coroutine_stacks_prewarm(const uint64_t n, size_t stack_size)
+{
+    cmb_assert_release(n > 0u);
+
+    if (stack_size == 0u) {
+        stack_size = CMI_COROUTINE_DEFAULT_STACKSIZE;
+    }
+
+    const bool slab = __atomic_load_n(&stack_slabs, __ATOMIC_RELAXED) && !cmi_arena.on;
+    cmi_coroutine_stack_prewarm(n, stack_size, slab);
+}
+
+/*
+ * cmi_coroutine_stack_paint - Fill the usable stack with the pattern, whole
+ * words from the limit up to the base. Touches every page of the stack, so
+ * only worth it while measuring.
+ */
+void cmi_coroutine_stack_paint(struct cmi_coroutine *cp)
+{
+    cmb_assert_release(cp != NULL);
+    cmb_assert_release(cp->status == CMI_COROUTINE_INITIALIZED);
+    cmb_assert_release(!cp->stack_shared);
+    cmb_assert_debug(cp->stack_limit != NULL);
+    cmb_assert_debug(((uintptr_t)cp->stack_limit % sizeof(uint64_t)) == 0u);
+
+    uint64_t *wp = (uint64_t *)cp->stack_limit;
+    const uint64_t *endp = (uint64_t *)((uintptr_t)cp->stack_base & ~(uintptr_t)(sizeof(uint64_t) - 1u));
+    while (wp < endp) {
+        *wp++ = STACK_PAINT;
+    }
+
+    cp->stack_painted = true;
+}
+
+/*
+ * cmi_coroutine_stack_peak - Scan up from the limit for the first word that has
+ * been overwritten. Anything the coroutine wrote that happens to match the
+ * pattern could make it look a word or two shallower than it was, no more.
+ */
+size_t cmi_coroutine_stack_peak(const struct cmi_coroutine *cp)
+{
+    cmb_assert_release(cp != NULL);
+    cmb_assert_release(cp->stack_painted);
+    cmb_assert_debug(cp != coroutine_current);
+
+    /* ASan may have left redzones of old frames poisoned */
+    cmi_asan_unpoison(cp->stack_limit, (size_t)(cp->stack_base - cp->stack_limit));
+
+    const uint64_t *wp = (uint64_t *)cp->stack_limit;
+    const uint64_t *endp = (uint64_t *)((uintptr_t)cp->stack_base & ~(uintptr_t)(sizeof(uint64_t) - 1u));
+    while ((wp < endp) && (*wp == STACK_PAINT)) {
+        wp++;
+    }
+
+    return (size_t)(cp->stack_base - (const unsigned char *)wp);
+}
+
 /*
  * cmi_coroutine_destroy - Free memory allocated for a coroutine.
  * The given coroutine cannot be main or the currently executing coroutine.
@@ -257,9 +585,20 @@ void *cmi_coroutine_start(struct cmi_coroutine *cp, void *msg)
     cmb_assert_release(cp->status != CMI_COROUTINE_RUNNING);
     cmb_assert_debug(coroutine_current != NULL);
 
-    /* Prepare the stack for launching the coroutine function */
-    cmi_coroutine_context_init(cp);
-    cmb_assert_debug(cmi_coroutine_stack_valid(cp));
+    /* Prepare the stack for launching the coroutine function, on the shared
+     * stack not until it goes there */
+    if (cp->stack_shared) {
+        if (shared_stack.owner == cp) {
+            shared_stack.owner = NULL;
+        }
+
+        cp->stack_pointer = NULL;
+    }
+    else {
+        cmi_coroutine_context_init(cp);
+        cmb_assert_debug(cmi_coroutine_stack_valid(cp));
+    }
+
     cmb_assert_debug(cmi_coroutine_registers_valid(cp));
 
     /* The current coroutine now becomes both the parent and caller of cp */
@@ -310,7 +649,7 @@ void cmi_coroutine_stop(struct cmi_coroutine *cp, void *retval)
 {
     cmb_assert_release(cp != NULL);
     cmb_assert_release(cp->status == CMI_COROUTINE_RUNNING);
-    cmb_assert_debug(cmi_coroutine_stack_valid(cp));
+    cmb_assert_debug(coroutine_stack_ready(cp));
     cmb_assert_debug(cmi_coroutine_registers_valid(cp));
 
     if (cp == cmi_coroutine_current()) {
@@ -323,6 +662,64 @@ void cmi_coroutine_stop(struct cmi_coroutine *cp, void *retval)
     }
 }
 
+/*
+ * coroutine_switch - Switch the processor context from one coroutine to the
+ * other, announcing the fiber switch to the sanitizers, if any.
+ */
+static inline void *coroutine_switch(struct cmi_coroutine *from,
+                                     struct cmi_coroutine *to,
+                                     void *msg)
+{
+    /* Announce the fiber switch. ASan wants the destination stack bounds; if
+     * `from` has finished it will never resume, so pass NULL and ASan discards
+     * its fake stack instead of saving it. */
+    void *asan_fake = NULL;
+    cmi_asan_start_switch((from->status == CMI_COROUTINE_FINISHED) ? NULL : &asan_fake,
+                          to->stack_limit,
+                          (size_t)(to->stack_base - to->stack_limit));
+    cmi_tsan_switch_fiber(to->tsan_fiber);
+
+    /* The actual context switch happens in assembly */
+    void **fromstk = (void **)&(from->stack_pointer);
+    void **tostk = (void **)&(to->stack_pointer);
+    void *ret = cmi_coroutine_context_switch(fromstk, tostk, msg);
+
+    /* Possibly much later, when control has returned here again, perhaps from
+     * some other coroutine than the one we switched to, which may be gone */
+    cmi_asan_finish_switch(asan_fake);
+    cmb_assert_debug(cmi_coroutine_stack_valid(from));
+
+    return ret;
+}
+
+/*
+ * coroutine_switch_hooked - The same, tracing it and timing it and the
+ * coroutine switched out of, as asked for. Kept apart to leave the ordinary
+ * switch as it was, ending in a tail call to the assembly code. The actual
+ * destination is the relay when going from one shared stack coroutine to
+ * another, but the trace shows where control is really going.
+ */
+__attribute__((noinline))
+static void *coroutine_switch_hooked(struct cmi_coroutine *from,
+                                     struct cmi_coroutine *to,
+                                     struct cmi_coroutine *dest,
+                                     void *msg)
+{
+    if (cmi_trace_on) {
+        cmi_trace_switch(from, to);
+    }
+
+    if (!cmi_profiler_on) {
+        return coroutine_switch(from, dest, msg);
+    }
+
+    cmi_profiler_switch_out(from);
+    void *ret = coroutine_switch(from, dest, msg);
+    cmi_profiler_switch_in();
+
+    return ret;
+}
+
 /*
  * cmi_coroutine_transfer - Symmetric (and general) coroutine pattern,
  * transferring control to whatever coroutine is given, with arg as the
@@ -337,7 +734,7 @@ extern void *cmi_coroutine_transfer(struct cmi_coroutine *to, void *msg)
 {
     cmb_assert_release(to != NULL);
     cmb_assert_release(to->status == CMI_COROUTINE_RUNNING);
-    cmb_assert_debug(cmi_coroutine_stack_valid(to));
+    cmb_assert_debug(coroutine_stack_ready(to));
     cmb_assert_debug(cmi_coroutine_registers_valid(to));
 
     struct cmi_coroutine *from = coroutine_current;
@@ -351,26 +748,24 @@ extern void *cmi_coroutine_transfer(struct cmi_coroutine *to, void *msg)
     to->caller = from;
     coroutine_current = to;
 
-    /* Announce the fiber switch. ASan wants the destination stack bounds; if
-     * `from` has finished it will never resume, so pass NULL and ASan discards
-     * its fake stack instead of saving it. */
-    void *asan_fake = NULL;
-    cmi_asan_start_switch((from->status == CMI_COROUTINE_FINISHED) ? NULL : &asan_fake,
-                          to->stack_limit,
-                          (size_t)(to->stack_base - to->stack_limit));
-    cmi_tsan_switch_fiber(to->tsan_fiber);
-
-    /* The actual context switch happens in assembly */
-    void **fromstk = (void **)&(from->stack_pointer);
-    void **tostk = (void **)&(to->stack_pointer);
-    void *ret = cmi_coroutine_context_switch(fromstk, tostk, msg);
+    struct cmi_coroutine *dest = to;
+    if (to->stack_shared && (shared_stack.owner != to)) {
+        if (from->stack_shared) {
+            /* Cannot copy over the stack we are on, let the relay do it */
+            shared_stack.relay_to = to;
+            shared_stack.relay_msg = msg;
+            dest = &shared_relay;
+        }
+        else {
+            shared_take(to);
+        }
+    }
 
-    /* Possibly much later, when control has returned here again */
-    cmi_asan_finish_switch(asan_fake);
-    cmb_assert_debug(cmi_coroutine_stack_valid(to));
-    cmb_assert_debug(cmi_coroutine_stack_valid(from));
+    if (cmi_profiler_on || cmi_trace_on) {
+        return coroutine_switch_hooked(from, to, dest, msg);
+    }
 
-    return ret;
+    return coroutine_switch(from, dest, msg);
 }
 
 /* Asymmetric coroutine pattern yield/resume, called from within coroutine */
@@ -420,6 +815,10 @@ struct cmi_coroutine *cmi_coroutine_main(void)
 void *cmi_coroutine_launch(struct cmi_coroutine *cp, void *arg)
 {
     cmi_asan_finish_switch(NULL);
+    if (cmi_profiler_on) {
+        cmi_profiler_switch_in();
+    }
+
     return cp->cr_function(cp, arg);
 }
 
@@ -434,7 +833,13 @@ void cmi_coroutine_thread_cleanup(void)
         struct cmi_coroutine *cp = coroutine_registry;
         cmb_assert_debug(cp != cmi_coroutine_current());
         coroutine_registry_remove(cp);
-        cmi_coroutine_stack_free(cp->stack, cp->stack_size);
+        if (cp->stack_shared) {
+            shared_drop(cp);
+        }
+        else {
+            cmi_coroutine_stack_free(cp->stack, cp->stack_size, cp->stack_slab);
+        }
+
         cmi_tsan_destroy_fiber(cp->tsan_fiber);
         if (cp->pool_allocated) {
             cmi_mempool_free(&coroutine_pool, cp);
@@ -442,6 +847,7 @@ void cmi_coroutine_thread_cleanup(void)
     }
 
     /* Perform any system-dependent cleanup of stack allocations */
+    shared_close();
     cmi_coroutine_stack_cleanup();
 
     /* Nowhere else to go */
@@ -498,3 +904,29 @@ void cmi_coroutine_recovery_finalize(void *stack_marker)
     /* We should be safe now, officially declare that we are in main */
     coroutine_current = coroutine_main;
 }
+
+/*
+ * cmi_coroutine_snapshot_regions - Add the coroutine pool, the registry, and
+ * the recycled stacks to the snapshot. Not the main coroutine, which keeps
+ * running as is.
+ */
+void cmi_coroutine_snapshot_regions(struct cmb_snapshot *sp)
+{
+    cmi_snapshot_add(sp, &coroutine_pool, sizeof(coroutine_pool));
+    cmi_snapshot_add(sp, &coroutine_registry, sizeof(coroutine_registry));
+    cmi_snapshot_add(sp, &shared_stack, sizeof(shared_stack));
+    cmi_snapshot_add(sp, &shared_relay, sizeof(shared_relay));
+    if ((shared_stack.raw != NULL) && !cmi_arena_owns(shared_stack.raw)) {
+        /* Allocated before the arena, the relay parked at the top of its loop,
+         * and whatever is on the shared stack now */
+        cmi_snapshot_add(sp, shared_relay.stack_limit,
+                         (size_t)(shared_relay.stack_base - shared_relay.stack_limit));
+        const struct cmi_coroutine *owner = shared_stack.owner;
+        if ((owner != NULL) && (owner->status == CMI_COROUTINE_RUNNING)) {
+            cmi_snapshot_add(sp, owner->stack_pointer,
+                             (size_t)(owner->stack_base - owner->stack_pointer));
+        }
+    }
+
+    cmi_coroutine_stack_snapshot_regions(sp);
+}
@@ -87,6 +87,12 @@ enum cmi_coroutine_state {
 #  define CMI_COROUTINE_DEFAULT_STACKSIZE (64u * 1024u)
 #endif
 
+/* Default cap on recycled stacks kept in the pool of each thread, in bytes */
+#define CMI_COROUTINE_STACK_RETENTION ((size_t)1 << 30)
+
+/* Size of the stack shared by the shared stack coroutines of each thread */
+#define CMI_COROUTINE_SHARED_STACKSIZE (1024u * 1024u)
+
 /* Declare that there is such a thing */
 struct cmi_coroutine;
 
@@ -145,6 +151,12 @@ struct cmi_coroutine {
     struct cmi_coroutine *reg_prev;
     struct cmi_coroutine *reg_next;
     bool pool_allocated;
+    bool stack_painted;
+    bool stack_slab;
+    bool stack_shared;
+    unsigned char *saved;
+    size_t saved_len;
+    size_t saved_cap;
 };
 
 /*
@@ -172,6 +184,25 @@ extern void cmi_coroutine_initialize(struct cmi_coroutine *cp,
                                      cmi_coroutine_exit_func *crexit,
                                      size_t stack_size);
 
+/*
+ * cmi_coroutine_initialize_shared - Initialize a coroutine object to run on the
+ * stack shared by all such coroutines in the thread, instead of a stack of its
+ * own. Only one of them can be on the shared stack at a time. When another one
+ * needs it, the live part of the stack of the one there is copied out to a heap
+ * buffer belonging to that coroutine, and the live part of the incoming one
+ * copied back in, at the same addresses as before.
+ *
+ * This saves memory for coroutines with shallow call stacks that mostly sit
+ * waiting, at the cost of the copying. Nothing may point into the stack of a
+ * shared stack coroutine while it is switched out, since the addresses then
+ * belong to some other coroutine. In particular, no other coroutine can read or
+ * write its local variables through pointers.
+ */
+extern void cmi_coroutine_initialize_shared(struct cmi_coroutine *cp,
+                                            cmi_coroutine_func *crfunction,
+                                            void *context,
+                                            cmi_coroutine_exit_func *crexit);
+
 /*
  * cmi_coroutine_reset - Returns coroutine to a newly initialized state.
  */
@@ -184,6 +215,56 @@ extern void cmi_coroutine_reset(struct cmi_coroutine *cp);
  */
 extern void cmi_coroutine_terminate(struct cmi_coroutine *cp);
 
+/*
+ * cmi_coroutine_stack_slabs - Do new stacks come from reserved slabs of address
+ * space, committed only as touched, rather than from the heap?
+ */
+extern bool cmi_coroutine_stack_slabs(void);
+
+/*
+ * cmi_coroutine_stack_slabs_set - Set where new stacks come from, for all
+ * threads. Stacks already allocated go back where they came from.
+ */
+extern void cmi_coroutine_stack_slabs_set(bool on);
+
+/*
+ * cmi_coroutine_stack_retention - The most bytes of recycled stacks each thread
+ * keeps in its pool. Stacks coming back when the pool is full are freed.
+ */
+extern size_t cmi_coroutine_stack_retention(void);
+
+/*
+ * cmi_coroutine_stack_retention_set - Set the cap for all threads, taking
+ * effect as stacks come back, not freeing any already in the pools.
+ */
+extern void cmi_coroutine_stack_retention_set(size_t cap);
+
+/*
+ * cmi_coroutine_stacks_prewarm - Make sure that the pool of this thread has at
+ * least n stacks of stack_size bytes (zero for the default), from the heap or
+ * slabs as cmi_coroutine_initialize would take them now, whatever the cap.
+ */
+extern void cmi_coroutine_stacks_prewarm(uint64_t n, size_t stack_size);
+
+/*
+ * cmi_coroutine_stack_pooled - The number of bytes of recycled stacks kept in
+ * the pool of this thread, guard pages included, slab stacks not.
+ */
+extern size_t cmi_coroutine_stack_pooled(void);
+
+/*
+ * cmi_coroutine_stack_paint - Fill the stack of a newly initialized coroutine
+ * with a known pattern, to find out later how deep it has been used.
+ */
+extern void cmi_coroutine_stack_paint(struct cmi_coroutine *cp);
+
+/*
+ * cmi_coroutine_stack_peak - Return the high-water mark of a painted stack,
+ * the number of bytes from the stack base down to the deepest word that no
+ * longer holds the pattern.
+ */
+extern size_t cmi_coroutine_stack_peak(const struct cmi_coroutine *cp);
+
 /*
  * cmi_coroutine_destroy - Free memory allocated to coroutine.
  */
@@ -0,0 +1,477 @@
+/*
+ * cmi_fastlane.c - Implements the fast lane, a few ring buffers of entries
+ * at the current time, one per priority, in order of decreasing priority.
+ *
+ * Each ring is a power of two in size, doubling when full. An entry keeps its
+ * running position in the ring from push until it is dequeued or cancelled,
+ * also across a doubling, so a caller that noted the position can go straight
+ * back to it. Otherwise, the hash keys increase from head to tail within each
+ * ring, dead entries included, so a key is found by a range check and a binary
+ * search per ring. When a ring runs out of live entries, it is reset to empty,
+ * discarding any dead entries left in it.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cmi_fastlane.h"
+#include "cmi_memutils.h"
+
+/* The initial number of entries in a ring, growing as needed */
+#define RING_INIT_SIZE 16u
+
+/*
+ * cmi_fastlane_create - Allocate memory for a new fast lane struct.
+ */
+struct cmi_fastlane *cmi_fastlane_create(void)
+{
+    struct cmi_fastlane *flp = cmi_malloc(sizeof(*flp));
+    cmi_memset(flp, 0u, sizeof(*flp));
+
+    return flp;
+}
+
+/*
+ * cmi_fastlane_initialize - Start out with no rings, allocated on first use.
+ */
+void cmi_fastlane_initialize(struct cmi_fastlane *flp)
+{
+    cmb_assert_release(flp != NULL);
+
+    cmi_memset(flp, 0u, sizeof(*flp));
+}
+
+/*
+ * ring_empty - Reset a ring without live entries, discarding any dead ones.
+ */
+static void ring_empty(struct cmi_fastlane_ring *rp)
+{
+    cmb_assert_debug(rp != NULL);
+
+    rp->head = 0u;
+    rp->tail = 0u;
+    rp->live = 0u;
+}
+
+/*
+ * cmi_fastlane_clear - Empty all rings, keeping them and their buffers.
+ */
+void cmi_fastlane_clear(struct cmi_fastlane *flp)
+{
+    cmb_assert_release(flp != NULL);
+
+    for (unsigned ui = 0u; ui < flp->ring_count; ui++) {
+        ring_empty(&(flp->rings[ui]));
+    }
+
+    flp->count = 0u;
+}
+
+/*
+ * cmi_fastlane_terminate - Free the ring buffers, leaving the lane empty.
+ */
+void cmi_fastlane_terminate(struct cmi_fastlane *flp)
+{
+    cmb_assert_release(flp != NULL);
+
+    for (unsigned ui = 0u; ui < flp->ring_count; ui++) {
+        if (flp->rings[ui].entries != NULL) {
+            cmi_free(flp->rings[ui].entries);
+        }
+    }
+
+    cmi_memset(flp, 0u, sizeof(*flp));
+}
+
+/*
+ * cmi_fastlane_destroy - Free the lane struct itself.
+ */
+void cmi_fastlane_destroy(struct cmi_fastlane *flp)
+{
+    cmb_assert_release(flp != NULL);
+
+    cmi_free(flp);
+}
+
+/*
+ * ring_grow - Double the capacity of a full ring, each entry moving to where
+ * its running position masks into the new buffer.
+ */
+static void ring_grow(struct cmi_fastlane_ring *rp)
+{
+    cmb_assert_debug(rp != NULL);
+    cmb_assert_debug(rp->tail - rp->head == rp->capacity);
+
+    const uint64_t newcap = (rp->capacity > 0u) ? 2u * rp->capacity : RING_INIT_SIZE;
+    struct cmi_fastlane_entry *nbuf = cmi_malloc(newcap * sizeof(*nbuf));
+    const uint64_t n = rp->tail - rp->head;
+    for (uint64_t ui = 0u; ui < n; ui++) {
+        nbuf[(rp->head + ui) & (newcap - 1u)] = *cmi_fastlane_entry_at(rp, rp->head + ui);
+    }
+
+    if (rp->entries != NULL) {
+        cmi_free(rp->entries);
+    }
+
+    rp->entries = nbuf;
+    rp->capacity = newcap;
+}
+
+/*
+ * ring_for - Find the ring for the given priority, taking a new or an empty
+ * one and putting it in its place by priority if there is none yet. Returns
+ * NULL if all rings are in use by other priorities.
+ */
+static struct cmi_fastlane_ring *ring_for(struct cmi_fastlane *flp,
+                                          const int64_t priority)
+{
+    cmb_assert_debug(flp != NULL);
+
+    struct cmi_fastlane_ring *rings = flp->rings;
+    unsigned r = 0u;
+    while ((r < flp->ring_count) && (rings[r].priority > priority)) {
+        r++;
+    }
+
+    if ((r < flp->ring_count) && (rings[r].priority == priority)) {
+        return &(rings[r]);
+    }
+
+    struct cmi_fastlane_ring spare;
+    if (flp->ring_count < CMI_FASTLANE_RINGS) {
+        cmi_memset(&spare, 0u, sizeof(spare));
+        flp->ring_count++;
+    }
+    else {
+        /* Take over an empty ring, closing the gap after it */
+        unsigned e = 0u;
+        while ((e < flp->ring_count) && (rings[e].live > 0u)) {
+            e++;
+        }
+
+        if (e == flp->ring_count) {
+            return NULL;
+        }
+
+        spare = rings[e];
+        ring_empty(&spare);
+        for (unsigned ui = e; ui + 1u < flp->ring_count; ui++) {
+            rings[ui] = rings[ui + 1u];
+        }
+
+        if (e < r) {
+            r--;
+        }
+    }
+
+    /* Open a gap at position r for it */
+    for (unsigned ui = flp->ring_count - 1u; ui > r; ui--) {
+        rings[ui] = rings[ui - 1u];
+    }
+
+    spare.priority = priority;
+    rings[r] = spare;
+
+    return &(rings[r]);
+}
+
+/*
+ * cmi_fastlane_push - Append an entry at the tail of the ring for its priority.
+ */
+bool cmi_fastlane_push(struct cmi_fastlane *flp,
+                       void *pl1,
+                       void *pl2,
+                       void *pl3,
+                       void *pl4,
+                       const uint64_t hashkey,
+                       const int64_t priority,
+                       uint64_t *pos)
+{
+    cmb_assert_release(flp != NULL);
+    cmb_assert_release(hashkey != 0u);
+
+    struct cmi_fastlane_ring *rp = ring_for(flp, priority);
+    if (rp == NULL) {
+        return false;
+    }
+
+    cmb_assert_debug((rp->tail == rp->head)
+                     || (cmi_fastlane_entry_at(rp, rp->tail - 1u)->hash_key < hashkey));
+    if (rp->tail - rp->head == rp->capacity) {
+        ring_grow(rp);
+    }
+
+    struct cmi_fastlane_entry *ep = &(rp->entries[rp->tail & (rp->capacity - 1u)]);
+    ep->item[0] = pl1;
+    ep->item[1] = pl2;
+    ep->item[2] = pl3;
+    ep->item[3] = pl4;
+    ep->hash_key = hashkey;
+    ep->live = 1u;
+    if (pos != NULL) {
+        *pos = rp->tail;
+    }
+
+    rp->tail++;
+    rp->live++;
+    flp->count++;
+
+    return true;
+}
+
+/*
+ * front_ring - The ring holding the first live entry, with any dead entries
+ * before it discarded, NULL if the lane is empty.
+ */
+static struct cmi_fastlane_ring *front_ring(struct cmi_fastlane *flp)
+{
+    cmb_assert_debug(flp != NULL);
+
+    if (flp->count == 0u) {
+        return NULL;
+    }
+
+    for (unsigned ui = 0u; ui < flp->ring_count; ui++) {
+        struct cmi_fastlane_ring *rp = &(flp->rings[ui]);
+        if (rp->live > 0u) {
+            while (cmi_fastlane_entry_at(rp, rp->head)->live == 0u) {
+                rp->head++;
+            }
+
+            return rp;
+        }
+    }
+
+    /* Not reached while the counts are right */
+    cmb_assert_debug(false);
+    return NULL;
+}
+
+/*
+ * cmi_fastlane_peek - The first live entry and its priority.
+ */
+const struct cmi_fastlane_entry *cmi_fastlane_peek(struct cmi_fastlane *flp,
+                                                   int64_t *priority)
+{
+    cmb_assert_release(flp != NULL);
+    cmb_assert_release(priority != NULL);
+
+    const struct cmi_fastlane_ring *rp = front_ring(flp);
+    if (rp == NULL) {
+        return NULL;
+    }
+
+    *priority = rp->priority;
+
+    return cmi_fastlane_entry_at(rp, rp->head);
+}
+
+/*
+ * cmi_fastlane_dequeue - Move the first live entry to flp->last.
+ */
+void **cmi_fastlane_dequeue(struct cmi_fastlane *flp)
+{
+    cmb_assert_release(flp != NULL);
+    cmb_assert_release(flp->count > 0u);
+
+    struct cmi_fastlane_ring *rp = front_ring(flp);
+    cmb_assert_debug(rp != NULL);
+
+    flp->last = *cmi_fastlane_entry_at(rp, rp->head);
+    flp->last.live = 0u;
+    rp->head++;
+    rp->live--;
+    flp->count--;
+    if (rp->live == 0u) {
+        ring_empty(rp);
+    }
+
+    return flp->last.item;
+}
+
+/*
+ * lane_lookup - Locate the live entry with the given key and the ring it is in.
+ */
+static struct cmi_fastlane_entry *lane_lookup(const struct cmi_fastlane *flp,
+                                              const uint64_t hashkey,
+                                              struct cmi_fastlane_ring **rpp)
+{
+    cmb_assert_debug(flp != NULL);
+    cmb_assert_debug(rpp != NULL);
+
+    if (flp->count == 0u) {
+        return NULL;
+    }
+
+    for (unsigned ui = 0u; ui < flp->ring_count; ui++) {
+        struct cmi_fastlane_ring *rp = (struct cmi_fastlane_ring *)&(flp->rings[ui]);
+        if ((rp->live == 0u)
+            || (hashkey < cmi_fastlane_entry_at(rp, rp->head)->hash_key)
+            || (hashkey > cmi_fastlane_entry_at(rp, rp->tail - 1u)->hash_key)) {
+            continue;
+        }
+
+        uint64_t lo = rp->head;
+        uint64_t hi = rp->tail;
+        while (lo < hi) {
+            const uint64_t mid = lo + (hi - lo) / 2u;
+            struct cmi_fastlane_entry *ep = cmi_fastlane_entry_at(rp, mid);
+            if (ep->hash_key == hashkey) {
+                if (ep->live == 0u) {
+                    return NULL;
+                }
+
+                *rpp = rp;
+                return ep;
+            }
+            else if (ep->hash_key < hashkey) {
+                lo = mid + 1u;
+            }
+            else {
+                hi = mid;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * cmi_fastlane_find - The live entry with the given key, NULL if none.
+ */
+struct cmi_fastlane_entry *cmi_fastlane_find(struct cmi_fastlane *flp,
+                                             const uint64_t hashkey,
+                                             int64_t *priority)
+{
+    cmb_assert_release(flp != NULL);
+
+    struct cmi_fastlane_ring *rp = NULL;
+    struct cmi_fastlane_entry *ep = lane_lookup(flp, hashkey, &rp);
+    if ((ep != NULL) && (priority != NULL)) {
+        *priority = rp->priority;
+    }
+
+    return ep;
+}
+
+/*
+ * lane_lookup_at - Locate the live entry with the given key at running
+ * position pos in the ring for the given priority, without searching.
+ */
+static struct cmi_fastlane_entry *lane_lookup_at(const struct cmi_fastlane *flp,
+                                                 const uint64_t hashkey,
+                                                 const int64_t priority,
+                                                 const uint64_t pos,
+                                                 struct cmi_fastlane_ring **rpp)
+{
+    cmb_assert_debug(flp != NULL);
+    cmb_assert_debug(rpp != NULL);
+
+    for (unsigned ui = 0u; ui < flp->ring_count; ui++) {
+        struct cmi_fastlane_ring *rp = (struct cmi_fastlane_ring *)&(flp->rings[ui]);
+        if (rp->priority != priority) {
+            continue;
+        }
+
+        if ((rp->live == 0u) || (pos < rp->head) || (pos >= rp->tail)) {
+            return NULL;
+        }
+
+        struct cmi_fastlane_entry *ep = cmi_fastlane_entry_at(rp, pos);
+        if ((ep->hash_key != hashkey) || (ep->live == 0u)) {
+            return NULL;
+        }
+
+        *rpp = rp;
+        return ep;
+    }
+
+    return NULL;
+}
+
+/*
+ * cmi_fastlane_find_at - The live entry with the given key at the given place.
+ */
+struct cmi_fastlane_entry *cmi_fastlane_find_at(struct cmi_fastlane *flp,
+                                                const uint64_t hashkey,
+                                                const int64_t priority,
+                                                const uint64_t pos)
+{
+    cmb_assert_release(flp != NULL);
+
+    struct cmi_fastlane_ring *rp = NULL;
+
+    return lane_lookup_at(flp, hashkey, priority, pos, &rp);
+}
+
+/*
+ * entry_kill - Mark a live entry as dead, emptying its ring if it was the last.
+ */
+static void entry_kill(struct cmi_fastlane *flp,
+                       struct cmi_fastlane_ring *rp,
+                       struct cmi_fastlane_entry *ep)
+{
+    cmb_assert_debug(flp != NULL);
+    cmb_assert_debug(rp != NULL);
+    cmb_assert_debug((ep != NULL) && (ep->live != 0u));
+
+    ep->live = 0u;
+    rp->live--;
+    flp->count--;
+    if (rp->live == 0u) {
+        ring_empty(rp);
+    }
+}
+
+/*
+ * cmi_fastlane_remove - Mark the entry as dead, to be discarded at the front.
+ */
+bool cmi_fastlane_remove(struct cmi_fastlane *flp, const uint64_t hashkey)
+{
+    cmb_assert_release(flp != NULL);
+
+    struct cmi_fastlane_ring *rp = NULL;
+    struct cmi_fastlane_entry *ep = lane_lookup(flp, hashkey, &rp);
+    if (ep == NULL) {
+        return false;
+    }
+
+    entry_kill(flp, rp, ep);
+
+    return true;
+}
+
+/*
+ * cmi_fastlane_remove_at - As remove, but going straight to the given place.
+ */
+bool cmi_fastlane_remove_at(struct cmi_fastlane *flp,
+                            const uint64_t hashkey,
+                            const int64_t priority,
+                            const uint64_t pos)
+{
+    cmb_assert_release(flp != NULL);
+
+    struct cmi_fastlane_ring *rp = NULL;
+    struct cmi_fastlane_entry *ep = lane_lookup_at(flp, hashkey, priority, pos, &rp);
+    if (ep == NULL) {
+        return false;
+    }
+
+    entry_kill(flp, rp, ep);
+
+    return true;
+}
@@ -0,0 +1,198 @@
+/*
+ * cmi_fastlane.h - A side queue for events due at the current time, kept in
+ * front of the main event queue. Events scheduled with zero delay, such as the
+ * wakeup calls to processes that just got a resource, go in a FIFO ring buffer
+ * for their priority instead of through the heap. With few distinct
+ * priorities in use, this makes both enqueue and dequeue O(1).
+ *
+ * All entries have the same time, so the order within the lane is higher
+ * priority first, then lower hash_key. Entries are only ever appended with a
+ * fresh hash_key larger than any already there, keeping each ring sorted by
+ * hash_key, which allows lookup by binary search. Cancellation is lazy, the
+ * entry stays in its ring marked as dead until it reaches the front.
+ *
+ * The lane does not issue its own hash keys, but takes them from the same
+ * running counter as the main event queue, and the caller decides between the
+ * lane and the main queue for each dequeue by comparing the front entries.
+ * An entry stays at the same running position in its ring while live, so a
+ * caller that keeps the position from the push can find it without searching.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CIMBA_CMI_FASTLANE_H
+#define CIMBA_CMI_FASTLANE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cmb_assert.h"
+
+#include "cmi_config.h"
+
+/* The number of distinct priorities the lane can hold at the same time */
+#define CMI_FASTLANE_RINGS 8u
+
+/*
+ * struct cmi_fastlane_entry - The payload and key of an entry in a ring,
+ * 6 * 8 = 48 bytes. The payload layout is the same as the hashheap item.
+ */
+struct cmi_fastlane_entry {
+    void *item[4];          /* The payload, four 64-bit values */
+    uint64_t hash_key;      /* The unique handle/ID, kept also when dead */
+    uint64_t live;          /* Nonzero until dequeued or cancelled */
+};
+
+/*
+ * struct cmi_fastlane_ring - A growable ring buffer of entries at one
+ * priority. The head and tail are running counts, masked into the buffer,
+ * capacity always a power of two.
+ */
+struct cmi_fastlane_ring {
+    struct cmi_fastlane_entry *entries;
+    uint64_t capacity;
+    uint64_t head;          /* First entry, possibly dead */
+    uint64_t tail;          /* One past the last entry */
+    uint64_t live;          /* Number of live entries in the ring */
+    int64_t priority;
+};
+
+/*
+ * struct cmi_fastlane - The rings in order of decreasing priority. Empty rings
+ * are kept for reuse, also for another priority if all are taken.
+ */
+struct cmi_fastlane {
+    struct cmi_fastlane_ring rings[CMI_FASTLANE_RINGS];
+    unsigned ring_count;
+    uint64_t count;                 /* Total number of live entries */
+    struct cmi_fastlane_entry last; /* The most recently dequeued entry */
+};
+
+/*
+ * cmi_fastlane_create - Allocate memory for a fast lane.
+ */
+extern struct cmi_fastlane *cmi_fastlane_create(void);
+
+/*
+ * cmi_fastlane_initialize - Set up an empty lane, no rings allocated yet.
+ */
+extern void cmi_fastlane_initialize(struct cmi_fastlane *flp);
+
+/*
+ * cmi_fastlane_clear - Remove all entries, keeping the ring buffers.
+ */
+extern void cmi_fastlane_clear(struct cmi_fastlane *flp);
+
+/*
+ * cmi_fastlane_terminate - Free the ring buffers.
+ */
+extern void cmi_fastlane_terminate(struct cmi_fastlane *flp);
+
+/*
+ * cmi_fastlane_destroy - Free the lane itself.
+ */
+extern void cmi_fastlane_destroy(struct cmi_fastlane *flp);
+
+/*
+ * cmi_fastlane_push - Append an entry with the given hash key, larger than any
+ * already in the lane, at the given priority. Returns false without doing
+ * anything if all rings are in use by other priorities, leaving it to the
+ * caller to put the entry somewhere else. If pos is not NULL, sets *pos to the
+ * running position of the entry in its ring, where it stays while live.
+ */
+extern bool cmi_fastlane_push(struct cmi_fastlane *flp,
+                              void *pl1,
+                              void *pl2,
+                              void *pl3,
+                              void *pl4,
+                              uint64_t hashkey,
+                              int64_t priority,
+                              uint64_t *pos);
+
+/*
+ * cmi_fastlane_peek - Return the first live entry and set *priority to its
+ * priority, NULL if the lane is empty. Discards any dead entries before it.
+ */
+extern const struct cmi_fastlane_entry *cmi_fastlane_peek(struct cmi_fastlane *flp,
+                                                          int64_t *priority);
+
+/*
+ * cmi_fastlane_dequeue - Remove the first live entry and return a pointer to
+ * its payload, copied to flp->last where it stays until the next dequeue.
+ * Precondition: The lane is not empty.
+ */
+extern void **cmi_fastlane_dequeue(struct cmi_fastlane *flp);
+
+/*
+ * cmi_fastlane_count - Returns the number of live entries in the lane.
+ */
+CMB_MAYBE_UNUSED
+static inline uint64_t cmi_fastlane_count(const struct cmi_fastlane *flp)
+{
+    cmb_assert_debug(flp != NULL);
+
+    return flp->count;
+}
+
+/*
+ * cmi_fastlane_find - Return the live entry with the given hash key, NULL if
+ * not in the lane. If found and priority is not NULL, sets *priority.
+ */
+extern struct cmi_fastlane_entry *cmi_fastlane_find(struct cmi_fastlane *flp,
+                                                    uint64_t hashkey,
+                                                    int64_t *priority);
+
+/*
+ * cmi_fastlane_remove - Remove the entry with the given hash key, returns
+ * false if it was not in the lane.
+ */
+extern bool cmi_fastlane_remove(struct cmi_fastlane *flp, uint64_t hashkey);
+
+/*
+ * cmi_fastlane_find_at - As find, but going straight to the priority and the
+ * position given by push instead of searching. NULL if the entry there is not
+ * live or has another hash key.
+ */
+extern struct cmi_fastlane_entry *cmi_fastlane_find_at(struct cmi_fastlane *flp,
+                                                       uint64_t hashkey,
+                                                       int64_t priority,
+                                                       uint64_t pos);
+
+/*
+ * cmi_fastlane_remove_at - As remove, but going straight to the priority and
+ * the position given by push. Returns false if the entry was not there.
+ */
+extern bool cmi_fastlane_remove_at(struct cmi_fastlane *flp,
+                                   uint64_t hashkey,
+                                   int64_t priority,
+                                   uint64_t pos);
+
+/*
+ * cmi_fastlane_entry_at - The entry at running position pos in the ring,
+ * for iterating from head to tail. May be dead.
+ */
+CMB_MAYBE_UNUSED
+static inline struct cmi_fastlane_entry *cmi_fastlane_entry_at(
+                                            const struct cmi_fastlane_ring *rp,
+                                            const uint64_t pos)
+{
+    cmb_assert_debug(rp != NULL);
+    cmb_assert_debug((pos >= rp->head) && (pos < rp->tail));
+
+    return &(rp->entries[pos & (rp->capacity - 1u)]);
+}
+
+#endif /* CIMBA_CMI_FASTLANE_H */
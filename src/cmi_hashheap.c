@@ -1,13 +1,19 @@
 /*
  * cmi_hashheap.c - Implements the hashheap priority queue, i.e. a binary heap
- * combined with an open addressing hash map, both allocated contiguously in
- * a shared memory array for the best possible memory performance. The array
- * resizes as needed, always in powers of two, where the number of hash map
- * slots is twice the heap size, guaranteeing less than 50 % load factor.
+ * (or optionally a 4-ary or 8-ary heap) combined with an open addressing hash
+ * map, both allocated contiguously in a shared memory array for the best
+ * possible memory performance. The array resizes as needed, always in powers
+ * of two, where the number of hash map slots is twice the heap size,
+ * guaranteeing less than 50 % load factor.
+ *
+ * The heap itself only holds the sort keys and a reference to a slot in a
+ * separate item array where the payload stays put, so that the reshuffling
+ * of the heap moves as few bytes as possible.
  *
  * The hash map uses a Fibonacci hash, aka Knuth's multiplicative method,
- * combined with simple linear probing and lazy deletions from the hash map when
- * items leave the heap.
+ * combined with Robin Hood linear probing, keeping the probe lengths even, and
+ * backward-shift deletions from the hash map when items leave the heap, so
+ * that no tombstones are left behind.
  *
  * See also: Malte Skarupke (2018), "Fibonacci Hashing: The Optimization
  *   that the World Forgot (or: a Better Alternative to Integer Modulo)",
@@ -34,6 +40,8 @@
 
 #include "cmi_hashheap.h"
 #include "cmi_memutils.h"
+#include "cmi_snapshot.h"
+#include "cmi_subjectindex.h"
 
 /* The initial capacity of the heap is 2^QUEUE_INIT_EXP items, resizing as needed */
 #define QUEUE_INIT_EXP 3
@@ -87,27 +95,202 @@ static bool default_compare(const struct cmi_heap_tag *a,
 }
 
 /*
- * cmi_hashheap_initialize - Initialize hashheap for use.
- * Allocates a contiguous memory array aligned to an integer number of memory
- * pages for efficiency.
+ * priority_time_compare - Higher priority (rank_i64) first, then earlier time
+ * (rank_d64), then FIFO by hash key. The resource guard order.
+ */
+static bool priority_time_compare(const struct cmi_heap_tag *a,
+                                  const struct cmi_heap_tag *b)
+{
+    cmb_assert_debug(a != NULL);
+    cmb_assert_debug(b != NULL);
+
+    if (a->rank_i64 != b->rank_i64) {
+        return a->rank_i64 > b->rank_i64;
+    }
+
+    if (a->rank_d64 != b->rank_d64) {
+        return a->rank_d64 < b->rank_d64;
+    }
+
+    return a->hash_key < b->hash_key;
+}
+
+/*
+ * priority_compare - Higher priority (rank_i64) first, then FIFO by hash key.
+ * The priority queue order.
+ */
+static bool priority_compare(const struct cmi_heap_tag *a,
+                             const struct cmi_heap_tag *b)
+{
+    cmb_assert_debug(a != NULL);
+    cmb_assert_debug(b != NULL);
+
+    if (a->rank_i64 != b->rank_i64) {
+        return a->rank_i64 > b->rank_i64;
+    }
+
+    return a->hash_key < b->hash_key;
+}
+
+/*
+ * order_* - The comparison for each ordering, in the form expected by the
+ * HEAP_SIFT_DEFINE macro below. All but the custom one are static functions
+ * in this file that the compiler inlines into the sift loops.
+ */
+static inline bool order_time(const struct cmi_hashheap *hp,
+                              const struct cmi_heap_tag *a,
+                              const struct cmi_heap_tag *b)
+{
+    cmb_unused(hp);
+
+    return default_compare(a, b);
+}
+
+static inline bool order_priority_time(const struct cmi_hashheap *hp,
+                                       const struct cmi_heap_tag *a,
+                                       const struct cmi_heap_tag *b)
+{
+    cmb_unused(hp);
+
+    return priority_time_compare(a, b);
+}
+
+static inline bool order_priority(const struct cmi_hashheap *hp,
+                                  const struct cmi_heap_tag *a,
+                                  const struct cmi_heap_tag *b)
+{
+    cmb_unused(hp);
+
+    return priority_compare(a, b);
+}
+
+static inline bool order_custom(const struct cmi_hashheap *hp,
+                                const struct cmi_heap_tag *a,
+                                const struct cmi_heap_tag *b)
+{
+    return (*hp->heap_compare)(a, b);
+}
+
+/*
+ * heap_pad - The number of unused heap tags in front of heap[0], placing every
+ * sibling group of a d-ary heap on a d-tag boundary. Zero for a binary heap.
+ */
+static uint64_t heap_pad(const struct cmi_hashheap *hp)
+{
+    cmb_assert_debug(hp != NULL);
+    cmb_assert_debug(hp->heap_dexp >= 1u);
+
+    return (UINT64_C(1) << hp->heap_dexp) - 2u;
+}
+
+/*
+ * heap_bytes - The number of bytes for the heap part of the array, including
+ * the padding and the working space at index 0, rounded up to a whole number
+ * of cache lines to keep the item array after the hash map cache aligned.
+ */
+static size_t heap_bytes(const struct cmi_hashheap *hp, const uint64_t heapsz)
+{
+    cmb_assert_debug(hp != NULL);
+
+    const size_t heap_bts = (heap_pad(hp) + heapsz + 1u) * sizeof(struct cmi_heap_tag);
+
+    return (heap_bts + 63u) & ~(size_t)63u;
+}
+
+/*
+ * hash_bytes - The number of bytes for the hash map, twice the heap size.
+ */
+static size_t hash_bytes(const uint64_t heapsz)
+{
+    return (heapsz << 1u) * sizeof(struct cmi_hash_tag);
+}
+
+/*
+ * item_bytes - The number of bytes for the item array, one slot more than the
+ * heap size for the most recently dequeued item, plus the unused slot zero.
+ */
+static size_t item_bytes(const uint64_t heapsz)
+{
+    return (heapsz + 2u) * sizeof(struct cmi_heap_item);
+}
+
+/*
+ * heap_block - The start of the allocated memory block, before the padding.
+ */
+static unsigned char *heap_block(const struct cmi_hashheap *hp)
+{
+    cmb_assert_debug(hp != NULL);
+    cmb_assert_debug(hp->heap != NULL);
+
+    return (unsigned char *)(hp->heap - heap_pad(hp));
+}
+
+/*
+ * cmi_hashheap_initialize - Initialize a binary hashheap for use.
  */
 void cmi_hashheap_initialize(struct cmi_hashheap *hp,
                              const uint16_t hexp,
                              cmi_heap_compare_func *cmp)
+{
+    cmi_hashheap_initialize_wflags(hp, hexp, cmp, CMI_HASHHEAP_BINARY);
+}
+
+/*
+ * cmi_hashheap_initialize_wflags - Initialize hashheap for use with the given
+ * layout options. Allocates a contiguous memory array aligned to an integer
+ * number of memory pages for efficiency.
+ */
+void cmi_hashheap_initialize_wflags(struct cmi_hashheap *hp,
+                                    const uint16_t hexp,
+                                    cmi_heap_compare_func *cmp,
+                                    const uint16_t flags)
 {
     cmb_assert_release(hp != NULL);
     cmb_assert_release(hp->heap == NULL);
     cmb_assert_release(hp->hash_map == NULL);
+    cmb_assert_release(hp->subjects == NULL);
     cmb_assert_release(hexp > 0u);
+    cmb_assert_release((flags & CMI_HASHHEAP_ARITY_MASK) != CMI_HASHHEAP_ARITY_MASK);
+    cmb_assert_release((flags & ~(CMI_HASHHEAP_ARITY_MASK
+                                  | CMI_HASHHEAP_SLOT_KEYS
+                                  | CMI_HASHHEAP_SUBJECT_INDEX
+                                  | CMI_HASHHEAP_ORDER_MASK)) == 0u);
+    cmb_assert_release((cmp == NULL)
+                       || ((flags & CMI_HASHHEAP_ORDER_MASK) == CMI_HASHHEAP_ORDER_CUSTOM));
+
+    /* Set the ordering, built in unless given a compare function */
+    uint16_t order = flags & CMI_HASHHEAP_ORDER_MASK;
+    if (order == CMI_HASHHEAP_ORDER_CUSTOM) {
+        if (cmp == NULL) {
+            order = CMI_HASHHEAP_ORDER_TIME;
+        }
+    }
+
+    switch (order) {
+        case CMI_HASHHEAP_ORDER_TIME:
+            hp->heap_compare = default_compare;
+            break;
+        case CMI_HASHHEAP_ORDER_PRIORITY_TIME:
+            hp->heap_compare = priority_time_compare;
+            break;
+        case CMI_HASHHEAP_ORDER_PRIORITY:
+            hp->heap_compare = priority_compare;
+            break;
+        default:
+            hp->heap_compare = cmp;
+            break;
+    }
 
     /* Initialize the powers-of-two growth parameters */
+    hp->heap_flags = (uint16_t)((flags & ~CMI_HASHHEAP_ORDER_MASK) | order);
+    hp->heap_dexp = (uint16_t)((flags & CMI_HASHHEAP_ARITY_MASK) + 1u);
     hp->heap_exp_init = hexp;
     hp->heap_exp_cur = hexp;
     hp->heap_size = UINT64_C(1) << hp->heap_exp_cur;
 
-    const size_t heap_bts = (hp->heap_size + 1u) * sizeof(struct cmi_heap_tag);
-    const size_t hash_bts = (hp->heap_size << 1u) * sizeof(struct cmi_hash_tag);
-    const size_t total_bts = heap_bts + hash_bts;
+    const size_t heap_bts = heap_bytes(hp, hp->heap_size);
+    const size_t hash_bts = hash_bytes(hp->heap_size);
+    const size_t total_bts = heap_bts + hash_bts + item_bytes(hp->heap_size);
 
     const size_t page_bts = cmi_pagesize();
     cmb_assert_debug(page_bts > 0 && (page_bts & (page_bts - 1)) == 0);
@@ -116,16 +299,27 @@ void cmi_hashheap_initialize(struct cmi_hashheap *hp,
     unsigned char *mem = cmi_aligned_alloc(page_bts, rndtot_bts);
     cmi_memset(mem, 0u, rndtot_bts);
 
-    hp->heap = (struct cmi_heap_tag *)mem;
+    hp->heap = (struct cmi_heap_tag *)mem + heap_pad(hp);
     hp->hash_map = (struct cmi_hash_tag *)(mem + heap_bts);
+    hp->items = (struct cmi_heap_item *)(mem + heap_bts + hash_bts);
 
     hp->heap_count = 0u;
     hp->item_counter = 0u;
-    hp->tombstones = 0u;
-    hp->heap_compare = (cmp == NULL) ? default_compare : cmp;
+    hp->item_top = 0u;
+    hp->item_free = 0u;
+    hp->item_current = 0u;
+    hp->item_reserved = 0u;
+    hp->batch_from = 0u;
+    hp->heap_peak = 0u;
+    cmi_memset(&(hp->stats), 0u, sizeof(hp->stats));
 
     /* Lazy initialization of hashmap, only at first actual need for it */
     hp->map_active = false;
+
+    if ((flags & CMI_HASHHEAP_SUBJECT_INDEX) != 0u) {
+        hp->subjects = cmi_subjectindex_create();
+        cmi_subjectindex_initialize(hp->subjects, hp->heap_size + 2u);
+    }
 }
 
 /*
@@ -136,9 +330,15 @@ void cmi_hashheap_terminate(struct cmi_hashheap *hp)
     cmb_assert_release(hp != NULL);
 
     if (hp->heap != NULL) {
-        cmi_aligned_free(hp->heap);
+        cmi_aligned_free(heap_block(hp));
         hp->heap = NULL;
         hp->hash_map = NULL;
+        hp->items = NULL;
+    }
+
+    if (hp->subjects != NULL) {
+        cmi_subjectindex_destroy(hp->subjects);
+        hp->subjects = NULL;
     }
 }
 
@@ -163,18 +363,42 @@ void cmi_hashheap_clear(struct cmi_hashheap *hp)
     cmb_assert_release(hp != NULL);
 
     if (hp->heap != NULL) {
-        /* Adding one for the working space at the end */
-        const size_t heap_bts = (hp->heap_size + 1u) * sizeof(struct cmi_heap_tag);
-        const size_t hash_bts = (hp->heap_size << 1u) * sizeof(struct cmi_hash_tag);
-        const size_t total_bts = heap_bts + hash_bts;
-        cmi_memset(hp->heap, 0u, total_bts);
+        /* Includes the padding and the working space at index 0 */
+        const size_t heap_bts = heap_bytes(hp, hp->heap_size);
+        const size_t hash_bts = hash_bytes(hp->heap_size);
+        const size_t total_bts = heap_bts + hash_bts + item_bytes(hp->heap_size);
+        cmi_memset(heap_block(hp), 0u, total_bts);
 
         hp->heap_count = 0u;
-        hp->tombstones = 0u;
+        hp->item_top = 0u;
+        hp->item_free = 0u;
+        hp->item_current = 0u;
+        hp->item_reserved = 0u;
+        hp->batch_from = 0u;
         hp->map_active = false;
+
+        if (hp->subjects != NULL) {
+            cmi_subjectindex_clear(hp->subjects);
+        }
     }
 }
 
+/*
+ * cmi_hashheap_rewind - Flush out the hashheap and start the key series over,
+ * keeping the allocated space. Saves the allocation and regrowth when the same
+ * hashheap is used again for another run of the same kind.
+ */
+void cmi_hashheap_rewind(struct cmi_hashheap *hp)
+{
+    cmb_assert_release(hp != NULL);
+    cmb_assert_release(hp->heap != NULL);
+
+    cmi_hashheap_clear(hp);
+    hp->item_counter = 0u;
+    hp->heap_peak = 0u;
+    cmi_memset(&(hp->stats), 0u, sizeof(hp->stats));
+}
+
 /*
  * cmi_hashheap_reset - Hard reset to newly initialized state
  */
@@ -184,10 +408,12 @@ void cmi_hashheap_reset(struct cmi_hashheap *hp)
     cmb_assert_release(hp->heap != NULL);
 
     const uint16_t hexp = hp->heap_exp_init;
-    cmi_heap_compare_func *cmp = hp->heap_compare;
+    const uint16_t flags = hp->heap_flags;
+    cmi_heap_compare_func *cmp = ((flags & CMI_HASHHEAP_ORDER_MASK) == CMI_HASHHEAP_ORDER_CUSTOM)
+                                 ? hp->heap_compare : NULL;
 
     cmi_hashheap_terminate(hp);
-    cmi_hashheap_initialize(hp, hexp, cmp);
+    cmi_hashheap_initialize_wflags(hp, hexp, cmp, flags);
 }
 
 
@@ -208,32 +434,104 @@ static uint64_t hash_key(const struct cmi_hashheap *hp, const uint64_t key)
 }
 
 /*
- * hash_find_slot - Find the first free hash map slot for the given hash_key.
- * Uses a bitmap to loop around efficiently.
+ * hash_dist - How far the entry for the key at idx is from its home position,
+ * counting around the end of the hash map.
  */
-static uint64_t hash_find_slot(const struct cmi_hashheap *hp, const uint64_t key)
+static inline uint64_t hash_dist(const struct cmi_hashheap *hp,
+                                 const uint64_t idx,
+                                 const uint64_t key)
 {
     cmb_assert_debug(hp != NULL);
-    cmb_assert_debug(hp->hash_map != NULL);
 
-    const struct cmi_hash_tag *hm = hp->hash_map;
-    uint64_t hash = hash_key(hp, key);
-    const uint64_t hash_size = hp->heap_size << 1u;
-    const uint64_t bitmap = hash_size - 1u;
-    for (;;) {
-        /* Guaranteed to find a slot eventually, < 50 % hash load factor */
-        if (hm[hash].heap_index == 0u) {
-            /* Found a free slot */
-            return hash;
+    const uint64_t bitmap = (hp->heap_size << 1u) - 1u;
+
+    return (idx - hash_key(hp, key)) & bitmap;
+}
+
+/*
+ * hash_insert - Robin Hood insertion. Walk from the home position of the key,
+ * and wherever the entry found there is closer to its own home than the new one
+ * is, take its place and carry that entry onwards instead, until reaching a
+ * free position. This evens out the probe lengths, keeping the longest short,
+ * and keeps each run of entries in order of home position, so that a lookup can
+ * stop as soon as it passes where the key would have been.
+ */
+static void hash_insert(const struct cmi_hashheap *hp,
+                        const uint64_t key,
+                        const uint64_t slot)
+{
+    cmb_assert_debug(hp != NULL);
+    cmb_assert_debug(hp->hash_map != NULL);
+    cmb_assert_debug(key != 0u);
+    cmb_assert_debug(slot != 0u);
+
+    struct cmi_hash_tag *hm = hp->hash_map;
+    struct cmi_heap_item *items = hp->items;
+    const uint64_t bitmap = (hp->heap_size << 1u) - 1u;
+    struct cmi_hash_tag carried = { .hash_key = key, .item_slot = slot };
+    uint64_t idx = hash_key(hp, key);
+    uint64_t dist = 0u;
+
+    /* Guaranteed to find a free position eventually, < 50 % hash load factor */
+    while (hm[idx].hash_key != 0u) {
+        const uint64_t d = hash_dist(hp, idx, hm[idx].hash_key);
+        if (d < dist) {
+            const struct cmi_hash_tag tmp = hm[idx];
+            hm[idx] = carried;
+            items[carried.item_slot].hash_index = idx;
+            carried = tmp;
+            dist = d;
         }
 
-        /* Already taken, linear probing, try next, possibly looping around */
-        hash = (hash + 1u) & bitmap;
+        idx = (idx + 1u) & bitmap;
+        dist++;
+    }
+
+    hm[idx] = carried;
+    items[carried.item_slot].hash_index = idx;
+}
+
+/*
+ * hash_delete - Remove the entry at idx, shifting the following entries in the
+ * same run back one position each until one that is already at its home
+ * position or a free position. Leaves the map as if the entry never was there,
+ * no tombstones.
+ */
+static void hash_delete(const struct cmi_hashheap *hp, uint64_t idx)
+{
+    cmb_assert_debug(hp != NULL);
+    cmb_assert_debug(hp->hash_map != NULL);
+    cmb_assert_debug(hp->hash_map[idx].hash_key != 0u);
+
+    struct cmi_hash_tag *hm = hp->hash_map;
+    struct cmi_heap_item *items = hp->items;
+    const uint64_t bitmap = (hp->heap_size << 1u) - 1u;
+    uint64_t nxt = (idx + 1u) & bitmap;
+    while ((hm[nxt].hash_key != 0u) && (hash_dist(hp, nxt, hm[nxt].hash_key) > 0u)) {
+        hm[idx] = hm[nxt];
+        items[hm[idx].item_slot].hash_index = idx;
+        idx = nxt;
+        nxt = (nxt + 1u) & bitmap;
     }
+
+    hm[idx].hash_key = 0u;
+    hm[idx].item_slot = 0u;
 }
 
 /*
- * hash_init - Initializes hashmap from current heap for first use
+ * index_tracked - Are the heap indexes in the items kept up to date? Always
+ * with slot keys, otherwise only while the hash map is active.
+ */
+static inline bool index_tracked(const struct cmi_hashheap *hp)
+{
+    cmb_assert_debug(hp != NULL);
+
+    return hp->map_active || ((hp->heap_flags & CMI_HASHHEAP_SLOT_KEYS) != 0u);
+}
+
+/*
+ * hash_init - Initializes hashmap from current heap for first use. Items with
+ * slot keys are found without it and stay out.
  */
 static void hash_init(const struct cmi_hashheap *hp)
 {
@@ -242,16 +540,19 @@ static void hash_init(const struct cmi_hashheap *hp)
     cmb_assert_debug(hp->hash_map != NULL);
 
     for (uint64_t ui = 1u; ui <= hp->heap_count; ui++) {
-        struct cmi_heap_tag *htp = &(hp->heap[ui]);
-        htp->hash_index = hash_find_slot(hp, htp->hash_key);
-        const uint64_t hashidx = htp->hash_index;
-        hp->hash_map[hashidx].hash_key = htp->hash_key;
-        hp->hash_map[hashidx].heap_index = ui;
+        const struct cmi_heap_tag *htp = &(hp->heap[ui]);
+        struct cmi_heap_item *itp = &(hp->items[htp->item_slot]);
+        itp->heap_index = ui;
+        if (cmi_hashheap_is_slot_key(hp, htp->hash_key)) {
+            continue;
+        }
+
+        hash_insert(hp, htp->hash_key, htp->item_slot);
     }
 }
 
 /*
- * hash_rehash - Rehash old hash entries to a new hash map, removing tombstones.
+ * hash_rehash - Rehash old hash entries to a new hash map.
  */
 static void hash_rehash(const struct cmi_hashheap *hp,
                         const struct cmi_hash_tag *old_hash_map,
@@ -262,146 +563,208 @@ static void hash_rehash(const struct cmi_hashheap *hp,
     cmb_assert_debug(hp->hash_map != NULL);
     cmb_assert_debug(old_hash_map != NULL);
 
-    struct cmi_heap_tag *heap = hp->heap;
-    struct cmi_hash_tag *hash = hp->hash_map;
-
     for (uint64_t ui = 0u; ui < old_hash_size; ui++) {
         const uint64_t key = old_hash_map[ui].hash_key;
         if (key != 0u) {
-            /* Something is here */
-            const uint64_t heapidx = old_hash_map[ui].heap_index;
-            if (heapidx != 0u) {
-                /* It is not a tombstone */
-                const uint64_t hashidx = hash_find_slot(hp, key);
-                hash[hashidx].hash_key = key;
-                hash[hashidx].heap_index = heapidx;
-                heap[heapidx].hash_index = hashidx;
-            }
+            hash_insert(hp, key, old_hash_map[ui].item_slot);
         }
     }
 }
 
 /*
- * heap_up - Bubble a tag at index k upwards into its right place
+ * HEAP_SIFT_DEFINE - Generate the pair of functions heap_up_<name> and
+ * heap_down_<name>, bubbling a tag at index k up or down into its right place
+ * in the heap, with the comparison before(hp, a, b) compiled into the loops.
+ * One pair for each ordering, so that only the custom ordering has a function
+ * call through a pointer for each step.
+ *
+ * heap_up: A d-ary tree, parent node at (k - 2) / d + 1, i.e., k / 2 if binary.
+ *
+ * heap_down: Children at d * (k - 1) + 2 through d * k + 1, i.e., at 2k and
+ * 2k + 1 if binary. Find the first in order among them.
  */
-static void heap_up(const struct cmi_hashheap *hp, uint64_t k)
+#define HEAP_SIFT_DEFINE(name, before)                                         \
+static void heap_up_##name(struct cmi_hashheap *hp, uint64_t k)                \
+{                                                                              \
+    cmb_assert_debug(hp != NULL);                                              \
+    cmb_assert_debug(hp->heap != NULL);                                        \
+    cmb_assert_debug(k <= hp->heap_count);                                     \
+                                                                               \
+    struct cmi_heap_tag *heap = hp->heap;                                      \
+    struct cmi_heap_item *items = hp->items;                                   \
+    const struct cmi_heap_tag hole_tag = heap[k];                              \
+    const bool tracked = index_tracked(hp);                                    \
+    const uint16_t dexp = hp->heap_dexp;                                       \
+    uint64_t levels = 0u;                                                      \
+    while (k > 1u) {                                                           \
+        const uint64_t l = ((k - 2u) >> dexp) + 1u;                            \
+        if (!before(hp, &hole_tag, &(heap[l]))) {                              \
+            break;                                                             \
+        }                                                                      \
+                                                                               \
+        heap[k] = heap[l];                                                     \
+        if (tracked) {                                                         \
+            items[heap[k].item_slot].heap_index = k;                           \
+        }                                                                      \
+                                                                               \
+        k = l;                                                                 \
+        levels++;                                                              \
+    }                                                                          \
+                                                                               \
+    heap[k] = hole_tag;                                                        \
+    if (tracked) {                                                             \
+        items[hole_tag.item_slot].heap_index = k;                              \
+    }                                                                          \
+                                                                               \
+    hp->stats.sifts++;                                                         \
+    hp->stats.sift_levels += levels;                                           \
+}                                                                              \
+                                                                               \
+static void heap_down_##name(struct cmi_hashheap *hp, uint64_t k)              \
+{                                                                              \
+    cmb_assert_debug(hp != NULL);                                              \
+    cmb_assert_debug(hp->heap != NULL);                                        \
+    cmb_assert_debug(k <= hp->heap_count);                                     \
+                                                                               \
+    struct cmi_heap_tag *heap = hp->heap;                                      \
+    struct cmi_heap_item *items = hp->items;                                   \
+    const struct cmi_heap_tag hole_tag = heap[k];                              \
+    const bool tracked = index_tracked(hp);                                    \
+    const uint16_t dexp = hp->heap_dexp;                                       \
+    const uint64_t cnt = hp->heap_count;                                       \
+    uint64_t levels = 0u;                                                      \
+    for (;;) {                                                                 \
+        uint64_t l = ((k - 1u) << dexp) + 2u;                                  \
+        if (l > cnt) {                                                         \
+            break;                                                             \
+        }                                                                      \
+                                                                               \
+        const uint64_t last = l + (UINT64_C(1) << dexp) - 1u;                  \
+        const uint64_t end = (last < cnt) ? last : cnt;                        \
+        for (uint64_t r = l + 1u; r <= end; r++) {                             \
+            if (before(hp, &(heap[r]), &(heap[l]))) {                          \
+                l = r;                                                         \
+            }                                                                  \
+        }                                                                      \
+                                                                               \
+        if (before(hp, &hole_tag, &(heap[l]))) {                               \
+            break;                                                             \
+        }                                                                      \
+                                                                               \
+        heap[k] = heap[l];                                                     \
+        if (tracked) {                                                         \
+            items[heap[k].item_slot].heap_index = k;                           \
+        }                                                                      \
+                                                                               \
+        k = l;                                                                 \
+        levels++;                                                              \
+    }                                                                          \
+                                                                               \
+    heap[k] = hole_tag;                                                        \
+    if (tracked) {                                                             \
+        items[hole_tag.item_slot].heap_index = k;                              \
+    }                                                                          \
+                                                                               \
+    hp->stats.sifts++;                                                         \
+    hp->stats.sift_levels += levels;                                           \
+}
+
+HEAP_SIFT_DEFINE(time, order_time)
+HEAP_SIFT_DEFINE(priority_time, order_priority_time)
+HEAP_SIFT_DEFINE(priority, order_priority)
+HEAP_SIFT_DEFINE(custom, order_custom)
+
+/*
+ * heap_up - Bubble a tag at index k upwards into its right place, choosing the
+ * sift loop for the ordering once rather than the comparison at every step.
+ */
+static void heap_up(struct cmi_hashheap *hp, const uint64_t k)
 {
     cmb_assert_debug(hp != NULL);
-    cmb_assert_debug(hp->heap != NULL);
-    cmb_assert_debug(k <= hp->heap_count);
-
-    struct cmi_heap_tag *heap = hp->heap;
-    struct cmi_hash_tag *hash = hp->hash_map;
-
-    const struct cmi_heap_tag hole_tag = heap[k];
-    cmi_heap_compare_func *compare = hp->heap_compare;
-    const bool defcmp = (compare == default_compare);
-
-    /* A binary tree, parent node at k / 2 */
-    uint64_t l;
-    while ((l = (k >> 1)) > 0) {
-        /* Trading one more branch for one less redirect in the default case */
-        const bool before = (defcmp) ? default_compare(&hole_tag, &(heap[l]))
-                                     : (*compare)(&(hole_tag), &(heap[l]));
-        if (before) {
-            heap[k] = heap[l];
-            if (hp->map_active) {
-                const uint64_t khash = heap[k].hash_index;
-                hash[khash].heap_index = k;
-            }
 
-            k = l;
-        }
-        else {
+    switch (hp->heap_flags & CMI_HASHHEAP_ORDER_MASK) {
+        case CMI_HASHHEAP_ORDER_TIME:
+            heap_up_time(hp, k);
+            break;
+        case CMI_HASHHEAP_ORDER_PRIORITY_TIME:
+            heap_up_priority_time(hp, k);
+            break;
+        case CMI_HASHHEAP_ORDER_PRIORITY:
+            heap_up_priority(hp, k);
+            break;
+        default:
+            heap_up_custom(hp, k);
             break;
-        }
-    }
-
-    /* Copy the candidate into its correct slot */
-    heap[k] = hole_tag;
-    if (hp->map_active) {
-        const uint64_t khash = heap[k].hash_index;
-        hash[khash].heap_index = k;
     }
 }
 
 /*
  * heap_down - Bubble a tag at index k downwards into its right place
  */
-static void heap_down(const struct cmi_hashheap *hp, uint64_t k)
+static void heap_down(struct cmi_hashheap *hp, const uint64_t k)
 {
     cmb_assert_debug(hp != NULL);
-    cmb_assert_debug(hp->heap != NULL);
-    cmb_assert_debug(k <= hp->heap_count);
 
-    struct cmi_heap_tag *heap = hp->heap;
-    struct cmi_hash_tag *hash = hp->hash_map;
-
-    const struct cmi_heap_tag hole_tag = heap[k];
-    cmi_heap_compare_func *compare = hp->heap_compare;
-    const bool defcmp = (compare == default_compare);
-
-    /* Binary heap, children at 2x and 2x + 1 */
-    const uint64_t j = (hp->heap_count >> 1);
-    bool before;
-    while (k <= j) {
-        uint64_t l = k << 1;
-        const uint64_t r = l + 1;
-        if (r <= hp->heap_count) {
-            before = (defcmp) ? default_compare(&heap[r], &(heap[l]))
-                              : (*compare)(&(heap[r]), &(heap[l]));
-            if (before) {
-                l = r;
-            }
-        }
-
-        before = (defcmp) ? default_compare(&hole_tag, &(heap[l]))
-                          : (*compare)(&(hole_tag), &(heap[l]));
-        if (before) {
+    switch (hp->heap_flags & CMI_HASHHEAP_ORDER_MASK) {
+        case CMI_HASHHEAP_ORDER_TIME:
+            heap_down_time(hp, k);
+            break;
+        case CMI_HASHHEAP_ORDER_PRIORITY_TIME:
+            heap_down_priority_time(hp, k);
+            break;
+        case CMI_HASHHEAP_ORDER_PRIORITY:
+            heap_down_priority(hp, k);
+            break;
+        default:
+            heap_down_custom(hp, k);
             break;
-        }
-        else {
-            heap[k] = heap[l];
-            if (hp->map_active) {
-                const uint64_t khash = heap[k].hash_index;
-                hash[khash].heap_index = k;
-            }
-
-            k = l;
-        }
     }
+}
 
-    /* Copy the candidate into its correct slot */
-    heap[k] = hole_tag;
-    if (hp->map_active) {
-        const uint64_t khash = heap[k].hash_index;
-        hash[khash].heap_index = k;
+/*
+ * heap_before - Does tag a go before tag b in this heap's ordering?
+ */
+static bool heap_before(const struct cmi_hashheap *hp,
+                        const struct cmi_heap_tag *a,
+                        const struct cmi_heap_tag *b)
+{
+    cmb_assert_debug(hp != NULL);
+
+    switch (hp->heap_flags & CMI_HASHHEAP_ORDER_MASK) {
+        case CMI_HASHHEAP_ORDER_TIME:
+            return order_time(hp, a, b);
+        case CMI_HASHHEAP_ORDER_PRIORITY_TIME:
+            return order_priority_time(hp, a, b);
+        case CMI_HASHHEAP_ORDER_PRIORITY:
+            return order_priority(hp, a, b);
+        default:
+            return order_custom(hp, a, b);
     }
 }
 
 /*
- * hashheap_grow: doubling the available heap and hash map sizes.
- * The old heap is memcpy'd into its new location, each event at the same
- * index as before. The new hash map is initialized to all zeros, the old
- * hash map is memcpy'd together with the old heap into the area that now
- * belongs to the new heap. From there, valid hash entries are rehashed into
- * their new locations in the new hash map. This works since there is no
- * memory overlap between the copy of the old hash map and the new one.
+ * hashheap_resize: enlarging the available heap and hash map sizes to 2^hexp
+ * and 2^(hexp + 1) entries.
+ * The old heap and item arrays are memcpy'd into their new locations, each
+ * event at the same index and slot as before. The new hash map is initialized
+ * to all zeros, and valid hash entries are rehashed from the old hash map into
+ * their new locations in the new hash map before the old memory is freed.
  */
-static void hashheap_grow(struct cmi_hashheap *hp)
+static void hashheap_resize(struct cmi_hashheap *hp, const uint16_t hexp)
 {
-cmb_assert_debug(hp != NULL);
+    cmb_assert_debug(hp != NULL);
     cmb_assert_debug(hp->heap != NULL);
     cmb_assert_debug(hp->hash_map != NULL);
+    cmb_assert_debug(hexp > hp->heap_exp_cur);
 
     const uint64_t old_heapsz = hp->heap_size;
 
-    hp->heap_exp_cur++;
+    hp->heap_exp_cur = hexp;
     hp->heap_size = UINT64_C(1) << hp->heap_exp_cur;
 
-    const size_t heap_bts = (hp->heap_size + 1u) * sizeof(struct cmi_heap_tag);
-    const size_t hash_bts = (hp->heap_size << 1u) * sizeof(struct cmi_hash_tag);
-    const size_t total_bts = heap_bts + hash_bts;
+    const size_t heap_bts = heap_bytes(hp, hp->heap_size);
+    const size_t hash_bts = hash_bytes(hp->heap_size);
+    const size_t total_bts = heap_bts + hash_bts + item_bytes(hp->heap_size);
 
     const size_t pagesz = cmi_pagesize();
     const size_t rndtot_bts = (total_bts + pagesz - 1u) & ~(pagesz - 1u);
@@ -409,17 +772,20 @@ cmb_assert_debug(hp != NULL);
     unsigned char *mem_new = cmi_aligned_alloc(pagesz, rndtot_bts);
     cmi_memset(mem_new, 0u, rndtot_bts);
 
-    struct cmi_heap_tag *heap_new = (struct cmi_heap_tag *)mem_new;
+    struct cmi_heap_tag *heap_new = (struct cmi_heap_tag *)mem_new + heap_pad(hp);
     struct cmi_hash_tag *hash_new = (struct cmi_hash_tag *)(mem_new + heap_bts);
+    struct cmi_heap_item *items_new = (struct cmi_heap_item *)(mem_new + heap_bts + hash_bts);
 
     const size_t old_heap_bts = (old_heapsz + 1u) * sizeof(struct cmi_heap_tag);
     cmi_memcpy(heap_new, hp->heap, old_heap_bts);
+    cmi_memcpy(items_new, hp->items, item_bytes(old_heapsz));
 
     /* Save old pointers */
     const struct cmi_hash_tag *hash_old = hp->hash_map;
-    struct cmi_heap_tag *heap_old_block = hp->heap;
+    unsigned char *heap_old_block = heap_block(hp);
     hp->heap = heap_new;
     hp->hash_map = hash_new;
+    hp->items = items_new;
 
     if (hp->map_active) {
         /* Rehash into new hashmap */
@@ -427,108 +793,362 @@ cmb_assert_debug(hp != NULL);
         hash_rehash(hp, hash_old, old_hashsz);
     }
 
-    /* The rehash dropped every tombstone */
-    hp->tombstones = 0u;
     cmi_aligned_free(heap_old_block);
+
+    if (hp->subjects != NULL) {
+        cmi_subjectindex_reserve(hp->subjects, hp->heap_size + 2u);
+    }
 }
 
 /*
-* hashheap_compact - Reclaim tombstones without growing. Rebuilds the hash map
-* at its current size from the live heap entries, restoring empty slots that
-* had bled into tombstones. Needed because the grow-triggered rehash only fires
-* when the heap fills; a workload that holds the live count below that
-* threshold while churning heavily would otherwise accumulate tombstones
-* indefinitely, lengthening every lookup (which only terminates on a genuinely
-* empty slot, never on a tombstone).
-*/
-static void hashheap_compact(struct cmi_hashheap *hp)
+ * hashheap_grow: doubling the available heap and hash map sizes.
+ */
+static void hashheap_grow(struct cmi_hashheap *hp)
 {
     cmb_assert_debug(hp != NULL);
-    cmb_assert_debug(hp->heap != NULL);
-    cmb_assert_debug(hp->hash_map != NULL);
-    cmb_assert_debug(hp->map_active);
 
-    const size_t hash_bts = (hp->heap_size << 1u) * sizeof(struct cmi_hash_tag);
-    cmi_memset(hp->hash_map, 0u, hash_bts);
-    hash_init(hp);
-    hp->tombstones = 0u;
+    hashheap_resize(hp, (uint16_t)(hp->heap_exp_cur + 1u));
+    hp->stats.grows++;
 }
 
 /*
- * cmi_hashheap_enqueue - Insert item in queue, return unique event hash_key.
- * Resizes hashheap if necessary.
+ * cmi_hashheap_reserve - Resize once to the smallest power of two holding n.
  */
-uint64_t cmi_hashheap_enqueue(struct cmi_hashheap *hp,
-                              void *pl1,
-                              void *pl2,
-                              void *pl3,
-                              void *pl4,
-                              uint64_t hashkey,
-                              const double rank_d64,
-                              const int64_t rank_i64)
+void cmi_hashheap_reserve(struct cmi_hashheap *hp, const uint64_t n)
+{
+    cmb_assert_release(hp != NULL);
+    cmb_assert_release(hp->heap != NULL);
+
+    uint16_t hexp = hp->heap_exp_cur;
+    while ((UINT64_C(1) << hexp) < n) {
+        hexp++;
+    }
+
+    if (hexp > hp->heap_exp_cur) {
+        hashheap_resize(hp, hexp);
+    }
+}
+
+/*
+ * item_alloc - Get a free slot in the item array, preferably a recently used
+ * one that is still warm in the cache.
+ */
+static uint64_t item_alloc(struct cmi_hashheap *hp)
+{
+    cmb_assert_debug(hp != NULL);
+    cmb_assert_debug(hp->items != NULL);
+
+    uint64_t slot = hp->item_free;
+    if (slot != 0u) {
+        hp->item_free = hp->items[slot].next_free;
+    }
+    else {
+        slot = ++hp->item_top;
+    }
+
+    cmb_assert_debug(slot <= hp->heap_size + 1u);
+    return slot;
+}
+
+/*
+ * item_release - Return a slot to the free list.
+ */
+static void item_release(struct cmi_hashheap *hp, const uint64_t slot)
+{
+    cmb_assert_debug(hp != NULL);
+    cmb_assert_debug(hp->items != NULL);
+    cmb_assert_debug((slot > 0u) && (slot <= hp->item_top));
+
+    struct cmi_heap_item *itp = &(hp->items[slot]);
+    itp->hash_key = 0u;
+    itp->heap_index = 0u;
+    itp->next_free = hp->item_free;
+    hp->item_free = slot;
+}
+
+/*
+ * cmi_hashheap_key_reserve - Issue a key with an item slot held for it.
+ */
+uint64_t cmi_hashheap_key_reserve(struct cmi_hashheap *hp)
+{
+    cmb_assert_release(hp != NULL);
+    cmb_assert_release(hp->heap != NULL);
+
+    if ((hp->heap_flags & CMI_HASHHEAP_SLOT_KEYS) == 0u) {
+        return cmi_hashheap_next_key(hp);
+    }
+
+    /* Counts against the heap size, as if already enqueued */
+    if (hp->heap_count + hp->item_reserved >= hp->heap_size) {
+        hashheap_grow(hp);
+    }
+
+    const uint64_t slot = item_alloc(hp);
+    cmb_assert_release(slot <= CMI_HASHHEAP_SLOT_MASK);
+    const uint64_t hashkey = cmi_hashheap_next_key(hp) | slot;
+
+    struct cmi_heap_item *itp = &(hp->items[slot]);
+    cmi_memset(itp->item, 0u, sizeof(itp->item));
+    itp->hash_key = hashkey;
+    itp->heap_index = 0u;
+    itp->period = 0.0;
+    hp->item_reserved++;
+
+    return hashkey;
+}
+
+/*
+ * cmi_hashheap_key_release - Free the slot held for a reserved key.
+ */
+void cmi_hashheap_key_release(struct cmi_hashheap *hp, const uint64_t hashkey)
 {
     cmb_assert_release(hp != NULL);
+
+    if (cmi_hashheap_reserved_item(hp, hashkey) != NULL) {
+        cmb_assert_debug(hp->item_reserved > 0u);
+        item_release(hp, hashkey & CMI_HASHHEAP_SLOT_MASK);
+        hp->item_reserved--;
+    }
+}
+
+/*
+ * heap_append - Put a new item at the end of the heap, without restoring the
+ * heap order yet. Resizes hashheap if necessary. Returns its hash_key.
+ */
+static uint64_t heap_append(struct cmi_hashheap *hp,
+                            void *pl1,
+                            void *pl2,
+                            void *pl3,
+                            void *pl4,
+                            uint64_t hashkey,
+                            const double rank_d64,
+                            const int64_t rank_i64)
+{
+    cmb_assert_debug(hp != NULL);
     cmb_assert_debug(hp->heap != NULL);
     cmb_assert_debug(hp->hash_map != NULL);
-    cmb_assert_release(hp->heap_count <= hp->heap_size);
+    cmb_assert_release(hp->heap_count + hp->item_reserved <= hp->heap_size);
+
+    /* A reserved key already has its slot, anything else needs a new one */
+    const bool reserved = cmi_hashheap_is_slot_key(hp, hashkey);
+    cmb_assert_release(!reserved || (cmi_hashheap_reserved_item(hp, hashkey) != NULL));
 
     /* Do we have space? */
-    if (hp->heap_count == hp->heap_size) {
+    if (!reserved && (hp->heap_count + hp->item_reserved == hp->heap_size)) {
        hashheap_grow(hp);
     }
-    else if (hp->map_active &&
-            (hp->heap_count + hp->tombstones >= (3 * (hp->heap_size << 1)) / 4)) {
-        hashheap_compact(hp);
-    }
 
     /* Now we have space, put the new entry at the end */
     cmb_assert_debug(hp->heap_count < hp->heap_size);
     const uint64_t hc = ++hp->heap_count;
-    hp->item_counter += 1u;
-    if (hashkey == 0u) {
-        hashkey = hp->item_counter;
+    if (hc > hp->heap_peak) {
+        hp->heap_peak = hc;
     }
 
     struct cmi_heap_tag *heap = hp->heap;
-    struct cmi_hash_tag *hash = hp->hash_map;
+
+    /* The payload goes into a slot of its own, the keys into the heap */
+    uint64_t slot;
+    if (reserved) {
+        slot = hashkey & CMI_HASHHEAP_SLOT_MASK;
+        hp->item_reserved--;
+    }
+    else {
+        slot = item_alloc(hp);
+        if (hashkey == 0u) {
+            hashkey = cmi_hashheap_next_key(hp);
+            if ((hp->heap_flags & CMI_HASHHEAP_SLOT_KEYS) != 0u) {
+                cmb_assert_release(slot <= CMI_HASHHEAP_SLOT_MASK);
+                hashkey |= slot;
+            }
+        }
+    }
+
+    struct cmi_heap_item *itp = &(hp->items[slot]);
+    itp->item[0] = pl1;
+    itp->item[1] = pl2;
+    itp->item[2] = pl3;
+    itp->item[3] = pl4;
+    itp->hash_key = hashkey;
+    itp->period = 0.0;
 
     heap[hc].hash_key = hashkey;
+    heap[hc].item_slot = slot;
     heap[hc].rank_d64 = rank_d64;
     heap[hc].rank_i64 = rank_i64;
-    heap[hc].item[0] = pl1;
-    heap[hc].item[1] = pl2;
-    heap[hc].item[2] = pl3;
-    heap[hc].item[3] = pl4;
 
-    if (hp->map_active) {
-        const uint64_t idx = hash_find_slot(hp, hashkey);
-        if (hash[idx].hash_key != 0u) {
-            /* Reclaiming a tombstone. */
-            cmb_assert_debug(hp->tombstones > 0u);
-            hp->tombstones--;
-        }
+    if (hp->map_active && !cmi_hashheap_is_slot_key(hp, hashkey)) {
+        hash_insert(hp, hashkey, slot);
+    }
 
-        hash[idx].hash_key = hashkey;
-        hash[idx].heap_index = hc;
-        heap[hc].hash_index = idx;
+    if (index_tracked(hp)) {
+        itp->heap_index = hc;
     }
 
-    /* Shuffle it up into its right place */
-    heap_up(hp, hc);
+    if (hp->subjects != NULL) {
+        cmi_subjectindex_insert(hp->subjects, pl2, slot);
+    }
 
     cmb_assert_debug(hashkey > 0u);
     return hashkey;
 }
 
+/*
+ * cmi_hashheap_enqueue - Insert item in queue, return unique event hash_key.
+ * Resizes hashheap if necessary.
+ */
+uint64_t cmi_hashheap_enqueue(struct cmi_hashheap *hp,
+                              void *pl1,
+                              void *pl2,
+                              void *pl3,
+                              void *pl4,
+                              const uint64_t hashkey,
+                              const double rank_d64,
+                              const int64_t rank_i64)
+{
+    cmb_assert_release(hp != NULL);
+    cmb_assert_debug(hp->batch_from == 0u);
+
+    const uint64_t key = heap_append(hp, pl1, pl2, pl3, pl4, hashkey, rank_d64, rank_i64);
+
+    /* Shuffle it up into its right place */
+    heap_up(hp, hp->heap_count);
+
+    return key;
+}
+
+/*
+ * cmi_hashheap_enqueue_recurring - Insert item with a period, the new tag is
+ * still last in the heap right after the append.
+ */
+uint64_t cmi_hashheap_enqueue_recurring(struct cmi_hashheap *hp,
+                                        void *pl1,
+                                        void *pl2,
+                                        void *pl3,
+                                        void *pl4,
+                                        const uint64_t hashkey,
+                                        const double rank_d64,
+                                        const int64_t rank_i64,
+                                        const double period)
+{
+    cmb_assert_release(hp != NULL);
+    cmb_assert_debug(hp->batch_from == 0u);
+
+    const uint64_t key = heap_append(hp, pl1, pl2, pl3, pl4, hashkey, rank_d64, rank_i64);
+    hp->items[hp->heap[hp->heap_count].item_slot].period = period;
+    heap_up(hp, hp->heap_count);
+
+    return key;
+}
+
+/*
+ * heap_rebuilds - Is it cheaper to rebuild the entire heap of n items bottom
+ * up, O(n), than to sift k of them into place one by one, O(k log n)?
+ */
+static bool heap_rebuilds(const struct cmi_hashheap *hp, const uint64_t n, const uint64_t k)
+{
+    cmb_assert_debug(hp != NULL);
+
+    if (n < 2u) {
+        return false;
+    }
+
+    /* The depth of the tree, in levels of d-ary nodes */
+    const unsigned depth = (63u - (unsigned)__builtin_clzll(n)) / hp->heap_dexp + 1u;
+
+    return (k * depth > n);
+}
+
+/*
+ * heap_heapify - Floyd's bottom-up heap construction, sifting down every
+ * node that has children, from the last one to the root. O(n) in total, since
+ * most nodes are close to the bottom with little room to move.
+ */
+static void heap_heapify(struct cmi_hashheap *hp)
+{
+    cmb_assert_debug(hp != NULL);
+
+    const uint64_t cnt = hp->heap_count;
+    if (cnt < 2u) {
+        return;
+    }
+
+    const uint64_t last_parent = ((cnt - 2u) >> hp->heap_dexp) + 1u;
+    for (uint64_t k = last_parent; k > 0u; k--) {
+        heap_down(hp, k);
+    }
+}
+
+/*
+ * cmi_hashheap_batch_begin - Make room for n more items in one go and start
+ * appending.
+ */
+void cmi_hashheap_batch_begin(struct cmi_hashheap *hp, const uint64_t n)
+{
+    cmb_assert_release(hp != NULL);
+    cmb_assert_release(hp->heap != NULL);
+    cmb_assert_release(hp->batch_from == 0u);
+
+    cmi_hashheap_reserve(hp, hp->heap_count + n);
+    hp->batch_from = hp->heap_count + 1u;
+}
+
+/*
+ * cmi_hashheap_batch_append - As enqueue, but leaving the new item at the end
+ * of the heap for cmi_hashheap_batch_end to put in order.
+ */
+uint64_t cmi_hashheap_batch_append(struct cmi_hashheap *hp,
+                                   void *pl1,
+                                   void *pl2,
+                                   void *pl3,
+                                   void *pl4,
+                                   const uint64_t hashkey,
+                                   const double rank_d64,
+                                   const int64_t rank_i64)
+{
+    cmb_assert_release(hp != NULL);
+    cmb_assert_release(hp->batch_from != 0u);
+
+    return heap_append(hp, pl1, pl2, pl3, pl4, hashkey, rank_d64, rank_i64);
+}
+
+/*
+ * cmi_hashheap_batch_end - Restore the heap order, either by sifting each new
+ * item up from the end or by rebuilding the whole heap, whichever is cheaper.
+ */
+void cmi_hashheap_batch_end(struct cmi_hashheap *hp)
+{
+    cmb_assert_release(hp != NULL);
+    cmb_assert_release(hp->batch_from != 0u);
+
+    const uint64_t first = hp->batch_from;
+    const uint64_t cnt = hp->heap_count;
+    hp->batch_from = 0u;
+    if (first > cnt) {
+        /* Nothing appended */
+        return;
+    }
+
+    if (heap_rebuilds(hp, cnt, cnt - first + 1u)) {
+        heap_heapify(hp);
+    }
+    else {
+        for (uint64_t k = first; k <= cnt; k++) {
+            heap_up(hp, k);
+        }
+    }
+}
+
 /*
  * cmi_hashheap_dequeue - Remove and return the next item.
- * Temporarily saves the event to location 0 of the heap. Note that this space
- * will be overwritten by the next call to dequeue. It is not a valid pointer
- * for very long.
+ * Temporarily saves the heap tag to location 0 of the heap and holds on to the
+ * item slot. Note that both will be reused after the next call to dequeue.
+ * It is not a valid pointer for very long.
  */
 void **cmi_hashheap_dequeue(struct cmi_hashheap *hp)
 {
     cmb_assert_release(hp != NULL);
+    cmb_assert_debug(hp->batch_from == 0u);
 
     const uint64_t heapcnt = hp->heap_count;
     if ((hp->heap == NULL) || (heapcnt == 0u)) {
@@ -536,23 +1156,36 @@ void **cmi_hashheap_dequeue(struct cmi_hashheap *hp)
         return NULL;
     }
 
-    /* Copy the event to the working space at index 0. */
+    /* Let go of the previous one, now it is safe to reuse its slot */
+    if (hp->item_current != 0u) {
+        item_release(hp, hp->item_current);
+    }
+
+    /* Copy the keys to the working space at index 0, keep the payload slot */
     struct cmi_heap_tag *heap = hp->heap;
+    struct cmi_heap_item *items = hp->items;
     heap[0u] = heap[1u];
+    const uint64_t slot = heap[0u].item_slot;
+    hp->item_current = slot;
 
-    if (hp->map_active) {
-        /* Mark it as deleted (a tombstone) in the hash map */
-        const uint64_t idx = heap[0u].hash_index;
-        hp->hash_map[idx].heap_index = 0u;
-        hp->tombstones++;
+    const bool tracked = index_tracked(hp);
+    if (hp->map_active && !cmi_hashheap_is_slot_key(hp, heap[0u].hash_key)) {
+        hash_delete(hp, items[slot].hash_index);
+    }
+
+    if (tracked) {
+        items[slot].heap_index = 0u;
+    }
+
+    if (hp->subjects != NULL) {
+        cmi_subjectindex_erase(hp->subjects, items[slot].item[1], slot);
     }
 
     /* Reshuffle the heap */
     if (heapcnt > 1u) {
         heap[1u] = heap[heapcnt];
-        if (hp->map_active) {
-            const uint64_t idx = hp->heap[1u].hash_index;
-            hp->hash_map[idx].heap_index = 1u;
+        if (tracked) {
+            items[heap[1u].item_slot].heap_index = 1u;
         }
 
         hp->heap_count = heapcnt - 1u;
@@ -564,7 +1197,7 @@ void **cmi_hashheap_dequeue(struct cmi_hashheap *hp)
         hp->heap_count = 0u;
     }
 
-    return heap[0u].item;
+    return items[slot].item;
 }
 
 /*
@@ -575,26 +1208,31 @@ bool cmi_hashheap_remove(struct cmi_hashheap *hp, const uint64_t hashkey)
     cmb_assert_release(hp != NULL);
     cmb_assert_release(hashkey != 0u);
 
+    cmb_assert_debug(hp->batch_from == 0u);
+
     if ((hp->heap == NULL) || (hp->heap_count == 0u)) {
          return false;
     }
 
-    if (!hp->map_active) {
-        /* Lazy activation, now's the time */
-        hash_init(hp);
-        hp->map_active = true;
-    }
-
-    const uint64_t heapidx = cmi_hash_find_index(hp, hashkey);
-    if (heapidx == 0u) {
+    /* Turns on the hash map if needed for this key */
+    const uint64_t slot = cmi_hash_find_slot(hp, hashkey);
+    if (slot == 0u) {
         return false;
     }
 
-    /* Lazy hashmap deletion, tombstone it */
+    /* Take it out of the hash map, and free the item slot */
+    struct cmi_heap_item *items = hp->items;
+    const uint64_t heapidx = items[slot].heap_index;
     cmb_assert_debug(hp->heap[heapidx].hash_key == hashkey);
-    uint64_t hashidx = hp->heap[heapidx].hash_index;
-    hp->hash_map[hashidx].heap_index = 0u;
-    hp->tombstones++;
+    if (!cmi_hashheap_is_slot_key(hp, hashkey)) {
+        hash_delete(hp, items[slot].hash_index);
+    }
+
+    if (hp->subjects != NULL) {
+        cmi_subjectindex_erase(hp->subjects, items[slot].item[1], slot);
+    }
+
+    item_release(hp, slot);
 
     /* Remove entry from heap */
     if (heapidx == hp->heap_count) {
@@ -605,12 +1243,9 @@ bool cmi_hashheap_remove(struct cmi_hashheap *hp, const uint64_t hashkey)
         const uint64_t heapcnt = hp->heap_count;
         const struct cmi_heap_tag *a = &(hp->heap[heapidx]);
         const struct cmi_heap_tag *b = &(hp->heap[heapcnt]);
-        const bool defcmp = (hp->heap_compare == default_compare);
-        const bool move_down = (defcmp) ? default_compare(a, b)
-                                     : (*hp->heap_compare)(a, b);
+        const bool move_down = heap_before(hp, a, b);
         hp->heap[heapidx] = hp->heap[heapcnt];
-        hashidx = hp->heap[heapidx].hash_index;
-        hp->hash_map[hashidx].heap_index = heapidx;
+        items[hp->heap[heapidx].item_slot].heap_index = heapidx;
         hp->heap_count--;
         if (move_down) {
             heap_down(hp, heapidx);
@@ -624,46 +1259,172 @@ bool cmi_hashheap_remove(struct cmi_hashheap *hp, const uint64_t hashkey)
 }
 
 /*
- * hash_find_index - Find the heap index of a given hashkey, zero if not found.
+ * cmi_hashheap_remove_batch - Remove the given entries. If there are enough of
+ * them, fill each hole with the last tag in the heap without sifting, and
+ * rebuild the heap once at the end, otherwise remove them one by one.
+ */
+uint64_t cmi_hashheap_remove_batch(struct cmi_hashheap *hp,
+                                   const uint64_t *keys,
+                                   const uint64_t n)
+{
+    cmb_assert_release(hp != NULL);
+    cmb_assert_release((keys != NULL) || (n == 0u));
+    cmb_assert_debug(hp->batch_from == 0u);
+
+    if ((hp->heap == NULL) || (hp->heap_count == 0u)) {
+         return 0u;
+    }
+
+    uint64_t cnt = 0u;
+    if (!heap_rebuilds(hp, hp->heap_count, n)) {
+        for (uint64_t ui = 0u; ui < n; ui++) {
+            if (cmi_hashheap_remove(hp, keys[ui])) {
+                cnt++;
+            }
+        }
+
+        return cnt;
+    }
+
+    struct cmi_heap_item *items = hp->items;
+    for (uint64_t ui = 0u; ui < n; ui++) {
+        /* Turns on the hash map if needed for this key */
+        const uint64_t slot = cmi_hash_find_slot(hp, keys[ui]);
+        if (slot == 0u) {
+            continue;
+        }
+
+        const uint64_t heapidx = items[slot].heap_index;
+        cmb_assert_debug(hp->heap[heapidx].hash_key == keys[ui]);
+        if (!cmi_hashheap_is_slot_key(hp, keys[ui])) {
+            hash_delete(hp, items[slot].hash_index);
+        }
+
+        if (hp->subjects != NULL) {
+            cmi_subjectindex_erase(hp->subjects, items[slot].item[1], slot);
+        }
+
+        item_release(hp, slot);
+
+        /* Plug the hole with the last one, never mind the order for now */
+        const uint64_t heapcnt = hp->heap_count;
+        if (heapidx != heapcnt) {
+            hp->heap[heapidx] = hp->heap[heapcnt];
+            items[hp->heap[heapidx].item_slot].heap_index = heapidx;
+        }
+
+        hp->heap_count--;
+        cnt++;
+    }
+
+    heap_heapify(hp);
+
+    return cnt;
+}
+
+/*
+ * hash_count_probe - Note the probe length of a lookup in the statistics.
+ */
+static inline void hash_count_probe(struct cmi_hashheap *hp, const uint64_t dist)
+{
+    hp->stats.lookups++;
+    hp->stats.probes += dist;
+    if (dist > hp->stats.probe_max) {
+        hp->stats.probe_max = dist;
+    }
+}
+
+/*
+ * cmi_hash_find_slot - Find the item slot of a given hashkey, zero if not found.
  * Uses a bitmap with all ones in the first positions to wrap around fast,
  * instead of using the modulo operator. In effect, simulates overflow in an
  * unsigned integer of (heap_exp_cur + 1) bits.
+ *
+ * A slot key is checked against the key in its item slot instead, only valid
+ * if the item there has the same key and is still in the heap.
  */
-uint64_t cmi_hash_find_index(struct cmi_hashheap *hp, const uint64_t hashkey)
+uint64_t cmi_hash_find_slot(struct cmi_hashheap *hp, const uint64_t hashkey)
 {
     cmb_assert_debug(hp != NULL);
     cmb_assert_debug(hp->hash_map != NULL);
 
+    if (cmi_hashheap_is_slot_key(hp, hashkey)) {
+        const uint64_t slot = hashkey & CMI_HASHHEAP_SLOT_MASK;
+        if ((slot <= hp->item_top)
+            && (hp->items[slot].hash_key == hashkey)
+            && (hp->items[slot].heap_index != 0u)) {
+            return slot;
+        }
+
+        return 0u;
+    }
+
     if (!hp->map_active) {
         /* Initialize hashmap */
         hash_init(hp);
         hp->map_active = true;
     }
 
-    const uint64_t hash_size = hp->heap_size << 1u;
-    const uint64_t bitmap = hash_size - 1u;
+    const uint64_t bitmap = (hp->heap_size << 1u) - 1u;
     const struct cmi_hash_tag *hm = hp->hash_map;
     uint64_t hash = hash_key(hp, hashkey);
-    const uint64_t hash_start = hash;
+    uint64_t dist = 0u;
     for (;;) {
-        if (hm[hash].hash_key == hashkey) {
-            /* Found, return the heap index (possibly a tombstone zero) */
-            return hm[hash].heap_index;
+        const uint64_t key = hm[hash].hash_key;
+        if (key == hashkey) {
+            hash_count_probe(hp, dist);
+            return hm[hash].item_slot;
         }
 
-        /* If we reached a never-used slot, the hashkey is not in the hash map */
-        if (hm[hash].hash_key == 0u) {
+        /* A free position, or an entry closer to home than this key would be
+         * here, means that the key is not in the hash map */
+        if ((key == 0u) || (hash_dist(hp, hash, key) < dist)) {
+            hash_count_probe(hp, dist);
             return 0u;
         }
 
         /* Not in slot, use linear probing, try next, possibly looping around */
         hash = (hash + 1u) & bitmap;
+        dist++;
+    }
+}
 
-        /* If we've wrapped around to where we started, the hashkey is not here */
-        if (hash == hash_start) {
-            return 0u;
+/*
+ * cmi_hashheap_probe_max - The longest probe distance in the hash map.
+ */
+uint64_t cmi_hashheap_probe_max(const struct cmi_hashheap *hp)
+{
+    cmb_assert_release(hp != NULL);
+
+    uint64_t dmax = 0u;
+    if ((hp->heap == NULL) || !hp->map_active) {
+        return dmax;
+    }
+
+    const uint64_t hash_size = hp->heap_size << 1u;
+    for (uint64_t ui = 0u; ui < hash_size; ui++) {
+        const uint64_t key = hp->hash_map[ui].hash_key;
+        if (key != 0u) {
+            const uint64_t d = hash_dist(hp, ui, key);
+            if (d > dmax) {
+                dmax = d;
+            }
         }
     }
+
+    return dmax;
+}
+
+/*
+ * cmi_hash_find_index - Find the heap index of a given hashkey, zero if not found.
+ */
+uint64_t cmi_hash_find_index(struct cmi_hashheap *hp, const uint64_t hashkey)
+{
+    cmb_assert_debug(hp != NULL);
+
+    const uint64_t slot = cmi_hash_find_slot(hp, hashkey);
+
+    return (slot != 0u) ? hp->items[slot].heap_index : 0u;
 }
 
 /*
@@ -676,10 +1437,10 @@ void **cmi_hashheap_item(struct cmi_hashheap *hp, const uint64_t hashkey)
     cmb_assert_debug(hp->heap != NULL);
     cmb_assert_debug(hp->heap_count != 0u);
 
-    const uint64_t idx = cmi_hash_find_index(hp, hashkey);
-    cmb_assert_release(idx != 0u);
+    const uint64_t slot = cmi_hash_find_slot(hp, hashkey);
+    cmb_assert_release(slot != 0u);
 
-    return hp->heap[idx].item;
+    return hp->items[slot].item;
 }
 
 /*
@@ -731,12 +1492,9 @@ void cmi_hashheap_reprioritize(struct cmi_hashheap *hp,
     cmb_assert_debug(hp->heap != NULL);
     cmb_assert_debug(hp->heap_count != 0u);
     cmb_assert_debug(hp->heap_compare != NULL);
+    cmb_assert_debug(hp->batch_from == 0u);
 
-    if (!hp->map_active) {
-        hash_init(hp);
-        hp->map_active = true;
-    }
-
+    /* Turns on the hash map if needed for this key */
     const uint64_t idx = cmi_hash_find_index(hp, hashkey);
     cmb_assert_release(idx != 0u);
 
@@ -744,9 +1502,7 @@ void cmi_hashheap_reprioritize(struct cmi_hashheap *hp,
     hp->heap[idx].rank_d64 = drank;
     hp->heap[idx].rank_i64 = irank;
 
-    const bool defcmp = (hp->heap_compare == default_compare);
-    const bool move_down = (defcmp) ? default_compare(&old_tagval, &(hp->heap[idx]))
-                                    : (*hp->heap_compare)(&old_tagval, &(hp->heap[idx]));
+    const bool move_down = heap_before(hp, &old_tagval, &(hp->heap[idx]));
     if (move_down) {
         heap_down(hp, idx);
     }
@@ -755,33 +1511,62 @@ void cmi_hashheap_reprioritize(struct cmi_hashheap *hp,
     }
 }
 
+/*
+ * cmi_hashheap_requeue_first - New rank_d64 for the first item, sifted down
+ * from the top without leaving the heap.
+ */
+void cmi_hashheap_requeue_first(struct cmi_hashheap *hp, const double drank)
+{
+    cmb_assert_release(hp != NULL);
+    cmb_assert_release(hp->heap_count != 0u);
+    cmb_assert_debug(hp->heap != NULL);
+    cmb_assert_debug(hp->batch_from == 0u);
+
+    hp->heap[1].rank_d64 = drank;
+    if (hp->heap_count > 1u) {
+        heap_down(hp, 1u);
+    }
+}
+
 /*
  * item_match - Wildcard search helper function to get the condition
  * out of the next three functions.
  */
-static bool item_match(const struct cmi_heap_tag *htp,
+static bool item_match(const struct cmi_heap_item *itp,
                        const void *val1,
                        const void *val2,
                        const void *val3,
                        const void *val4)
 {
-    cmb_assert_debug(htp != NULL);
+    cmb_assert_debug(itp != NULL);
 
     bool ret = true;
-    if ( ((val1 != htp->item[0]) && (val1 != CMI_ANY_ITEM))
-      || ((val2 != htp->item[1]) && (val2 != CMI_ANY_ITEM))
-      || ((val3 != htp->item[2]) && (val3 != CMI_ANY_ITEM))
-      || ((val4 != htp->item[3]) && (val4 != CMI_ANY_ITEM))) {
+    if ( ((val1 != itp->item[0]) && (val1 != CMI_ANY_ITEM))
+      || ((val2 != itp->item[1]) && (val2 != CMI_ANY_ITEM))
+      || ((val3 != itp->item[2]) && (val3 != CMI_ANY_ITEM))
+      || ((val4 != itp->item[3]) && (val4 != CMI_ANY_ITEM))) {
         ret = false;
     }
 
     return ret;
 }
 
+/*
+ * by_subject - Can the search go through the subject index? Only if there is
+ * one and the subject is given.
+ */
+static inline bool by_subject(const struct cmi_hashheap *hp, const void *val2)
+{
+    cmb_assert_debug(hp != NULL);
+
+    return (hp->subjects != NULL) && (val2 != CMI_ANY_ITEM);
+}
+
 /*
  * cmi_hashheap_find - Locate a specific event, using CMB_ANY_ITEM as a
  * wildcard in the respective positions. Returns the hash_key of the item, or
- * zero if none is found. Simple linear search from the start of the heap.
+ * zero if none is found. Simple linear search from the start of the heap,
+ * or through the items for the given val2 if indexed by it.
  */
 uint64_t cmi_hashheap_pattern_find(const struct cmi_hashheap *hp,
                                    const void *val1,
@@ -795,9 +1580,22 @@ uint64_t cmi_hashheap_pattern_find(const struct cmi_hashheap *hp,
         return 0u;
     }
 
+    if (by_subject(hp, val2)) {
+        for (uint64_t slot = cmi_subjectindex_first(hp->subjects, val2);
+             slot != 0u;
+             slot = cmi_subjectindex_next(hp->subjects, slot)) {
+            const struct cmi_heap_item *itp = &(hp->items[slot]);
+            if (item_match(itp, val1, val2, val3, val4)) {
+                return itp->hash_key;
+            }
+        }
+
+        return 0u;
+    }
+
     for (uint64_t ui = 1u; ui <= hp->heap_count; ui++) {
-        const struct cmi_heap_tag *htp = &(hp->heap[ui]);
-        if (item_match(htp, val1, val2, val3, val4)) {
+        const struct cmi_heap_item *itp = &(hp->items[hp->heap[ui].item_slot]);
+        if (item_match(itp, val1, val2, val3, val4)) {
             return hp->heap[ui].hash_key;
         }
     }
@@ -823,9 +1621,25 @@ uint64_t cmi_hashheap_pattern_count(const struct cmi_hashheap *hp,
     }
 
     uint64_t cnt = 0u;
+    if (by_subject(hp, val2)) {
+        if ((val1 == CMI_ANY_ITEM) && (val3 == CMI_ANY_ITEM) && (val4 == CMI_ANY_ITEM)) {
+            return cmi_subjectindex_count(hp->subjects, val2);
+        }
+
+        for (uint64_t slot = cmi_subjectindex_first(hp->subjects, val2);
+             slot != 0u;
+             slot = cmi_subjectindex_next(hp->subjects, slot)) {
+            if (item_match(&(hp->items[slot]), val1, val2, val3, val4)) {
+                cnt++;
+            }
+        }
+
+        return cnt;
+    }
+
     for (uint64_t ui = 1u; ui <= hp->heap_count; ui++) {
-        const struct cmi_heap_tag *htp = &(hp->heap[ui]);
-        if (item_match(htp, val1, val2, val3, val4)) {
+        const struct cmi_heap_item *itp = &(hp->items[hp->heap[ui].item_slot]);
+        if (item_match(itp, val1, val2, val3, val4)) {
             cnt++;
         }
     }
@@ -858,27 +1672,34 @@ uint64_t cmi_hashheap_pattern_cancel(struct cmi_hashheap *hp,
     if (hsz > match_buf_size) {
         /* Safe also for initial call, since realloc reverts to malloc if target
          * is NULL, and our cmb_calloc wrapper includes the return value test */
-        match_buf = (uint64_t*)cmi_realloc(match_buf, hsz);
+        match_buf = (uint64_t*)cmi_realloc(match_buf, hsz * sizeof(*match_buf));
         match_buf_size = hsz;
     }
     /* First pass, recording the matches */
     uint64_t cnt = 0u;
-    for (uint64_t ui = 1; ui <= hp->heap_count; ui++) {
-        const struct cmi_heap_tag *htp = &(hp->heap[ui]);
-        if (item_match(htp, val1, val2, val3, val4)) {
-            /* Matched, note it on the list */
-            match_buf[cnt++] = hp->heap[ui].hash_key;
+    if (by_subject(hp, val2)) {
+        for (uint64_t slot = cmi_subjectindex_first(hp->subjects, val2);
+             slot != 0u;
+             slot = cmi_subjectindex_next(hp->subjects, slot)) {
+            const struct cmi_heap_item *itp = &(hp->items[slot]);
+            if (item_match(itp, val1, val2, val3, val4)) {
+                match_buf[cnt++] = itp->hash_key;
+            }
         }
     }
-
-    /*
-     * Second pass, remove the matching events, never mind the
-     * heap reshuffling underneath us for each cancellation.
-     */
-    for (uint64_t ui = 0u; ui < cnt; ui++) {
-        cmi_hashheap_remove(hp, match_buf[ui]);
+    else {
+        for (uint64_t ui = 1; ui <= hp->heap_count; ui++) {
+            const struct cmi_heap_item *itp = &(hp->items[hp->heap[ui].item_slot]);
+            if (item_match(itp, val1, val2, val3, val4)) {
+                /* Matched, note it on the list */
+                match_buf[cnt++] = hp->heap[ui].hash_key;
+            }
+        }
     }
 
+    /* Second pass, remove the matching events, rebuilding the heap once */
+    (void)cmi_hashheap_remove_batch(hp, match_buf, cnt);
+
     return cnt;
 }
 
@@ -913,16 +1734,17 @@ void cmi_hashheap_heap_print(const struct cmi_hashheap *hp, FILE *fp,
     }
 
     fprintf(fp, "------------------------------------- Heap -------------------------------------\n");
-    fprintf(fp, "Heap idx\tHash key\tHash idx\tDbl rank\tInt rank\tValues\n");
+    fprintf(fp, "Heap idx\tHash key\tItem slot\tDbl rank\tInt rank\tValues\n");
     for (uint64_t ui = 1u; ui <= hp->heap_count; ui++) {
         const struct cmi_heap_tag *htp = &(hp->heap[ui]);
+        const struct cmi_heap_item *itp = &(hp->items[htp->item_slot]);
         fprintf(fp, "%8" PRIu64 "\t%8" PRIu64 "\t%8" PRIu64 "\t%#8.4g\t%8" PRIi64 "\t%s\n",
                 ui,
                 htp->hash_key,
-                htp->hash_index,
+                htp->item_slot,
                 htp->rank_d64,
                 htp->rank_i64,
-                (*hif)(htp->item[0], htp->item[1], htp->item[2], htp->item[3]));
+                (*hif)(itp->item[0], itp->item[1], itp->item[2], itp->item[3]));
     }
 
     fprintf(fp, "--------------------------------------------------------------------------------\n");
@@ -936,10 +1758,10 @@ void cmi_hashheap_hash_print(const struct cmi_hashheap *hp, FILE *fp)
 
     fprintf(fp, "Hash map %s\n", hp->map_active ? "active" : "inactive");
     fprintf(fp, "------------------------------------- Hash -------------------------------------\n");
-    fprintf(fp, "Hash idx\tHash key\tHeap idx\n");
+    fprintf(fp, "Hash idx\tHash key\tItem slot\n");
     for (uint64_t ui = 0u; ui < 2 * hp->heap_size; ui++) {
         const struct cmi_hash_tag *htp = &(hp->hash_map[ui]);
-        fprintf(fp, "%8" PRIu64 "\t%8" PRIu64 "\t%8" PRIu64 "\n", ui, htp->hash_key, htp->heap_index);
+        fprintf(fp, "%8" PRIu64 "\t%8" PRIu64 "\t%8" PRIu64 "\n", ui, htp->hash_key, htp->item_slot);
     }
 
     fprintf(fp, "--------------------------------------------------------------------------------\n");
@@ -958,3 +1780,12 @@ void cmi_hashheap_thread_cleanup(void)
         match_buf_size = UINT64_C(0);
     }
 }
+
+/*
+ * cmi_hashheap_snapshot_regions - Add the thread local match buffer to the snapshot.
+ */
+void cmi_hashheap_snapshot_regions(struct cmb_snapshot *sp)
+{
+    cmi_snapshot_add(sp, &match_buf, sizeof(match_buf));
+    cmi_snapshot_add(sp, &match_buf_size, sizeof(match_buf_size));
+}
@@ -44,18 +44,42 @@
 
 #include "cmb_assert.h"
 
+/* The optional subject index, see cmi_subjectindex.h */
+struct cmi_subjectindex;
+
 /*
- * struct cmi_heap_tag - The record to store an item in the priority queue.
- * These tags only exist as members of the event queue array, never alone.
- * The hash_key is a unique event identifier, the hash_index a reference to where
- * in the hash map it is located. The heap tag is 8 * 8 = 64 bytes large.
+ * struct cmi_heap_tag - The sort keys of an item in the priority queue.
+ * These tags only exist as members of the heap array, never alone.
+ * The hash_key is a unique event identifier, the item_slot a reference to where
+ * in the item array its payload is located. The heap tag is 4 * 8 = 32 bytes
+ * large, two to a cache line, and is all that moves when the heap reshuffles.
  */
 struct cmi_heap_tag {
     uint64_t hash_key;    /* The unique handle/ID, sorting tiebreaker */
-    uint64_t hash_index;  /* Position in the hash map */
+    uint64_t item_slot;   /* Position of the payload in the item array */
     double   rank_d64;    /* Primary sort (e.g., time) */
     int64_t  rank_i64;    /* Secondary sort (e.g., priority) */
+};
+
+/*
+ * struct cmi_heap_item - The payload of an item in the priority queue, stored
+ * in a separate item array. It stays in the same slot from enqueue until the
+ * next dequeue after its own, while its heap tag moves around in the heap.
+ * The heap_index and hash_index lead back to the heap tag and the hash map
+ * entry, but are only maintained while the hash map is active.
+ * The period is only for the user's bookkeeping of recurring items, zero for
+ * others, sharing space with the free list link that is only used while free.
+ * The item record is 8 * 8 = 64 bytes large, one cache line.
+ */
+struct cmi_heap_item {
     void    *item[4];     /* The actual payload items */
+    uint64_t hash_key;    /* The unique handle/ID, zero if slot is free */
+    uint64_t heap_index;  /* Current position in the heap array */
+    uint64_t hash_index;  /* Position in the hash map */
+    union {
+        uint64_t next_free;   /* Next slot in the free list, if free */
+        double period;        /* Recurrence interval, if in use */
+    };
 };
 
 /*
@@ -67,14 +91,36 @@ typedef bool (cmi_heap_compare_func)(const struct cmi_heap_tag *a,
                                      const struct cmi_heap_tag *b);
 
 /*
- * struct cmi_hash_tag - Hash mapping from event hash_key to heap position.
- * Heap index value zero indicates a tombstone, event is no longer in the heap.
+ * struct cmi_hash_tag - Hash mapping from event hash_key to its item slot.
+ * Hash key value zero indicates a free position. Since the item slot does not
+ * change, the hash map is not touched by the heap reshuffling, only by
+ * insertions and removals.
+ *
+ * The hashheap probes the map Robin Hood style, where an entry further from
+ * its home position takes the place of one closer to its own, and deletes
+ * with backward shift, moving the rest of the run back to fill the hole
+ * instead of leaving a tombstone.
  *
  * Note that the hashtag is 2 * 8 = 16 bytes large.
  */
 struct cmi_hash_tag {
     uint64_t hash_key;      /* The lookup handle */
-    uint64_t heap_index;    /* Current position in the heap array */
+    uint64_t item_slot;     /* Position in the item array */
+};
+
+/*
+ * struct cmi_hashheap_stats - Running counts of the work done since the
+ * hashheap was initialized or rewound, a few additions per operation. Lookups
+ * and probes only count keys found through the hash map, and the probe length
+ * is the distance from the home position of the key to where it was found.
+ */
+struct cmi_hashheap_stats {
+    uint64_t grows;         /* Doublings of the heap when full */
+    uint64_t lookups;       /* Keys looked up in the hash map */
+    uint64_t probes;        /* Sum of the probe lengths of the lookups */
+    uint64_t probe_max;     /* Longest probe length in a lookup */
+    uint64_t sifts;         /* Calls to sift a tag up or down the heap */
+    uint64_t sift_levels;   /* Sum of the levels moved by the sifts */
 };
 
 /*
@@ -95,21 +141,219 @@ struct cmi_hash_tag {
  *
  * item_counter is a running count of all items seen, used to assign new keys
  * valid for this hashheap only.
+ *
+ * The item array has heap_size + 1 usable slots, numbered from 1, enough for
+ * every item in the heap or reserved for it, plus the most recently dequeued
+ * one, whose slot is held as item_current until the next dequeue. Freed slots
+ * are reused in LIFO order from the item_free list, untouched ones from
+ * item_top upwards.
  */
 
 struct cmi_hashheap {
     struct cmi_heap_tag *heap;
     struct cmi_hash_tag *hash_map;
+    struct cmi_heap_item *items;
     cmi_heap_compare_func *heap_compare;
+    struct cmi_subjectindex *subjects;  /* Index by item[1], if asked for */
     uint64_t heap_size;     /* Max number of items */
     uint64_t heap_count;    /* Current number of items */
     uint64_t item_counter;  /* Running counter */
-    uint64_t tombstones;    /* Current number */
+    uint64_t item_top;      /* Highest item slot used so far */
+    uint64_t item_free;     /* First slot in the free list, zero if none */
+    uint64_t item_current;  /* Slot of the most recently dequeued item */
+    uint64_t item_reserved; /* Slots held for keys not in the heap yet */
+    uint64_t batch_from;    /* First heap index appended in a batch, zero if none */
+    uint64_t heap_peak;     /* Highest heap_count since initialized or rewound */
+    struct cmi_hashheap_stats stats;
     bool map_active;        /* Is the hash map turned on? */
     uint16_t heap_exp_init; /* Initial sizing, */
     uint16_t heap_exp_cur;  /* Current sizing */
+    uint16_t heap_dexp;     /* Arity of the heap is 2^heap_dexp */
+    uint16_t heap_flags;    /* Layout options given at initialization */
 };
 
+/*
+ * Layout options for cmi_hashheap_initialize_wflags. The heap is binary by
+ * default, but can be made 4-ary or 8-ary for very large queues, trading a few
+ * more comparisons per level for a tree that is half or a third as deep.
+ *
+ * In a d-ary heap, the children of node k are at d * (k - 1) + 2 through
+ * d * k + 1, and the parent of node k is at (k - 2) / d + 1. The heap array is
+ * offset by d - 2 slots from the start of the page-aligned allocation, so that
+ * each sibling group starts on a d-tag boundary. With 32-byte heap tags, the
+ * siblings compared in one heap_down step occupy exactly d / 2 adjacent cache
+ * lines, never straddling more.
+ */
+#define CMI_HASHHEAP_BINARY     0x0000u
+#define CMI_HASHHEAP_QUATERNARY 0x0001u
+#define CMI_HASHHEAP_OCTONARY   0x0002u
+#define CMI_HASHHEAP_ARITY_MASK 0x0003u
+
+/*
+ * Key option for cmi_hashheap_initialize_wflags. By default, keys are issued
+ * from a running counter and looked up through the hash map. With slot keys,
+ * each key is the running count shifted up by CMI_HASHHEAP_SLOT_BITS with the
+ * item slot in the lower bits. The key then leads straight to its item slot,
+ * where it is only valid if the item there still has the very same key. The
+ * running count works as a generation counter for the slot, and keeps the keys
+ * in the order they were issued for the FIFO tiebreaker.
+ *
+ * The heap index in each item is kept up to date all the time, not only when
+ * the hash map is active, so that lookup, removal, and reprioritizing is one
+ * memory access from the key. Keys issued by cmi_hashheap_key_reserve for an
+ * item kept somewhere else for now hold an item slot of their own until
+ * enqueued or released. Keys given by the caller, and keys issued by
+ * cmi_hashheap_next_key, have zero in the slot bits and go through the hash map
+ * as before, turning it on at first need. The 36 bits left for the running
+ * count are enough for some 68 billion keys.
+ */
+#define CMI_HASHHEAP_SLOT_KEYS  0x0004u
+#define CMI_HASHHEAP_SLOT_BITS  28u
+#define CMI_HASHHEAP_SLOT_MASK  ((UINT64_C(1) << CMI_HASHHEAP_SLOT_BITS) - 1u)
+
+/*
+ * Index option for cmi_hashheap_initialize_wflags. Keeps a secondary index from
+ * the second payload value, item[1], to the items holding it, so that pattern
+ * find, count, and cancel with a given val2 only visit those items instead of
+ * the entire heap. Costs a hash map update for each enqueue and dequeue.
+ */
+#define CMI_HASHHEAP_SUBJECT_INDEX 0x0008u
+
+/*
+ * Ordering option for cmi_hashheap_initialize_wflags. The orderings used by the
+ * event queue, the resource guards, and the priority queues are built in, with
+ * the comparison compiled into the heap sift loops instead of called through
+ * the heap_compare pointer for every step. Ties are broken by the lower hash
+ * key, i.e., FIFO, in all of them. With a built-in ordering, pass NULL for the
+ * compare function, heap_compare is then set to the equivalent function for
+ * any other use.
+ *
+ * CMI_HASHHEAP_ORDER_CUSTOM calls the given compare function. If it is NULL,
+ * the ordering is CMI_HASHHEAP_ORDER_TIME.
+ */
+#define CMI_HASHHEAP_ORDER_CUSTOM        0x0000u /* Call heap_compare */
+#define CMI_HASHHEAP_ORDER_TIME          0x0010u /* Lower rank_d64, then higher rank_i64 */
+#define CMI_HASHHEAP_ORDER_PRIORITY_TIME 0x0020u /* Higher rank_i64, then lower rank_d64 */
+#define CMI_HASHHEAP_ORDER_PRIORITY      0x0030u /* Higher rank_i64 */
+#define CMI_HASHHEAP_ORDER_MASK          0x0030u
+
+/*
+ * cmi_hashheap_arity_flag - Translate an arity of 2, 4, or 8 into the layout
+ * flag value above, firing an assert for anything else.
+ */
+CMB_MAYBE_UNUSED
+static inline uint16_t cmi_hashheap_arity_flag(const unsigned arity)
+{
+    cmb_assert_release((arity == 2u) || (arity == 4u) || (arity == 8u));
+
+    return (arity == 2u) ? CMI_HASHHEAP_BINARY
+         : (arity == 4u) ? CMI_HASHHEAP_QUATERNARY
+                         : CMI_HASHHEAP_OCTONARY;
+}
+
+/*
+ * cmi_hashheap_arity - Return the branching factor of the heap, 2, 4, or 8.
+ */
+CMB_MAYBE_UNUSED
+static inline unsigned cmi_hashheap_arity(const struct cmi_hashheap *hp)
+{
+    cmb_assert_release(hp != NULL);
+
+    return 1u << hp->heap_dexp;
+}
+
+/*
+ * cmi_hashheap_is_slot_key - Does the key lead directly to its item slot?
+ */
+CMB_MAYBE_UNUSED
+static inline bool cmi_hashheap_is_slot_key(const struct cmi_hashheap *hp,
+                                            const uint64_t hashkey)
+{
+    cmb_assert_debug(hp != NULL);
+
+    return ((hp->heap_flags & CMI_HASHHEAP_SLOT_KEYS) != 0u)
+           && ((hashkey & CMI_HASHHEAP_SLOT_MASK) != 0u);
+}
+
+/*
+ * cmi_hashheap_next_key - Issue a new key from the running counter without
+ * enqueuing anything, for an item kept somewhere else for now that may be
+ * enqueued with this key later. Orders the same as the keys issued by
+ * cmi_hashheap_enqueue for the FIFO tiebreaker.
+ */
+CMB_MAYBE_UNUSED
+static inline uint64_t cmi_hashheap_next_key(struct cmi_hashheap *hp)
+{
+    cmb_assert_debug(hp != NULL);
+
+    hp->item_counter++;
+    if ((hp->heap_flags & CMI_HASHHEAP_SLOT_KEYS) != 0u) {
+        cmb_assert_release(hp->item_counter < (UINT64_C(1) << (64u - CMI_HASHHEAP_SLOT_BITS)));
+        return hp->item_counter << CMI_HASHHEAP_SLOT_BITS;
+    }
+
+    return hp->item_counter;
+}
+
+/*
+ * cmi_hashheap_key_reserve - As cmi_hashheap_next_key, but with slot keys, the
+ * key also gets an item slot held for it, leading straight to the item later
+ * enqueued with this key, and in the meantime to a payload for the caller's
+ * own bookkeeping. The slot is held until the key is enqueued or released.
+ * Without slot keys, the same as cmi_hashheap_next_key.
+ */
+extern uint64_t cmi_hashheap_key_reserve(struct cmi_hashheap *hp);
+
+/*
+ * cmi_hashheap_key_release - Let go of the slot held for a reserved key that
+ * will not be enqueued after all. Does nothing for other keys.
+ */
+extern void cmi_hashheap_key_release(struct cmi_hashheap *hp, uint64_t hashkey);
+
+/*
+ * cmi_hashheap_reserved_item - The payload of the slot held for a reserved key,
+ * NULL if the key is not reserved (any more). The hashheap does not use it, the
+ * caller may keep whatever it likes there until the key is enqueued.
+ */
+CMB_MAYBE_UNUSED
+static inline void **cmi_hashheap_reserved_item(struct cmi_hashheap *hp,
+                                                const uint64_t hashkey)
+{
+    cmb_assert_debug(hp != NULL);
+
+    if (!cmi_hashheap_is_slot_key(hp, hashkey)) {
+        return NULL;
+    }
+
+    /* A dequeued item keeps its key, not in the heap either, until its slot
+     * is reused, but a reserved slot is never the current one */
+    const uint64_t slot = hashkey & CMI_HASHHEAP_SLOT_MASK;
+    if ((slot > hp->item_top)
+        || (slot == hp->item_current)
+        || (hp->items[slot].hash_key != hashkey)
+        || (hp->items[slot].heap_index != 0u)) {
+        return NULL;
+    }
+
+    return hp->items[slot].item;
+}
+
+/*
+ * cmi_hashheap_key_max - An upper bound for all keys issued so far, for
+ * continuing the series of keys in some other queue.
+ */
+CMB_MAYBE_UNUSED
+static inline uint64_t cmi_hashheap_key_max(const struct cmi_hashheap *hp)
+{
+    cmb_assert_debug(hp != NULL);
+
+    if ((hp->heap_flags & CMI_HASHHEAP_SLOT_KEYS) != 0u) {
+        return (hp->item_counter << CMI_HASHHEAP_SLOT_BITS) | CMI_HASHHEAP_SLOT_MASK;
+    }
+
+    return hp->item_counter;
+}
+
 /*
  * cmi_hashheap_create - Allocate memory for a new priority queue.
  * Initializes the pointers to NULL, call cmi_hashmap_initialize next.
@@ -126,12 +370,24 @@ extern struct cmi_hashheap *cmi_hashheap_create(void);
  * cmp is the application-defined compare function for this hashheap, taking
  * pointers to two heap tags and returning true if the first should go before
  * the second, using whatever consideration is appropriate for the usage. If
- * NULL, we will sort in an increasing `rank_d64` order.
+ * NULL, we will sort in an increasing `rank_d64` order, see
+ * CMI_HASHHEAP_ORDER_TIME.
  */
 extern void cmi_hashheap_initialize(struct cmi_hashheap *hp,
                                     uint16_t hexp,
                                     cmi_heap_compare_func *cmp);
 
+/*
+ * cmi_hashheap_initialize_wflags - As cmi_hashheap_initialize, but with layout
+ * and ordering options given as the CMI_HASHHEAP_* flags above.
+ * cmi_hashheap_initialize is equivalent to calling this with flags
+ * CMI_HASHHEAP_BINARY. With a built-in ordering flag, cmp must be NULL.
+ */
+extern void cmi_hashheap_initialize_wflags(struct cmi_hashheap *hp,
+                                           uint16_t hexp,
+                                           cmi_heap_compare_func *cmp,
+                                           uint16_t flags);
+
 /*
  * cmi_hashheap_clear - Empties the hash heap.
  * Does not shrink the heap to the initial size, continues at the size it has.
@@ -139,6 +395,26 @@ extern void cmi_hashheap_initialize(struct cmi_hashheap *hp,
  */
 extern void cmi_hashheap_clear(struct cmi_hashheap *hp);
 
+/*
+ * cmi_hashheap_rewind - Empties the hash heap and restarts the item counter,
+ * keeping the allocated space at the size it has. Issues the same keys as a
+ * newly initialized hashheap, without allocating anything.
+ */
+extern void cmi_hashheap_rewind(struct cmi_hashheap *hp);
+
+/*
+ * cmi_hashheap_reserve - Grow the hashheap, if needed, to hold at least n items
+ * without further resizing, in one step rather than doubling repeatedly.
+ */
+extern void cmi_hashheap_reserve(struct cmi_hashheap *hp, uint64_t n);
+
+/*
+ * cmi_hashheap_probe_max - The longest distance from an entry in the hash map
+ * to its home position, zero if all are at home or the map is not active.
+ * Scans the entire map, for diagnostics only.
+ */
+extern uint64_t cmi_hashheap_probe_max(const struct cmi_hashheap *hp);
+
 /*
  * cmi_hashheap_terminate - Return the hashheap to a newly created state
  * freeing any allocated memory for the heap and hash map.
@@ -163,6 +439,8 @@ extern void cmi_hashheap_destroy(struct cmi_hashheap *hp);
  * application defined, depending on the heap compare function provided.
  * If the hashkey is zero, an internal hash_key will be generated, otherwise the one
  * given will be used. Returns the hash_key to the new item, hash_key > 0.
+ * With slot keys, a given hashkey must either have zero in the slot bits or be
+ * reserved by cmi_hashheap_key_reserve.
  */
 extern uint64_t cmi_hashheap_enqueue(struct cmi_hashheap *hp,
                                      void *pl1,
@@ -173,11 +451,47 @@ extern uint64_t cmi_hashheap_enqueue(struct cmi_hashheap *hp,
                                      double rank_d64,
                                      int64_t rank_i64);
 
+/*
+ * cmi_hashheap_enqueue_recurring - As cmi_hashheap_enqueue, also setting the
+ * period of the new item, see struct cmi_heap_item.
+ */
+extern uint64_t cmi_hashheap_enqueue_recurring(struct cmi_hashheap *hp,
+                                               void *pl1,
+                                               void *pl2,
+                                               void *pl3,
+                                               void *pl4,
+                                               uint64_t hashkey,
+                                               double rank_d64,
+                                               int64_t rank_i64,
+                                               double period);
+
+/*
+ * cmi_hashheap_batch_begin/append/end - Enqueue many items at once. Begin
+ * makes room for n items, append puts each one at the end of the heap as
+ * cmi_hashheap_enqueue would, but without sifting it into place, and end
+ * restores the heap order. If the batch is large compared to the heap, end
+ * rebuilds the entire heap bottom up in O(n) time (Floyd 1964) instead of
+ * sifting up each new item in O(log n) time. Appending more than n items is
+ * allowed, only slower. Between begin and end, the heap is out of order, and
+ * nothing but appending and key lookups may be done.
+ */
+extern void cmi_hashheap_batch_begin(struct cmi_hashheap *hp, uint64_t n);
+extern uint64_t cmi_hashheap_batch_append(struct cmi_hashheap *hp,
+                                          void *pl1,
+                                          void *pl2,
+                                          void *pl3,
+                                          void *pl4,
+                                          uint64_t hashkey,
+                                          double rank_d64,
+                                          int64_t rank_i64);
+extern void cmi_hashheap_batch_end(struct cmi_hashheap *hp);
+
 /*
  * cmi_hashheap_dequeue - Removes the highest priority item from the queue
  * (according to the ordering given by the comparator function) and returns a
- * pointer to its current location. Note that this is a temporary location that
- * will be overwritten in the next enqueue operation.
+ * pointer to its payload in the item array. Its heap tag is copied to heap[0].
+ * Both stay valid until the next dequeue, but the pointer to the payload may
+ * be invalidated by an enqueue that grows the hashheap.
  */
 extern void **cmi_hashheap_dequeue(struct cmi_hashheap *hp);
 
@@ -213,9 +527,27 @@ static inline void **cmi_hashheap_peek_item(const struct cmi_hashheap *hp)
         return NULL;
     }
 
-    struct cmi_heap_tag *first = &(hp->heap[1]);
+    const struct cmi_heap_tag *first = &(hp->heap[1]);
 
-    return first->item;
+    return hp->items[first->item_slot].item;
+}
+
+/*
+ * cmi_hashheap_item_at - Returns a pointer to the payload of the item at the
+ * given heap index, where index zero is the most recently dequeued item.
+ * Mostly for iterating over all items in the heap, 1 <= idx <= heap_count.
+ */
+CMB_MAYBE_UNUSED
+static inline void **cmi_hashheap_item_at(const struct cmi_hashheap *hp,
+                                          const uint64_t idx)
+{
+    cmb_assert_debug(hp != NULL);
+    cmb_assert_debug(hp->heap != NULL);
+    cmb_assert_debug(idx <= hp->heap_count);
+
+    const struct cmi_heap_tag *htp = &(hp->heap[idx]);
+
+    return hp->items[htp->item_slot].item;
 }
 
 /*
@@ -255,6 +587,15 @@ static inline int64_t cmi_hashheap_peek_irank(const struct cmi_hashheap *hp)
  */
 extern bool cmi_hashheap_remove(struct cmi_hashheap *hp, uint64_t hashkey);
 
+/*
+ * cmi_hashheap_remove_batch - Remove the n items with the given keys, skipping
+ * any not in the queue. Returns the number removed. For many items, fills the
+ * holes without sifting and rebuilds the heap once at the end.
+ */
+extern uint64_t cmi_hashheap_remove_batch(struct cmi_hashheap *hp,
+                                          const uint64_t *keys,
+                                          uint64_t n);
+
 /*
  * cmi_hashheap_cancel - Syntactic sugar for cmi_hashheap_remove
  */
@@ -269,6 +610,11 @@ static inline bool cmi_hashheap_cancel(struct cmi_hashheap *hp, const uint64_t h
  */
 extern uint64_t cmi_hash_find_index(struct cmi_hashheap *hp, uint64_t hashkey);
 
+/*
+ * cmi_hash_find_slot - look up the item slot for a given hash hashkey.
+ */
+extern uint64_t cmi_hash_find_slot(struct cmi_hashheap *hp, uint64_t hashkey);
+
 /*
  * cmi_hashheap_is_enqueued - Is the given item currently in the queue?
  */
@@ -283,16 +629,15 @@ static inline bool cmi_hashheap_is_enqueued(struct cmi_hashheap *hp,
         return false;
     }
     else {
-        return (cmi_hash_find_index(hp, hashkey) != 0u);
+        return (cmi_hash_find_slot(hp, hashkey) != 0u);
     }
 }
 
 /*
  * cmi_hashheap_item - Return a pointer to the current location of the item
- * associated with the given hashkey. Note that the location is volatile and will
- * be overwritten in the next enqueue/dequeue operation, but the item value will
- * continue to be associated with the hashkey also when moved to a different
- * location. This function can be used to manipulate the contents of an item, but
+ * associated with the given hashkey. The item keeps its slot in the item array
+ * while in the queue, but the whole array moves if the hashheap grows during an
+ * enqueue. This function can be used to manipulate the contents of an item, but
  * this needs to be done atomically. Do not expect the item to be in the same
  * location later, retrieve it again before each use.
  */
@@ -315,6 +660,15 @@ extern void cmi_hashheap_reprioritize(struct cmi_hashheap *hp,
                                       double drank,
                                       int64_t irank);
 
+/*
+ * cmi_hashheap_requeue_first - Give the first item a new rank_d64, no earlier
+ * in the ordering than the current one, and sift it down into place in one
+ * pass. The item keeps its hash_key and its slot, sparing a dequeue and an
+ * enqueue for items that recur.
+ * Precondition: The hashheap is not empty.
+ */
+extern void cmi_hashheap_requeue_first(struct cmi_hashheap *hp, double drank);
+
 /*
  * cmi_hashheap_pattern_find - Search the priority queue for an item with values
  * matching the given pattern and return its hashkey if one exists in the queue,
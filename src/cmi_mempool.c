@@ -27,6 +27,7 @@
 
 #include "cmi_mempool.h"
 #include "cmi_slist.h"
+#include "cmi_snapshot.h"
 #include "cmi_thread.h"
 
 /* Initial size of the memory chunk list as such */
@@ -218,3 +219,30 @@ void cmi_mempool_thread_cleanup(void)
         cmi_free(stp);
     }
  }
+
+/*
+ * cmi_mempool_snapshot_regions - Add the list of thread local pools to the
+ * snapshot, and the memory chunks of those pools that were allocated before
+ * the arena was turned on. The pools themselves are added by their owners,
+ * since a pool may start its lazy allocation after the snapshot is taken.
+ */
+void cmi_mempool_snapshot_regions(struct cmb_snapshot *sp)
+{
+    cmi_snapshot_add(sp, &static_pools, sizeof(static_pools));
+
+    struct cmi_slist_node *node = static_pools.next;
+    while (node != NULL) {
+        const struct static_pools_tag *stp = cmi_container_of(node,
+                                                              struct static_pools_tag,
+                                                              head);
+        const struct cmi_mempool *mp = stp->pool;
+        for (uint64_t ui = 0u; ui < mp->chunk_list_cnt; ui++) {
+            void *cp = mp->chunk_list[ui];
+            if (!cmi_arena_owns(cp)) {
+                cmi_snapshot_add(sp, cp, cmi_usable_size(cp, cmi_pagesize()));
+            }
+        }
+
+        node = node->next;
+    }
+}
@@ -20,6 +20,7 @@
  */
 
 #include "cmi_memregistry.h"
+#include "cmi_snapshot.h"
 
 CMB_THREAD_LOCAL bool cmi_memregistry_is_demolishing = false;
 CMB_THREAD_LOCAL struct cmi_dlist_node cmi_memregistry = { NULL, NULL };
@@ -88,3 +89,12 @@ void cmi_memregistry_cleanup(void)
         cmi_memregistry_is_demolishing = false;
     }
 }
+
+/*
+ * cmi_memregistry_snapshot_regions - Add the thread local registry to the snapshot.
+ */
+void cmi_memregistry_snapshot_regions(struct cmb_snapshot *sp)
+{
+    cmi_snapshot_add(sp, &cmi_memregistry_is_demolishing, sizeof(cmi_memregistry_is_demolishing));
+    cmi_snapshot_add(sp, &cmi_memregistry, sizeof(cmi_memregistry));
+}
@@ -22,12 +22,15 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "cmb_assert.h"
 #include "cmb_logger.h"
 
+#include "cmi_arena.h"
+
 #define CMI_UNINITIALIZED 0xBAADF00DBAADF00D
 #define CMI_INITIALIZED   0x00FA151F1AB1E000
 
@@ -36,6 +39,10 @@ static inline void *cmi_malloc(const size_t sz)
 {
     cmb_assert_debug(sz > 0);
 
+    if (cmi_arena.on) {
+        return cmi_arena_alloc(16u, sz);
+    }
+
     void *rp = malloc(sz);
     cmb_assert_always(rp != NULL);
 
@@ -48,6 +55,12 @@ static inline void *cmi_calloc(const size_t n, const size_t sz)
     cmb_assert_debug(n > 0);
     cmb_assert_debug(sz > 0);
 
+    if (cmi_arena.on) {
+        cmb_assert_release(n <= SIZE_MAX / sz);
+        void *rp = cmi_arena_alloc(16u, n * sz);
+        return memset(rp, 0, n * sz);
+    }
+
     void *rp = calloc(n, sz);
     cmb_assert_always(rp != NULL);
 
@@ -60,6 +73,10 @@ static inline void *cmi_realloc(void* restrict p, const size_t sz)
 {
     cmb_assert_debug(sz > 0);
 
+    if (cmi_arena.on || cmi_arena_owns(p)) {
+        return cmi_arena_realloc(p, 0u, sz);
+    }
+
     void *tmp = realloc(p, sz);
     if (tmp == NULL) {
         if (p != NULL) {
@@ -77,6 +94,54 @@ static inline void cmi_free(void *p)
 {
     cmb_assert_always(p != NULL);
 
+    if (cmi_arena_owns(p)) {
+        cmi_arena_free(p);
+    }
+    else if (!cmi_arena.on) {
+        free(p);
+    }
+    /* else leave it, a snapshot restore may bring back a pointer to it */
+}
+
+/*
+ * The same, but always on the heap, for memory that must stay out of the
+ * snapshot arena even when it is on, e.g., the profiler tables.
+ */
+CMB_MAYBE_UNUSED
+static inline void *cmi_calloc_heap(const size_t n, const size_t sz)
+{
+    cmb_assert_debug(n > 0);
+    cmb_assert_debug(sz > 0);
+
+    void *rp = calloc(n, sz);
+    cmb_assert_always(rp != NULL);
+
+    return rp;
+}
+
+CMB_MAYBE_UNUSED
+static inline void *cmi_realloc_heap(void* restrict p, const size_t sz)
+{
+    cmb_assert_debug(sz > 0);
+
+    void *tmp = realloc(p, sz);
+    if (tmp == NULL) {
+        if (p != NULL) {
+            free(p);
+        }
+
+        cmb_logger_fatal(stderr, "Out of memory");
+    }
+
+    return tmp;
+}
+
+CMB_MAYBE_UNUSED
+static inline void cmi_free_heap(void *p)
+{
+    cmb_assert_always(p != NULL);
+    cmb_assert_debug(!cmi_arena_owns(p));
+
     free(p);
 }
 
@@ -110,6 +175,12 @@ static inline void *cmi_memset(void* restrict ptr, const int c, const size_t n)
 #define cmi_container_of(ptr, type, member) \
             ((type *)((char *)(ptr) - cmi_offset_of(type, member)))
 
+/* The address of a function as an object pointer, e.g., as a table key.
+ * Convoluted type cast to circumvent the C language barrier between pointers
+ * to functions and pointers to objects, safe on the intended target
+ * architectures (but verify when porting to some other architecture) */
+#define cmi_func_key(f) (*(const void **)&(f))
+
 CMB_MAYBE_UNUSED
 static inline bool cmi_is_power_of_two(const size_t n)
 {
@@ -122,5 +193,9 @@ extern size_t cmi_pagesize(void);
 extern void *cmi_aligned_alloc(size_t align, size_t sz);
 extern void cmi_aligned_free(void *p);
 extern void *cmi_aligned_realloc(void *p, size_t align, size_t sz);
+extern size_t cmi_usable_size(void *p, size_t align);
+extern void *cmi_vm_reserve(size_t sz);
+extern void cmi_vm_commit(void *p, size_t sz);
+extern void cmi_vm_release(void *p, size_t sz);
 
 #endif /* CIMBA_CMI_MEMUTILS_H */
\ No newline at end of file
@@ -65,6 +65,9 @@ extern bool cmi_process_remove_awaitable(struct cmb_process *pp,
 
 extern void cmi_process_cancel_awaiteds(struct cmb_process *pp);
 
+/* Suspends the calling process, see cmb_process.c */
+extern void *cmi_process_yield(void);
+
 /* Returns true iff pp currently has a RESOURCE awaitable enqueued under this key.
  * The key is globally unique, so this identifies one specific wait episode. */
 extern bool cmi_process_awaiting_key(const struct cmb_process *pp, uint64_t key);
@@ -0,0 +1,86 @@
+/*
+ * cmi_profiler.h - The hooks into the event loop and the coroutine context
+ * switch for the built-in profiler, see cmb_profiler.h. Each hook is guarded
+ * by a test of cmi_profiler_on at the call site, so that the cost is one
+ * predictable branch when the profiler is off.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CIMBA_CMI_PROFILER_H
+#define CIMBA_CMI_PROFILER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <x86intrin.h>
+
+#include "cmb_event.h"
+
+#include "cmi_config.h"
+#include "cmi_coroutine.h"
+
+/*
+ * cmi_profiler_on - Is this thread profiling the current trial? Set from the
+ * global setting by cmi_profiler_trial_start.
+ */
+extern CMB_THREAD_LOCAL bool cmi_profiler_on;
+
+/*
+ * cmi_profiler_clock - The processor time stamp counter.
+ */
+CMB_MAYBE_UNUSED
+static inline uint64_t cmi_profiler_clock(void)
+{
+    return __rdtsc();
+}
+
+/*
+ * cmi_profiler_trial_start - Pick up the global setting for the new trial and
+ * forget any half-measured switch from the previous one.
+ */
+extern void cmi_profiler_trial_start(void);
+
+/*
+ * cmi_profiler_event - Execute the event action, charging its own time to it.
+ */
+extern void cmi_profiler_event(cmb_event_func *action, void *subject, void *object);
+
+/*
+ * cmi_profiler_switch_out - Charge the time since the coroutine was switched
+ * in to its function, and start timing the switch. Called just before the
+ * context switch, with from still running.
+ */
+extern void cmi_profiler_switch_out(const struct cmi_coroutine *from);
+
+/*
+ * cmi_profiler_switch_in - Charge the time since the switch started to the
+ * context switches, and start timing the coroutine now running. Called right
+ * after the context switch, on the stack switched to.
+ */
+extern void cmi_profiler_switch_in(void);
+
+/*
+ * cmi_profiler_process_label - Note the name of a process as a fallback label
+ * for its process function, if that has none yet.
+ */
+extern void cmi_profiler_process_label(const struct cmi_coroutine *cp, const char *name);
+
+/*
+ * cmi_profiler_thread_cleanup - Merge the profile of this thread into the
+ * common one and free its table.
+ */
+extern void cmi_profiler_thread_cleanup(void);
+
+#endif /* CIMBA_CMI_PROFILER_H */
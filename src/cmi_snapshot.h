@@ -0,0 +1,46 @@
+/*
+ * cmi_snapshot.h - The internal side of the snapshots, see cmb_snapshot.h.
+ * Each module with thread local simulation state outside the arena has a
+ * function cmi_<module>_snapshot_regions that adds its variables to the
+ * snapshot about to be taken, called from cmb_snapshot_take.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CIMBA_CMI_SNAPSHOT_H
+#define CIMBA_CMI_SNAPSHOT_H
+
+#include <stddef.h>
+
+#include "cmb_snapshot.h"
+
+/*
+ * cmi_snapshot_add - Include the region in the snapshot being taken.
+ */
+extern void cmi_snapshot_add(struct cmb_snapshot *sp, void *p, size_t sz);
+
+/*
+ * cmi_snapshot_trial_start - Pick up the global setting for the new trial,
+ * turning the arena of this thread on or off.
+ */
+extern void cmi_snapshot_trial_start(void);
+
+/*
+ * cmi_snapshot_thread_cleanup - Turn the arena off for the thread cleanup, so
+ * that the memory outside it is freed as usual.
+ */
+extern void cmi_snapshot_thread_cleanup(void);
+
+#endif /* CIMBA_CMI_SNAPSHOT_H */
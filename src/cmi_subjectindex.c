@@ -0,0 +1,300 @@
+/*
+ * cmi_subjectindex.c - Implements the subject index, a hash map from subject
+ * pointer to the head of a doubly linked list of item slots.
+ *
+ * The hash map uses a Fibonacci hash of the pointer value, which takes the
+ * high bits of the product and is not bothered by the always zero low bits of
+ * aligned pointers. It doubles when half full, and shrinks never. New items go
+ * first in their list, so that a subject with only one pending item, the usual
+ * case for a process, costs one probe and a few stores to enter or leave.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cmi_subjectindex.h"
+#include "cmi_memutils.h"
+
+/* The initial hash map size is 2^MAP_INIT_EXP entries, doubling as needed */
+#define MAP_INIT_EXP 4u
+
+/*
+ * cmi_subjectindex_create - Allocate memory for a new subject index struct.
+ */
+struct cmi_subjectindex *cmi_subjectindex_create(void)
+{
+    struct cmi_subjectindex *sip = cmi_malloc(sizeof(*sip));
+    cmi_memset(sip, 0u, sizeof(*sip));
+
+    return sip;
+}
+
+/*
+ * cmi_subjectindex_initialize - Allocate the link array and the hash map.
+ */
+void cmi_subjectindex_initialize(struct cmi_subjectindex *sip, const uint64_t slots)
+{
+    cmb_assert_release(sip != NULL);
+    cmb_assert_release(sip->links == NULL);
+    cmb_assert_release(slots > 0u);
+
+    sip->link_size = slots;
+    sip->links = cmi_calloc(slots, sizeof(struct cmi_subject_link));
+    sip->map_exp = MAP_INIT_EXP;
+    sip->map_size = UINT64_C(1) << sip->map_exp;
+    sip->map = cmi_calloc(sip->map_size, sizeof(struct cmi_subject_tag));
+    sip->subjects = 0u;
+}
+
+/*
+ * cmi_subjectindex_reserve - Extend the link array, the new part zeroed.
+ */
+void cmi_subjectindex_reserve(struct cmi_subjectindex *sip, const uint64_t slots)
+{
+    cmb_assert_release(sip != NULL);
+    cmb_assert_release(sip->links != NULL);
+
+    if (slots <= sip->link_size) {
+        return;
+    }
+
+    sip->links = cmi_realloc(sip->links, slots * sizeof(struct cmi_subject_link));
+    cmi_memset(&(sip->links[sip->link_size]), 0u,
+               (slots - sip->link_size) * sizeof(struct cmi_subject_link));
+    sip->link_size = slots;
+}
+
+/*
+ * cmi_subjectindex_clear - Forget all subjects and links.
+ */
+void cmi_subjectindex_clear(struct cmi_subjectindex *sip)
+{
+    cmb_assert_release(sip != NULL);
+    cmb_assert_release(sip->links != NULL);
+
+    cmi_memset(sip->links, 0u, sip->link_size * sizeof(struct cmi_subject_link));
+    cmi_memset(sip->map, 0u, sip->map_size * sizeof(struct cmi_subject_tag));
+    sip->subjects = 0u;
+}
+
+/*
+ * cmi_subjectindex_terminate - Free the arrays, back to the newly created state.
+ */
+void cmi_subjectindex_terminate(struct cmi_subjectindex *sip)
+{
+    cmb_assert_release(sip != NULL);
+
+    if (sip->links != NULL) {
+        cmi_free(sip->links);
+        cmi_free(sip->map);
+    }
+
+    cmi_memset(sip, 0u, sizeof(*sip));
+}
+
+/*
+ * cmi_subjectindex_destroy - Free the subject index struct itself.
+ */
+void cmi_subjectindex_destroy(struct cmi_subjectindex *sip)
+{
+    cmb_assert_release(sip != NULL);
+
+    cmi_subjectindex_terminate(sip);
+    cmi_free(sip);
+}
+
+/*
+ * map_home - Fibonacci hash of the subject pointer, its preferred position.
+ */
+static uint64_t map_home(const struct cmi_subjectindex *sip, const void *subject)
+{
+    cmb_assert_debug(sip != NULL);
+
+    return ((uint64_t)(uintptr_t)subject * UINT64_C(11400714819323198485))
+           >> (64u - sip->map_exp);
+}
+
+/*
+ * map_find - The map position of the subject, or of the free entry where it
+ * would go if it is not there.
+ */
+static uint64_t map_find(const struct cmi_subjectindex *sip, const void *subject)
+{
+    cmb_assert_debug(sip != NULL);
+
+    const struct cmi_subject_tag *map = sip->map;
+    const uint64_t mask = sip->map_size - 1u;
+    uint64_t idx = map_home(sip, subject);
+    while ((map[idx].head != 0u) && (map[idx].subject != subject)) {
+        idx = (idx + 1u) & mask;
+    }
+
+    return idx;
+}
+
+/*
+ * map_grow - Double the hash map and move the entries over.
+ */
+static void map_grow(struct cmi_subjectindex *sip)
+{
+    cmb_assert_debug(sip != NULL);
+
+    struct cmi_subject_tag *old_map = sip->map;
+    const uint64_t old_size = sip->map_size;
+
+    sip->map_exp++;
+    sip->map_size = UINT64_C(1) << sip->map_exp;
+    sip->map = cmi_calloc(sip->map_size, sizeof(struct cmi_subject_tag));
+    for (uint64_t ui = 0u; ui < old_size; ui++) {
+        if (old_map[ui].head != 0u) {
+            const uint64_t idx = map_find(sip, old_map[ui].subject);
+            sip->map[idx] = old_map[ui];
+        }
+    }
+
+    cmi_free(old_map);
+}
+
+/*
+ * map_delete - Remove the entry at idx, now with an empty list, shifting any
+ * following entries in the same probe run back into the hole if that brings
+ * them closer to home.
+ */
+static void map_delete(struct cmi_subjectindex *sip, uint64_t idx)
+{
+    cmb_assert_debug(sip != NULL);
+    cmb_assert_debug(sip->map[idx].count == 0u);
+
+    struct cmi_subject_tag *map = sip->map;
+    const uint64_t mask = sip->map_size - 1u;
+    uint64_t nxt = idx;
+    for (;;) {
+        nxt = (nxt + 1u) & mask;
+        if (map[nxt].head == 0u) {
+            break;
+        }
+
+        /* Stays put if its home is cyclically in (idx, nxt] */
+        const uint64_t home = map_home(sip, map[nxt].subject);
+        const bool stays = (idx <= nxt) ? ((idx < home) && (home <= nxt))
+                                        : ((idx < home) || (home <= nxt));
+        if (!stays) {
+            map[idx] = map[nxt];
+            idx = nxt;
+        }
+    }
+
+    map[idx].subject = NULL;
+    map[idx].head = 0u;
+    map[idx].count = 0u;
+    sip->subjects--;
+}
+
+/*
+ * cmi_subjectindex_insert - Put the slot first in the list for its subject.
+ */
+void cmi_subjectindex_insert(struct cmi_subjectindex *sip,
+                             const void *subject,
+                             const uint64_t slot)
+{
+    cmb_assert_release(sip != NULL);
+    cmb_assert_release((slot > 0u) && (slot < sip->link_size));
+
+    if (2u * (sip->subjects + 1u) > sip->map_size) {
+        map_grow(sip);
+    }
+
+    const uint64_t idx = map_find(sip, subject);
+    struct cmi_subject_tag *stp = &(sip->map[idx]);
+    struct cmi_subject_link *links = sip->links;
+    if (stp->head == 0u) {
+        stp->subject = subject;
+        stp->count = 0u;
+        links[slot].next = 0u;
+        sip->subjects++;
+    }
+    else {
+        links[slot].next = stp->head;
+        links[stp->head].prev = slot;
+    }
+
+    links[slot].prev = 0u;
+    stp->head = slot;
+    stp->count++;
+}
+
+/*
+ * cmi_subjectindex_erase - Unlink the slot, dropping the subject from the map
+ * if it was the last one.
+ */
+void cmi_subjectindex_erase(struct cmi_subjectindex *sip,
+                            const void *subject,
+                            const uint64_t slot)
+{
+    cmb_assert_release(sip != NULL);
+    cmb_assert_release((slot > 0u) && (slot < sip->link_size));
+
+    const uint64_t idx = map_find(sip, subject);
+    struct cmi_subject_tag *stp = &(sip->map[idx]);
+    cmb_assert_debug(stp->head != 0u);
+    cmb_assert_debug(stp->count > 0u);
+
+    struct cmi_subject_link *links = sip->links;
+    const uint64_t next = links[slot].next;
+    const uint64_t prev = links[slot].prev;
+    if (prev != 0u) {
+        links[prev].next = next;
+    }
+    else {
+        cmb_assert_debug(stp->head == slot);
+        stp->head = next;
+    }
+
+    if (next != 0u) {
+        links[next].prev = prev;
+    }
+
+    links[slot].next = 0u;
+    links[slot].prev = 0u;
+    stp->count--;
+    if (stp->count == 0u) {
+        cmb_assert_debug(stp->head == 0u);
+        map_delete(sip, idx);
+    }
+}
+
+/*
+ * cmi_subjectindex_first - The head of the list for the subject.
+ */
+uint64_t cmi_subjectindex_first(const struct cmi_subjectindex *sip,
+                                const void *subject)
+{
+    cmb_assert_release(sip != NULL);
+
+    return sip->map[map_find(sip, subject)].head;
+}
+
+/*
+ * cmi_subjectindex_count - The length of the list for the subject.
+ */
+uint64_t cmi_subjectindex_count(const struct cmi_subjectindex *sip,
+                                const void *subject)
+{
+    cmb_assert_release(sip != NULL);
+
+    return sip->map[map_find(sip, subject)].count;
+}
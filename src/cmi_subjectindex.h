@@ -0,0 +1,152 @@
+/*
+ * cmi_subjectindex.h - A secondary index from the subject of an item, the
+ * second of its four payload values, to the item slots holding that subject
+ * in a hashheap or bucket queue. For the event queue, the subject is usually
+ * the process the event acts upon, and the index lets a process find and
+ * cancel its own pending events without scanning the entire queue.
+ *
+ * The items for each subject form a doubly linked list through a link array
+ * parallel to the owner's item array, so that entering or leaving the index
+ * does not move anything. The head of each list and the number of items in it
+ * are found from the subject pointer through an open addressing hash map with
+ * linear probing and backward shift deletion, as in the bucket queue.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CIMBA_CMI_SUBJECTINDEX_H
+#define CIMBA_CMI_SUBJECTINDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cmb_assert.h"
+
+#include "cmi_config.h"
+
+/*
+ * struct cmi_subject_link - The neighbours of an item slot in the list for its
+ * subject, zero meaning none, 2 * 8 = 16 bytes.
+ */
+struct cmi_subject_link {
+    uint64_t next;
+    uint64_t prev;
+};
+
+/*
+ * struct cmi_subject_tag - Hash map entry for one subject, with the first item
+ * slot in its list and the length of the list. Head zero marks a free entry,
+ * since a subject without items is removed from the map. 3 * 8 = 24 bytes.
+ */
+struct cmi_subject_tag {
+    const void *subject;
+    uint64_t head;
+    uint64_t count;
+};
+
+/*
+ * struct cmi_subjectindex - The control structure. The link array covers item
+ * slots zero to link_size - 1, the hash map has map_size = 2^map_exp entries,
+ * kept at least twice the number of subjects in it.
+ */
+struct cmi_subjectindex {
+    struct cmi_subject_link *links;
+    struct cmi_subject_tag *map;
+    uint64_t link_size;     /* Number of item slots covered */
+    uint64_t map_size;      /* Allocated hash map entries */
+    uint64_t subjects;      /* Distinct subjects currently in the map */
+    uint16_t map_exp;       /* map_size is 2^map_exp */
+};
+
+/*
+ * cmi_subjectindex_create - Allocate memory for a subject index.
+ */
+extern struct cmi_subjectindex *cmi_subjectindex_create(void);
+
+/*
+ * cmi_subjectindex_initialize - Allocate the link array for item slots zero to
+ * slots - 1, and a small hash map that grows as needed.
+ */
+extern void cmi_subjectindex_initialize(struct cmi_subjectindex *sip,
+                                        uint64_t slots);
+
+/*
+ * cmi_subjectindex_reserve - Extend the link array to cover item slots zero to
+ * slots - 1, keeping the existing links. To be called whenever the owner's item
+ * array grows.
+ */
+extern void cmi_subjectindex_reserve(struct cmi_subjectindex *sip,
+                                     uint64_t slots);
+
+/*
+ * cmi_subjectindex_clear - Empty the index, keeping the allocated arrays.
+ */
+extern void cmi_subjectindex_clear(struct cmi_subjectindex *sip);
+
+/*
+ * cmi_subjectindex_terminate - Free the arrays.
+ */
+extern void cmi_subjectindex_terminate(struct cmi_subjectindex *sip);
+
+/*
+ * cmi_subjectindex_destroy - Free the index itself.
+ */
+extern void cmi_subjectindex_destroy(struct cmi_subjectindex *sip);
+
+/*
+ * cmi_subjectindex_insert - Enter the item slot in the list for the subject.
+ * Precondition: The slot is covered by the link array and not already in.
+ */
+extern void cmi_subjectindex_insert(struct cmi_subjectindex *sip,
+                                    const void *subject,
+                                    uint64_t slot);
+
+/*
+ * cmi_subjectindex_erase - Take the item slot out of the list for the subject.
+ * Precondition: It is there, entered with the same subject.
+ */
+extern void cmi_subjectindex_erase(struct cmi_subjectindex *sip,
+                                   const void *subject,
+                                   uint64_t slot);
+
+/*
+ * cmi_subjectindex_first - The first item slot for the subject, zero if none.
+ * The order within the list is unspecified.
+ */
+extern uint64_t cmi_subjectindex_first(const struct cmi_subjectindex *sip,
+                                       const void *subject);
+
+/*
+ * cmi_subjectindex_next - The item slot after the given one in its list, zero
+ * at the end. Do not change the index while iterating, collect first.
+ */
+CMB_MAYBE_UNUSED
+static inline uint64_t cmi_subjectindex_next(const struct cmi_subjectindex *sip,
+                                             const uint64_t slot)
+{
+    cmb_assert_debug(sip != NULL);
+    cmb_assert_debug((slot > 0u) && (slot < sip->link_size));
+
+    return sip->links[slot].next;
+}
+
+/*
+ * cmi_subjectindex_count - The number of item slots for the subject.
+ */
+extern uint64_t cmi_subjectindex_count(const struct cmi_subjectindex *sip,
+                                       const void *subject);
+
+#endif /* CIMBA_CMI_SUBJECTINDEX_H */
@@ -0,0 +1,71 @@
+/*
+ * cmi_trace.h - The hooks into the event loop, the coroutine context switch,
+ * and the process naming for the binary event trace, see cmb_trace.h. Each
+ * hook is guarded by a test of cmi_trace_on at the call site.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CIMBA_CMI_TRACE_H
+#define CIMBA_CMI_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cmb_event.h"
+
+#include "cmi_config.h"
+#include "cmi_coroutine.h"
+
+/*
+ * cmi_trace_on - Is this thread tracing the current trial? Set from the global
+ * setting by cmi_trace_trial_start.
+ */
+extern CMB_THREAD_LOCAL bool cmi_trace_on;
+
+/*
+ * cmi_trace_trial_start - Pick up the global setting for the new trial, open
+ * the trace file of this thread if not open already, and note the new trial.
+ */
+extern void cmi_trace_trial_start(void);
+
+/*
+ * cmi_trace_event - Record an event about to execute at the current time.
+ */
+extern void cmi_trace_event(cmb_event_func *action,
+                            const void *subject,
+                            const void *object,
+                            uint64_t handle,
+                            int64_t priority);
+
+/*
+ * cmi_trace_switch - Record the coroutine context switch about to happen, as
+ * the yield or exit of from and the run of to, leaving out the main coroutine.
+ */
+extern void cmi_trace_switch(const struct cmi_coroutine *from,
+                             const struct cmi_coroutine *to);
+
+/*
+ * cmi_trace_process_name - Record the handle and the name of the process at
+ * the given address.
+ */
+extern void cmi_trace_process_name(const void *pp, uint64_t handle, const char *name);
+
+/*
+ * cmi_trace_thread_cleanup - Close the trace file of this thread, if any.
+ */
+extern void cmi_trace_thread_cleanup(void);
+
+#endif /* CIMBA_CMI_TRACE_H */
@@ -30,6 +30,7 @@
 #include "cmi_coroutine.h"
 #include "cmi_memutils.h"
 #include "cmi_sanitizer.h"
+#include "cmi_snapshot.h"
 
 /* Assembly function, see src/arc/cmi_coroutine_context_*.asm */
 extern void cmi_coroutine_trampoline(void);
@@ -40,8 +41,11 @@ extern void *cmi_coroutine_launch(struct cmi_coroutine *cp, void *arg);
 /*
  * Intrusive singly linked list of recycled stacks. Note that stacks are only
  * recycled within the current thread (thread local to avoid race conditions or
- * potentially serializing synchronizations) and that stacks are never freed
- * until thread exit (remains at high-water mark, to keep the logic simple).
+ * potentially serializing synchronizations). The pool keeps stacks up to the
+ * retention cap in bytes, freeing any beyond that as they come back.
+ *
+ * The lists are found directly by the number of pages in the stack, up to
+ * STACK_CLASSES pages, and by walking a list of lists for larger stacks.
  */
 struct stack_tag {
     size_t size;                /* Size of stacks in this list */
@@ -49,7 +53,46 @@ struct stack_tag {
     struct stack_tag *next;     /* Next list, a different size stack */
 };
 
+#define STACK_CLASSES 256u
+
+CMB_THREAD_LOCAL static struct stack_tag *stack_class[STACK_CLASSES];
 CMB_THREAD_LOCAL static struct stack_tag *stack_list = NULL;
+CMB_THREAD_LOCAL static size_t stack_pool_bytes = 0u;
+
+/*
+ * Stacks carved from large reserved address ranges, slabs, when asked for.
+ * Each slot is a guard page followed by the stack. Nothing is committed until
+ * a coroutine touches it, and a stack going back to the pool gives its pages
+ * back to the system, leaving only the address range. The free slots are kept
+ * in an array rather than linked through the stacks themselves, since the link
+ * would keep a page of each stack committed.
+ */
+struct slab_tag {
+    size_t size;                /* Size of stacks from this list */
+    unsigned char *fresh;       /* Next never used slot in the current slab */
+    unsigned char *end;         /* End of the current slab */
+    unsigned char **free;       /* Slots returned to the pool */
+    uint64_t free_cnt;
+    uint64_t free_len;
+    struct slab_tag *next;      /* Next list, a different size stack */
+};
+
+/*
+ * The reserved ranges, for giving them back at cleanup.
+ */
+struct slab_range {
+    unsigned char *base;
+    size_t size;
+    struct slab_range *next;
+};
+
+/* Address space reserved at a time, rounded down to whole slots */
+#define SLAB_RESERVE (UINT64_C(1) << 26)
+
+CMB_THREAD_LOCAL static struct slab_tag *slab_class[STACK_CLASSES];
+CMB_THREAD_LOCAL static struct slab_tag *slab_list = NULL;
+CMB_THREAD_LOCAL static struct slab_range *slab_ranges = NULL;
+CMB_THREAD_LOCAL static uint64_t slab_stacks_out = 0u;
 
 /*
  * Linux-specific code to allocate and initialize stack for a new coroutine,
@@ -233,45 +276,220 @@ void cmi_coroutine_context_init(struct cmi_coroutine *cp)
     cmb_assert_debug(cmi_coroutine_stack_valid(cp));
 }
 
+/*
+ * stack_tag_find - The list of recycled stacks of this size, a new empty one
+ * if there is none yet and create is set, otherwise NULL.
+ */
+static struct stack_tag *stack_tag_find(const size_t size_rnd,
+                                        const size_t pagesz,
+                                        const bool create)
+{
+    const size_t pages = size_rnd / pagesz;
+    struct stack_tag **headp;
+    if (pages <= STACK_CLASSES) {
+        headp = &(stack_class[pages - 1u]);
+        if ((*headp != NULL) || !create) {
+            return *headp;
+        }
+    }
+    else {
+        struct stack_tag *st = stack_list;
+        while (st != NULL) {
+            if (st->size == size_rnd) {
+                return st;
+            }
+
+            st = st->next;
+        }
+
+        if (!create) {
+            return NULL;
+        }
+
+        headp = &stack_list;
+    }
+
+    struct stack_tag *st = cmi_malloc(sizeof(*st));
+    st->size = size_rnd;
+    st->head = NULL;
+    st->next = *headp;
+    *headp = st;
+
+    return st;
+}
+
+/*
+ * slab_tag_find - The same for the slab stacks.
+ */
+static struct slab_tag *slab_tag_find(const size_t size_rnd,
+                                      const size_t pagesz,
+                                      const bool create)
+{
+    const size_t pages = size_rnd / pagesz;
+    struct slab_tag **headp;
+    if (pages <= STACK_CLASSES) {
+        headp = &(slab_class[pages - 1u]);
+        if ((*headp != NULL) || !create) {
+            return *headp;
+        }
+    }
+    else {
+        struct slab_tag *st = slab_list;
+        while (st != NULL) {
+            if (st->size == size_rnd) {
+                return st;
+            }
+
+            st = st->next;
+        }
+
+        if (!create) {
+            return NULL;
+        }
+
+        headp = &slab_list;
+    }
+
+    struct slab_tag *st = cmi_calloc_heap(1u, sizeof(*st));
+    st->size = size_rnd;
+    st->next = *headp;
+    *headp = st;
+
+    return st;
+}
+
+/*
+ * stack_release - Give a stack back for real, unprotecting the guard page
+ */
+static void stack_release(unsigned char *stack_raw, const size_t pagesz)
+{
+    if (!cmi_arena_owns(stack_raw)) {
+        const int r = mprotect(stack_raw, pagesz, PROT_READ | PROT_WRITE);
+        cmb_assert_always(r == 0);
+    }
+
+    cmi_aligned_free(stack_raw);
+}
+
+/*
+ * stack_push - Put a stack in the pool, whatever the retention cap
+ */
+static void stack_push(unsigned char *stack_raw, const size_t size_rnd, const size_t pagesz)
+{
+    struct stack_tag *st = stack_tag_find(size_rnd, pagesz, true);
+    unsigned char **nextloc = (unsigned char **)(stack_raw + pagesz);
+    *nextloc = st->head;
+    st->head = stack_raw;
+    stack_pool_bytes += size_rnd + pagesz;
+}
+
+/*
+ * slab_alloc - A slot from the pool or the current slab, reserving another
+ * slab if this one is used up. The guard page is protected once, when the slot
+ * is first carved out, and stays protected while the slot is in the pool.
+ */
+static unsigned char *slab_alloc(const size_t size_rnd, const size_t pagesz)
+{
+    struct slab_tag *st = slab_tag_find(size_rnd, pagesz, true);
+
+    unsigned char *stack_raw;
+    if (st->free_cnt > 0u) {
+        stack_raw = st->free[--(st->free_cnt)];
+    }
+    else {
+        const size_t slot = size_rnd + pagesz;
+        if ((size_t)(st->end - st->fresh) < slot) {
+            const size_t slots = (SLAB_RESERVE > slot) ? (SLAB_RESERVE / slot) : 1u;
+            struct slab_range *rp = cmi_calloc_heap(1u, sizeof(*rp));
+            rp->size = slots * slot;
+            rp->base = cmi_vm_reserve(rp->size);
+            rp->next = slab_ranges;
+            slab_ranges = rp;
+            st->fresh = rp->base;
+            st->end = rp->base + rp->size;
+        }
+
+        stack_raw = st->fresh;
+        st->fresh += slot;
+        const int r = mprotect(stack_raw, pagesz, PROT_NONE);
+        cmb_assert_always(r == 0);
+    }
+
+    slab_stacks_out++;
+
+    return stack_raw;
+}
+
+/*
+ * slab_free - Give the pages back and put the slot in the pool. Touching the
+ * stack again gets fresh zero pages.
+ */
+static void slab_free(unsigned char *stack_raw, const size_t size_rnd, const size_t pagesz)
+{
+    cmb_assert_debug(slab_stacks_out > 0u);
+
+    struct slab_tag *st = slab_tag_find(size_rnd, pagesz, false);
+    cmb_assert_release(st != NULL);
+    const int r = madvise(stack_raw + pagesz, size_rnd, MADV_DONTNEED);
+    cmb_assert_always(r == 0);
+    if (st->free_cnt == st->free_len) {
+        st->free_len = (st->free_len == 0u) ? 64u : 2u * st->free_len;
+        st->free = cmi_realloc_heap(st->free, st->free_len * sizeof(*(st->free)));
+    }
+
+    st->free[st->free_cnt++] = stack_raw;
+    slab_stacks_out--;
+}
+
 /*
  * Allocate memory suitable for a stack, including one extra guard page.
  * The mprotect call is badly serializing for multithreaded applications,
  * hence managing a pool of recycled stacks of various sizes, assuming that
  * the application will only use a few different stack sizes. (Most likely, just
  * one size, all stacks the same size.)
+ *
+ * If slab is set, the stack comes from a reserved slab instead of the heap.
  */
-unsigned char *cmi_coroutine_stack_alloc(const size_t size_req, unsigned char **base_p, unsigned char **limit_p)
+unsigned char *cmi_coroutine_stack_alloc(const size_t size_req,
+                                         const bool slab,
+                                         unsigned char **base_p,
+                                         unsigned char **limit_p)
 {
     cmb_assert_debug(size_req > 0u);
     cmb_assert_debug((base_p != NULL) && (limit_p != NULL));
+    cmb_assert_debug(!(slab && cmi_arena.on));
 
     const size_t pagesz = cmi_pagesize();
     cmb_assert_debug(size_req <= SIZE_MAX - pagesz);
     const size_t size_rnd = (size_req + pagesz - 1u) & ~(pagesz - 1u);
 
-    /* Do we have one lying around? */
     unsigned char *stack_raw = NULL;
-    struct stack_tag *st = stack_list;
-    while (st != NULL) {
-        if (st->size == size_rnd) {
-            if (st->head != NULL) {
-                stack_raw = st->head;
-                cmi_asan_unpoison(stack_raw + pagesz, size_rnd);
-                unsigned char **nextloc = (unsigned char **)(stack_raw + pagesz);
-                st->head = *nextloc;
-            }
-            break;
+    if (slab) {
+        stack_raw = slab_alloc(size_rnd, pagesz);
+    }
+    else {
+        /* Do we have one lying around? */
+        struct stack_tag *st = stack_tag_find(size_rnd, pagesz, false);
+        if ((st != NULL) && (st->head != NULL)) {
+            stack_raw = st->head;
+            cmi_asan_unpoison(stack_raw + pagesz, size_rnd);
+            unsigned char **nextloc = (unsigned char **)(stack_raw + pagesz);
+            st->head = *nextloc;
+            cmb_assert_debug(stack_pool_bytes >= size_rnd + pagesz);
+            stack_pool_bytes -= size_rnd + pagesz;
         }
-        st = st->next;
     }
 
     if (stack_raw == NULL) {
         /* None lying around, create one */
         stack_raw = cmi_aligned_alloc(pagesz, size_rnd + pagesz);
         cmb_assert_always(stack_raw != NULL);
-        /* Protect the guard page */
-        const int r = mprotect(stack_raw, pagesz, PROT_NONE);
-        cmb_assert_always(r == 0);
+        /* Protect the guard page, unless in the snapshot arena, where all
+         * pages need to stay readable for copying */
+        if (!cmi_arena_owns(stack_raw)) {
+            const int r = mprotect(stack_raw, pagesz, PROT_NONE);
+            cmb_assert_always(r == 0);
+        }
     }
 
     /* Stack grows downwards, the stack base is at the top */
@@ -285,7 +503,7 @@ unsigned char *cmi_coroutine_stack_alloc(const size_t size_req, unsigned char **
 }
 
 /* Free memory previously allocated for a stack, pushing it back on pool */
-void cmi_coroutine_stack_free(unsigned char *stack_raw, size_t size_req)
+void cmi_coroutine_stack_free(unsigned char *stack_raw, size_t size_req, const bool slab)
 {
     cmb_assert_release(stack_raw != NULL);
 
@@ -296,52 +514,120 @@ void cmi_coroutine_stack_free(unsigned char *stack_raw, size_t size_req)
      * poison for the usable region first, the guard page stays PROT_NONE. */
     cmi_asan_unpoison(stack_raw + pagesz, size_rnd);
 
-    struct stack_tag *st = stack_list;
-    while (st != NULL) {
-        if (st->size == size_rnd) {
-            /* Found its slot, push it. */
-            unsigned char **nextloc = (unsigned char **)(stack_raw + pagesz);
-            *nextloc = st->head;
-            st->head = stack_raw;
-            return;
+    if (slab) {
+        slab_free(stack_raw, size_rnd, pagesz);
+    }
+    else if (stack_pool_bytes + size_rnd + pagesz > cmi_coroutine_stack_retention()) {
+        /* Enough in the pool already */
+        stack_release(stack_raw, pagesz);
+    }
+    else {
+        stack_push(stack_raw, size_rnd, pagesz);
+    }
+}
+
+/*
+ * Make sure there are at least n stacks of the size ready in the pool, taking
+ * them out and putting them all back, whatever the retention cap.
+ */
+void cmi_coroutine_stack_prewarm(const uint64_t n, const size_t size_req, const bool slab)
+{
+    cmb_assert_release(n > 0u);
+
+    const size_t pagesz = cmi_pagesize();
+    const size_t size_rnd = (size_req + pagesz - 1u) & ~(pagesz - 1u);
+    unsigned char **raws = cmi_calloc_heap(n, sizeof(*raws));
+    for (uint64_t ui = 0u; ui < n; ui++) {
+        unsigned char *base, *limit;
+        raws[ui] = cmi_coroutine_stack_alloc(size_req, slab, &base, &limit);
+    }
+
+    for (uint64_t ui = 0u; ui < n; ui++) {
+        if (slab) {
+            slab_free(raws[ui], size_rnd, pagesz);
         }
         else {
-            st = st->next;
+            stack_push(raws[ui], size_rnd, pagesz);
         }
     }
 
-    /* Made it here, so first stack this size to be recycled */
-    st = cmi_malloc(sizeof(*st));
-    *(unsigned char **)(stack_raw + pagesz) = NULL;
-    st->size = size_rnd;
-    st->head = stack_raw;
-    st->next = stack_list;
-    stack_list = st;
+    cmi_free_heap(raws);
 }
 
-void cmi_coroutine_stack_cleanup(void)
+/* The bytes of recycled heap stacks in the pool of this thread */
+size_t cmi_coroutine_stack_pooled(void)
+{
+    return stack_pool_bytes;
+}
+
+/* Free all stacks in the lists and the lists themselves */
+static void stack_tags_free(struct stack_tag *st, const size_t pagesz)
 {
-    const size_t pagesz = cmi_pagesize();
-    struct stack_tag *st = stack_list;
     while (st != NULL) {
         while (st->head != NULL) {
             unsigned char *raw = st->head;
-            unsigned char *next = *(unsigned char **)(raw + pagesz);
-
-            /* Unprotect guard page to avoid complaints */
-            const int r = mprotect(raw, pagesz, PROT_READ | PROT_WRITE);
-            cmb_assert_always(r == 0);
-            cmi_aligned_free(raw);
-
-            st->head = next;
+            st->head = *(unsigned char **)(raw + pagesz);
+            stack_release(raw, pagesz);
         }
 
         struct stack_tag *next = st->next;
         cmi_free(st);
         st = next;
     }
+}
+
+/* The same for the slab lists */
+static void slab_tags_free(struct slab_tag *st)
+{
+    while (st != NULL) {
+        struct slab_tag *next = st->next;
+        if (st->free != NULL) {
+            cmi_free_heap(st->free);
+        }
+
+        cmi_free_heap(st);
+        st = next;
+    }
+}
+
+void cmi_coroutine_stack_cleanup(void)
+{
+    const size_t pagesz = cmi_pagesize();
+    for (unsigned ui = 0u; ui < STACK_CLASSES; ui++) {
+        stack_tags_free(stack_class[ui], pagesz);
+        stack_class[ui] = NULL;
+    }
 
+    stack_tags_free(stack_list, pagesz);
     stack_list = NULL;
+    stack_pool_bytes = 0u;
+
+    /* Every coroutine is gone by now, and its slab stack with it */
+    cmb_assert_debug(slab_stacks_out == 0u);
+    for (unsigned ui = 0u; ui < STACK_CLASSES; ui++) {
+        slab_tags_free(slab_class[ui]);
+        slab_class[ui] = NULL;
+    }
+
+    slab_tags_free(slab_list);
+    slab_list = NULL;
+
+    while (slab_ranges != NULL) {
+        struct slab_range *next = slab_ranges->next;
+        cmi_vm_release(slab_ranges->base, slab_ranges->size);
+        cmi_free_heap(slab_ranges);
+        slab_ranges = next;
+    }
+
+    slab_stacks_out = 0u;
+}
+
+/* Add the lists of recycled stacks to a snapshot */
+void cmi_coroutine_stack_snapshot_regions(struct cmb_snapshot *sp)
+{
+    cmi_snapshot_add(sp, stack_class, sizeof(stack_class));
+    cmi_snapshot_add(sp, &stack_list, sizeof(stack_list));
+    cmi_snapshot_add(sp, &stack_pool_bytes, sizeof(stack_pool_bytes));
 }
 
 /*
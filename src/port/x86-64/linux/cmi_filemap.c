@@ -0,0 +1,64 @@
+/*
+ * cmi_filemap.c - Create a file of a given size and map it into memory, shared
+ * with the operating system page cache, so that whatever is written there ends
+ * up in the file even if the program crashes.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "cmb_assert.h"
+
+/*
+ * cmi_filemap_open - Create or truncate the file, set its size, and map it
+ * for reading and writing. Returns NULL if any of it fails. The file
+ * descriptor is not needed once the mapping is there.
+ */
+void *cmi_filemap_open(const char *path, const size_t sz)
+{
+    cmb_assert_release(path != NULL);
+    cmb_assert_release(sz > 0u);
+
+    const int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    void *p = NULL;
+    if (ftruncate(fd, (off_t)sz) == 0) {
+        p = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            p = NULL;
+        }
+    }
+
+    (void)close(fd);
+
+    return p;
+}
+
+/*
+ * cmi_filemap_close - Unmap the file. The contents stay in the file.
+ */
+void cmi_filemap_close(void *p, const size_t sz)
+{
+    cmb_assert_release(p != NULL);
+
+    (void)munmap(p, sz);
+}
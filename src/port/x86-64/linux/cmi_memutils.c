@@ -16,10 +16,12 @@
  * limitations under the License.
  */
 
+#define _GNU_SOURCE // NOLINT(bugprone-reserved-identifier)
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
 #include <malloc.h>
+#include <sys/mman.h>
 
 #include "cmb_assert.h"
 #include "cmi_memutils.h"
@@ -51,6 +53,10 @@ void *cmi_aligned_alloc(const size_t align, const size_t sz)
     cmb_assert_release(sz > 8u);
     cmb_assert_release((sz % align) == 0u);
 
+    if (cmi_arena.on) {
+        return cmi_arena_alloc(align, sz);
+    }
+
     void *rp = aligned_alloc(align, sz);
     cmb_assert_release(rp != NULL);
     if (!rp) abort();
@@ -65,7 +71,13 @@ void *cmi_aligned_alloc(const size_t align, const size_t sz)
 void cmi_aligned_free(void *p)
 {
     cmb_assert_release(p != NULL);
-    free(p);
+
+    if (cmi_arena_owns(p)) {
+        cmi_arena_free(p);
+    }
+    else if (!cmi_arena.on) {
+        free(p);
+    }
 }
 
 /*
@@ -84,6 +96,10 @@ void *cmi_aligned_realloc(void *p, const size_t align, const size_t sz)
     cmb_assert_release(sz > 8u);
     cmb_assert_release((sz % align) == 0u);
 
+    if (cmi_arena.on || cmi_arena_owns(p)) {
+        return cmi_arena_realloc(p, align, sz);
+    }
+
     /* Emulate realloc behavior for aligned memory on Linux */
     void *rp = aligned_alloc(align, sz);
     cmb_assert_release(rp != NULL);
@@ -95,4 +111,53 @@ void *cmi_aligned_realloc(void *p, const size_t align, const size_t sz)
     free(p);
 
     return rp;
-}
\ No newline at end of file
+}
+
+/*
+ * cmi_usable_size : The size of a block from malloc or cmi_aligned_alloc,
+ * possibly a little more than asked for. The same either way under Linux.
+ */
+size_t cmi_usable_size(void *p, const size_t align)
+{
+    cmb_assert_release(p != NULL);
+    cmb_unused(align);
+
+    return malloc_usable_size(p);
+}
+
+/*
+ * cmi_vm_reserve : Reserve a range of addresses, sz bytes, without backing it
+ * with memory or swap until the pages are touched.
+ */
+void *cmi_vm_reserve(const size_t sz)
+{
+    cmb_assert_release(sz > 0u);
+
+    void *rp = mmap(NULL, sz, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (rp == MAP_FAILED) {
+        cmb_logger_fatal(stderr, "Cannot reserve %zu bytes of address space", sz);
+    }
+
+    return rp;
+}
+
+/*
+ * cmi_vm_commit : Make the reserved range usable. Nothing to do under Linux,
+ * the pages appear when first touched.
+ */
+void cmi_vm_commit(void *p, const size_t sz)
+{
+    cmb_unused(p);
+    cmb_unused(sz);
+}
+
+/*
+ * cmi_vm_release : Give back a range from cmi_vm_reserve.
+ */
+void cmi_vm_release(void *p, const size_t sz)
+{
+    cmb_assert_release(p != NULL);
+
+    (void)munmap(p, sz);
+}
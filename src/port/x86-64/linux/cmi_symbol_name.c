@@ -0,0 +1,58 @@
+/*
+ * cmi_symbol_name.c - Look up the name of the function at a given address in
+ * the dynamic symbol tables of the executable and the shared libraries.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Make sure we get dladdr and avoid Clang-Tidy complaints */
+#define _GNU_SOURCE // NOLINT(bugprone-reserved-identifier)
+#include <dlfcn.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * cmi_symbol_name - Write the name of the function at addr into buf, or the
+ * file it is in and the offset into that file if it has no exported name, for
+ * looking up with addr2line. Returns false, leaving buf alone, if the address
+ * is not in any loaded file at all.
+ *
+ * dladdr gives the nearest exported symbol below the address, which is some
+ * other function if this one is static, so only an exact match counts.
+ */
+bool cmi_symbol_name(const void *addr, char *buf, const size_t len)
+{
+    Dl_info info;
+    if ((dladdr(addr, &info) == 0) || (info.dli_fname == NULL)) {
+        return false;
+    }
+
+    if ((info.dli_sname != NULL) && (info.dli_saddr == addr)) {
+        (void)snprintf(buf, len, "%s", info.dli_sname);
+    }
+    else {
+        const char *file = strrchr(info.dli_fname, '/');
+        file = (file != NULL) ? file + 1 : info.dli_fname;
+        (void)snprintf(buf, len, "%s+0x%" PRIxPTR, file,
+                       (uintptr_t)addr - (uintptr_t)info.dli_fbase);
+    }
+
+    return true;
+}
@@ -27,6 +27,7 @@
 
 #include "cmi_coroutine.h"
 #include "cmi_memutils.h"
+#include "cmi_snapshot.h"
 
 /* Assembly functions, see src/port/x86-64/windows/cmi_coroutine_context_*.asm */
 extern void cmi_coroutine_trampoline(void);
@@ -229,18 +230,33 @@ void cmi_coroutine_context_init(struct cmi_coroutine *cp)
     cmb_assert_debug(cmi_coroutine_stack_valid(cp));
 }
 
-/* Allocate memory suitable for a stack */
+/*
+ * Allocate memory suitable for a stack. Each stack is its own reservation
+ * here already, so there are no slabs, and the slab argument makes no
+ * difference under Windows.
+ */
 unsigned char *cmi_coroutine_stack_alloc(const size_t size,
+                                         const bool slab,
                                          unsigned char **base_p,
                                          unsigned char **limit_p)
 {
+    cmb_unused(slab);
+
     const size_t pagesz = cmi_pagesize();
-    void *raw = VirtualAlloc(NULL, size + pagesz, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
-    cmb_assert_always(raw != NULL);
+    unsigned char *raw;
+    if (cmi_arena.on) {
+        /* In the snapshot arena, without a guard page to keep it copyable */
+        const size_t size_rnd = (size + pagesz - 1u) & ~(pagesz - 1u);
+        raw = cmi_aligned_alloc(pagesz, size_rnd + pagesz);
+    }
+    else {
+        raw = VirtualAlloc(NULL, size + pagesz, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        cmb_assert_always(raw != NULL);
 
-    DWORD old_protect;
-    const int ok = VirtualProtect(raw, pagesz, PAGE_NOACCESS, &old_protect);
-    cmb_assert_always(ok != 0);
+        DWORD old_protect;
+        const int ok = VirtualProtect(raw, pagesz, PAGE_NOACCESS, &old_protect);
+        cmb_assert_always(ok != 0);
+    }
 
     /* The stack grows downwards; the base is at the top */
     *base_p = raw + size + pagesz;
@@ -252,9 +268,16 @@ unsigned char *cmi_coroutine_stack_alloc(const size_t size,
 }
 
 /* Free memory previously allocated for a stack */
-void cmi_coroutine_stack_free(unsigned char *stack)
+void cmi_coroutine_stack_free(unsigned char *stack, const size_t size, const bool slab)
 {
     cmb_assert_release(stack != NULL);
+    cmb_unused(size);
+    cmb_unused(slab);
+
+    if (cmi_arena_owns(stack)) {
+        cmi_aligned_free(stack);
+        return;
+    }
 
     int r = VirtualFree(stack, 0, MEM_RELEASE);
     cmb_assert_always(r != 0);
@@ -280,6 +303,25 @@ void cmi_coroutine_os_adopt_stack(const struct cmi_coroutine *cp)
     cmi_coroutine_set_stack_teb(cp->stack_base, cp->stack_limit, cp->stack);
 }
 
+/* Add the list of recycled stacks to a snapshot, none here */
+void cmi_coroutine_stack_snapshot_regions(struct cmb_snapshot *sp)
+{
+    cmb_unused(sp);
+}
+
+/* No pool of stacks under Windows, hence nothing to prewarm */
+void cmi_coroutine_stack_prewarm(const uint64_t n, const size_t size_req, const bool slab)
+{
+    cmb_unused(n);
+    cmb_unused(size_req);
+    cmb_unused(slab);
+}
+
+size_t cmi_coroutine_stack_pooled(void)
+{
+    return 0u;
+}
+
 /* Called from the thread exit handler to deallocate any memory pools */
 void cmi_coroutine_stack_cleanup(void)
 {
@@ -0,0 +1,67 @@
+/*
+ * cmi_filemap.c - Create a file of a given size and map it into memory, shared
+ * with the operating system file cache, so that whatever is written there ends
+ * up in the file even if the program crashes.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <windows.h>
+
+#include "cmb_assert.h"
+
+/*
+ * cmi_filemap_open - Create or truncate the file, set its size, and map it
+ * for reading and writing. Returns NULL if any of it fails. The view keeps the
+ * file open, the handles are not needed once it is there.
+ */
+void *cmi_filemap_open(const char *path, const size_t sz)
+{
+    cmb_assert_release(path != NULL);
+    cmb_assert_release(sz > 0u);
+
+    HANDLE fh = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+                            NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fh == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+
+    void *p = NULL;
+    HANDLE mh = CreateFileMappingA(fh, NULL, PAGE_READWRITE,
+                                   (DWORD)((uint64_t)sz >> 32),
+                                   (DWORD)((uint64_t)sz & 0xFFFFFFFFu),
+                                   NULL);
+    if (mh != NULL) {
+        p = MapViewOfFile(mh, FILE_MAP_WRITE, 0, 0, sz);
+        CloseHandle(mh);
+    }
+
+    CloseHandle(fh);
+
+    return p;
+}
+
+/*
+ * cmi_filemap_close - Unmap the file. The contents stay in the file.
+ */
+void cmi_filemap_close(void *p, const size_t sz)
+{
+    cmb_assert_release(p != NULL);
+    cmb_unused(sz);
+
+    (void)UnmapViewOfFile(p);
+}
@@ -51,6 +51,10 @@ void *cmi_aligned_alloc(const size_t align, const size_t sz)
     cmb_assert_debug(sz > 8u);
     cmb_assert_debug((sz % align) == 0u);
 
+    if (cmi_arena.on) {
+        return cmi_arena_alloc(align, sz);
+    }
+
     /* Note reversed order of arguments vs C standard aligned_alloc */
     void *rp = _aligned_malloc(sz, align);
     cmb_assert_release(rp != NULL);
@@ -67,7 +71,13 @@ void *cmi_aligned_alloc(const size_t align, const size_t sz)
 void cmi_aligned_free(void *p)
 {
     cmb_assert_debug(p != NULL);
-    _aligned_free(p);
+
+    if (cmi_arena_owns(p)) {
+        cmi_arena_free(p);
+    }
+    else if (!cmi_arena.on) {
+        _aligned_free(p);
+    }
 }
 
 /*
@@ -87,10 +97,65 @@ void *cmi_aligned_realloc(void *p, const size_t align, const size_t sz)
     cmb_assert_debug(sz > 8u);
     cmb_assert_debug((sz % align) == 0u);
 
+    if (cmi_arena.on || cmi_arena_owns(p)) {
+        return cmi_arena_realloc(p, align, sz);
+    }
+
     /* Note reversed order of arguments vs C standard aligned_alloc */
     void *rp = _aligned_realloc(p, sz, align);
     cmb_assert_release(rp != NULL);
     if (!rp) abort();
 
     return rp;
-}
\ No newline at end of file
+}
+
+/*
+ * cmi_usable_size : The size of a block from malloc (align zero) or from
+ * cmi_aligned_alloc (the alignment it was allocated with). These are two
+ * different things on Windows.
+ */
+size_t cmi_usable_size(void *p, const size_t align)
+{
+    cmb_assert_debug(p != NULL);
+
+    return (align == 0u) ? _msize(p) : _aligned_msize(p, align, 0u);
+}
+
+/*
+ * cmi_vm_reserve : Reserve a range of addresses, sz bytes, without committing
+ * any memory to it yet, see cmi_vm_commit.
+ */
+void *cmi_vm_reserve(const size_t sz)
+{
+    cmb_assert_debug(sz > 0u);
+
+    void *rp = VirtualAlloc(NULL, sz, MEM_RESERVE, PAGE_NOACCESS);
+    if (rp == NULL) {
+        cmb_logger_fatal(stderr, "Cannot reserve %zu bytes of address space", sz);
+    }
+
+    return rp;
+}
+
+/*
+ * cmi_vm_commit : Commit memory to a part of a reserved range.
+ */
+void cmi_vm_commit(void *p, const size_t sz)
+{
+    cmb_assert_debug(p != NULL);
+
+    if (VirtualAlloc(p, sz, MEM_COMMIT, PAGE_READWRITE) == NULL) {
+        cmb_logger_fatal(stderr, "Cannot commit %zu bytes of memory", sz);
+    }
+}
+
+/*
+ * cmi_vm_release : Give back a range from cmi_vm_reserve.
+ */
+void cmi_vm_release(void *p, const size_t sz)
+{
+    cmb_assert_debug(p != NULL);
+    cmb_unused(sz);
+
+    (void)VirtualFree(p, 0u, MEM_RELEASE);
+}
@@ -0,0 +1,33 @@
+/*
+ * cmi_symbol_name.c - Look up the name of the function at a given address.
+ * Not available on Windows without the debug help library, the caller falls
+ * back to other names or the address.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cmb_assert.h"
+
+bool cmi_symbol_name(const void *addr, char *buf, const size_t len)
+{
+    cmb_unused(addr);
+    cmb_unused(buf);
+    cmb_unused(len);
+
+    return false;
+}
@@ -22,6 +22,7 @@
 
 #include <errno.h>
 #include <inttypes.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -32,6 +33,8 @@
 #include "cmb_random.h"
 #include "cmb_logger.h"
 
+#include "cmi_memutils.h"
+
 #include "test.h"
 
 #define USERFLAG 0x00000001
@@ -209,6 +212,862 @@ void test_events(const uint64_t seed)
     cmi_test_print_line("*");
 }
 
+/*
+ * test_event_backends - Run the same event sequence on each event queue
+ * backend, including an automatic switch from heap to ladder queue, and verify
+ * that the events execute in exactly the same order with the same handles.
+ * Times are rounded to whole numbers to get plenty of ties in time, broken by
+ * priority and FIFO order. Also schedule the initial events in one batch and
+ * cancel some of them by pattern instead of one by one, for the same result.
+ */
+#define BACKEND_EVENTS 20000u
+#define BACKEND_RUNS 100000u
+
+static uint64_t backend_trace[BACKEND_RUNS];
+static uint64_t backend_trace_cnt = 0u;
+
+static void backend_action(void *subject, void *object)
+{
+    backend_trace[backend_trace_cnt++] = cmb_event_current();
+    if (backend_trace_cnt == BACKEND_RUNS) {
+        cmb_event_queue_clear();
+    }
+    else {
+        const double t = cmb_time() + floor(cmb_random_exponential(1000.0));
+        const int64_t p = cmb_random_dice(1, 3);
+        (void)cmb_event_schedule(backend_action, subject, object, t, p);
+    }
+}
+
+static char backend_marker;
+
+static uint64_t backend_run(const enum cmb_event_queue_backend backend,
+                            const bool batch,
+                            const uint64_t seed)
+{
+    cmb_random_initialize(seed);
+    cmb_event_queue_backend_set(backend);
+    cmb_event_queue_initialize(0.0);
+    backend_trace_cnt = 0u;
+
+    static uint64_t handles[BACKEND_EVENTS];
+    if (batch) {
+        /* Every seventh marked for cancellation by pattern below */
+        static struct cmb_event_spec specs[BACKEND_EVENTS];
+        for (uint64_t ui = 0u; ui < BACKEND_EVENTS; ui++) {
+            specs[ui].action = backend_action;
+            specs[ui].subject = NULL;
+            specs[ui].object = ((ui % 7u) == 0u) ? &backend_marker : NULL;
+            specs[ui].time = floor(cmb_random_exponential(1000.0));
+            specs[ui].priority = cmb_random_dice(1, 3);
+        }
+
+        cmb_event_schedule_batch(BACKEND_EVENTS, specs, handles);
+        const uint64_t n = cmb_event_pattern_cancel(CMB_ANY_ACTION,
+                                                    CMB_ANY_SUBJECT,
+                                                    &backend_marker);
+        cmb_assert_always(n == (BACKEND_EVENTS + 6u) / 7u);
+    }
+    else {
+        for (uint64_t ui = 0u; ui < BACKEND_EVENTS; ui++) {
+            const double t = floor(cmb_random_exponential(1000.0));
+            const int64_t p = cmb_random_dice(1, 3);
+            handles[ui] = cmb_event_schedule(backend_action, NULL, NULL, t, p);
+        }
+
+        /* Cancel every seventh */
+        for (uint64_t ui = 0u; ui < BACKEND_EVENTS; ui += 7u) {
+            cmb_assert_always(cmb_event_cancel(handles[ui]));
+        }
+    }
+
+    /* Move every eleventh to a new time and priority */
+    for (uint64_t ui = 0u; ui < BACKEND_EVENTS; ui += 7u) {
+        cmb_assert_always(!cmb_event_is_scheduled(handles[ui]));
+    }
+    for (uint64_t ui = 1u; ui < BACKEND_EVENTS; ui += 11u) {
+        if (cmb_event_is_scheduled(handles[ui])) {
+            const double t = floor(cmb_random_exponential(500.0));
+            cmb_assert_always(cmb_event_reschedule(handles[ui], t));
+            cmb_assert_always(cmb_event_reprioritize(handles[ui], 2));
+            cmb_assert_always(cmb_event_time(handles[ui]) == t);
+        }
+    }
+
+    const uint64_t cnt = cmb_event_queue_count();
+    cmb_assert_always(cmb_event_pattern_count(backend_action, NULL, CMB_ANY_OBJECT) == cnt);
+
+    cmb_event_queue_execute();
+    cmb_event_queue_terminate();
+    cmb_random_terminate();
+
+    return cnt;
+}
+
+void test_event_backends(const uint64_t seed)
+{
+    cmi_test_print_line("-");
+    printf("Testing event queue backends against each other\n");
+
+    static uint64_t ref_trace[BACKEND_RUNS];
+    const uint64_t ref_cnt = backend_run(CMB_EVENT_QUEUE_HEAP, false, seed);
+    cmi_memcpy(ref_trace, backend_trace, sizeof(ref_trace));
+    printf("  heap: %" PRIu64 " events in queue, %" PRIu64 " executed\n",
+           ref_cnt, backend_trace_cnt);
+
+    const enum cmb_event_queue_backend backends[] = { CMB_EVENT_QUEUE_LADDER,
+                                                      CMB_EVENT_QUEUE_RADIX,
+                                                      CMB_EVENT_QUEUE_AUTO,
+                                                      CMB_EVENT_QUEUE_HEAP,
+                                                      CMB_EVENT_QUEUE_LADDER };
+    const bool batches[] = { false, false, false, true, true };
+    const char *names[] = { "ladder", "radix", "auto", "heap, batch", "ladder, batch" };
+    for (unsigned ui = 0u; ui < sizeof(backends) / sizeof(backends[0]); ui++) {
+        const uint64_t cnt = backend_run(backends[ui], batches[ui], seed);
+        cmb_assert_always(cnt == ref_cnt);
+        cmb_assert_always(backend_trace_cnt == BACKEND_RUNS);
+        for (uint64_t uj = 0u; uj < BACKEND_RUNS; uj++) {
+            cmb_assert_always(backend_trace[uj] == ref_trace[uj]);
+        }
+
+        printf("  %s: %" PRIu64 " events in queue, %" PRIu64 " executed in reference order\n",
+               names[ui], cnt, backend_trace_cnt);
+    }
+
+    cmb_event_queue_backend_set(CMB_EVENT_QUEUE_HEAP);
+    cmi_test_print_line("*");
+}
+
+/*
+ * test_event_same_time - Mix events due at the current time, scheduled with
+ * zero delay, with events scheduled earlier for the same time, more
+ * priorities than the fast lane holds, and cancel or reprioritize some of
+ * them. Verify that everything executes in (time, priority, handle) order.
+ */
+#define SAME_TIME_EVENTS 2000u
+#define SAME_TIME_PRIOS 12
+
+static uint64_t same_time_trace[2u * SAME_TIME_EVENTS];
+static double same_time_times[2u * SAME_TIME_EVENTS];
+static int64_t same_time_prios[2u * SAME_TIME_EVENTS + 1u];
+static uint64_t same_time_cnt = 0u;
+
+static void same_time_action(void *subject, void *object)
+{
+    cmb_unused(subject);
+    cmb_unused(object);
+
+    same_time_times[same_time_cnt] = cmb_time();
+    same_time_trace[same_time_cnt++] = cmb_event_current();
+}
+
+static void same_time_burst(void *subject, void *object)
+{
+    cmb_unused(subject);
+    cmb_unused(object);
+
+    static uint64_t handles[SAME_TIME_EVENTS];
+    for (uint64_t ui = 0u; ui < SAME_TIME_EVENTS; ui++) {
+        const int64_t p = cmb_random_dice(0, SAME_TIME_PRIOS - 1);
+        handles[ui] = cmb_event_schedule(same_time_action, NULL, NULL, cmb_time(), p);
+        cmb_assert_always(cmb_event_time(handles[ui]) == cmb_time());
+        cmb_assert_always(cmb_event_priority(handles[ui]) == p);
+        same_time_prios[handles[ui]] = p;
+    }
+
+    for (uint64_t ui = 0u; ui < SAME_TIME_EVENTS; ui += 5u) {
+        cmb_assert_always(cmb_event_cancel(handles[ui]));
+        cmb_assert_always(!cmb_event_is_scheduled(handles[ui]));
+    }
+
+    for (uint64_t ui = 1u; ui < SAME_TIME_EVENTS; ui += 7u) {
+        if (cmb_event_is_scheduled(handles[ui])) {
+            const int64_t p = cmb_random_dice(0, SAME_TIME_PRIOS - 1);
+            cmb_assert_always(cmb_event_reprioritize(handles[ui], p));
+            cmb_assert_always(cmb_event_priority(handles[ui]) == p);
+            same_time_prios[handles[ui]] = p;
+        }
+    }
+}
+
+void test_event_same_time(const uint64_t seed)
+{
+    cmi_test_print_line("-");
+    printf("Testing events scheduled for the current time\n");
+
+    cmb_random_initialize(seed);
+    cmb_event_queue_initialize(0.0);
+    same_time_cnt = 0u;
+
+    /* Events for time 1 and 2, known to the main queue before the burst at 1 */
+    const uint64_t bh = cmb_event_schedule(same_time_burst, NULL, NULL, 1.0, SAME_TIME_PRIOS);
+    same_time_prios[bh] = SAME_TIME_PRIOS;
+    for (uint64_t ui = 0u; ui < SAME_TIME_EVENTS / 2u; ui++) {
+        const int64_t p = cmb_random_dice(0, SAME_TIME_PRIOS - 1);
+        const double t = (double)cmb_random_dice(1, 2);
+        const uint64_t h = cmb_event_schedule(same_time_action, NULL, NULL, t, p);
+        same_time_prios[h] = p;
+    }
+
+    cmb_event_queue_execute();
+    printf("  %" PRIu64 " events executed\n", same_time_cnt);
+    cmb_assert_always(cmb_event_queue_is_empty());
+
+    for (uint64_t ui = 1u; ui < same_time_cnt; ui++) {
+        const double ta = same_time_times[ui - 1u];
+        const double tb = same_time_times[ui];
+        const int64_t pa = same_time_prios[same_time_trace[ui - 1u]];
+        const int64_t pb = same_time_prios[same_time_trace[ui]];
+        cmb_assert_always((ta < tb)
+                          || ((ta == tb) && (pa > pb))
+                          || ((ta == tb) && (pa == pb)
+                              && (same_time_trace[ui - 1u] < same_time_trace[ui])));
+    }
+
+    printf("  all in time, priority, and FIFO order\n");
+
+    cmb_event_queue_terminate();
+    cmb_random_terminate();
+    cmi_test_print_line("*");
+}
+
+/*
+ * test_event_slot_lane - The same mix of events due at the current time, with
+ * and without slot handles, the events numbered through their subject. With
+ * slot handles, the events in the fast lane have heap item slots reserved for
+ * their handles, found without the hash map before and after they leave the
+ * lane. Verify that the execution order is the same, that handles of executed
+ * events are stale, and that no handle goes through the hash map.
+ */
+static uint64_t slot_lane_trace[2u * SAME_TIME_EVENTS];
+static uint64_t slot_lane_cnt = 0u;
+static uint64_t slot_lane_last = 0u;
+
+static void slot_lane_action(void *subject, void *object)
+{
+    cmb_unused(object);
+
+    /* The previous event is gone, even if its slot is taken by a new one */
+    if (slot_lane_last != 0u) {
+        cmb_assert_always(!cmb_event_is_scheduled(slot_lane_last));
+        cmb_assert_always(!cmb_event_cancel(slot_lane_last));
+    }
+
+    slot_lane_last = cmb_event_current();
+    slot_lane_trace[slot_lane_cnt++] = (uint64_t)(uintptr_t)subject;
+}
+
+static void slot_lane_burst(void *subject, void *object)
+{
+    cmb_unused(subject);
+    cmb_unused(object);
+
+    static uint64_t handles[SAME_TIME_EVENTS];
+    for (uint64_t ui = 0u; ui < SAME_TIME_EVENTS; ui++) {
+        const int64_t p = cmb_random_dice(0, SAME_TIME_PRIOS - 1);
+        handles[ui] = cmb_event_schedule(slot_lane_action, (void *)(uintptr_t)ui,
+                                         NULL, cmb_time(), p);
+        cmb_assert_always(cmb_event_priority(handles[ui]) == p);
+    }
+
+    for (uint64_t ui = 0u; ui < SAME_TIME_EVENTS; ui += 5u) {
+        cmb_assert_always(cmb_event_cancel(handles[ui]));
+        cmb_assert_always(!cmb_event_is_scheduled(handles[ui]));
+        cmb_assert_always(!cmb_event_cancel(handles[ui]));
+    }
+
+    for (uint64_t ui = 1u; ui < SAME_TIME_EVENTS; ui += 7u) {
+        if (cmb_event_is_scheduled(handles[ui])) {
+            const int64_t p = cmb_random_dice(0, SAME_TIME_PRIOS - 1);
+            cmb_assert_always(cmb_event_reprioritize(handles[ui], p));
+            cmb_assert_always(cmb_event_priority(handles[ui]) == p);
+            cmb_assert_always(cmb_event_time(handles[ui]) == cmb_time());
+        }
+    }
+}
+
+static uint64_t slot_lane_run(const bool slots, const uint64_t seed)
+{
+    cmb_random_initialize(seed);
+    cmb_event_queue_slot_handles_set(slots);
+    cmb_event_queue_initialize(0.0);
+    slot_lane_cnt = 0u;
+    slot_lane_last = 0u;
+
+    (void)cmb_event_schedule(slot_lane_burst, NULL, NULL, 1.0, SAME_TIME_PRIOS);
+    for (uint64_t ui = 0u; ui < SAME_TIME_EVENTS / 2u; ui++) {
+        const int64_t p = cmb_random_dice(0, SAME_TIME_PRIOS - 1);
+        const double t = (double)cmb_random_dice(1, 2);
+        (void)cmb_event_schedule(slot_lane_action, (void *)(uintptr_t)(SAME_TIME_EVENTS + ui),
+                                 NULL, t, p);
+    }
+
+    cmb_event_queue_execute();
+    cmb_assert_always(cmb_event_queue_is_empty());
+
+    struct cmb_event_queue_stats qs;
+    cmb_event_queue_stats(&qs);
+    cmb_event_queue_terminate();
+    cmb_random_terminate();
+
+    return qs.hash_lookups;
+}
+
+void test_event_slot_lane(const uint64_t seed)
+{
+    cmi_test_print_line("-");
+    printf("Testing slot handles for events in the fast lane\n");
+
+    static uint64_t ref_trace[2u * SAME_TIME_EVENTS];
+    const uint64_t ref_lookups = slot_lane_run(false, seed);
+    const uint64_t ref_cnt = slot_lane_cnt;
+    cmi_memcpy(ref_trace, slot_lane_trace, sizeof(ref_trace));
+    cmb_assert_always(ref_lookups > 0u);
+
+    const uint64_t lookups = slot_lane_run(true, seed);
+    cmb_assert_always(slot_lane_cnt == ref_cnt);
+    for (uint64_t ui = 0u; ui < ref_cnt; ui++) {
+        cmb_assert_always(slot_lane_trace[ui] == ref_trace[ui]);
+    }
+
+    cmb_assert_always(lookups == 0u);
+    printf("  %" PRIu64 " events executed in the same order, hash lookups: "
+           "%" PRIu64 " without, %" PRIu64 " with slot handles\n",
+           slot_lane_cnt, ref_lookups, lookups);
+
+    cmb_event_queue_slot_handles_set(false);
+    cmi_test_print_line("*");
+}
+
+/*
+ * test_event_subjects - Schedule events for many subjects on each backend,
+ * with and without the subject index, and cancel all events for one subject
+ * now and then, as when a process stops. Keep a tally of the pending events
+ * for each subject on the side and verify the pattern counts and
+ * cancellations against it, and that the execution order is the same with
+ * and without the index.
+ */
+#define SUBJECT_COUNT 64u
+#define SUBJECT_EVENTS 5000u
+#define SUBJECT_RUNS 20000u
+#define SUBJECT_HANDLES (SUBJECT_EVENTS + SUBJECT_RUNS + 1u)
+
+static char subject_objs[SUBJECT_COUNT];
+static uint8_t subject_of[SUBJECT_HANDLES];
+static uint64_t subject_pending[SUBJECT_COUNT];
+static uint64_t subject_trace[SUBJECT_RUNS];
+static uint64_t subject_trace_cnt = 0u;
+static uint64_t subject_cancelled = 0u;
+
+static void subject_action_a(void *subject, void *object);
+static void subject_action_b(void *subject, void *object);
+
+static void subject_schedule(const double t)
+{
+    const unsigned s = (unsigned)cmb_random_dice(0, SUBJECT_COUNT - 1u);
+    const unsigned o = (unsigned)cmb_random_dice(0, SUBJECT_COUNT - 1u);
+    cmb_event_func *action = (cmb_random_dice(0, 1) == 0) ? subject_action_a
+                                                          : subject_action_b;
+    const int64_t p = cmb_random_dice(0, 2);
+    const uint64_t h = cmb_event_schedule(action, &(subject_objs[s]), &(subject_objs[o]), t, p);
+    cmb_assert_always(h < SUBJECT_HANDLES);
+    subject_of[h] = (uint8_t)(s + 1u);
+    subject_pending[s]++;
+}
+
+static void subject_stop(const unsigned s)
+{
+    const void *subject = &(subject_objs[s]);
+    cmb_assert_always(cmb_event_pattern_count(CMB_ANY_ACTION, subject, CMB_ANY_OBJECT)
+                      == subject_pending[s]);
+    const uint64_t na = cmb_event_pattern_count(subject_action_a, subject, CMB_ANY_OBJECT);
+    const uint64_t nb = cmb_event_pattern_count(subject_action_b, subject, CMB_ANY_OBJECT);
+    cmb_assert_always(na + nb == subject_pending[s]);
+    if (subject_pending[s] > 0u) {
+        const uint64_t h = cmb_event_pattern_find(CMB_ANY_ACTION, subject, CMB_ANY_OBJECT);
+        cmb_assert_always((h > 0u) && (subject_of[h] == s + 1u));
+    }
+
+    const uint64_t n = cmb_event_pattern_cancel(CMB_ANY_ACTION, subject, CMB_ANY_OBJECT);
+    cmb_assert_always(n == subject_pending[s]);
+    cmb_assert_always(cmb_event_pattern_find(CMB_ANY_ACTION, subject, CMB_ANY_OBJECT) == 0u);
+    for (uint64_t h = 1u; h < SUBJECT_HANDLES; h++) {
+        if (subject_of[h] == s + 1u) {
+            cmb_assert_always(!cmb_event_is_scheduled(h));
+            subject_of[h] = 0u;
+        }
+    }
+
+    subject_pending[s] = 0u;
+    subject_cancelled += n;
+}
+
+static void subject_action(void *subject)
+{
+    const uint64_t h = cmb_event_current();
+    const unsigned s = (unsigned)((char *)subject - subject_objs);
+    cmb_assert_always(subject_of[h] == s + 1u);
+    subject_of[h] = 0u;
+    subject_pending[s]--;
+
+    subject_trace[subject_trace_cnt++] = h;
+    if (subject_trace_cnt == SUBJECT_RUNS) {
+        cmb_event_queue_clear();
+        return;
+    }
+
+    if ((subject_trace_cnt % 50u) == 0u) {
+        subject_stop((unsigned)cmb_random_dice(0, SUBJECT_COUNT - 1u));
+    }
+
+    /* Now and then at the current time, going through the fast lane */
+    const double dt = (cmb_random_dice(0, 9) == 0) ? 0.0
+                                                   : floor(cmb_random_exponential(100.0));
+    subject_schedule(cmb_time() + dt);
+}
+
+static void subject_action_a(void *subject, void *object)
+{
+    cmb_unused(object);
+    subject_action(subject);
+}
+
+static void subject_action_b(void *subject, void *object)
+{
+    cmb_unused(object);
+    subject_action(subject);
+}
+
+static void subject_run(const enum cmb_event_queue_backend backend,
+                        const bool indexed,
+                        const uint64_t seed)
+{
+    cmb_random_initialize(seed);
+    cmb_event_queue_backend_set(backend);
+    cmb_event_queue_subject_index_set(indexed);
+    cmb_event_queue_initialize(0.0);
+    cmi_memset(subject_of, 0u, sizeof(subject_of));
+    cmi_memset(subject_pending, 0u, sizeof(subject_pending));
+    subject_trace_cnt = 0u;
+    subject_cancelled = 0u;
+
+    for (uint64_t ui = 0u; ui < SUBJECT_EVENTS; ui++) {
+        subject_schedule(floor(cmb_random_exponential(100.0)));
+    }
+
+    for (unsigned s = 0u; s < SUBJECT_COUNT; s += 7u) {
+        subject_stop(s);
+    }
+
+    cmb_event_queue_execute();
+    cmb_assert_always(subject_trace_cnt == SUBJECT_RUNS);
+
+    cmb_event_queue_terminate();
+    cmb_random_terminate();
+}
+
+void test_event_subjects(const uint64_t seed)
+{
+    cmi_test_print_line("-");
+    printf("Testing pattern cancellation by subject, with and without index\n");
+
+    static uint64_t ref_trace[SUBJECT_RUNS];
+    const enum cmb_event_queue_backend backends[] = { CMB_EVENT_QUEUE_HEAP,
+                                                      CMB_EVENT_QUEUE_LADDER,
+                                                      CMB_EVENT_QUEUE_RADIX,
+                                                      CMB_EVENT_QUEUE_AUTO };
+    const char *names[] = { "heap", "ladder", "radix", "auto" };
+    for (unsigned ui = 0u; ui < sizeof(backends) / sizeof(backends[0]); ui++) {
+        subject_run(backends[ui], false, seed);
+        cmi_memcpy(ref_trace, subject_trace, sizeof(ref_trace));
+        const uint64_t ref_cancelled = subject_cancelled;
+
+        subject_run(backends[ui], true, seed);
+        cmb_assert_always(subject_cancelled == ref_cancelled);
+        for (uint64_t uj = 0u; uj < SUBJECT_RUNS; uj++) {
+            cmb_assert_always(subject_trace[uj] == ref_trace[uj]);
+        }
+
+        printf("  %s: %" PRIu64 " executed, %" PRIu64 " cancelled, same with index\n",
+               names[ui], subject_trace_cnt, subject_cancelled);
+    }
+
+    cmb_event_queue_subject_index_set(false);
+    cmb_event_queue_backend_set(CMB_EVENT_QUEUE_HEAP);
+    cmi_test_print_line("*");
+}
+
+/*
+ * test_event_retain - Run the same trial over again with a fresh event queue
+ * each time, with the one kept from the previous trial, presized from its peak,
+ * and with capacity hints too large to keep and too small to matter. Verify
+ * that the events execute in the same order with the same handles every time.
+ */
+void test_event_retain(const uint64_t seed)
+{
+    cmi_test_print_line("-");
+    printf("Testing event queue reuse across trials\n");
+
+    static uint64_t ref_trace[BACKEND_RUNS];
+    const uint64_t retain_limit = cmb_event_queue_retain_limit();
+    cmb_event_queue_retain_limit_set(0u);
+    const uint64_t ref_cnt = backend_run(CMB_EVENT_QUEUE_HEAP, false, seed);
+    cmi_memcpy(ref_trace, backend_trace, sizeof(ref_trace));
+    printf("  fresh: %" PRIu64 " events in queue, %" PRIu64 " executed\n",
+           ref_cnt, backend_trace_cnt);
+
+    cmb_event_queue_retain_limit_set(retain_limit);
+    const uint64_t hints[] = { 0u, 0u, 1u << 20, 100u, 0u };
+    const char *names[] = { "kept", "kept again", "large hint", "small hint", "no hint" };
+    for (unsigned ui = 0u; ui < sizeof(hints) / sizeof(hints[0]); ui++) {
+        cmb_event_queue_capacity_hint_set(hints[ui]);
+        const uint64_t cnt = backend_run(CMB_EVENT_QUEUE_HEAP, (ui % 2u) == 1u, seed);
+        cmb_assert_always(cnt == ref_cnt);
+        cmb_assert_always(backend_trace_cnt == BACKEND_RUNS);
+        for (uint64_t uj = 0u; uj < BACKEND_RUNS; uj++) {
+            cmb_assert_always(backend_trace[uj] == ref_trace[uj]);
+        }
+
+        printf("  %s: %" PRIu64 " events in queue, %" PRIu64 " executed in reference order\n",
+               names[ui], cnt, backend_trace_cnt);
+    }
+
+    cmb_event_queue_capacity_hint_set(0u);
+    cmi_test_print_line("*");
+}
+
+/* An event that does nothing, for counting */
+static void stats_action(void *subject, void *object)
+{
+    cmb_unused(subject);
+    cmb_unused(object);
+}
+
+#define STATS_EVENTS 2000u
+
+/*
+ * stats_run - Schedule STATS_EVENTS events at random times, cancel every fifth
+ * and reschedule every seventh of the rest, then execute the queue. Verify the
+ * event counts against the known numbers and the heap figures against each
+ * other, the same before and after the queue is terminated.
+ */
+static void stats_run(const enum cmb_event_queue_backend backend, const uint64_t seed)
+{
+    cmb_random_initialize(seed);
+    cmb_event_queue_backend_set(backend);
+    cmb_event_queue_initialize(0.0);
+
+    static uint64_t handles[STATS_EVENTS];
+    for (uint64_t ui = 0u; ui < STATS_EVENTS; ui++) {
+        handles[ui] = cmb_event_schedule(stats_action, NULL, NULL,
+                                         cmb_random_exponential(100.0), 0);
+    }
+
+    uint64_t cancelled = 0u;
+    uint64_t rescheduled = 0u;
+    for (uint64_t ui = 0u; ui < STATS_EVENTS; ui++) {
+        if ((ui % 5u) == 0u) {
+            cmb_assert_always(cmb_event_cancel(handles[ui]));
+            cancelled++;
+        }
+        else if ((ui % 7u) == 0u) {
+            cmb_assert_always(cmb_event_reschedule(handles[ui],
+                                                   cmb_random_exponential(100.0)));
+            rescheduled++;
+        }
+    }
+
+    cmb_event_queue_execute();
+
+    struct cmb_event_queue_stats qs;
+    cmb_event_queue_stats(&qs);
+    cmb_assert_always(qs.enqueues == STATS_EVENTS);
+    cmb_assert_always(qs.cancels == cancelled);
+    cmb_assert_always(qs.reschedules == rescheduled);
+    cmb_assert_always(qs.dequeues == STATS_EVENTS - cancelled);
+    cmb_assert_always(qs.peak_depth == STATS_EVENTS);
+    cmb_assert_always(qs.heap_sifts > 0u);
+    cmb_assert_always((qs.hash_lookups > 0u) == (backend == CMB_EVENT_QUEUE_HEAP));
+    cmb_assert_always((double)(qs.probe_max) >= qs.probe_mean);
+    cmb_assert_always(qs.sift_mean < 12.0);
+
+    cmb_event_queue_terminate();
+    struct cmb_event_queue_stats after;
+    cmb_event_queue_stats(&after);
+    cmb_assert_always(after.dequeues == qs.dequeues);
+    cmb_assert_always(after.heap_sifts == qs.heap_sifts);
+    cmb_assert_always(after.hash_lookups == qs.hash_lookups);
+
+    printf("  %" PRIu64 " enqueued, %" PRIu64 " dequeued, %" PRIu64 " cancelled, "
+           "%" PRIu64 " rescheduled, peak depth %" PRIu64 "\n",
+           qs.enqueues, qs.dequeues, qs.cancels, qs.reschedules, qs.peak_depth);
+    printf("  heap: %" PRIu64 " sifts, %" PRIu64 " hash lookups\n",
+           qs.heap_sifts, qs.hash_lookups);
+}
+
+/*
+ * test_event_stats - Check the event queue statistics with the heap, and with
+ * an automatic queue that moves to a ladder queue partway, keeping the heap
+ * figures from before the switch. The cancellations come after the switch,
+ * so the automatic queue does no hash map lookups.
+ */
+void test_event_stats(const uint64_t seed)
+{
+    cmi_test_print_line("-");
+    printf("Testing event queue statistics\n");
+
+    printf("Heap:\n");
+    stats_run(CMB_EVENT_QUEUE_HEAP, seed);
+    printf("Auto:\n");
+    stats_run(CMB_EVENT_QUEUE_AUTO, seed);
+
+    cmb_event_queue_backend_set(CMB_EVENT_QUEUE_HEAP);
+    cmi_test_print_line("*");
+}
+
+/* The time of the last event executed by window_action */
+static double window_last = -1.0;
+
+/* Note the time, checking that it never goes backwards */
+static void window_action(void *subject, void *object)
+{
+    cmb_unused(subject);
+    cmb_unused(object);
+
+    cmb_assert_always(cmb_time() >= window_last);
+    window_last = cmb_time();
+}
+
+/* Schedule a follower at the same time, once */
+static void chain_action(void *subject, void *object)
+{
+    cmb_unused(object);
+
+    window_action(subject, NULL);
+    if (subject != NULL) {
+        (void)cmb_event_schedule(chain_action, NULL, NULL, cmb_time(), 0);
+    }
+}
+
+#define WINDOW_EVENTS 3000u
+#define WINDOW_SIZE 100.0
+#define WINDOW_BATCH 700u
+
+/*
+ * window_run - Schedule WINDOW_EVENTS events at random times and run them in
+ * windows of WINDOW_SIZE time units, checking that each window executes the
+ * events in it and no others and stops the clock at its end. Then the same
+ * events again in batches of WINDOW_BATCH events.
+ */
+static void window_run(const enum cmb_event_queue_backend backend, const uint64_t seed)
+{
+    cmb_random_initialize(seed);
+    cmb_event_queue_backend_set(backend);
+    cmb_event_queue_initialize(0.0);
+
+    for (uint64_t ui = 0u; ui < WINDOW_EVENTS; ui++) {
+        (void)cmb_event_schedule(window_action, NULL, NULL,
+                                 cmb_random_exponential(WINDOW_SIZE), 0);
+    }
+
+    /* A chain at the very end of the first window, all of it inside */
+    (void)cmb_event_schedule(chain_action, &window_last, NULL, WINDOW_SIZE, 0);
+
+    uint64_t total = 0u;
+    unsigned windows = 0u;
+    double t = 0.0;
+    window_last = 0.0;
+    while (!cmb_event_queue_is_empty()) {
+        t += WINDOW_SIZE;
+        const uint64_t cnt = cmb_event_queue_execute_until(t);
+        cmb_assert_always(cmb_time() == t);
+        cmb_assert_always(window_last <= t);
+        cmb_assert_always((window_last > t - WINDOW_SIZE) || (cnt == 0u));
+        cmb_assert_always(cmb_event_queue_count() == WINDOW_EVENTS + 2u - total - cnt);
+        total += cnt;
+        windows++;
+    }
+
+    cmb_assert_always(total == WINDOW_EVENTS + 2u);
+    printf("  %" PRIu64 " events in %u windows, clock at %g\n", total, windows, cmb_time());
+
+    /* An empty queue just moves the clock */
+    cmb_assert_always(cmb_event_queue_execute_until(t + 1.0) == 0u);
+    cmb_assert_always(cmb_time() == t + 1.0);
+
+    for (uint64_t ui = 0u; ui < WINDOW_EVENTS; ui++) {
+        (void)cmb_event_schedule(window_action, NULL, NULL,
+                                 cmb_time() + cmb_random_exponential(WINDOW_SIZE), 0);
+    }
+
+    unsigned batches = 0u;
+    total = 0u;
+    uint64_t cnt;
+    while ((cnt = cmb_event_queue_execute_n(WINDOW_BATCH)) > 0u) {
+        total += cnt;
+        batches++;
+        cmb_assert_always((cnt == WINDOW_BATCH) || cmb_event_queue_is_empty());
+        cmb_assert_always(cmb_event_queue_count() == WINDOW_EVENTS - total);
+        cmb_assert_always(cmb_time() == window_last);
+    }
+
+    cmb_assert_always(total == WINDOW_EVENTS);
+    printf("  %" PRIu64 " events in %u batches, clock at %g\n", total, batches, cmb_time());
+
+    cmb_event_queue_terminate();
+}
+
+/*
+ * test_event_windows - Run the same events in time windows and in batches of
+ * a given number, with the heap and with an automatic queue that moves to a
+ * ladder queue at the start.
+ */
+void test_event_windows(const uint64_t seed)
+{
+    cmi_test_print_line("-");
+    printf("Testing execution in time windows and in batches\n");
+
+    printf("Heap:\n");
+    window_run(CMB_EVENT_QUEUE_HEAP, seed);
+    printf("Auto:\n");
+    window_run(CMB_EVENT_QUEUE_AUTO, seed);
+
+    cmb_event_queue_backend_set(CMB_EVENT_QUEUE_HEAP);
+    cmi_test_print_line("*");
+}
+
+/*
+ * The periodic events: a tick that cancels itself after PERIODIC_TICKS
+ * occurrences, a sample that is cancelled from outside at PERIODIC_STOP, both
+ * among PERIODIC_EVENTS one-time events, enough for the automatic queue to
+ * switch to a ladder queue with the periodic events already in it.
+ */
+#define PERIODIC_EVENTS 2000u
+#define PERIODIC_TICKS 50u
+#define PERIODIC_STOP 300.0
+#define PERIODIC_RUNS (PERIODIC_EVENTS + PERIODIC_TICKS + 100u)
+
+static uint64_t periodic_trace[PERIODIC_RUNS];
+static uint64_t periodic_trace_cnt = 0u;
+static uint64_t tick_handle = 0u;
+static uint64_t tick_cnt = 0u;
+static uint64_t sample_handle = 0u;
+static uint64_t sample_cnt = 0u;
+
+static void periodic_note(void)
+{
+    cmb_assert_always(periodic_trace_cnt < PERIODIC_RUNS);
+    periodic_trace[periodic_trace_cnt++] = cmb_event_current();
+}
+
+static void tick_action(void *subject, void *object)
+{
+    cmb_unused(subject);
+    cmb_unused(object);
+
+    periodic_note();
+    cmb_assert_always(cmb_event_current() == tick_handle);
+    cmb_assert_always(cmb_time() == 0.5 + 10.0 * (double)tick_cnt);
+    tick_cnt++;
+
+    /* Already waiting for its next turn */
+    cmb_assert_always(cmb_event_is_scheduled(tick_handle));
+    cmb_assert_always(cmb_event_time(tick_handle) == cmb_time() + 10.0);
+    if (tick_cnt == PERIODIC_TICKS) {
+        cmb_assert_always(cmb_event_cancel(tick_handle));
+    }
+}
+
+static void sample_action(void *subject, void *object)
+{
+    cmb_unused(subject);
+    cmb_unused(object);
+
+    periodic_note();
+    cmb_assert_always(cmb_event_current() == sample_handle);
+    sample_cnt++;
+}
+
+static void periodic_stop(void *subject, void *object)
+{
+    cmb_unused(subject);
+    cmb_unused(object);
+
+    periodic_note();
+    cmb_assert_always(cmb_event_cancel(sample_handle));
+}
+
+static void periodic_other(void *subject, void *object)
+{
+    cmb_unused(subject);
+    cmb_unused(object);
+
+    periodic_note();
+}
+
+static void periodic_run(const enum cmb_event_queue_backend backend, const uint64_t seed)
+{
+    cmb_random_initialize(seed);
+    cmb_event_queue_backend_set(backend);
+    cmb_event_queue_initialize(0.0);
+    periodic_trace_cnt = 0u;
+    tick_cnt = 0u;
+    sample_cnt = 0u;
+
+    tick_handle = cmb_event_schedule_periodic(tick_action, NULL, NULL, 0.5, 10.0, 0);
+    sample_handle = cmb_event_schedule_periodic(sample_action, NULL, NULL, 0.0, 7.0, 1);
+    (void)cmb_event_schedule(periodic_stop, NULL, NULL, PERIODIC_STOP, 0);
+    for (uint64_t ui = 0u; ui < PERIODIC_EVENTS; ui++) {
+        const double t = floor(cmb_random_exponential(200.0));
+        (void)cmb_event_schedule(periodic_other, NULL, NULL, t, cmb_random_dice(0, 2));
+    }
+
+    cmb_event_queue_execute();
+    cmb_assert_always(tick_cnt == PERIODIC_TICKS);
+    cmb_assert_always(!cmb_event_is_scheduled(tick_handle));
+    cmb_assert_always(!cmb_event_is_scheduled(sample_handle));
+
+    /* Samples at 0, 7, ..., 294, the one at 301 cancelled */
+    cmb_assert_always(sample_cnt == 43u);
+    cmb_assert_always(periodic_trace_cnt == PERIODIC_EVENTS + PERIODIC_TICKS + 44u);
+
+    cmb_event_queue_terminate();
+    cmb_random_terminate();
+}
+
+/*
+ * test_event_periodic - Run periodic events with each backend and check that
+ * they keep their handles and times, can be cancelled both from their own
+ * action and from another event, and execute in the same order everywhere.
+ */
+void test_event_periodic(const uint64_t seed)
+{
+    cmi_test_print_line("-");
+    printf("Testing periodic events\n");
+
+    static uint64_t ref_trace[PERIODIC_RUNS];
+    periodic_run(CMB_EVENT_QUEUE_HEAP, seed);
+    cmi_memcpy(ref_trace, periodic_trace, sizeof(ref_trace));
+    printf("  heap: %" PRIu64 " events executed, %" PRIu64 " ticks, %" PRIu64 " samples\n",
+           periodic_trace_cnt, tick_cnt, sample_cnt);
+
+    const enum cmb_event_queue_backend backends[] = { CMB_EVENT_QUEUE_LADDER,
+                                                      CMB_EVENT_QUEUE_RADIX,
+                                                      CMB_EVENT_QUEUE_AUTO };
+    const char *names[] = { "ladder", "radix", "auto" };
+    for (unsigned ui = 0u; ui < sizeof(backends) / sizeof(backends[0]); ui++) {
+        periodic_run(backends[ui], seed);
+        for (uint64_t uj = 0u; uj < periodic_trace_cnt; uj++) {
+            cmb_assert_always(periodic_trace[uj] == ref_trace[uj]);
+        }
+
+        printf("  %s: same order\n", names[ui]);
+    }
+
+    cmb_event_queue_backend_set(CMB_EVENT_QUEUE_HEAP);
+    cmi_test_print_line("*");
+}
+
 int main(const int argc, char *argv[])
 {
     bool timing_enabled = false;
@@ -237,6 +1096,14 @@ int main(const int argc, char *argv[])
     const clock_t start_time = clock();
 
     test_events(seed);
+    test_event_backends(seed);
+    test_event_same_time(seed);
+    test_event_slot_lane(seed);
+    test_event_subjects(seed);
+    test_event_retain(seed);
+    test_event_stats(seed);
+    test_event_windows(seed);
+    test_event_periodic(seed);
 
     const clock_t end_time = clock();
     const double elapsed_time = (double)(end_time - start_time) / CLOCKS_PER_SEC;
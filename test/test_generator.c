@@ -0,0 +1,266 @@
+/*
+ * Test script for the stackless generators.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cimba.h"
+#include "test.h"
+
+#define MM1_OBJECTS 20000u
+#define MM1_ARRIVAL 1.1
+#define MM1_SERVICE 1.0
+
+/*
+ * struct mm1 - An M/M/1 queue, the arrivals made either by a process or by a
+ * generator, the arrival times kept in the objects.
+ */
+struct mm1 {
+    struct cmb_objectqueue *queue;
+    double times[MM1_OBJECTS];
+    uint64_t arrived;
+    uint64_t served;
+    double sum_wait;
+};
+
+static void *arrival_proc(struct cmb_process *me, void *vctx)
+{
+    cmb_unused(me);
+
+    struct mm1 *mp = vctx;
+    for (uint64_t ui = 0u; ui < MM1_OBJECTS; ui++) {
+        (void)cmb_process_hold(cmb_random_exponential(MM1_ARRIVAL));
+        mp->times[mp->arrived] = cmb_time();
+        (void)cmb_objectqueue_put(mp->queue, &(mp->times[mp->arrived]));
+        mp->arrived++;
+    }
+
+    return NULL;
+}
+
+/* The same, a step at a time */
+static double arrival_step(struct cmb_generator *gp, void *vctx)
+{
+    struct mm1 *mp = vctx;
+    if (cmb_generator_steps(gp) > 0u) {
+        mp->times[mp->arrived] = cmb_time();
+        (void)cmb_objectqueue_put(mp->queue, &(mp->times[mp->arrived]));
+        mp->arrived++;
+    }
+
+    if (mp->arrived == MM1_OBJECTS) {
+        return CMB_GENERATOR_DONE;
+    }
+
+    return cmb_random_exponential(MM1_ARRIVAL);
+}
+
+static void *service_proc(struct cmb_process *me, void *vctx)
+{
+    cmb_unused(me);
+
+    struct mm1 *mp = vctx;
+    while (true) {
+        void *object = NULL;
+        (void)cmb_objectqueue_get(mp->queue, &object);
+        const double *tp = object;
+        (void)cmb_process_hold(cmb_random_exponential(MM1_SERVICE));
+        mp->sum_wait += cmb_time() - *tp;
+        mp->served++;
+    }
+
+    /* Not reached */
+    return NULL;
+}
+
+static void mm1_run(struct mm1 *mp, const bool stackless, const uint64_t seed)
+{
+    cmb_random_initialize(seed);
+    cmb_event_queue_initialize(0.0);
+    mp->arrived = 0u;
+    mp->served = 0u;
+    mp->sum_wait = 0.0;
+
+    mp->queue = cmb_objectqueue_create();
+    cmb_objectqueue_initialize(mp->queue, "Queue", CMB_UNLIMITED);
+    struct cmb_process *arr = NULL;
+    struct cmb_generator *gen = NULL;
+    if (stackless) {
+        gen = cmb_generator_create();
+        cmb_generator_initialize(gen, "Arrivals", arrival_step, mp, 0);
+        cmb_generator_start(gen);
+    }
+    else {
+        arr = cmb_process_create();
+        cmb_process_initialize(arr, "Arrivals", arrival_proc, mp, 0);
+        cmb_process_start(arr);
+    }
+
+    struct cmb_process *srv = cmb_process_create();
+    cmb_process_initialize(srv, "Service", service_proc, mp, 0);
+    cmb_process_start(srv);
+
+    cmb_event_queue_execute();
+    cmb_assert_always(mp->served == MM1_OBJECTS);
+
+    if (stackless) {
+        cmb_assert_always(cmb_generator_status(gen) == CMB_PROCESS_FINISHED);
+        cmb_assert_always(cmb_generator_steps(gen) == MM1_OBJECTS + 1u);
+        cmb_assert_always(cmb_generator_event(gen) == 0u);
+        cmb_generator_terminate(gen);
+        cmb_generator_destroy(gen);
+    }
+    else {
+        cmb_process_terminate(arr);
+        cmb_process_destroy(arr);
+    }
+
+    (void)cmb_process_stop(srv, NULL);
+    cmb_process_terminate(srv);
+    cmb_process_destroy(srv);
+    cmb_objectqueue_terminate(mp->queue);
+    cmb_objectqueue_destroy(mp->queue);
+    cmb_event_queue_terminate();
+    cmb_random_terminate();
+}
+
+/*
+ * test_generator_mm1 - The same M/M/1 queue with a process and a generator
+ * making the arrivals, the same random numbers drawn in the same order, hence
+ * exactly the same outcome.
+ */
+static void test_generator_mm1(const uint64_t seed)
+{
+    cmi_test_print_line("-");
+    printf("Testing a generator in place of an arrival process\n");
+
+    static struct mm1 ref, gen;
+    mm1_run(&ref, false, seed);
+    mm1_run(&gen, true, seed);
+    printf("  process: %" PRIu64 " served, mean wait %f\n",
+           ref.served, ref.sum_wait / (double)ref.served);
+    printf("  generator: %" PRIu64 " served, mean wait %f\n",
+           gen.served, gen.sum_wait / (double)gen.served);
+    cmb_assert_always(gen.served == ref.served);
+    cmb_assert_always(gen.sum_wait == ref.sum_wait);
+
+    cmi_test_print_line("*");
+}
+
+/*
+ * A ticking generator, a process waiting for its steps and then stopping it,
+ * and another generator stopping itself.
+ */
+#define TICKS_WAITED 5u
+
+static double tick_step(struct cmb_generator *gp, void *vctx)
+{
+    cmb_unused(gp);
+    cmb_unused(vctx);
+
+    return 1.0;
+}
+
+static double self_stop_step(struct cmb_generator *gp, void *vctx)
+{
+    cmb_unused(vctx);
+
+    if (cmb_generator_steps(gp) == 3u) {
+        cmb_generator_stop(gp);
+        cmb_assert_always(cmb_generator_event(gp) == 0u);
+    }
+
+    return 2.0;
+}
+
+static void *watcher_proc(struct cmb_process *me, void *vctx)
+{
+    cmb_unused(me);
+
+    struct cmb_generator *gp = vctx;
+    for (unsigned ui = 0u; ui < TICKS_WAITED; ui++) {
+        const int64_t sig = cmb_process_wait_event(cmb_generator_event(gp));
+        cmb_assert_always(sig == CMB_PROCESS_SUCCESS);
+        cmb_assert_always(cmb_time() == (double)(ui + 1u));
+    }
+
+    cmb_generator_stop(gp);
+    cmb_assert_always(cmb_generator_status(gp) == CMB_PROCESS_FINISHED);
+    cmb_assert_always(cmb_generator_event(gp) == 0u);
+
+    return NULL;
+}
+
+static void test_generator_control(void)
+{
+    cmi_test_print_line("-");
+    printf("Testing waiting for and stopping generators\n");
+
+    cmb_event_queue_initialize(0.0);
+    struct cmb_generator *ticker = cmb_generator_create();
+    cmb_generator_initialize(ticker, "Ticker", tick_step, NULL, 1);
+    cmb_assert_always(cmb_generator_status(ticker) == CMB_PROCESS_INITIALIZED);
+    cmb_generator_start(ticker);
+    cmb_assert_always(cmb_generator_status(ticker) == CMB_PROCESS_RUNNING);
+
+    struct cmb_generator *quitter = cmb_generator_create();
+    cmb_generator_initialize(quitter, "Quitter", self_stop_step, NULL, 0);
+    cmb_generator_start(quitter);
+
+    struct cmb_process *watcher = cmb_process_create();
+    cmb_process_initialize(watcher, "Watcher", watcher_proc, ticker, 0);
+    cmb_process_start(watcher);
+
+    cmb_event_queue_execute();
+    printf("  ticker: %" PRIu64 " steps, quitter: %" PRIu64 " steps, ended at %g\n",
+           cmb_generator_steps(ticker), cmb_generator_steps(quitter), cmb_time());
+    cmb_assert_always(cmb_generator_steps(ticker) == TICKS_WAITED + 1u);
+    cmb_assert_always(cmb_generator_steps(quitter) == 4u);
+    cmb_assert_always(cmb_generator_status(quitter) == CMB_PROCESS_FINISHED);
+    cmb_assert_always(cmb_process_status(watcher) == CMB_PROCESS_FINISHED);
+
+    /* Terminating a running one cancels its next step */
+    cmb_generator_terminate(ticker);
+    cmb_generator_initialize(ticker, "Again", tick_step, NULL, 0);
+    cmb_generator_start(ticker);
+    cmb_assert_always(cmb_event_execute_next());
+    cmb_assert_always(cmb_generator_steps(ticker) == 1u);
+    cmb_generator_terminate(ticker);
+    cmb_assert_always(cmb_event_queue_is_empty());
+
+    cmb_generator_destroy(ticker);
+    cmb_generator_terminate(quitter);
+    cmb_generator_destroy(quitter);
+    cmb_process_terminate(watcher);
+    cmb_process_destroy(watcher);
+    cmb_event_queue_terminate();
+
+    cmi_test_print_line("*");
+}
+
+int main(void)
+{
+    const uint64_t seed = cmb_random_hwseed();
+    cmb_logger_flags_off(CMB_LOGGER_INFO);
+
+    test_generator_mm1(seed);
+    test_generator_control();
+
+    return 0;
+}
@@ -209,15 +209,16 @@ void test_hashheap(uint64_t seed)
 }
 
 /*
- * test_hashheap_churn - Stress the tombstone reclamation (issue M1).
+ * test_hashheap_churn - Stress the hash map deletion (issue M1).
  *
  * Holds the live count well below the heap capacity while churning heavily, so
- * the heap never grows and the grow-triggered rehash never fires. Without
- * compaction the hash map bleeds empty slots into tombstones without bound, and
- * lookups (which only stop at a genuinely empty slot) keep getting longer. With
- * it, tombstones are reclaimed once they reach half the hash slots (heap_size).
- * Verifies correctness throughout, that the heap does not grow, that compaction
- * actually fires repeatedly, and that the tombstone count stays bounded.
+ * the heap never grows and the grow-triggered rehash never fires. With lazy
+ * deletion, the hash map would bleed free positions into tombstones, and the
+ * lookups (which only stop at a genuinely free position) keep getting longer.
+ * With backward shift deletion, the map holds exactly the live entries at all
+ * times. Verifies correctness throughout, that the heap does not grow, that
+ * the map holds no more entries than the heap, and that the longest probe
+ * distance stays short.
  *
  * Deterministic by construction: no use of the random generator, so its output
  * does not depend on the seed.
@@ -225,15 +226,27 @@ void test_hashheap(uint64_t seed)
 #define CHURN_LIVE       100u
 #define CHURN_ITERATIONS 50000u
 
+static uint64_t churn_map_entries(const struct cmi_hashheap *hhp)
+{
+    uint64_t cnt = 0u;
+    for (uint64_t ui = 0u; ui < 2u * hhp->heap_size; ui++) {
+        if (hhp->hash_map[ui].hash_key != 0u) {
+            cnt++;
+        }
+    }
+
+    return cnt;
+}
+
 static void test_hashheap_churn(void)
 {
     cmi_test_print_line("*");
-    printf("Testing tombstone reclamation under churn\n");
+    printf("Testing hash map deletion under churn\n");
 
     struct cmi_hashheap *hhp = cmi_hashheap_create();
     cmb_assert_always(hhp != NULL);
 
-    /* Small heap so compaction is reached quickly; live count stays below it. */
+    /* Small heap, live count stays below it. */
     cmi_hashheap_initialize(hhp, 8u, heap_order_check);     /* heap_size = 256 */
     const uint64_t heap_size = hhp->heap_size;
     cmb_assert_always(CHURN_LIVE < heap_size);
@@ -252,8 +265,7 @@ static void test_hashheap_churn(void)
 
     uint64_t head = 0u;
     uint64_t removes = 0u;
-    uint64_t compactions = 0u;
-    uint64_t max_tombstones = 0u;
+    uint64_t max_probe = 0u;
 
     for (uint64_t it = 0u; it < CHURN_ITERATIONS; it++) {
         /* Retire the oldest live key. */
@@ -263,29 +275,23 @@ static void test_hashheap_churn(void)
         cmb_assert_always(cmi_hashheap_is_enqueued(hhp, oldkey) == false);
         removes++;
 
-        /* Insert a fresh one. A compaction fires exactly when the tombstone
-         * count had reached the trigger (half the hash slots) on entry. */
-        const uint64_t tomb_before = hhp->tombstones;
-        const uint64_t entries_before = cmi_hashheap_count(hhp);
+        /* Insert a fresh one. */
+        const uint64_t nextkey = ring[(head + 1u) % CHURN_LIVE];
+        void **nextitem = cmi_hashheap_item(hhp, nextkey);
         payload++;
         const double d = (double)((payload * 2654435761u) % 1000u);
         const uint64_t newkey = cmi_hashheap_enqueue(hhp,
                                     (void *)(uintptr_t)payload,
                                     NULL, NULL, NULL, 0u, d, 0);
-        if (tomb_before + entries_before >= 1.5 * heap_size) {
-            compactions++;
-            cmb_assert_always(hhp->tombstones == 0u);
-        }
         ring[head] = newkey;
         head = (head + 1u) % CHURN_LIVE;
 
-        /* The heap must not have grown, and tombstones must stay bounded. */
+        /* The payloads stay in their slots while the heap reshuffles */
+        cmb_assert_always(cmi_hashheap_item(hhp, nextkey) == nextitem);
+
+        /* The heap must not have grown */
         cmb_assert_always(hhp->heap_size == heap_size);
         cmb_assert_always(hhp->heap_count == CHURN_LIVE);
-        cmb_assert_always(hhp->heap_count + hhp->tombstones <= 1.5 * heap_size);
-        if (hhp->tombstones > max_tombstones) {
-            max_tombstones = hhp->tombstones;
-        }
 
         /* The new key is live and carries the right payload. */
         cmb_assert_always(cmi_hashheap_is_enqueued(hhp, newkey) == true);
@@ -293,24 +299,559 @@ static void test_hashheap_churn(void)
         cmb_assert_always(item != NULL);
         cmb_assert_always(item[0] == (void *)(uintptr_t)payload);
 
-        /* Periodically verify every live key is still findable. */
+        /* Periodically verify every live key is still findable, and that
+         * nothing but the live keys is left in the hash map. */
         if ((it % 5000u) == 0u) {
             for (uint64_t ui = 0u; ui < CHURN_LIVE; ui++) {
                 cmb_assert_always(cmi_hashheap_is_enqueued(hhp, ring[ui]) == true);
             }
+
+            cmb_assert_always(churn_map_entries(hhp) == CHURN_LIVE);
+            const uint64_t probe = cmi_hashheap_probe_max(hhp);
+            if (probe > max_probe) {
+                max_probe = probe;
+            }
         }
     }
 
-    /* Compaction must have actually fired, repeatedly. */
-    cmb_assert_always(compactions > 0u);
+    /* At most 100 of 512 positions taken, runs stay short */
+    cmb_assert_always(max_probe < 16u);
 
     printf("  live = %u, heap_size = %" PRIu64 ", iterations = %u\n",
            CHURN_LIVE, heap_size, CHURN_ITERATIONS);
-    printf("  removes = %" PRIu64 ", compactions = %" PRIu64
-           ", max tombstones = %" PRIu64 "\n",
-           removes, compactions, max_tombstones);
-    printf("  final live count = %" PRIu64 ", tombstones = %" PRIu64 "\n",
-           cmi_hashheap_count(hhp), hhp->tombstones);
+    printf("  removes = %" PRIu64 ", longest probe = %" PRIu64 "\n",
+           removes, max_probe);
+    printf("  final live count = %" PRIu64 ", hash map entries = %" PRIu64 "\n",
+           cmi_hashheap_count(hhp), churn_map_entries(hhp));
+
+    cmi_hashheap_terminate(hhp);
+    cmi_hashheap_destroy(hhp);
+    cmi_test_print_line("*");
+}
+
+/*
+ * test_hashheap_probing - Enqueue items with keys given by the caller, spread
+ * at random over the 64-bit range so that they collide in the hash map, unlike
+ * the running count. Remove and replace them in random order at close to the
+ * highest load factor, and verify after each step that exactly the live keys
+ * are found, and that the probe distances stay short.
+ *
+ * Deterministic by construction, keys from a fixed xorshift sequence.
+ */
+#define PROBE_LIVE 240u
+#define PROBE_ROUNDS 20000u
+
+static uint64_t probe_next(uint64_t *x)
+{
+    *x ^= *x << 13;
+    *x ^= *x >> 7;
+    *x ^= *x << 17;
+
+    return *x;
+}
+
+static void test_hashheap_probing(void)
+{
+    cmi_test_print_line("*");
+    printf("Testing hash map probing with colliding keys\n");
+
+    struct cmi_hashheap *hhp = cmi_hashheap_create();
+    cmi_hashheap_initialize(hhp, 8u, NULL);     /* heap_size = 256 */
+    const uint64_t heap_size = hhp->heap_size;
+
+    uint64_t x = UINT64_C(0x9E3779B97F4A7C15);
+    uint64_t live[PROBE_LIVE];
+    for (uint64_t ui = 0u; ui < PROBE_LIVE; ui++) {
+        live[ui] = probe_next(&x);
+        (void)cmi_hashheap_enqueue(hhp, (void *)(uintptr_t)ui, NULL, NULL, NULL,
+                                   live[ui], (double)ui, 0);
+    }
+
+    /* Turns the hash map on */
+    cmb_assert_always(cmi_hashheap_is_enqueued(hhp, live[0]));
+
+    uint64_t max_probe = cmi_hashheap_probe_max(hhp);
+    for (uint64_t ui = 0u; ui < PROBE_ROUNDS; ui++) {
+        const uint64_t idx = probe_next(&x) % PROBE_LIVE;
+        const uint64_t gone = live[idx];
+        cmb_assert_always(cmi_hashheap_remove(hhp, gone));
+        cmb_assert_always(!cmi_hashheap_is_enqueued(hhp, gone));
+
+        live[idx] = probe_next(&x);
+        (void)cmi_hashheap_enqueue(hhp, (void *)(uintptr_t)idx, NULL, NULL, NULL,
+                                   live[idx], (double)ui, 0);
+        if ((ui % 100u) == 0u) {
+            for (uint64_t uj = 0u; uj < PROBE_LIVE; uj++) {
+                void **item = cmi_hashheap_item(hhp, live[uj]);
+                cmb_assert_always(item[0] == (void *)(uintptr_t)uj);
+            }
+
+            const uint64_t probe = cmi_hashheap_probe_max(hhp);
+            if (probe > max_probe) {
+                max_probe = probe;
+            }
+        }
+    }
+
+    cmb_assert_always(hhp->heap_size == heap_size);
+    cmb_assert_always(max_probe < 32u);
+    printf("  live = %u of %" PRIu64 ", rounds = %u, longest probe = %" PRIu64 "\n",
+           PROBE_LIVE, heap_size, PROBE_ROUNDS, max_probe);
+
+    cmi_hashheap_terminate(hhp);
+    cmi_hashheap_destroy(hhp);
+    cmi_test_print_line("*");
+}
+
+/*
+ * test_hashheap_arity - Run the same deterministic sequence of enqueues,
+ * reprioritizations, removals, and dequeues against binary, 4-ary, and 8-ary
+ * heaps, both with the default and with a user-provided compare function,
+ * and verify that all of them dequeue the items in exactly the same order.
+ */
+#define ARITY_ITEMS 5000u
+
+static uint64_t arity_run(const uint16_t flags,
+                          cmi_heap_compare_func *cmp,
+                          uint64_t *order)
+{
+    struct cmi_hashheap *hhp = cmi_hashheap_create();
+    cmi_hashheap_initialize_wflags(hhp, 3u, cmp, flags);
+    const unsigned arity = cmi_hashheap_arity(hhp);
+
+    /* Each sibling group starts on a cache line aligned d-tag boundary */
+    if (arity > 2u) {
+        const uintptr_t grp = (uintptr_t)arity * sizeof(struct cmi_heap_tag);
+        cmb_assert_always(((uintptr_t)&(hhp->heap[2]) % grp) == 0u);
+    }
+
+    /* Few distinct ranks, lots of ties to be broken in FIFO order */
+    uint64_t keys[ARITY_ITEMS];
+    for (uint64_t ui = 0u; ui < ARITY_ITEMS; ui++) {
+        const double d = (double)((ui * 2654435761u) % 97u);
+        const int64_t p = (int64_t)((ui * 40503u) % 5u);
+        keys[ui] = cmi_hashheap_enqueue(hhp, (void *)(uintptr_t)(ui + 1u),
+                                        NULL, NULL, NULL, 0u, d, p);
+    }
+
+    /* Move every seventh item, remove every eleventh */
+    for (uint64_t ui = 0u; ui < ARITY_ITEMS; ui += 7u) {
+        const double d = (double)((ui * 40503u) % 89u);
+        cmi_hashheap_reprioritize(hhp, keys[ui], d, 2);
+    }
+    for (uint64_t ui = 0u; ui < ARITY_ITEMS; ui += 11u) {
+        cmb_assert_always(cmi_hashheap_remove(hhp, keys[ui]) == true);
+    }
+
+    uint64_t cnt = 0u;
+    double prev = -1.0;
+    while (cmi_hashheap_count(hhp) > 0u) {
+        const double d = cmi_hashheap_peek_drank(hhp);
+        cmb_assert_always(d >= prev);
+        prev = d;
+        void **item = cmi_hashheap_dequeue(hhp);
+        order[cnt++] = (uint64_t)(uintptr_t)item[0];
+    }
+
+    cmi_hashheap_terminate(hhp);
+    cmi_hashheap_destroy(hhp);
+
+    return cnt;
+}
+
+static void test_hashheap_arity(void)
+{
+    cmi_test_print_line("*");
+    printf("Testing d-ary heap layouts against the binary heap\n");
+
+    static uint64_t ref_order[ARITY_ITEMS];
+    static uint64_t order[ARITY_ITEMS];
+    const uint64_t ref_cnt = arity_run(CMI_HASHHEAP_BINARY, NULL, ref_order);
+
+    const uint16_t flags[] = { CMI_HASHHEAP_BINARY,
+                               CMI_HASHHEAP_QUATERNARY,
+                               CMI_HASHHEAP_OCTONARY,
+                               CMI_HASHHEAP_BINARY | CMI_HASHHEAP_SLOT_KEYS,
+                               CMI_HASHHEAP_OCTONARY | CMI_HASHHEAP_SLOT_KEYS };
+    cmi_heap_compare_func *cmps[] = { NULL, heap_order_check };
+    for (unsigned ui = 0u; ui < sizeof(flags) / sizeof(flags[0]); ui++) {
+        for (unsigned uj = 0u; uj < sizeof(cmps) / sizeof(cmps[0]); uj++) {
+            const uint64_t cnt = arity_run(flags[ui], cmps[uj], order);
+            cmb_assert_always(cnt == ref_cnt);
+            for (uint64_t uk = 0u; uk < cnt; uk++) {
+                cmb_assert_always(order[uk] == ref_order[uk]);
+            }
+
+            printf("  arity %u, %s compare%s: %" PRIu64 " items in reference order\n",
+                   1u << ((flags[ui] & CMI_HASHHEAP_ARITY_MASK) + 1u),
+                   (cmps[uj] == NULL) ? "default" : "custom",
+                   ((flags[ui] & CMI_HASHHEAP_SLOT_KEYS) != 0u) ? ", slot keys" : "",
+                   cnt);
+        }
+    }
+
+    cmi_test_print_line("*");
+}
+
+/*
+ * test_hashheap_order - Run the same sequence as in test_hashheap_arity against
+ * each built-in ordering and a custom compare function doing the same thing,
+ * verifying that they dequeue the items in exactly the same order.
+ */
+static bool priority_time_check(const struct cmi_heap_tag *a,
+                                const struct cmi_heap_tag *b)
+{
+    if (a->rank_i64 != b->rank_i64) {
+        return a->rank_i64 > b->rank_i64;
+    }
+    else if (a->rank_d64 != b->rank_d64) {
+        return a->rank_d64 < b->rank_d64;
+    }
+
+    return a->hash_key < b->hash_key;
+}
+
+static bool priority_check(const struct cmi_heap_tag *a,
+                           const struct cmi_heap_tag *b)
+{
+    if (a->rank_i64 != b->rank_i64) {
+        return a->rank_i64 > b->rank_i64;
+    }
+
+    return a->hash_key < b->hash_key;
+}
+
+static uint64_t order_run(const uint16_t flags,
+                          cmi_heap_compare_func *cmp,
+                          uint64_t *order)
+{
+    struct cmi_hashheap *hhp = cmi_hashheap_create();
+    cmi_hashheap_initialize_wflags(hhp, 3u, cmp, flags);
+
+    uint64_t keys[ARITY_ITEMS];
+    for (uint64_t ui = 0u; ui < ARITY_ITEMS; ui++) {
+        const double d = (double)((ui * 2654435761u) % 97u);
+        const int64_t p = (int64_t)((ui * 40503u) % 5u);
+        keys[ui] = cmi_hashheap_enqueue(hhp, (void *)(uintptr_t)(ui + 1u),
+                                        NULL, NULL, NULL, 0u, d, p);
+    }
+
+    for (uint64_t ui = 0u; ui < ARITY_ITEMS; ui += 7u) {
+        const double d = (double)((ui * 40503u) % 89u);
+        cmi_hashheap_reprioritize(hhp, keys[ui], d, (int64_t)(ui % 3u));
+    }
+    for (uint64_t ui = 0u; ui < ARITY_ITEMS; ui += 11u) {
+        cmb_assert_always(cmi_hashheap_remove(hhp, keys[ui]) == true);
+    }
+
+    uint64_t cnt = 0u;
+    while (cmi_hashheap_count(hhp) > 0u) {
+        void **item = cmi_hashheap_dequeue(hhp);
+        order[cnt++] = (uint64_t)(uintptr_t)item[0];
+    }
+
+    cmi_hashheap_terminate(hhp);
+    cmi_hashheap_destroy(hhp);
+
+    return cnt;
+}
+
+static void test_hashheap_order(void)
+{
+    cmi_test_print_line("*");
+    printf("Testing built-in orderings against custom compare functions\n");
+
+    static uint64_t ref_order[ARITY_ITEMS];
+    static uint64_t order[ARITY_ITEMS];
+    const uint16_t orders[] = { CMI_HASHHEAP_ORDER_TIME,
+                                CMI_HASHHEAP_ORDER_PRIORITY_TIME,
+                                CMI_HASHHEAP_ORDER_PRIORITY };
+    cmi_heap_compare_func *cmps[] = { heap_order_check,
+                                      priority_time_check,
+                                      priority_check };
+    const char *names[] = { "time", "priority, time", "priority" };
+    const uint16_t arities[] = { CMI_HASHHEAP_BINARY, CMI_HASHHEAP_OCTONARY };
+    for (unsigned ui = 0u; ui < sizeof(orders) / sizeof(orders[0]); ui++) {
+        for (unsigned uj = 0u; uj < sizeof(arities) / sizeof(arities[0]); uj++) {
+            const uint64_t ref_cnt = order_run(arities[uj], cmps[ui], ref_order);
+            const uint64_t cnt = order_run(arities[uj] | orders[ui], NULL, order);
+            cmb_assert_always(cnt == ref_cnt);
+            for (uint64_t uk = 0u; uk < cnt; uk++) {
+                cmb_assert_always(order[uk] == ref_order[uk]);
+            }
+
+            printf("  %s, arity %u: %" PRIu64 " items in the same order as custom\n",
+                   names[ui], 1u << (arities[uj] + 1u), cnt);
+        }
+    }
+
+    cmi_test_print_line("*");
+}
+
+/*
+ * test_hashheap_rewind - Fill a hashheap, rewind it, and verify that it issues
+ * the same keys again without shrinking. Reserve space ahead and verify that
+ * it resizes once and the contents survive.
+ */
+static void test_hashheap_rewind(void)
+{
+    cmi_test_print_line("*");
+    printf("Testing rewind and reserve\n");
+
+    struct cmi_hashheap *hhp = cmi_hashheap_create();
+    cmi_hashheap_initialize(hhp, 3u, NULL);
+    for (uint64_t ui = 1u; ui <= 100u; ui++) {
+        const uint64_t key = cmi_hashheap_enqueue(hhp, NULL, NULL, NULL, NULL, 0u,
+                                                  (double)(ui % 7u), 0);
+        cmb_assert_always(key == ui);
+    }
+
+    /* Turn the hash map on */
+    cmb_assert_always(cmi_hashheap_is_enqueued(hhp, 50u));
+    const uint64_t size = hhp->heap_size;
+    printf("  peak %" PRIu64 " items, size %" PRIu64 "\n", hhp->heap_peak, size);
+    cmb_assert_always(hhp->heap_peak == 100u);
+
+    cmi_hashheap_rewind(hhp);
+    cmb_assert_always(cmi_hashheap_count(hhp) == 0u);
+    cmb_assert_always(hhp->heap_size == size);
+    cmb_assert_always(hhp->heap_peak == 0u);
+    cmb_assert_always(!cmi_hashheap_is_enqueued(hhp, 50u));
+    for (uint64_t ui = 1u; ui <= 10u; ui++) {
+        const uint64_t key = cmi_hashheap_enqueue(hhp, NULL, NULL, NULL, NULL, 0u,
+                                                  (double)(11u - ui), 0);
+        cmb_assert_always(key == ui);
+    }
+
+    cmi_hashheap_reserve(hhp, 5000u);
+    printf("  rewound, reserved for 5000 items, size %" PRIu64 "\n", hhp->heap_size);
+    cmb_assert_always(hhp->heap_size == 8192u);
+    cmb_assert_always(cmi_hashheap_is_enqueued(hhp, 5u));
+    for (uint64_t ui = 10u; ui >= 1u; ui--) {
+        (void)cmi_hashheap_dequeue(hhp);
+        cmb_assert_always(hhp->items[hhp->item_current].hash_key == ui);
+    }
+
+    cmi_hashheap_terminate(hhp);
+    cmi_hashheap_destroy(hhp);
+
+    cmi_test_print_line("*");
+}
+
+/*
+ * test_hashheap_batch - Enqueue the same items one by one and in batches,
+ * a small batch on top of a large heap, sifted into place one by one, and a
+ * large batch, rebuilding the heap. Remove every eleventh one by one or in a
+ * batch, and verify that the items come out in the same order.
+ */
+#define BATCH_ITEMS 6000u
+#define BATCH_SMALL 100u
+
+static uint64_t batch_run(const uint16_t flags, const bool batch, uint64_t *order)
+{
+    struct cmi_hashheap *hhp = cmi_hashheap_create();
+    cmi_hashheap_initialize_wflags(hhp, 3u, NULL, flags);
+
+    static uint64_t keys[BATCH_ITEMS];
+    for (uint64_t ui = 0u; ui < BATCH_ITEMS; ui++) {
+        const bool batched = batch && ((ui < BATCH_SMALL) || (ui >= 2u * BATCH_SMALL));
+        if (batched && ((ui == 0u) || (ui == 2u * BATCH_SMALL))) {
+            cmi_hashheap_batch_begin(hhp, (ui == 0u) ? BATCH_SMALL
+                                                     : BATCH_ITEMS - 2u * BATCH_SMALL);
+        }
+
+        const double d = (double)((ui * 2654435761u) % 97u);
+        const int64_t p = (int64_t)((ui * 40503u) % 5u);
+        void *pl = (void *)(uintptr_t)(ui + 1u);
+        keys[ui] = (batched) ? cmi_hashheap_batch_append(hhp, pl, NULL, NULL, NULL, 0u, d, p)
+                             : cmi_hashheap_enqueue(hhp, pl, NULL, NULL, NULL, 0u, d, p);
+
+        if (batched && ((ui == BATCH_SMALL - 1u) || (ui == BATCH_ITEMS - 1u))) {
+            cmi_hashheap_batch_end(hhp);
+        }
+    }
+
+    /* Every eleventh, a few of them twice, only counted once */
+    static uint64_t rmkeys[(BATCH_ITEMS + 10u) / 11u + 10u];
+    uint64_t nrm = 0u;
+    for (uint64_t ui = 0u; ui < BATCH_ITEMS; ui += 11u) {
+        rmkeys[nrm++] = keys[ui];
+    }
+
+    const uint64_t nuniq = nrm;
+    for (uint64_t ui = 0u; ui < 10u; ui++) {
+        rmkeys[nrm++] = keys[11u * ui];
+    }
+
+    cmb_assert_always(nrm <= sizeof(rmkeys) / sizeof(rmkeys[0]));
+
+    if (batch) {
+        cmb_assert_always(cmi_hashheap_remove_batch(hhp, rmkeys, nrm) == nuniq);
+    }
+    else {
+        for (uint64_t ui = 0u; ui < nrm; ui++) {
+            (void)cmi_hashheap_remove(hhp, rmkeys[ui]);
+        }
+    }
+
+    /* And a few more, too few to rebuild for */
+    if (batch) {
+        cmb_assert_always(cmi_hashheap_remove_batch(hhp, &(keys[1]), 3u) == 3u);
+    }
+    else {
+        for (uint64_t ui = 1u; ui <= 3u; ui++) {
+            cmb_assert_always(cmi_hashheap_remove(hhp, keys[ui]));
+        }
+    }
+
+    uint64_t cnt = 0u;
+    while (cmi_hashheap_count(hhp) > 0u) {
+        void **item = cmi_hashheap_dequeue(hhp);
+        order[cnt++] = (uint64_t)(uintptr_t)item[0];
+    }
+
+    cmi_hashheap_terminate(hhp);
+    cmi_hashheap_destroy(hhp);
+
+    return cnt;
+}
+
+static void test_hashheap_batch(void)
+{
+    cmi_test_print_line("*");
+    printf("Testing batch enqueue and removal\n");
+
+    static uint64_t ref_order[BATCH_ITEMS];
+    static uint64_t order[BATCH_ITEMS];
+    const uint16_t flags[] = { CMI_HASHHEAP_BINARY,
+                               CMI_HASHHEAP_OCTONARY,
+                               CMI_HASHHEAP_BINARY | CMI_HASHHEAP_SLOT_KEYS };
+    for (unsigned ui = 0u; ui < sizeof(flags) / sizeof(flags[0]); ui++) {
+        const uint64_t ref_cnt = batch_run(flags[ui], false, ref_order);
+        const uint64_t cnt = batch_run(flags[ui], true, order);
+        cmb_assert_always(cnt == ref_cnt);
+        for (uint64_t uj = 0u; uj < cnt; uj++) {
+            cmb_assert_always(order[uj] == ref_order[uj]);
+        }
+
+        printf("  arity %u%s: %" PRIu64 " items in the same order\n",
+               1u << ((flags[ui] & CMI_HASHHEAP_ARITY_MASK) + 1u),
+               ((flags[ui] & CMI_HASHHEAP_SLOT_KEYS) != 0u) ? ", slot keys" : "",
+               cnt);
+    }
+
+    cmi_test_print_line("*");
+}
+
+/*
+ * test_hashheap_slots - Slot keys lead straight to the item slot. Check that
+ * a key goes stale when its item leaves, also after the slot is reused, and
+ * that keys given by the caller still work through the hash map alongside.
+ */
+#define SLOT_ITEMS 1000u
+
+static void test_hashheap_slots(void)
+{
+    cmi_test_print_line("*");
+    printf("Testing slot keys\n");
+
+    struct cmi_hashheap *hhp = cmi_hashheap_create();
+    cmi_hashheap_initialize_wflags(hhp, 4u, NULL, CMI_HASHHEAP_SLOT_KEYS);
+
+    uint64_t keys[SLOT_ITEMS];
+    for (uint64_t ui = 0u; ui < SLOT_ITEMS; ui++) {
+        const double d = (double)((ui * 2654435761u) % 101u);
+        keys[ui] = cmi_hashheap_enqueue(hhp, (void *)(uintptr_t)(ui + 1u),
+                                        NULL, NULL, NULL, 0u, d, 0);
+        cmb_assert_always(cmi_hashheap_is_slot_key(hhp, keys[ui]));
+        cmb_assert_always((ui == 0u) || (keys[ui] > keys[ui - 1u]));
+    }
+
+    /* Generated slot keys never need the hash map */
+    cmb_assert_always(hhp->map_active == false);
+
+    /* Keys from the running counter without a slot, given back by the caller */
+    uint64_t given[SLOT_ITEMS / 10u];
+    for (uint64_t ui = 0u; ui < SLOT_ITEMS / 10u; ui++) {
+        given[ui] = cmi_hashheap_next_key(hhp);
+        cmb_assert_always(!cmi_hashheap_is_slot_key(hhp, given[ui]));
+        cmb_assert_always(given[ui] < cmi_hashheap_key_max(hhp));
+        const uint64_t key = cmi_hashheap_enqueue(hhp, (void *)(uintptr_t)(ui + 1u),
+                                                  NULL, NULL, NULL, given[ui], 50.0, 1);
+        cmb_assert_always(key == given[ui]);
+    }
+
+    /* Remove every third, reprioritize every fifth of the rest, still no map */
+    uint64_t removed = 0u;
+    for (uint64_t ui = 0u; ui < SLOT_ITEMS; ui++) {
+        if ((ui % 3u) == 0u) {
+            cmb_assert_always(cmi_hashheap_remove(hhp, keys[ui]) == true);
+            cmb_assert_always(cmi_hashheap_is_enqueued(hhp, keys[ui]) == false);
+            cmb_assert_always(cmi_hashheap_remove(hhp, keys[ui]) == false);
+            removed++;
+        }
+        else if ((ui % 5u) == 0u) {
+            cmi_hashheap_reprioritize(hhp, keys[ui], 200.0, 0);
+            cmb_assert_always(cmi_hashheap_drank(hhp, keys[ui]) == 200.0);
+        }
+    }
+
+    cmb_assert_always(hhp->map_active == false);
+
+    for (uint64_t ui = 0u; ui < SLOT_ITEMS / 10u; ui += 2u) {
+        cmb_assert_always(cmi_hashheap_remove(hhp, given[ui]) == true);
+        cmb_assert_always(cmi_hashheap_is_enqueued(hhp, given[ui]) == false);
+        removed++;
+    }
+
+    cmb_assert_always(hhp->map_active == true);
+
+    /* New items reuse the freed slots, the old keys stay stale */
+    uint64_t fresh[SLOT_ITEMS / 3u + 1u];
+    uint64_t nfresh = 0u;
+    for (uint64_t ui = 0u; ui < SLOT_ITEMS; ui += 3u) {
+        fresh[nfresh] = cmi_hashheap_enqueue(hhp, (void *)(uintptr_t)(ui + 1u),
+                                             NULL, NULL, NULL, 0u, 300.0, 0);
+        cmb_assert_always((fresh[nfresh] & CMI_HASHHEAP_SLOT_MASK) <= hhp->item_top);
+        nfresh++;
+    }
+
+    cmb_assert_always(hhp->item_top <= SLOT_ITEMS + SLOT_ITEMS / 10u);
+
+    uint64_t stale = 0u;
+    for (uint64_t ui = 0u; ui < SLOT_ITEMS; ui += 3u) {
+        cmb_assert_always(cmi_hashheap_is_enqueued(hhp, keys[ui]) == false);
+        stale++;
+    }
+
+    for (uint64_t ui = 0u; ui < nfresh; ui++) {
+        cmb_assert_always(cmi_hashheap_is_enqueued(hhp, fresh[ui]) == true);
+    }
+
+    for (uint64_t ui = 1u; ui < SLOT_ITEMS / 10u; ui += 2u) {
+        void **item = cmi_hashheap_item(hhp, given[ui]);
+        cmb_assert_always(item != NULL);
+        cmb_assert_always(item[0] == (void *)(uintptr_t)(ui + 1u));
+    }
+
+    /* Everything comes out in order, leaving all keys stale */
+    uint64_t cnt = 0u;
+    double prev = -1.0;
+    while (cmi_hashheap_count(hhp) > 0u) {
+        const double d = cmi_hashheap_peek_drank(hhp);
+        cmb_assert_always(d >= prev);
+        prev = d;
+        (void)cmi_hashheap_dequeue(hhp);
+        cnt++;
+    }
+
+    cmb_assert_always(cnt == SLOT_ITEMS + SLOT_ITEMS / 10u + nfresh - removed);
+    for (uint64_t ui = 0u; ui < nfresh; ui++) {
+        cmb_assert_always(cmi_hashheap_is_enqueued(hhp, fresh[ui]) == false);
+    }
+
+    printf("  %" PRIu64 " items dequeued in order, %" PRIu64 " stale keys rejected\n",
+           cnt, stale);
 
     cmi_hashheap_terminate(hhp);
     cmi_hashheap_destroy(hhp);
@@ -346,6 +887,12 @@ int main(const int argc, char *argv[])
 
     test_hashheap(seed);
     test_hashheap_churn();
+    test_hashheap_probing();
+    test_hashheap_arity();
+    test_hashheap_slots();
+    test_hashheap_batch();
+    test_hashheap_rewind();
+    test_hashheap_order();
 
     if (timing_enabled) {
         const clock_t end_time = clock();
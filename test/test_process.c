@@ -18,6 +18,7 @@
 
 #include <errno.h>
 #include <inttypes.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -29,6 +30,8 @@
 #include "cmb_process.h"
 #include "cmb_random.h"
 
+#include "cmi_memutils.h"
+
 #include "test.h"
 
 #define USERFLAG1 0x00000001
@@ -61,7 +64,6 @@ void cnclevtfunc(void *sub, void *obj)
 
 void *preemptable(struct cmb_process *me, void *ctx)
 {
-    cmb_unused(me);
     cmb_unused(ctx);
 
     cmb_logger_user(stdout, USERFLAG1, "Running");
@@ -69,6 +71,8 @@ void *preemptable(struct cmb_process *me, void *ctx)
         const double dur = cmb_random_exponential(5.0);
         cmb_assert_always(dur >= 0.0);
         const int64_t sig = cmb_process_hold(dur);
+        /* No wakeup call left behind, whatever ended the hold */
+        cmb_assert_always(me->hold == 0u);
         if (sig == CMB_PROCESS_SUCCESS) {
             cmb_logger_user(stdout, USERFLAG1,
                             "Hold returned normal signal %" PRIi64, sig);
@@ -206,6 +210,455 @@ void test_process(uint64_t seed)
     cmi_test_print_line("*");
 }
 
+/*
+ * The handoff test: HANDOFF_PROCS processes holding for random times, one of
+ * them now and then interrupting another, each noting who ran when.
+ */
+#define HANDOFF_PROCS 5u
+#define HANDOFF_STEPS 2000u
+#define HANDOFF_RUNS (HANDOFF_PROCS * HANDOFF_STEPS)
+
+struct handoff_note {
+    double time;
+    uint64_t who;
+    int64_t sig;
+};
+
+static struct handoff_note handoff_trace[HANDOFF_RUNS];
+static uint64_t handoff_cnt = 0u;
+static struct cmb_process *handoff_procs[HANDOFF_PROCS];
+
+void *handoff_proc(struct cmb_process *me, void *ctx)
+{
+    const uint64_t who = (uint64_t)(uintptr_t)ctx;
+    volatile uint64_t mark[16];
+    for (unsigned ui = 0u; ui < HANDOFF_STEPS; ui++) {
+        for (unsigned uj = 0u; uj < 16u; uj++) {
+            mark[uj] = who * HANDOFF_RUNS + ui + uj;
+        }
+
+        const int64_t sig = cmb_process_hold(floor(cmb_random_exponential(3.0)));
+        cmb_assert_always(me->hold == 0u);
+        /* Still there after the stack may have been swapped out and in again */
+        for (unsigned uj = 0u; uj < 16u; uj++) {
+            cmb_assert_always(mark[uj] == who * HANDOFF_RUNS + ui + uj);
+        }
+
+        handoff_trace[handoff_cnt].time = cmb_time();
+        handoff_trace[handoff_cnt].who = who;
+        handoff_trace[handoff_cnt].sig = sig;
+        handoff_cnt++;
+        if (cmb_random_dice(1, 20) == 1) {
+            struct cmb_process *tgt = handoff_procs[cmb_random_dice(0, HANDOFF_PROCS - 1u)];
+            if ((tgt != me) && (cmb_process_status(tgt) == CMB_PROCESS_RUNNING)) {
+                cmb_process_interrupt(tgt, CMB_PROCESS_INTERRUPTED, 0);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static uint64_t handoff_run(const bool handoff, const unsigned shared, const uint64_t seed)
+{
+    cmb_random_initialize(seed);
+    cmb_event_queue_handoff_set(handoff);
+    cmb_event_queue_initialize(0.0);
+    handoff_cnt = 0u;
+
+    char buf[32];
+    for (unsigned ui = 0u; ui < HANDOFF_PROCS; ui++) {
+        sprintf(buf, "Handoff_%u", ui);
+        handoff_procs[ui] = cmb_process_create();
+        if (ui < shared) {
+            cmb_process_initialize_shared(handoff_procs[ui], buf, handoff_proc,
+                                          (void *)(uintptr_t)ui, (int64_t)(ui % 2u));
+        }
+        else {
+            cmb_process_initialize(handoff_procs[ui], buf, handoff_proc,
+                                   (void *)(uintptr_t)ui, (int64_t)(ui % 2u));
+        }
+
+        cmb_process_start(handoff_procs[ui]);
+    }
+
+    /* In windows, then in batches, then the rest */
+    uint64_t events = 0u;
+    for (unsigned ui = 1u; ui <= 10u; ui++) {
+        const uint64_t cnt = cmb_event_queue_execute_until(100.0 * ui);
+        cmb_assert_always(cmb_time() == 100.0 * ui);
+        cmb_assert_always((handoff_cnt == 0u)
+                          || (handoff_trace[handoff_cnt - 1u].time <= cmb_time()));
+        events += cnt;
+    }
+
+    for (unsigned ui = 0u; ui < 10u; ui++) {
+        const uint64_t before = handoff_cnt;
+        const uint64_t cnt = cmb_event_queue_execute_n(100u);
+        cmb_assert_always(cnt == 100u);
+        cmb_assert_always(handoff_cnt - before <= 100u);
+        events += cnt;
+    }
+
+    while (cmb_event_execute_next()) {
+        events++;
+    }
+
+    cmb_assert_always(handoff_cnt == HANDOFF_RUNS);
+    for (unsigned ui = 0u; ui < HANDOFF_PROCS; ui++) {
+        cmb_assert_always(cmb_process_status(handoff_procs[ui]) == CMB_PROCESS_FINISHED);
+        cmb_process_terminate(handoff_procs[ui]);
+        cmb_process_destroy(handoff_procs[ui]);
+    }
+
+    cmb_event_queue_terminate();
+    cmb_random_terminate();
+    cmb_event_queue_handoff_set(false);
+
+    return events;
+}
+
+/*
+ * test_process_handoff - Run the same processes with and without direct
+ * handoff between them, and verify that everything happens in the same order,
+ * with the same counts of events from the windowed and batched runs.
+ */
+void test_process_handoff(const uint64_t seed)
+{
+    cmi_test_print_line("-");
+    printf("Testing direct handoff between processes\n");
+    cmb_logger_flags_off(CMB_LOGGER_INFO);
+
+    static struct handoff_note ref_trace[HANDOFF_RUNS];
+    const uint64_t ref_events = handoff_run(false, 0u, seed);
+    cmi_memcpy(ref_trace, handoff_trace, sizeof(ref_trace));
+    printf("  via dispatcher: %" PRIu64 " events\n", ref_events);
+
+    const uint64_t events = handoff_run(true, 0u, seed);
+    cmb_assert_always(events == ref_events);
+    for (uint64_t ui = 0u; ui < HANDOFF_RUNS; ui++) {
+        cmb_assert_always(handoff_trace[ui].time == ref_trace[ui].time);
+        cmb_assert_always(handoff_trace[ui].who == ref_trace[ui].who);
+        cmb_assert_always(handoff_trace[ui].sig == ref_trace[ui].sig);
+    }
+
+    printf("  direct handoff: %" PRIu64 " events, same order\n", events);
+    cmb_logger_flags_on(CMB_LOGGER_INFO);
+    cmi_test_print_line("*");
+}
+
+/*
+ * test_process_shared - The handoff test processes again, all or some of them
+ * on the shared stack, with and without direct handoff, to verify that they do
+ * exactly the same as with stacks of their own.
+ */
+void test_process_shared(const uint64_t seed)
+{
+    cmi_test_print_line("-");
+    printf("Testing processes on the shared stack\n");
+    cmb_logger_flags_off(CMB_LOGGER_INFO);
+
+    static struct handoff_note ref_trace[HANDOFF_RUNS];
+    const uint64_t ref_events = handoff_run(false, 0u, seed);
+    cmi_memcpy(ref_trace, handoff_trace, sizeof(ref_trace));
+
+    const bool handoffs[] = { false, true };
+    const unsigned shareds[] = { HANDOFF_PROCS, 2u };
+    for (unsigned ui = 0u; ui < 2u; ui++) {
+        for (unsigned uj = 0u; uj < 2u; uj++) {
+            const uint64_t events = handoff_run(handoffs[ui], shareds[uj], seed);
+            cmb_assert_always(events == ref_events);
+            for (uint64_t uk = 0u; uk < HANDOFF_RUNS; uk++) {
+                cmb_assert_always(handoff_trace[uk].time == ref_trace[uk].time);
+                cmb_assert_always(handoff_trace[uk].who == ref_trace[uk].who);
+                cmb_assert_always(handoff_trace[uk].sig == ref_trace[uk].sig);
+            }
+
+            printf("  %u of %u shared, handoff %s: %" PRIu64 " events, same order\n",
+                   shareds[uj], HANDOFF_PROCS, handoffs[ui] ? "on" : "off", events);
+        }
+    }
+
+    cmb_logger_flags_on(CMB_LOGGER_INFO);
+    cmi_test_print_line("*");
+}
+
+/*
+ * The stack measurement test: A shallow and a deep process function, measured
+ * in one run and given stacks sized from the measurements in the next.
+ */
+#define STACK_DEPTH 16u
+
+static unsigned stack_deep(const unsigned depth)
+{
+    volatile unsigned char buf[1024];
+    for (unsigned ui = 0u; ui < sizeof(buf); ui++) {
+        buf[ui] = (unsigned char)depth;
+    }
+
+    return (depth == 0u) ? buf[0] : stack_deep(depth - 1u) + buf[sizeof(buf) - 1u];
+}
+
+void *stack_deep_proc(struct cmb_process *me, void *ctx)
+{
+    cmb_unused(me);
+    cmb_unused(ctx);
+
+    (void)cmb_process_hold(1.0);
+    const unsigned r = stack_deep(STACK_DEPTH);
+    (void)cmb_process_hold(1.0);
+
+    return (void *)(uintptr_t)r;
+}
+
+void *stack_shallow_proc(struct cmb_process *me, void *ctx)
+{
+    cmb_unused(me);
+    cmb_unused(ctx);
+
+    (void)cmb_process_hold(1.0);
+
+    return NULL;
+}
+
+/* Shallow unless given a context, as in a pilot trial that never went there */
+void *stack_later_proc(struct cmb_process *me, void *ctx)
+{
+    cmb_unused(me);
+
+    (void)cmb_process_hold(1.0);
+    if (ctx != NULL) {
+        return (void *)(uintptr_t)stack_deep(STACK_DEPTH / 2u);
+    }
+
+    return NULL;
+}
+
+static size_t stack_later_run(void *ctx)
+{
+    cmb_event_queue_initialize(0.0);
+
+    struct cmb_process *pp = cmb_process_create();
+    cmb_process_initialize(pp, "Later", stack_later_proc, ctx, 0);
+    cmb_process_start(pp);
+    const size_t sz = pp->core.stack_size;
+    cmb_event_queue_execute();
+    cmb_assert_always(cmb_process_status(pp) == CMB_PROCESS_FINISHED);
+
+    cmb_process_terminate(pp);
+    cmb_process_destroy(pp);
+    cmb_event_queue_terminate();
+
+    return sz;
+}
+
+static void stack_run(size_t *deep_sz, size_t *shallow_sz)
+{
+    cmb_event_queue_initialize(0.0);
+
+    struct cmb_process *deep = cmb_process_create();
+    cmb_process_initialize(deep, "Deep", stack_deep_proc, NULL, 0);
+    cmb_process_start(deep);
+    struct cmb_process *shallow = cmb_process_create();
+    cmb_process_initialize(shallow, "Shallow", stack_shallow_proc, NULL, 0);
+    cmb_process_start(shallow);
+    *deep_sz = deep->core.stack_size;
+    *shallow_sz = shallow->core.stack_size;
+
+    cmb_event_queue_execute();
+    cmb_assert_always(cmb_process_status(deep) == CMB_PROCESS_FINISHED);
+    cmb_assert_always(cmb_process_status(shallow) == CMB_PROCESS_FINISHED);
+
+    cmb_process_terminate(deep);
+    cmb_process_destroy(deep);
+    cmb_process_terminate(shallow);
+    cmb_process_destroy(shallow);
+    cmb_event_queue_terminate();
+}
+
+/*
+ * test_process_stacks - Measure the peak stack use of the two functions, check
+ * that the deep one goes about as deep as it should, and that autosizing gives
+ * each what it used times the margin.
+ */
+void test_process_stacks(void)
+{
+    cmi_test_print_line("-");
+    printf("Testing stack measurement and automatic sizing\n");
+    cmb_logger_flags_off(CMB_LOGGER_INFO);
+
+    size_t deep_sz, shallow_sz;
+    cmb_process_stack_peaks_clear();
+    cmb_assert_always(cmb_process_stack_peak(stack_deep_proc) == 0u);
+    cmb_process_stack_measure_set(true);
+    stack_run(&deep_sz, &shallow_sz);
+    cmb_process_stack_measure_set(false);
+
+    const size_t deep_peak = cmb_process_stack_peak(stack_deep_proc);
+    const size_t shallow_peak = cmb_process_stack_peak(stack_shallow_proc);
+    printf("  measured: deep %zu bytes, shallow %zu bytes of %zu\n",
+           deep_peak, shallow_peak, deep_sz);
+    cmb_assert_always(shallow_peak > 0u);
+    cmb_assert_always(deep_peak > shallow_peak + STACK_DEPTH * 1024u);
+    cmb_assert_always(deep_peak < deep_sz);
+
+    cmb_process_stack_autosize_set(true);
+    cmb_process_stack_margin_set(1.5);
+    stack_run(&deep_sz, &shallow_sz);
+    cmb_process_stack_autosize_set(false);
+    cmb_process_stack_margin_set(CMB_PROCESS_STACK_MARGIN);
+    printf("  autosized: deep %zu bytes, shallow %zu bytes\n", deep_sz, shallow_sz);
+    cmb_assert_always(deep_sz >= (size_t)(1.5 * (double)deep_peak));
+    cmb_assert_always(shallow_sz >= (size_t)(1.5 * (double)shallow_peak));
+    cmb_assert_always(shallow_sz < deep_sz);
+    cmb_assert_always(deep_sz < cmb_process_default_stacksize());
+
+    cmb_assert_always(shallow_sz >= (size_t)(1.5 * (double)CMB_PROCESS_STACK_MIN));
+
+    /* Measured shallow, later going deep on an autosized stack */
+    cmb_process_stack_measure_set(true);
+    (void)stack_later_run(NULL);
+    cmb_process_stack_measure_set(false);
+    const size_t later_peak = cmb_process_stack_peak(stack_later_proc);
+    cmb_assert_always(later_peak < CMB_PROCESS_STACK_MIN);
+    cmb_process_stack_autosize_set(true);
+    const size_t later_sz = stack_later_run((void *)1);
+    cmb_process_stack_autosize_set(false);
+    printf("  measured shallow: %zu bytes, autosized %zu bytes, then went deep\n",
+           later_peak, later_sz);
+    cmb_assert_always(later_sz >= (size_t)(CMB_PROCESS_STACK_MARGIN * (double)CMB_PROCESS_STACK_MIN));
+
+    /* Not measured this time, the records stay as they were */
+    cmb_assert_always(cmb_process_stack_peak(stack_deep_proc) == deep_peak);
+    cmb_process_stack_peaks_clear();
+    cmb_assert_always(cmb_process_stack_peak(stack_deep_proc) == 0u);
+
+    cmb_logger_flags_on(CMB_LOGGER_INFO);
+    cmi_test_print_line("*");
+}
+
+/*
+ * test_process_slabs - Run a crowd of processes with stacks from slabs, check
+ * that the stacks are laid out one after the other with a guard page between,
+ * and that a terminated process' stack is used again by the next one.
+ */
+#define SLAB_PROCS 2000u
+
+void test_process_slabs(void)
+{
+    cmi_test_print_line("-");
+    printf("Testing process stacks from reserved slabs\n");
+    cmb_logger_flags_off(CMB_LOGGER_INFO);
+
+    cmb_process_stack_slabs_set(true);
+    cmb_assert_always(cmb_process_stack_slabs());
+    cmb_event_queue_initialize(0.0);
+
+    struct cmb_process **procs = malloc(SLAB_PROCS * sizeof(*procs));
+    for (unsigned ui = 0u; ui < SLAB_PROCS; ui++) {
+        procs[ui] = cmb_process_create();
+        cmb_process_initialize(procs[ui], "Slab", stack_shallow_proc, NULL, 0);
+        cmb_assert_always(procs[ui]->core.stack_slab);
+        cmb_process_start(procs[ui]);
+    }
+
+    const size_t slot = (size_t)(procs[0]->core.stack_base - procs[0]->core.stack);
+    const size_t gap = (size_t)(procs[1]->core.stack - procs[0]->core.stack);
+    printf("  %u processes, %zu bytes apart\n", SLAB_PROCS, gap);
+    cmb_assert_always(gap == slot);
+
+    cmb_event_queue_execute();
+    unsigned char *last = NULL;
+    for (unsigned ui = 0u; ui < SLAB_PROCS; ui++) {
+        cmb_assert_always(cmb_process_status(procs[ui]) == CMB_PROCESS_FINISHED);
+        last = procs[ui]->core.stack;
+        cmb_process_terminate(procs[ui]);
+    }
+
+    /* The last one back is the first one out again */
+    cmb_process_initialize(procs[0], "Again", stack_deep_proc, NULL, 0);
+    cmb_assert_always(procs[0]->core.stack == last);
+    cmb_process_start(procs[0]);
+    cmb_event_queue_execute();
+    cmb_assert_always(cmb_process_status(procs[0]) == CMB_PROCESS_FINISHED);
+    cmb_process_terminate(procs[0]);
+
+    for (unsigned ui = 0u; ui < SLAB_PROCS; ui++) {
+        cmb_process_destroy(procs[ui]);
+    }
+
+    free(procs);
+    cmb_event_queue_terminate();
+    cmb_process_stack_slabs_set(false);
+
+    cmb_logger_flags_on(CMB_LOGGER_INFO);
+    cmi_test_print_line("*");
+}
+
+/*
+ * test_process_stack_pool - Prewarm the pool, run more processes than the
+ * retention cap allows keeping, and check what the pool holds after each step.
+ */
+#define POOL_PROCS 50u
+#define POOL_KEEP 10u
+#define POOL_WARM 20u
+#define POOL_BIG (2u * 1024u * 1024u)
+
+void test_process_stack_pool(void)
+{
+    cmi_test_print_line("-");
+    printf("Testing the stack pool retention cap and prewarming\n");
+    cmb_logger_flags_off(CMB_LOGGER_INFO);
+
+    const size_t slot = cmb_process_default_stacksize() + cmi_pagesize();
+    const size_t cap = cmb_process_stack_retention();
+    cmb_event_queue_initialize(0.0);
+    const size_t before = cmb_process_stacks_pooled();
+    cmb_process_stack_retention_set(before + POOL_KEEP * slot);
+
+    cmb_process_stacks_prewarm(POOL_WARM, 0u);
+    size_t pooled = cmb_process_stacks_pooled();
+    printf("  prewarmed: %zu bytes in the pool\n", pooled);
+    cmb_assert_always(pooled >= POOL_WARM * slot);
+
+    struct cmb_process *procs[POOL_PROCS];
+    for (unsigned ui = 0u; ui < POOL_PROCS; ui++) {
+        procs[ui] = cmb_process_create();
+        cmb_process_initialize(procs[ui], "Pool", stack_shallow_proc, NULL, 0);
+        cmb_process_start(procs[ui]);
+    }
+
+    cmb_event_queue_execute();
+    for (unsigned ui = 0u; ui < POOL_PROCS; ui++) {
+        cmb_process_terminate(procs[ui]);
+    }
+
+    pooled = cmb_process_stacks_pooled();
+    printf("  after %u processes: %zu bytes in the pool\n", POOL_PROCS, pooled);
+    cmb_assert_always(pooled <= before + POOL_KEEP * slot);
+    cmb_assert_always(pooled + slot > before + POOL_KEEP * slot);
+
+    /* A size beyond the directly indexed classes */
+    cmb_process_stack_retention_set(cap);
+    pooled = cmb_process_stacks_pooled();
+    cmb_process_stacks_prewarm(2u, POOL_BIG);
+    cmb_assert_always(cmb_process_stacks_pooled() == pooled + 2u * (POOL_BIG + cmi_pagesize()));
+    cmb_process_initialize_wssz(procs[0], "Big", stack_deep_proc, NULL, 0, POOL_BIG);
+    cmb_assert_always(cmb_process_stacks_pooled() == pooled + POOL_BIG + cmi_pagesize());
+    cmb_process_start(procs[0]);
+    cmb_event_queue_execute();
+    cmb_process_terminate(procs[0]);
+    cmb_assert_always(cmb_process_stacks_pooled() == pooled + 2u * (POOL_BIG + cmi_pagesize()));
+
+    for (unsigned ui = 0u; ui < POOL_PROCS; ui++) {
+        cmb_process_destroy(procs[ui]);
+    }
+
+    cmb_event_queue_terminate();
+    cmb_logger_flags_on(CMB_LOGGER_INFO);
+    cmi_test_print_line("*");
+}
+
 int main(const int argc, char *argv[])
 {
     bool timing_enabled = false;
@@ -234,6 +687,11 @@ int main(const int argc, char *argv[])
     const clock_t start_time = clock();
 
     test_process(seed);
+    test_process_handoff(seed);
+    test_process_shared(seed);
+    test_process_stacks();
+    test_process_slabs();
+    test_process_stack_pool();
 
     if (timing_enabled) {
         const clock_t end_time = clock();
@@ -0,0 +1,315 @@
+/*
+ * Test script for the process pools.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cimba.h"
+#include "test.h"
+
+#define CUSTOMERS 20000u
+#define ARRIVAL_MEAN 1.0
+#define SERVICE_MEAN 0.9
+
+/*
+ * struct shop - A single server, the customers each a process of their own,
+ * made one by one or spawned from a pool.
+ */
+struct shop {
+    struct cmb_resource *server;
+    struct cmb_processpool *pool;
+    struct cmb_process **made;
+    double arrived[CUSTOMERS];
+    uint64_t served;
+    double sum_time;
+};
+
+/* The one running now */
+static struct shop *shop_open = NULL;
+
+static void *customer_proc(struct cmb_process *me, void *vctx)
+{
+    cmb_unused(me);
+
+    struct shop *sp = shop_open;
+    const uint64_t id = (uint64_t)(uintptr_t)vctx;
+    (void)cmb_resource_acquire(sp->server);
+    (void)cmb_process_hold(cmb_random_exponential(SERVICE_MEAN));
+    cmb_resource_release(sp->server);
+    sp->sum_time += cmb_time() - sp->arrived[id];
+    sp->served++;
+
+    return NULL;
+}
+
+static void *arrival_proc(struct cmb_process *me, void *vctx)
+{
+    cmb_unused(me);
+
+    struct shop *sp = vctx;
+    for (uint64_t ui = 0u; ui < CUSTOMERS; ui++) {
+        (void)cmb_process_hold(cmb_random_exponential(ARRIVAL_MEAN));
+        sp->arrived[ui] = cmb_time();
+        if (sp->pool != NULL) {
+            (void)cmb_processpool_spawn(sp->pool, customer_proc, (void *)(uintptr_t)ui);
+        }
+        else {
+            struct cmb_process *pp = cmb_process_create();
+            cmb_process_initialize(pp, "Customer", customer_proc, (void *)(uintptr_t)ui, 0);
+            cmb_process_start(pp);
+            sp->made[ui] = pp;
+        }
+    }
+
+    return NULL;
+}
+
+static void shop_run(struct shop *sp, const bool pooled, const uint64_t seed)
+{
+    cmb_random_initialize(seed);
+    cmb_event_queue_initialize(0.0);
+    shop_open = sp;
+    sp->served = 0u;
+    sp->sum_time = 0.0;
+    sp->server = cmb_resource_create();
+    cmb_resource_initialize(sp->server, "Server");
+    sp->pool = NULL;
+    sp->made = NULL;
+    if (pooled) {
+        sp->pool = cmb_processpool_create();
+        cmb_processpool_initialize(sp->pool, "Customer", 0);
+    }
+    else {
+        sp->made = calloc(CUSTOMERS, sizeof(*(sp->made)));
+    }
+
+    struct cmb_process *arr = cmb_process_create();
+    cmb_process_initialize(arr, "Arrivals", arrival_proc, sp, 1);
+    cmb_process_start(arr);
+    cmb_event_queue_execute();
+    cmb_assert_always(sp->served == CUSTOMERS);
+
+    if (pooled) {
+        printf("  pool: %" PRIu64 " spawns, %" PRIu64 " processes made, %" PRIu64 " available\n",
+               cmb_processpool_spawned(sp->pool), cmb_processpool_size(sp->pool),
+               cmb_processpool_available(sp->pool));
+        cmb_assert_always(cmb_processpool_spawned(sp->pool) == CUSTOMERS);
+        cmb_assert_always(cmb_processpool_size(sp->pool) < CUSTOMERS / 10u);
+        cmb_assert_always(cmb_processpool_available(sp->pool) == cmb_processpool_size(sp->pool));
+        cmb_processpool_terminate(sp->pool);
+        cmb_processpool_destroy(sp->pool);
+    }
+    else {
+        for (uint64_t ui = 0u; ui < CUSTOMERS; ui++) {
+            cmb_process_terminate(sp->made[ui]);
+            cmb_process_destroy(sp->made[ui]);
+        }
+
+        free(sp->made);
+    }
+
+    cmb_process_terminate(arr);
+    cmb_process_destroy(arr);
+    cmb_resource_terminate(sp->server);
+    cmb_resource_destroy(sp->server);
+    cmb_event_queue_terminate();
+    cmb_random_terminate();
+}
+
+/*
+ * test_processpool_shop - The same customers, made one by one or spawned from
+ * the pool, must be served in the same way.
+ */
+static void test_processpool_shop(const uint64_t seed)
+{
+    cmi_test_print_line("-");
+    printf("Testing a process pool for the customers of a queue\n");
+
+    static struct shop made, pooled;
+    shop_run(&made, false, seed);
+    shop_run(&pooled, true, seed);
+    printf("  made one by one: %" PRIu64 " served, mean time %f\n",
+           made.served, made.sum_time / (double)made.served);
+    printf("  from the pool: %" PRIu64 " served, mean time %f\n",
+           pooled.served, pooled.sum_time / (double)pooled.served);
+    cmb_assert_always(pooled.served == made.served);
+    cmb_assert_always(pooled.sum_time == made.sum_time);
+
+    cmi_test_print_line("*");
+}
+
+/*
+ * Pool processes stopped from outside, waited for, and still running when the
+ * pool is terminated.
+ */
+#define SLEEPERS 10u
+
+static void *sleeper_proc(struct cmb_process *me, void *vctx)
+{
+    cmb_unused(me);
+
+    const double t = (double)(uintptr_t)vctx;
+    (void)cmb_process_hold(t);
+
+    return NULL;
+}
+
+static void *stopper_proc(struct cmb_process *me, void *vctx)
+{
+    cmb_unused(me);
+
+    struct cmb_process **sleepers = vctx;
+    (void)cmb_process_hold(1.0);
+    for (unsigned ui = 0u; ui < SLEEPERS / 2u; ui++) {
+        (void)cmb_process_stop(sleepers[ui], NULL);
+    }
+
+    /* Wait for one of the others to finish */
+    const int64_t sig = cmb_process_wait_process(sleepers[SLEEPERS - 1u]);
+    cmb_assert_always(sig == CMB_PROCESS_SUCCESS);
+
+    return NULL;
+}
+
+static void test_processpool_stop(void)
+{
+    cmi_test_print_line("-");
+    printf("Testing stopping and waiting for pool processes\n");
+
+    cmb_event_queue_initialize(0.0);
+    struct cmb_processpool *ppp = cmb_processpool_create();
+    cmb_processpool_initialize(ppp, "Sleeper", 0);
+
+    struct cmb_process *sleepers[SLEEPERS];
+    for (unsigned ui = 0u; ui < SLEEPERS; ui++) {
+        sleepers[ui] = cmb_processpool_spawn(ppp, sleeper_proc, (void *)(uintptr_t)(10u + ui));
+    }
+
+    struct cmb_process *stopper = cmb_process_create();
+    cmb_process_initialize(stopper, "Stopper", stopper_proc, sleepers, 0);
+    cmb_process_start(stopper);
+
+    (void)cmb_event_queue_execute_until(2.0);
+    printf("  after the stops: %" PRIu64 " of %" PRIu64 " available\n",
+           cmb_processpool_available(ppp), cmb_processpool_size(ppp));
+    cmb_assert_always(cmb_processpool_available(ppp) == SLEEPERS / 2u);
+
+    /* Reused, not made anew */
+    for (unsigned ui = 0u; ui < SLEEPERS / 2u; ui++) {
+        (void)cmb_processpool_spawn(ppp, sleeper_proc, (void *)(uintptr_t)100u);
+    }
+
+    cmb_assert_always(cmb_processpool_size(ppp) == SLEEPERS);
+    cmb_assert_always(cmb_processpool_available(ppp) == 0u);
+
+    (void)cmb_event_queue_execute_until(50.0);
+    cmb_assert_always(cmb_process_status(stopper) == CMB_PROCESS_FINISHED);
+    cmb_assert_always(cmb_processpool_available(ppp) == SLEEPERS / 2u);
+    printf("  at time %g: %" PRIu64 " of %" PRIu64 " available\n",
+           cmb_time(), cmb_processpool_available(ppp), cmb_processpool_size(ppp));
+
+    /* The ones still holding are stopped by the terminate */
+    cmb_processpool_terminate(ppp);
+    cmb_processpool_destroy(ppp);
+    cmb_process_terminate(stopper);
+    cmb_process_destroy(stopper);
+    cmb_event_queue_terminate();
+
+    cmi_test_print_line("*");
+}
+
+/*
+ * A process from the pool measured in two lives, a deep one and then a shallow
+ * one, each recorded for its own function.
+ */
+static unsigned deep_call(const unsigned depth)
+{
+    volatile unsigned char buf[1024];
+    for (unsigned ui = 0u; ui < sizeof(buf); ui++) {
+        buf[ui] = (unsigned char)depth;
+    }
+
+    return (depth == 0u) ? buf[0] : deep_call(depth - 1u) + buf[sizeof(buf) - 1u];
+}
+
+static void *deep_proc(struct cmb_process *me, void *vctx)
+{
+    cmb_unused(me);
+    cmb_unused(vctx);
+
+    return (void *)(uintptr_t)deep_call(16u);
+}
+
+static void *shallow_proc(struct cmb_process *me, void *vctx)
+{
+    cmb_unused(me);
+    cmb_unused(vctx);
+
+    (void)cmb_process_hold(1.0);
+
+    return NULL;
+}
+
+static void test_processpool_stacks(void)
+{
+    cmi_test_print_line("-");
+    printf("Testing stack measurement of reused pool processes\n");
+
+    cmb_event_queue_initialize(0.0);
+    cmb_process_stack_peaks_clear();
+    cmb_process_stack_measure_set(true);
+    struct cmb_processpool *ppp = cmb_processpool_create();
+    cmb_processpool_initialize(ppp, "Measured", 0);
+
+    struct cmb_process *first = cmb_processpool_spawn(ppp, deep_proc, NULL);
+    cmb_event_queue_execute();
+    struct cmb_process *again = cmb_processpool_spawn(ppp, shallow_proc, NULL);
+    cmb_assert_always(again == first);
+    cmb_event_queue_execute();
+
+    /* The deep life is recorded on reuse, the shallow one when terminated */
+    const size_t deep_peak = cmb_process_stack_peak(deep_proc);
+    cmb_assert_always(deep_peak > 16u * 1024u);
+    cmb_processpool_terminate(ppp);
+    cmb_processpool_destroy(ppp);
+    cmb_process_stack_measure_set(false);
+    const size_t shallow_peak = cmb_process_stack_peak(shallow_proc);
+    printf("  deep life %zu bytes, shallow life %zu bytes\n", deep_peak, shallow_peak);
+    cmb_assert_always(shallow_peak > 0u);
+    cmb_assert_always(shallow_peak < deep_peak / 4u);
+
+    cmb_process_stack_peaks_clear();
+    cmb_event_queue_terminate();
+
+    cmi_test_print_line("*");
+}
+
+int main(void)
+{
+    const uint64_t seed = cmb_random_hwseed();
+    cmb_logger_flags_off(CMB_LOGGER_INFO);
+    cmb_logger_flags_off(CMB_LOGGER_WARNING);
+
+    test_processpool_shop(seed);
+    test_processpool_stop();
+    test_processpool_stacks();
+
+    return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * Test script for the built-in profiler.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "cimba.h"
+#include "test.h"
+#include "test_ticker.h"
+
+#define TRIALS 16u
+
+/*
+ * check_profile - Verify the counts for n trials, and that the busy process
+ * got charged for more of the time than the light event.
+ */
+static void check_profile(const uint64_t n)
+{
+    struct cmb_profiler_count evt;
+    cmb_assert_always(cmb_profiler_event(cmi_test_tock_event, &evt));
+    cmb_assert_always(evt.calls == n * CMI_TEST_TICKS);
+
+    /* Switched in once to start, then once after each hold */
+    struct cmb_profiler_count prc;
+    cmb_assert_always(cmb_profiler_process(cmi_test_ticker_proc, &prc));
+    cmb_assert_always(prc.calls == n * (CMI_TEST_TICKS + 1u));
+    cmb_assert_always(prc.cycles / prc.calls > evt.cycles / evt.calls);
+
+    /* There and back again for each activation */
+    struct cmb_profiler_count sw;
+    cmb_profiler_switches(&sw);
+    cmb_assert_always(sw.calls == 2u * prc.calls);
+    cmb_assert_always(sw.cycles > 0u);
+
+    printf("  %" PRIu64 " events, %" PRIu64 " process activations, %" PRIu64 " switches\n",
+           evt.calls, prc.calls, sw.calls);
+}
+
+static void test_profiler_single(void)
+{
+    cmi_test_print_line("-");
+    printf("Testing the profiler in a single trial\n");
+
+    struct cmi_test_trial trl;
+    cmb_profiler_enabled_set(false);
+    cmi_test_ticker_trial(&trl);
+    struct cmb_profiler_count pc;
+    cmb_assert_always(!cmb_profiler_event(cmi_test_tock_event, &pc));
+    cmb_assert_always(!cmb_profiler_process(cmi_test_ticker_proc, &pc));
+    printf("  off: nothing profiled\n");
+
+    cmb_profiler_enabled_set(true);
+    cmi_test_ticker_trial(&trl);
+    cmb_assert_always(trl.tocks == CMI_TEST_TICKS);
+    check_profile(1u);
+    cmb_profiler_print(stdout);
+
+    cmb_profiler_reset();
+    cmb_assert_always(!cmb_profiler_event(cmi_test_tock_event, &pc));
+    cmi_test_print_line("*");
+}
+
+static void test_profiler_threads(void)
+{
+    cmi_test_print_line("-");
+    printf("Testing the profiler across the threads of an experiment\n");
+
+    cmb_profiler_enabled_set(true);
+    (void)cmi_test_ticker_experiment(TRIALS);
+
+    check_profile(TRIALS);
+    cmb_profiler_print(stdout);
+
+    cmb_profiler_enabled_set(false);
+    cmb_profiler_reset();
+    cmi_test_print_line("*");
+}
+
+int main(void)
+{
+    test_profiler_single();
+    test_profiler_threads();
+
+    return 0;
+}
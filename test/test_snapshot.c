@@ -0,0 +1,286 @@
+/*
+ * Test script for the snapshot and restore of a trial.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cimba.h"
+#include "test.h"
+
+#define WARMUP 1000.0
+#define END 5000.0
+#define RING 4096u
+#define TRIALS 4u
+
+/*
+ * struct model - An M/M/1 queue with a resource for the server, the arrival
+ * times of the customers in the queue kept in a ring here, outside the arena.
+ */
+struct model {
+    struct cmb_process *arrival;
+    struct cmb_process *server;
+    struct cmb_objectqueue *queue;
+    struct cmb_resource *desk;
+    uint64_t arrived;
+    uint64_t served;
+    double waited;
+    double arrival_time[RING];
+};
+
+/*
+ * struct result - What a run to the end came to.
+ */
+struct result {
+    uint64_t served;
+    double waited;
+    double time;
+};
+
+static void *arrival_proc(struct cmb_process *me, void *vctx)
+{
+    cmb_unused(me);
+
+    struct model *mp = vctx;
+    while (true) {
+        (void)cmb_process_hold(cmb_random_exponential(1.0));
+        mp->arrival_time[mp->arrived % RING] = cmb_time();
+        (void)cmb_objectqueue_put(mp->queue, (void *)(uintptr_t)mp->arrived);
+        mp->arrived++;
+    }
+
+    /* Not reached */
+    return NULL;
+}
+
+static void *server_proc(struct cmb_process *me, void *vctx)
+{
+    cmb_unused(me);
+
+    struct model *mp = vctx;
+    while (true) {
+        void *obj = NULL;
+        (void)cmb_objectqueue_get(mp->queue, &obj);
+        const uint64_t seq = (uint64_t)(uintptr_t)obj;
+        mp->waited += cmb_time() - mp->arrival_time[seq % RING];
+        (void)cmb_resource_acquire(mp->desk);
+        (void)cmb_process_hold(cmb_random_exponential(0.8));
+        cmb_resource_release(mp->desk);
+        mp->served++;
+    }
+
+    /* Not reached */
+    return NULL;
+}
+
+static void end_sim_evt(void *subject, void *object)
+{
+    cmb_unused(object);
+
+    struct model *mp = subject;
+    (void)cmb_process_stop(mp->arrival, NULL);
+    (void)cmb_process_stop(mp->server, NULL);
+}
+
+/* A process that comes and goes without touching the model */
+static void *noise_proc(struct cmb_process *me, void *vctx)
+{
+    cmb_unused(me);
+    cmb_unused(vctx);
+
+    for (unsigned ui = 0u; ui < 100u; ui++) {
+        (void)cmb_process_hold(10.0);
+    }
+
+    return NULL;
+}
+
+static void model_setup(struct model *mp)
+{
+    mp->arrived = 0u;
+    mp->served = 0u;
+    mp->waited = 0.0;
+
+    mp->queue = cmb_objectqueue_create();
+    cmb_objectqueue_initialize(mp->queue, "Queue", RING);
+    mp->desk = cmb_resource_create();
+    cmb_resource_initialize(mp->desk, "Desk");
+
+    mp->arrival = cmb_process_create();
+    cmb_process_initialize(mp->arrival, "Arrival", arrival_proc, mp, 0);
+    cmb_process_start(mp->arrival);
+    mp->server = cmb_process_create();
+    cmb_process_initialize(mp->server, "Server", server_proc, mp, 0);
+    cmb_process_start(mp->server);
+
+    (void)cmb_event_schedule(end_sim_evt, mp, NULL, END, 0);
+}
+
+static void model_teardown(struct model *mp)
+{
+    cmb_process_terminate(mp->arrival);
+    cmb_process_destroy(mp->arrival);
+    cmb_process_terminate(mp->server);
+    cmb_process_destroy(mp->server);
+    cmb_objectqueue_terminate(mp->queue);
+    cmb_objectqueue_destroy(mp->queue);
+    cmb_resource_terminate(mp->desk);
+    cmb_resource_destroy(mp->desk);
+    cmb_event_queue_terminate();
+}
+
+static void run_to_end(const struct model *mp, struct result *rp)
+{
+    cmb_event_queue_execute();
+    rp->served = mp->served;
+    rp->waited = mp->waited;
+    rp->time = cmb_time();
+}
+
+static bool same_result(const struct result *ap, const struct result *bp)
+{
+    return (ap->served == bp->served)
+           && (ap->waited == bp->waited)
+           && (ap->time == bp->time);
+}
+
+static void test_snapshot_single(const uint64_t seed)
+{
+    cmi_test_print_line("-");
+    printf("Testing snapshot and restore in a single thread\n");
+
+    struct model *mp = malloc(sizeof(*mp));
+    cmb_snapshot_enabled_set(true);
+    cmb_assert_always(cmb_snapshot_enabled());
+    cmb_random_initialize(seed);
+    cmb_event_queue_initialize(0.0);
+    model_setup(mp);
+    (void)cmb_event_queue_execute_until(WARMUP);
+    const uint64_t warm_served = mp->served;
+
+    struct cmb_snapshot *sp = cmb_snapshot_create();
+    cmb_snapshot_region_add(sp, mp, sizeof(*mp));
+    cmb_snapshot_take(sp);
+    printf("  warm-up served %" PRIu64 ", snapshot %zu bytes\n",
+           warm_served, cmb_snapshot_size(sp));
+
+    /* Straight on from the warm-up, then the same again from the snapshot */
+    struct result first, again;
+    run_to_end(mp, &first);
+    cmb_snapshot_restore(sp);
+    cmb_assert_always(cmb_time() == WARMUP);
+    cmb_assert_always(mp->served == warm_served);
+    run_to_end(mp, &again);
+    cmb_assert_always(same_result(&first, &again));
+    printf("  continued: served %" PRIu64 ", restored: served %" PRIu64 "\n",
+           first.served, again.served);
+
+    /* A new seed gives another path, the same seed the same path, even with
+     * an unrelated process in between that is gone again after the restore */
+    struct result other, other_again;
+    cmb_snapshot_restore(sp);
+    cmb_random_initialize(seed + 1u);
+    struct cmb_process *noise = cmb_process_create();
+    cmb_process_initialize(noise, "Noise", noise_proc, NULL, 0);
+    cmb_process_start(noise);
+    run_to_end(mp, &other);
+    cmb_assert_always(!same_result(&first, &other));
+
+    cmb_snapshot_restore(sp);
+    cmb_random_initialize(seed + 1u);
+    run_to_end(mp, &other_again);
+    cmb_assert_always(same_result(&other, &other_again));
+    printf("  reseeded: served %" PRIu64 ", and again: served %" PRIu64 "\n",
+           other.served, other_again.served);
+
+    model_teardown(mp);
+    cmb_snapshot_destroy(sp);
+    cmb_snapshot_enabled_set(false);
+    free(mp);
+
+    cmi_test_print_line("*");
+}
+
+/*
+ * struct trial - Each trial takes its own snapshot after the warm-up and
+ * runs twice from there.
+ */
+struct trial {
+    uint64_t seed;
+    struct result first;
+    struct result again;
+};
+
+static void run_trial(void *vtrl)
+{
+    struct trial *trl = vtrl;
+
+    cmb_logger_flags_off(CMB_LOGGER_INFO);
+    struct model *mp = malloc(sizeof(*mp));
+    cmb_random_initialize(trl->seed);
+    cmb_event_queue_initialize(0.0);
+    model_setup(mp);
+    (void)cmb_event_queue_execute_until(WARMUP);
+
+    struct cmb_snapshot *sp = cmb_snapshot_create();
+    cmb_snapshot_region_add(sp, mp, sizeof(*mp));
+    cmb_snapshot_take(sp);
+    run_to_end(mp, &(trl->first));
+    cmb_snapshot_restore(sp);
+    run_to_end(mp, &(trl->again));
+
+    model_teardown(mp);
+    cmb_snapshot_destroy(sp);
+    free(mp);
+}
+
+static void test_snapshot_threads(const uint64_t seed)
+{
+    cmi_test_print_line("-");
+    printf("Testing snapshot and restore across the threads of an experiment\n");
+
+    struct trial *experiment = calloc(TRIALS, sizeof(*experiment));
+    for (unsigned ui = 0u; ui < TRIALS; ui++) {
+        experiment[ui].seed = seed + ui;
+    }
+
+    cmb_snapshot_enabled_set(true);
+    const uint64_t failed = cimba_run(experiment, TRIALS, sizeof(*experiment), run_trial);
+    cmb_assert_always(failed == 0u);
+    cmb_snapshot_enabled_set(false);
+
+    for (unsigned ui = 0u; ui < TRIALS; ui++) {
+        cmb_assert_always(same_result(&(experiment[ui].first), &(experiment[ui].again)));
+        printf("  trial %u: served %" PRIu64 " both times\n", ui, experiment[ui].first.served);
+    }
+
+    free(experiment);
+    cmi_test_print_line("*");
+}
+
+int main(void)
+{
+    const uint64_t seed = cmb_random_hwseed();
+    cmb_logger_flags_off(CMB_LOGGER_INFO);
+
+    test_snapshot_single(seed);
+    test_snapshot_threads(seed);
+
+    return 0;
+}
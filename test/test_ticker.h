@@ -0,0 +1,121 @@
+/*
+ * A small model shared by the test scripts for the profiler and the trace: an
+ * event rescheduling itself and a process holding, each a fixed number of
+ * times, run as a single trial or as an experiment across the worker threads.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CIMBA_CMI_TEST_TICKER_H
+#define CIMBA_CMI_TEST_TICKER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "cimba.h"
+
+#define CMI_TEST_TICKS 1000u
+
+/* Something for the processor to do, not optimized away */
+static volatile uint64_t cmi_test_busy_sink = 0u;
+
+static inline void cmi_test_busy_work(const unsigned n)
+{
+    for (unsigned ui = 0u; ui < n; ui++) {
+        cmi_test_busy_sink += ui;
+    }
+}
+
+/* An event that reschedules itself until CMI_TEST_TICKS have passed, doing very little */
+static inline void cmi_test_tock_event(void *subject, void *object)
+{
+    cmb_unused(object);
+
+    uint64_t *cnt = subject;
+    (*cnt)++;
+    if (*cnt < CMI_TEST_TICKS) {
+        (void)cmb_event_schedule(cmi_test_tock_event, subject, NULL, cmb_time() + 1.0, 0);
+    }
+}
+
+/* A process that holds CMI_TEST_TICKS times, doing a lot more between holds */
+static inline void *cmi_test_ticker_proc(struct cmb_process *me, void *vctx)
+{
+    cmb_unused(me);
+    cmb_unused(vctx);
+
+    for (unsigned ui = 0u; ui < CMI_TEST_TICKS; ui++) {
+        cmi_test_busy_work(2000u);
+        (void)cmb_process_hold(1.0);
+    }
+
+    return NULL;
+}
+
+struct cmi_test_trial {
+    uint64_t tocks;
+    uint64_t events;
+};
+
+/*
+ * cmi_test_ticker_trial - One trial of the model, the number of events
+ * executed noted in the trial struct.
+ */
+static inline void cmi_test_ticker_trial(void *vtrl)
+{
+    struct cmi_test_trial *trl = vtrl;
+
+    cmb_logger_flags_off(CMB_LOGGER_INFO);
+    cmb_event_queue_initialize(0.0);
+    trl->tocks = 0u;
+    (void)cmb_event_schedule(cmi_test_tock_event, &(trl->tocks), NULL, 0.5, 0);
+
+    struct cmb_process *pp = cmb_process_create();
+    cmb_process_initialize(pp, "Ticker", cmi_test_ticker_proc, NULL, 0);
+    cmb_process_start(pp);
+    cmb_event_queue_execute();
+
+    struct cmb_event_queue_stats qs;
+    cmb_event_queue_stats(&qs);
+    trl->events = qs.dequeues;
+
+    cmb_process_terminate(pp);
+    cmb_process_destroy(pp);
+    cmb_event_queue_terminate();
+}
+
+/*
+ * cmi_test_ticker_experiment - Run the trials across the worker threads, check
+ * that each one ticked all the way, and return the total number of events.
+ */
+static inline uint64_t cmi_test_ticker_experiment(const unsigned trials)
+{
+    struct cmi_test_trial *experiment = calloc(trials, sizeof(*experiment));
+    const uint64_t failed = cimba_run(experiment, trials, sizeof(*experiment),
+                                      cmi_test_ticker_trial);
+    cmb_assert_always(failed == 0u);
+
+    uint64_t events = 0u;
+    for (unsigned ui = 0u; ui < trials; ui++) {
+        cmb_assert_always(experiment[ui].tocks == CMI_TEST_TICKS);
+        events += experiment[ui].events;
+    }
+
+    free(experiment);
+
+    return events;
+}
+
+#endif /* CIMBA_CMI_TEST_TICKER_H */
@@ -0,0 +1,371 @@
+/*
+ * Test script for the binary event trace.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cimba.h"
+#include "test.h"
+#include "test_ticker.h"
+
+#define TRIALS 8u
+#define PREFIX "test_trace"
+
+/*
+ * struct tally - The number of records of each kind in one or more files.
+ */
+struct tally {
+    uint64_t written;
+    uint64_t held;
+    uint64_t kinds[CMB_TRACE_PROCESS_EXIT + 1];
+};
+
+/*
+ * read_trace - Add up the records in the file, checking the header and that
+ * the event times never go backwards within a trial. Returns false if there
+ * is no such file.
+ */
+static bool read_trace(const char *path, struct tally *tp)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+
+    struct cmb_trace_header hdr;
+    cmb_assert_always(fread(&hdr, sizeof(hdr), 1u, fp) == 1u);
+    cmb_assert_always(hdr.magic == CMB_TRACE_MAGIC);
+    cmb_assert_always(hdr.version == CMB_TRACE_VERSION);
+    cmb_assert_always(hdr.record_size == sizeof(struct cmb_trace_record));
+
+    struct cmb_trace_record *recs = calloc(hdr.capacity, sizeof(*recs));
+    cmb_assert_always(fread(recs, sizeof(*recs), hdr.capacity, fp) == hdr.capacity);
+    fclose(fp);
+
+    const uint64_t held = (hdr.written < hdr.capacity) ? hdr.written : hdr.capacity;
+    double last_time = -1.0;
+    for (uint64_t ui = hdr.written - held; ui < hdr.written; ui++) {
+        const struct cmb_trace_record *rp = &(recs[ui & (hdr.capacity - 1u)]);
+        cmb_assert_always((rp->kind >= CMB_TRACE_TRIAL) && (rp->kind <= CMB_TRACE_PROCESS_EXIT));
+        tp->kinds[rp->kind]++;
+        if (rp->kind == CMB_TRACE_TRIAL) {
+            last_time = -1.0;
+        }
+        else if (rp->kind == CMB_TRACE_EVENT) {
+            cmb_assert_always(rp->time >= last_time);
+            last_time = rp->time;
+        }
+        else if (rp->kind == CMB_TRACE_PROCESS_NAME) {
+            cmb_assert_always(strcmp(rp->u.process.name, "Ticker") == 0);
+        }
+    }
+
+    tp->written += hdr.written;
+    tp->held += held;
+    free(recs);
+
+    return true;
+}
+
+static void test_trace_single(void)
+{
+    cmi_test_print_line("-");
+    printf("Testing the trace in a single trial\n");
+
+    struct cmi_test_trial trl;
+    cmb_trace_start(PREFIX, 100000u);
+    cmb_assert_always(cmb_trace_enabled());
+    cmi_test_ticker_trial(&trl);
+    cmb_trace_stop();
+    cmb_assert_always(!cmb_trace_enabled());
+    cmb_assert_always(trl.tocks == CMI_TEST_TICKS);
+
+    /* Started once, then resumed after each hold */
+    struct tally tly = { 0 };
+    cmb_assert_always(read_trace(PREFIX ".0.cmbtrace", &tly));
+    cmb_assert_always(tly.written == tly.held);
+    cmb_assert_always(tly.kinds[CMB_TRACE_TRIAL] == 1u);
+    cmb_assert_always(tly.kinds[CMB_TRACE_EVENT] == trl.events);
+    cmb_assert_always(tly.kinds[CMB_TRACE_SYMBOL] > 0u);
+    cmb_assert_always(tly.kinds[CMB_TRACE_PROCESS_NAME] == 1u);
+    cmb_assert_always(tly.kinds[CMB_TRACE_PROCESS_RUN] == CMI_TEST_TICKS + 1u);
+    cmb_assert_always(tly.kinds[CMB_TRACE_PROCESS_YIELD] == CMI_TEST_TICKS);
+    cmb_assert_always(tly.kinds[CMB_TRACE_PROCESS_EXIT] == 1u);
+    printf("  %" PRIu64 " records, %" PRIu64 " events, %" PRIu64 " runs\n",
+           tly.written, tly.kinds[CMB_TRACE_EVENT], tly.kinds[CMB_TRACE_PROCESS_RUN]);
+
+    /* A small ring keeps the latest records only */
+    cmb_trace_start(PREFIX, 100u);
+    cmi_test_ticker_trial(&trl);
+    cmb_trace_stop();
+    struct tally small = { 0 };
+    cmb_assert_always(read_trace(PREFIX ".1.cmbtrace", &small));
+    cmb_assert_always(small.held == 128u);
+    cmb_assert_always(small.written > tly.written);
+    cmb_assert_always(small.kinds[CMB_TRACE_PROCESS_EXIT] == 1u);
+    printf("  small ring: %" PRIu64 " records written, %" PRIu64 " kept\n",
+           small.written, small.held);
+
+    (void)remove(PREFIX ".0.cmbtrace");
+    (void)remove(PREFIX ".1.cmbtrace");
+    cmi_test_print_line("*");
+}
+
+static void test_trace_threads(void)
+{
+    cmi_test_print_line("-");
+    printf("Testing the trace across the threads of an experiment\n");
+
+    cmb_trace_start(PREFIX, 100000u);
+    const uint64_t events = cmi_test_ticker_experiment(TRIALS);
+    cmb_trace_stop();
+
+    /* One file per worker thread, numbered on from the two above */
+    struct tally tly = { 0 };
+    unsigned files = 0u;
+    for (unsigned ui = 2u; ; ui++) {
+        char path[64];
+        (void)snprintf(path, sizeof(path), PREFIX ".%u.cmbtrace", ui);
+        if (!read_trace(path, &tly)) {
+            break;
+        }
+
+        (void)remove(path);
+        files++;
+    }
+
+    cmb_assert_always(files > 0u);
+    cmb_assert_always(tly.kinds[CMB_TRACE_TRIAL] == TRIALS);
+    cmb_assert_always(tly.kinds[CMB_TRACE_EVENT] == events);
+    cmb_assert_always(tly.kinds[CMB_TRACE_PROCESS_EXIT] == TRIALS);
+    printf("  %u files, %" PRIu64 " trials, %" PRIu64 " events\n",
+           files, tly.kinds[CMB_TRACE_TRIAL], tly.kinds[CMB_TRACE_EVENT]);
+
+    cmi_test_print_line("*");
+}
+
+/*
+ * json_ws - Skip any whitespace.
+ */
+static const char *json_ws(const char *cp)
+{
+    while ((*cp == ' ') || (*cp == '\n') || (*cp == '\r') || (*cp == '\t')) {
+        cp++;
+    }
+
+    return cp;
+}
+
+/*
+ * json_value - Skip over one JSON value, strictly as the grammar has it.
+ * Returns false at the first thing that does not belong there. Counts the
+ * elements of the arrays it passes into *elems.
+ */
+static bool json_value(const char **cpp, uint64_t *elems)
+{
+    const char *cp = json_ws(*cpp);
+    if (*cp == '{' || *cp == '[') {
+        const char close = (*cp == '{') ? '}' : ']';
+        const bool object = (*cp == '{');
+        cp = json_ws(cp + 1);
+        if (*cp != close) {
+            while (true) {
+                if (object) {
+                    if ((*cp != '"') || !json_value(&cp, elems)) {
+                        return false;
+                    }
+
+                    cp = json_ws(cp);
+                    if (*cp++ != ':') {
+                        return false;
+                    }
+                }
+                else {
+                    (*elems)++;
+                }
+
+                if (!json_value(&cp, elems)) {
+                    return false;
+                }
+
+                cp = json_ws(cp);
+                if (*cp != ',') {
+                    break;
+                }
+
+                cp++;
+            }
+        }
+
+        if (*cp++ != close) {
+            return false;
+        }
+    }
+    else if (*cp == '"') {
+        for (cp++; *cp != '"'; cp++) {
+            if ((unsigned char)*cp < 0x20u) {
+                return false;
+            }
+
+            if ((*cp == '\\') && (*++cp == '\0')) {
+                return false;
+            }
+        }
+
+        cp++;
+    }
+    else if ((*cp == '-') || ((*cp >= '0') && (*cp <= '9'))) {
+        char *endp;
+        (void)strtod(cp, &endp);
+        cp = endp;
+    }
+    else if (strncmp(cp, "true", 4u) == 0 || strncmp(cp, "null", 4u) == 0) {
+        cp += 4;
+    }
+    else if (strncmp(cp, "false", 5u) == 0) {
+        cp += 5;
+    }
+    else {
+        return false;
+    }
+
+    *cpp = cp;
+
+    return true;
+}
+
+/*
+ * read_text - The whole of a file as a string, to be freed by the caller.
+ */
+static char *read_text(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    cmb_assert_always(fp != NULL);
+    cmb_assert_always(fseek(fp, 0L, SEEK_END) == 0);
+    const long len = ftell(fp);
+    cmb_assert_always(len > 0L);
+    rewind(fp);
+
+    char *buf = malloc((size_t)len + 1u);
+    cmb_assert_always(fread(buf, 1u, (size_t)len, fp) == (size_t)len);
+    buf[len] = '\0';
+    fclose(fp);
+
+    return buf;
+}
+
+/*
+ * test_trace_dump - Decode a short trace with the cmb_tracedump tool, as text
+ * and as JSON, and check that all the events are there, in time order, and
+ * that the JSON is well formed.
+ */
+static void test_trace_dump(const char *dumper)
+{
+    cmi_test_print_line("-");
+    printf("Testing the trace decoder %s\n", dumper);
+
+    struct cmi_test_trial trl;
+    cmb_trace_start(PREFIX, 8192u);
+    cmi_test_ticker_trial(&trl);
+    cmb_trace_stop();
+
+    char path[64] = "";
+    for (unsigned ui = 0u; ui < 64u; ui++) {
+        (void)snprintf(path, sizeof(path), PREFIX ".%u.cmbtrace", ui);
+        FILE *fp = fopen(path, "rb");
+        if (fp != NULL) {
+            fclose(fp);
+            break;
+        }
+    }
+
+    char cmd[1024];
+    (void)snprintf(cmd, sizeof(cmd), "\"%s\" %s > " PREFIX ".txt", dumper, path);
+    cmb_assert_always(system(cmd) == 0);
+    (void)snprintf(cmd, sizeof(cmd), "\"%s\" -j %s > " PREFIX ".json", dumper, path);
+    cmb_assert_always(system(cmd) == 0);
+
+    /* One line per record, the events in time order */
+    char *text = read_text(PREFIX ".txt");
+    uint64_t events = 0u, runs = 0u;
+    double last_time = -1.0;
+    for (char *lp = strtok(text, "\n"); lp != NULL; lp = strtok(NULL, "\n")) {
+        if (strstr(lp, "  event  #") != NULL) {
+            const double t = strtod(lp, NULL);
+            cmb_assert_always(t >= last_time);
+            last_time = t;
+            events++;
+        }
+        else if (strstr(lp, "  run    process") != NULL) {
+            runs++;
+        }
+    }
+
+    free(text);
+    printf("  text: %" PRIu64 " events, %" PRIu64 " runs\n", events, runs);
+    cmb_assert_always(events == trl.events);
+    cmb_assert_always(runs == CMI_TEST_TICKS + 1u);
+
+    /* The events as instants on track zero, the holds as waiting spans */
+    char *json = read_text(PREFIX ".json");
+    const char *cp = json;
+    uint64_t elems = 0u;
+    cmb_assert_always(json_value(&cp, &elems));
+    cmb_assert_always(*json_ws(cp) == '\0');
+
+    const char *instant = "\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":0,\"ts\":";
+    uint64_t instants = 0u, waits = 0u;
+    last_time = -1.0;
+    for (const char *mp = strstr(json, instant); mp != NULL; mp = strstr(mp + 1, instant)) {
+        const double ts = strtod(mp + strlen(instant), NULL);
+        cmb_assert_always(ts >= last_time);
+        last_time = ts;
+        instants++;
+    }
+
+    for (const char *mp = strstr(json, "\"name\":\"waiting\""); mp != NULL;
+         mp = strstr(mp + 1, "\"name\":\"waiting\"")) {
+        waits++;
+    }
+
+    free(json);
+    printf("  json: %" PRIu64 " elements, %" PRIu64 " events, %" PRIu64 " waits\n",
+           elems, instants, waits);
+    cmb_assert_always(instants == trl.events);
+    cmb_assert_always(waits == CMI_TEST_TICKS);
+
+    (void)remove(path);
+    (void)remove(PREFIX ".txt");
+    (void)remove(PREFIX ".json");
+    cmi_test_print_line("*");
+}
+
+/* The path to the cmb_tracedump tool as the argument, if any */
+int main(const int argc, char *argv[])
+{
+    test_trace_single();
+    test_trace_threads();
+    if (argc > 1) {
+        test_trace_dump(argv[1]);
+    }
+
+    return 0;
+}
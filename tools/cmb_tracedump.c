@@ -0,0 +1,520 @@
+/*
+ * cmb_tracedump.c - Decode the binary trace files written by cmb_trace_start,
+ * either as text, one line per record, or as a JSON trace for the Chrome and
+ * Perfetto trace viewers (https://ui.perfetto.dev).
+ *
+ * Usage: cmb_tracedump [-j] [-s scale] file...
+ *   -j        Write a JSON trace instead of text.
+ *   -s scale  Microseconds per unit of simulation time in the JSON trace,
+ *             default 1000000, i.e., one unit is shown as one second.
+ *
+ * In the JSON trace, each trial is shown as a process of its own, with the
+ * events as instants on one track and each simulated process on a track of
+ * its own, showing the time it spent waiting between yielding and resuming.
+ *
+ * The records before the oldest one still in the ring are gone, including
+ * any process names and function names written there. These are then shown
+ * by their addresses instead.
+ *
+ * Copyright (c) Asbjørn M. Bonvik 2026.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cmb_trace.h"
+
+/* The trial index written outside cimba_run */
+#define NO_TRIAL_IDX UINT64_C(0xFFFFFFFF)
+
+/* Room for the names, the longer of process names and function names */
+#define NAME_SZ CMB_TRACE_SYMBOL_SZ
+
+/*
+ * struct addr_entry - What is known about an address, the handle and name of
+ * a process, or the name of a function. The waiting time is when the process
+ * last yielded, negative if it has not.
+ */
+struct addr_entry {
+    uint64_t addr;
+    uint64_t handle;
+    double waiting;
+    char name[NAME_SZ];
+};
+
+/*
+ * struct addr_map - Open addressing hash map from addresses to entries, size a
+ * power of two, doubling when half full. Address zero marks a free entry.
+ */
+struct addr_map {
+    struct addr_entry *entries;
+    uint64_t size;
+    uint64_t used;
+};
+
+/*
+ * struct decoder - The state across all records and files, the output format,
+ * and the trial being decoded, numbered in order of appearance for the JSON
+ * trace.
+ */
+struct decoder {
+    bool json;
+    double scale;
+    bool first_json;
+    uint64_t trial_seq;
+    struct addr_map symbols;
+    struct addr_map processes;
+};
+
+static void *checked_calloc(const size_t n, const size_t sz)
+{
+    void *p = calloc(n, sz);
+    if (p == NULL) {
+        fprintf(stderr, "cmb_tracedump: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return p;
+}
+
+static uint64_t map_home(const struct addr_map *mp, const uint64_t addr)
+{
+    return (addr * UINT64_C(11400714819323198485)) & (mp->size - 1u);
+}
+
+/*
+ * map_lookup - The entry for the address, NULL if none.
+ */
+static struct addr_entry *map_lookup(const struct addr_map *mp, const uint64_t addr)
+{
+    if (mp->entries == NULL) {
+        return NULL;
+    }
+
+    const uint64_t mask = mp->size - 1u;
+    for (uint64_t idx = map_home(mp, addr); ; idx = (idx + 1u) & mask) {
+        struct addr_entry *ep = &(mp->entries[idx]);
+        if (ep->addr == 0u) {
+            return NULL;
+        }
+
+        if (ep->addr == addr) {
+            return ep;
+        }
+    }
+}
+
+static struct addr_entry *map_place(struct addr_map *mp, const uint64_t addr)
+{
+    const uint64_t mask = mp->size - 1u;
+    uint64_t idx = map_home(mp, addr);
+    while (mp->entries[idx].addr != 0u) {
+        idx = (idx + 1u) & mask;
+    }
+
+    struct addr_entry *ep = &(mp->entries[idx]);
+    ep->addr = addr;
+    ep->waiting = -1.0;
+    mp->used++;
+
+    return ep;
+}
+
+/*
+ * map_find - The entry for the address, added if not there.
+ */
+static struct addr_entry *map_find(struct addr_map *mp, const uint64_t addr)
+{
+    struct addr_entry *ep = map_lookup(mp, addr);
+    if (ep != NULL) {
+        return ep;
+    }
+
+    if (2u * (mp->used + 1u) > mp->size) {
+        struct addr_entry *old = mp->entries;
+        const uint64_t old_size = mp->size;
+        mp->size = (old_size > 0u) ? 2u * old_size : 64u;
+        mp->entries = checked_calloc(mp->size, sizeof(*(mp->entries)));
+        mp->used = 0u;
+        for (uint64_t ui = 0u; ui < old_size; ui++) {
+            if (old[ui].addr != 0u) {
+                *map_place(mp, old[ui].addr) = old[ui];
+            }
+        }
+
+        free(old);
+    }
+
+    return map_place(mp, addr);
+}
+
+/*
+ * map_clear - Forget all entries, keeping the memory.
+ */
+static void map_clear(struct addr_map *mp)
+{
+    if (mp->entries != NULL) {
+        memset(mp->entries, 0, mp->size * sizeof(*(mp->entries)));
+    }
+
+    mp->used = 0u;
+}
+
+/*
+ * json_string - Print the string in double quotes, escaped as JSON needs.
+ */
+static void json_string(const char *s)
+{
+    putchar('"');
+    for (const unsigned char *cp = (const unsigned char *)s; *cp != '\0'; cp++) {
+        if ((*cp == '"') || (*cp == '\\')) {
+            printf("\\%c", *cp);
+        }
+        else if (*cp < 0x20u) {
+            printf("\\u%04x", *cp);
+        }
+        else {
+            putchar(*cp);
+        }
+    }
+
+    putchar('"');
+}
+
+/*
+ * json_begin - Start a new element of the traceEvents array.
+ */
+static void json_begin(struct decoder *dp)
+{
+    printf(dp->first_json ? "\n  {" : ",\n  {");
+    dp->first_json = false;
+}
+
+/*
+ * symbol_name - The name of the event function, or its address if no symbol
+ * record has been seen for it.
+ */
+static const char *symbol_name(const struct decoder *dp, const uint64_t addr, char *buf)
+{
+    const struct addr_entry *ep = map_lookup(&(dp->symbols), addr);
+    if (ep != NULL) {
+        return ep->name;
+    }
+
+    (void)snprintf(buf, NAME_SZ, "0x%" PRIx64, addr);
+
+    return buf;
+}
+
+/*
+ * process_entry - The entry for the process at the address, with a name made
+ * up from the address if no name record has been seen for it.
+ */
+static struct addr_entry *process_entry(struct decoder *dp, const uint64_t addr)
+{
+    struct addr_entry *ep = map_lookup(&(dp->processes), addr);
+    if (ep == NULL) {
+        ep = map_find(&(dp->processes), addr);
+        ep->handle = 0u;
+        (void)snprintf(ep->name, NAME_SZ, "0x%" PRIx64, addr);
+    }
+
+    return ep;
+}
+
+/*
+ * process_tid - The JSON track for a process, its handle if known, else some
+ * number made from its address, out of the way of the handles.
+ */
+static uint64_t process_tid(const struct addr_entry *ep)
+{
+    return (ep->handle != 0u) ? ep->handle
+                              : (UINT64_C(1) << 31) | ((ep->addr >> 4) & 0x7FFFFFFFu);
+}
+
+/*
+ * new_trial - A trial starts, or records turn up before the first trial record
+ * in the ring. The processes from before are gone.
+ */
+static void new_trial(struct decoder *dp, const uint64_t trial_idx, const uint64_t thread_id)
+{
+    map_clear(&(dp->processes));
+    dp->trial_seq++;
+    if (dp->json) {
+        char label[64];
+        if (trial_idx == NO_TRIAL_IDX) {
+            (void)snprintf(label, sizeof(label), "Thread %" PRIu64, thread_id);
+        }
+        else {
+            (void)snprintf(label, sizeof(label), "Trial %" PRIu64 " (thread %" PRIu64 ")",
+                           trial_idx, thread_id);
+        }
+
+        json_begin(dp);
+        printf("\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%" PRIu64 ",\"args\":{\"name\":",
+               dp->trial_seq);
+        json_string(label);
+        printf("}}");
+        json_begin(dp);
+        printf("\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%" PRIu64
+               ",\"tid\":0,\"args\":{\"name\":\"Events\"}}", dp->trial_seq);
+    }
+    else if (trial_idx == NO_TRIAL_IDX) {
+        printf("%16s  trial\n", "");
+    }
+    else {
+        printf("%16s  trial %" PRIu64 "\n", "", trial_idx);
+    }
+}
+
+static void text_record(struct decoder *dp, const struct cmb_trace_record *rp)
+{
+    char buf[NAME_SZ];
+    const struct addr_entry *ep;
+    switch (rp->kind) {
+        case CMB_TRACE_EVENT:
+            printf("%16.6f  event  #%" PRIu64 " pri %" PRIi64 "  %s  subject 0x%" PRIx64
+                   " object 0x%" PRIx64 "\n",
+                   rp->time, rp->u.event.handle, rp->u.event.priority,
+                   symbol_name(dp, rp->u.event.action, buf),
+                   rp->u.event.subject, rp->u.event.object);
+            break;
+
+        case CMB_TRACE_PROCESS_NAME:
+            printf("%16.6f  name   process #%" PRIu64 " \"%s\" at 0x%" PRIx64 "\n",
+                   rp->time, rp->u.process.handle, rp->u.process.name, rp->u.process.process);
+            break;
+
+        case CMB_TRACE_PROCESS_RUN:
+        case CMB_TRACE_PROCESS_YIELD:
+        case CMB_TRACE_PROCESS_EXIT:
+            ep = process_entry(dp, rp->u.process.process);
+            printf("%16.6f  %-5s  process #%" PRIu64 " \"%s\"\n", rp->time,
+                   (rp->kind == CMB_TRACE_PROCESS_RUN) ? "run"
+                   : (rp->kind == CMB_TRACE_PROCESS_YIELD) ? "yield" : "exit",
+                   ep->handle, ep->name);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void json_record(struct decoder *dp, const struct cmb_trace_record *rp)
+{
+    char buf[NAME_SZ];
+    struct addr_entry *ep;
+    const double ts = rp->time * dp->scale;
+    switch (rp->kind) {
+        case CMB_TRACE_EVENT:
+            json_begin(dp);
+            printf("\"name\":");
+            json_string(symbol_name(dp, rp->u.event.action, buf));
+            printf(",\"ph\":\"i\",\"s\":\"t\",\"pid\":%" PRIu64 ",\"tid\":0,\"ts\":%.3f,"
+                   "\"args\":{\"handle\":%" PRIu64 ",\"priority\":%" PRIi64
+                   ",\"subject\":\"0x%" PRIx64 "\",\"object\":\"0x%" PRIx64 "\"}}",
+                   dp->trial_seq, ts, rp->u.event.handle, rp->u.event.priority,
+                   rp->u.event.subject, rp->u.event.object);
+            break;
+
+        case CMB_TRACE_PROCESS_NAME:
+            json_begin(dp);
+            printf("\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%" PRIu64 ",\"tid\":%" PRIu64
+                   ",\"args\":{\"name\":", dp->trial_seq, rp->u.process.handle);
+            json_string(rp->u.process.name);
+            printf("}}");
+            break;
+
+        case CMB_TRACE_PROCESS_RUN:
+            ep = process_entry(dp, rp->u.process.process);
+            if (ep->waiting >= 0.0) {
+                json_begin(dp);
+                printf("\"name\":\"waiting\",\"ph\":\"X\",\"pid\":%" PRIu64 ",\"tid\":%" PRIu64
+                       ",\"ts\":%.3f,\"dur\":%.3f}",
+                       dp->trial_seq, process_tid(ep), ep->waiting * dp->scale,
+                       (rp->time - ep->waiting) * dp->scale);
+                ep->waiting = -1.0;
+            }
+            break;
+
+        case CMB_TRACE_PROCESS_YIELD:
+            ep = process_entry(dp, rp->u.process.process);
+            ep->waiting = rp->time;
+            break;
+
+        case CMB_TRACE_PROCESS_EXIT:
+            ep = process_entry(dp, rp->u.process.process);
+            ep->waiting = -1.0;
+            json_begin(dp);
+            printf("\"name\":\"exit\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%" PRIu64 ",\"tid\":%" PRIu64
+                   ",\"ts\":%.3f}", dp->trial_seq, process_tid(ep), ts);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/*
+ * decode_record - Note the names and trials, then print the record.
+ */
+static void decode_record(struct decoder *dp,
+                          const struct cmb_trace_header *hp,
+                          const struct cmb_trace_record *rp)
+{
+    struct addr_entry *ep;
+    switch (rp->kind) {
+        case CMB_TRACE_TRIAL:
+            new_trial(dp, rp->u.event.handle, hp->thread_id);
+            return;
+
+        case CMB_TRACE_SYMBOL:
+            ep = map_find(&(dp->symbols), rp->u.symbol.address);
+            memcpy(ep->name, rp->u.symbol.name, NAME_SZ);
+            ep->name[NAME_SZ - 1] = '\0';
+            return;
+
+        case CMB_TRACE_PROCESS_NAME:
+            ep = map_find(&(dp->processes), rp->u.process.process);
+            ep->handle = rp->u.process.handle;
+            ep->waiting = -1.0;
+            memcpy(ep->name, rp->u.process.name, CMB_TRACE_NAME_SZ);
+            ep->name[CMB_TRACE_NAME_SZ - 1] = '\0';
+            break;
+
+        default:
+            break;
+    }
+
+    if (dp->json) {
+        json_record(dp, rp);
+    }
+    else {
+        text_record(dp, rp);
+    }
+}
+
+/*
+ * decode_file - Read the whole file, check the header, and decode the records
+ * still in the ring, oldest first. Returns false if not a valid trace file.
+ */
+static bool decode_file(struct decoder *dp, const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "cmb_tracedump: cannot open %s\n", path);
+        return false;
+    }
+
+    struct cmb_trace_header hdr;
+    if ((fread(&hdr, sizeof(hdr), 1u, fp) != 1u)
+        || (hdr.magic != CMB_TRACE_MAGIC)
+        || (hdr.version != CMB_TRACE_VERSION)
+        || (hdr.record_size != sizeof(struct cmb_trace_record))
+        || (hdr.capacity == 0u)
+        || ((hdr.capacity & (hdr.capacity - 1u)) != 0u)) {
+        fprintf(stderr, "cmb_tracedump: %s is not a trace file of version %u\n",
+                path, CMB_TRACE_VERSION);
+        fclose(fp);
+        return false;
+    }
+
+    struct cmb_trace_record *records = checked_calloc(hdr.capacity, sizeof(*records));
+    const uint64_t held = (hdr.written < hdr.capacity) ? hdr.written : hdr.capacity;
+    const size_t got = fread(records, sizeof(*records), hdr.capacity, fp);
+    fclose(fp);
+    if (got < hdr.capacity) {
+        fprintf(stderr, "cmb_tracedump: %s is cut short\n", path);
+        free(records);
+        return false;
+    }
+
+    if (!dp->json) {
+        printf("Trace file %s: thread %" PRIu64 ", %" PRIu64 " records written, %" PRIu64
+               " overwritten\n", path, hdr.thread_id, hdr.written, hdr.written - held);
+    }
+
+    /* Anything before the first trial record belongs to some unknown trial */
+    map_clear(&(dp->symbols));
+    const uint64_t start = hdr.written - held;
+    const uint64_t mask = hdr.capacity - 1u;
+    if (records[start & mask].kind != CMB_TRACE_TRIAL) {
+        new_trial(dp, NO_TRIAL_IDX, hdr.thread_id);
+    }
+
+    for (uint64_t ui = start; ui < hdr.written; ui++) {
+        decode_record(dp, &hdr, &(records[ui & mask]));
+    }
+
+    free(records);
+
+    return true;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: cmb_tracedump [-j] [-s scale] file...\n"
+                    "  -j        JSON trace for the Chrome and Perfetto trace viewers\n"
+                    "  -s scale  Microseconds per unit of simulation time, default 1000000\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(const int argc, char *argv[])
+{
+    struct decoder dec = { .json = false, .scale = 1.0e6, .first_json = true };
+    int argi = 1;
+    for ( ; (argi < argc) && (argv[argi][0] == '-'); argi++) {
+        if (strcmp(argv[argi], "-j") == 0) {
+            dec.json = true;
+        }
+        else if ((strcmp(argv[argi], "-s") == 0) && (argi + 1 < argc)) {
+            dec.scale = strtod(argv[++argi], NULL);
+            if (!(dec.scale > 0.0)) {
+                usage();
+            }
+        }
+        else {
+            usage();
+        }
+    }
+
+    if (argi == argc) {
+        usage();
+    }
+
+    if (dec.json) {
+        printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    }
+
+    int ret = EXIT_SUCCESS;
+    for ( ; argi < argc; argi++) {
+        if (!decode_file(&dec, argv[argi])) {
+            ret = EXIT_FAILURE;
+        }
+    }
+
+    if (dec.json) {
+        printf("\n]}\n");
+    }
+
+    free(dec.symbols.entries);
+    free(dec.processes.entries);
+
+    return ret;
+}